@@ -0,0 +1,256 @@
+#include "Benchmark.h"
+#include <cwchar>
+#include <memory>
+#include "Recurrence.h"
+#include "TimerScheduler.h"
+
+namespace ChannelTimer {
+	namespace {
+		// 合成データ用の擬似乱数(xorshift)
+		class CRandom {
+		public:
+			std::uint32_t Next() {
+				m_state ^= m_state << 13;
+				m_state ^= m_state >> 17;
+				m_state ^= m_state << 5;
+				return m_state;
+			}
+
+		private:
+			std::uint32_t m_state = 2463534242u;
+		};
+
+		std::unique_ptr<CDriverChannels> MakeDriverChannels(const std::vector<CServiceInfo>& services)
+		{
+			std::unique_ptr<CDriverChannels> channels(new CDriverChannels);
+			channels->driverName = L"BonDriver_Benchmark.dll";
+			channels->AddSpace(L"地デジ");
+			for (const CServiceInfo& service : services)
+				channels->AddChannel(0, service);
+			return channels;
+		}
+
+		// 今から 1 週間以内の指定時刻のタイマー
+		std::vector<Timer> MakeTimers(std::size_t count, TimeValue now)
+		{
+			CRandom random;
+			std::vector<Timer> timers(count);
+			for (std::size_t i = 0; i < count; i++) {
+				Timer& timer = timers[i];
+				timer.condition = Timer::SleepCondition::CONDITION_DATETIME;
+				timer.dateToChange = now + (random.Next() % (7 * 24 * 60)) * FILETIME_MIN;
+				timer.tuner = L"BonDriver_Benchmark.dll";
+				timer.space = 0;
+				timer.channel = static_cast<int>(i % 64);
+				timer.serial = static_cast<std::uint32_t>(i + 1);
+			}
+			return timers;
+		}
+
+		// 今から 1 日以内の時刻に毎日繰り返すタイマー
+		std::vector<Timer> MakeDailyTimers(std::size_t count, TimeValue now)
+		{
+			std::vector<Timer> timers = MakeTimers(count, now);
+			for (Timer& timer : timers) {
+				timer.dateToChange = now + (timer.dateToChange - now) % FILETIME_DAY;
+				timer.recurrence.rule = Recurrence::Rule::RULE_DAILY;
+				timer.recurrence.localOffset = 9 * FILETIME_HOUR;
+			}
+			return timers;
+		}
+
+		// 合成データの基準の日時(2020/1/1 0:00 UTC)
+		const TimeValue BASE_TIME = 132223104000000000LL;
+		// 毎日繰り返すタイマーを実行していく日数
+		const int RECURRING_DAYS = 7;
+
+		// 予定表ごとに、予約・取り出し・繰り返しの次の回の予約を測る
+		template<typename Scheduler>
+		void RunScheduler(CBenchmark* pBench, const wchar_t* pszName,
+			const std::vector<Timer>& timers, const std::vector<Timer>& dailyTimers)
+		{
+			const std::wstring prefix = std::wstring(L"Scheduler.") + pszName;
+
+			pBench->Run((prefix + L".Add").c_str(), timers.size(),
+				[]() { return std::unique_ptr<Scheduler>(new Scheduler); },
+				[&timers](std::unique_ptr<Scheduler>& scheduler) {
+					for (const Timer& timer : timers)
+						scheduler->Add(timer, BASE_TIME);
+				});
+
+			pBench->Run((prefix + L".PopDue").c_str(), timers.size(),
+				[&timers]() {
+					std::unique_ptr<Scheduler> scheduler(new Scheduler);
+					for (const Timer& timer : timers)
+						scheduler->Add(timer, BASE_TIME);
+					return scheduler;
+				},
+				[pBench](std::unique_ptr<Scheduler>& scheduler) {
+					// 1 分ずつ時刻を進めて、期限の来たタイマーを全て取り出す
+					Timer timer;
+					for (TimeValue now = BASE_TIME; !scheduler->Empty(); now += FILETIME_MIN) {
+						while (scheduler->PopDue(now, &timer))
+							pBench->Consume(timer.serial);
+					}
+				});
+
+			// 全てのタイマーの期限が過ぎてから、まとめて取り出す(スリープから復帰した時など)
+			pBench->Run((prefix + L".Drain").c_str(), timers.size(),
+				[&timers]() {
+					std::unique_ptr<Scheduler> scheduler(new Scheduler);
+					for (const Timer& timer : timers)
+						scheduler->Add(timer, BASE_TIME);
+					return scheduler;
+				},
+				[pBench](std::unique_ptr<Scheduler>& scheduler) {
+					Timer timer;
+					while (scheduler->PopDue(BASE_TIME + 7 * FILETIME_DAY, &timer))
+						pBench->Consume(timer.serial);
+				});
+
+			// 実行したら次の回を求めて予約し直す。各タイマーが RECURRING_DAYS 回ずつ実行される
+			pBench->Run((prefix + L".Recurring").c_str(), dailyTimers.size() * RECURRING_DAYS,
+				[&dailyTimers]() {
+					std::unique_ptr<Scheduler> scheduler(new Scheduler);
+					for (const Timer& timer : dailyTimers)
+						scheduler->Add(timer, BASE_TIME);
+					return scheduler;
+				},
+				[pBench](std::unique_ptr<Scheduler>& scheduler) {
+					Timer timer;
+					const TimeValue end = BASE_TIME + RECURRING_DAYS * FILETIME_DAY;
+					for (TimeValue now = BASE_TIME; now < end; now += FILETIME_MIN) {
+						while (scheduler->PopDue(now, &timer)) {
+							pBench->Consume(timer.serial);
+							if (NextOccurrence(&timer.recurrence, &timer.dateToChange, now + timer.leadTime))
+								scheduler->Add(timer, now);
+						}
+					}
+				});
+		}
+	}
+
+	constexpr int CBenchmark::REPEAT;
+	constexpr double CBenchmark::REGRESSION_RATIO;
+	constexpr double CBenchmark::ALLOCATION_TOLERANCE;
+	constexpr std::size_t CBenchmark::CHANNEL_COUNT;
+	constexpr std::size_t CBenchmark::TIMER_COUNT;
+	constexpr std::size_t CBenchmark::RECURRING_TIMER_COUNT;
+
+	void CBenchmark::RunCore()
+	{
+		const std::vector<CServiceInfo> services = MakeServices(CHANNEL_COUNT);
+
+		Run(L"DriverChannels.AddChannel", services.size(),
+			[]() {
+				std::unique_ptr<CDriverChannels> channels(new CDriverChannels);
+				channels->AddSpace(L"地デジ");
+				return channels;
+			},
+			[&services](std::unique_ptr<CDriverChannels>& channels) {
+				for (const CServiceInfo& service : services)
+					channels->AddChannel(0, service);
+			});
+
+		const std::unique_ptr<CDriverChannels> channels = MakeDriverChannels(services);
+		Run(L"DriverChannels.FindService", services.size(),
+			[]() { return 0; },
+			[this, &services, &channels](int) {
+				for (const CServiceInfo& service : services)
+					Consume(channels->FindService(service.GetKey())->index);
+			});
+
+		Run(L"ChannelView.toString", services.size(),
+			[]() { return 0; },
+			[this, &channels](int) {
+				for (const CChannelView channel : channels->spaces[0].channels)
+					Consume(channel.toString().length());
+			});
+
+		const std::vector<Timer> timers = MakeTimers(TIMER_COUNT, BASE_TIME);
+		const std::vector<Timer> dailyTimers = MakeDailyTimers(RECURRING_TIMER_COUNT, BASE_TIME);
+		RunScheduler<CBasicTimerScheduler<CSchedule<Timer>>>(this, L"Heap", timers, dailyTimers);
+		RunScheduler<CBasicTimerScheduler<CTimingWheel<Timer>>>(this, L"Wheel", timers, dailyTimers);
+	}
+
+	std::vector<CServiceInfo> CBenchmark::MakeServices(std::size_t count)
+	{
+		std::vector<CServiceInfo> services;
+		services.reserve(count);
+		for (std::size_t i = 0; i < count; i++) {
+			const std::wstring name = L"テスト放送" + std::to_wstring(i % 100) + L"-" + std::to_wstring(i);
+			services.emplace_back(
+				static_cast<std::uint16_t>(0x7F00 + i / 1000), static_cast<std::uint16_t>(i / 8),
+				static_cast<std::uint16_t>(i), static_cast<int>(i / 8), name.c_str());
+		}
+		return services;
+	}
+
+	bool CBenchmark::ParseBaseline(const std::wstring& key, const std::wstring& value,
+		const std::wstring& allocsPerOp)
+	{
+		if (key.empty())
+			return false;
+		wchar_t* pEnd;
+		const double nsPerOp = std::wcstod(value.c_str(), &pEnd);
+		if (pEnd == value.c_str() || *pEnd != L'\0' || !(nsPerOp > 0))
+			return false;
+		double allocs = -1.0;
+		if (!allocsPerOp.empty()) {
+			allocs = std::wcstod(allocsPerOp.c_str(), &pEnd);
+			if (pEnd == allocsPerOp.c_str() || *pEnd != L'\0')
+				return false;
+		}
+		m_baselines[key] = Baseline{ nsPerOp, allocs };
+		return true;
+	}
+
+	std::wstring CBenchmark::FormatValue(const CBenchmarkResult& result)
+	{
+		wchar_t szValue[32];
+		std::swprintf(szValue, 32, L"%.1f", result.nsPerOp);
+		return szValue;
+	}
+
+	std::vector<std::wstring> CBenchmark::FormatReport() const
+	{
+		std::vector<std::wstring> lines;
+		for (const CBenchmarkResult& result : m_results) {
+			wchar_t szLine[256];
+			std::swprintf(szLine, 256, L"%ls: %.1f ns/op (%llu 回",
+				result.name.c_str(), result.nsPerOp, static_cast<unsigned long long>(result.ops));
+			std::wstring line = szLine;
+			if (result.allocsPerOp >= 0) {
+				std::swprintf(szLine, 256, L"、確保 %.2f 回/op", result.allocsPerOp);
+				line += szLine;
+			}
+			if (result.baseline > 0) {
+				std::swprintf(szLine, 256, L"、基準 %.1f ns/op、%+.0f%%)%ls",
+					result.baseline, (result.nsPerOp / result.baseline - 1.0) * 100.0,
+					IsSlower(result) ? L" 遅くなっています" : L"");
+				line += szLine;
+			} else {
+				line += L")";
+			}
+			if (HasMoreAllocations(result)) {
+				std::swprintf(szLine, 256, L" 確保が増えています(基準 %.2f 回/op)", result.baselineAllocs);
+				line += szLine;
+			}
+			lines.push_back(line);
+		}
+		return lines;
+	}
+
+	void CBenchmark::AddResult(const wchar_t* name, std::uint64_t ops, double nsPerOp, double allocsPerOp)
+	{
+		CBenchmarkResult result;
+		result.name = name;
+		result.ops = ops;
+		result.nsPerOp = nsPerOp;
+		result.allocsPerOp = allocsPerOp;
+		const auto it = m_baselines.find(result.name);
+		result.baseline = it != m_baselines.end() ? it->second.nsPerOp : 0;
+		result.baselineAllocs = it != m_baselines.end() ? it->second.allocsPerOp : -1.0;
+		m_results.push_back(result);
+	}
+}
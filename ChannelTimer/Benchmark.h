@@ -0,0 +1,150 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "Channels.h"
+
+namespace TVTest {
+	class CTVTestApp;
+}
+
+namespace ChannelTimer {
+	/**
+	 * ベンチマークの一つのケースの結果
+	 */
+	struct CBenchmarkResult {
+		std::wstring name;
+		std::uint64_t ops;		// 1 回の計測での操作の数
+		double nsPerOp;			// 最も速かった回の 1 操作あたりの時間(ns 単位)
+		double baseline;		// 保存していた基準値(無ければ 0)
+		double allocsPerOp;		// 最も少なかった回の 1 操作あたりのメモリ確保の回数(数えていなければ負)
+		double baselineAllocs;	// 保存していたメモリ確保の回数の基準値(無ければ負)
+	};
+
+	/**
+	 * チャンネルの一覧・文字列の組み立て・予定表(ヒープとタイミングホイールの両方)などの処理時間の計測
+	 * 時刻は呼び出し側の単調な時計(µs 単位)で測り、基準値は「名前=ns/op」で保存して読み込む
+	 * メモリ確保の回数は、呼び出し側が operator new を置き換えて数えていれば、その累計から求める
+	 */
+	class CBenchmark {
+	public:
+		using Clock = std::int64_t (*)();
+		using AllocationCounter = std::uint64_t (*)();
+
+		// 計測を繰り返す回数(最も速かった回を結果にする)
+		static constexpr int REPEAT = 5;
+		// 基準値よりこの割合を超えて遅くなれば退行とする(既定値)
+		static constexpr double REGRESSION_RATIO = 1.25;
+		// メモリ確保の回数が基準値よりこれを超えて増えれば退行とする(保存した値の丸めの分)
+		static constexpr double ALLOCATION_TOLERANCE = 0.01;
+		// 合成データのチャンネルとタイマーの数
+		static constexpr std::size_t CHANNEL_COUNT = 10000;
+		static constexpr std::size_t TIMER_COUNT = 10000;
+		// 合成データの毎日繰り返すタイマーの数
+		static constexpr std::size_t RECURRING_TIMER_COUNT = 1000;
+
+		explicit CBenchmark(Clock clock, AllocationCounter allocations = nullptr)
+			: m_clock(clock)
+			, m_allocations(allocations)
+		{}
+
+		/**
+		 * 計測する
+		 * setup() の戻り値を body に渡し、body の時間だけを測る。ops は body の中の操作の数
+		 */
+		template<typename Setup, typename Body>
+		void Run(const wchar_t* name, std::uint64_t ops, Setup setup, Body body)
+		{
+			if (ops == 0)
+				return;
+			std::int64_t best = INT64_MAX;
+			std::uint64_t fewestAllocations = UINT64_MAX;
+			for (int i = 0; i < REPEAT; i++) {
+				auto state = setup();
+				const std::uint64_t allocations = m_allocations != nullptr ? m_allocations() : 0;
+				const std::int64_t start = m_clock();
+				body(state);
+				const std::int64_t elapsed = m_clock() - start;
+				if (elapsed < best)
+					best = elapsed;
+				if (m_allocations != nullptr && m_allocations() - allocations < fewestAllocations)
+					fewestAllocations = m_allocations() - allocations;
+			}
+			AddResult(name, ops, static_cast<double>(best) * 1000.0 / static_cast<double>(ops),
+				m_allocations != nullptr ? static_cast<double>(fewestAllocations) / static_cast<double>(ops) : -1.0);
+		}
+
+		/**
+		 * Win32 に依存しない部分を合成データで計測する
+		 */
+		void RunCore();
+
+		/**
+		 * ホストからのチャンネルの一覧の取得を、driverName のチューナーで計測する
+		 * HostBenchmark.cpp にあり、ホストとやり取りする部分と一緒にリンクする
+		 */
+		void RunHost(/* const */ TVTest::CTVTestApp* pApp, const std::wstring& driverName);
+
+		/**
+		 * 地上波のように似た名前の並ぶ合成データのサービス
+		 */
+		static std::vector<CServiceInfo> MakeServices(std::size_t count);
+
+		/**
+		 * 計測結果が最適化で消されないように混ぜる値
+		 */
+		void Consume(std::uint64_t value) { m_sink = m_sink + value; }
+
+		/**
+		 * 保存した基準値を読み込む。読めなければ false
+		 * allocsPerOp が空でなければ、メモリ確保の回数も比べる
+		 */
+		bool ParseBaseline(const std::wstring& key, const std::wstring& value,
+			const std::wstring& allocsPerOp = std::wstring());
+
+		/**
+		 * 遅くなったとする基準値との比(計測する環境が基準値と違う時に緩める)
+		 */
+		void SetRegressionRatio(double ratio) { m_regressionRatio = ratio; }
+
+		/**
+		 * 保存用の値
+		 */
+		static std::wstring FormatValue(const CBenchmarkResult& result);
+
+		bool IsRegression(const CBenchmarkResult& result) const {
+			return IsSlower(result) || HasMoreAllocations(result);
+		}
+		bool IsSlower(const CBenchmarkResult& result) const {
+			return result.baseline > 0 && result.nsPerOp > result.baseline * m_regressionRatio;
+		}
+		bool HasMoreAllocations(const CBenchmarkResult& result) const {
+			return result.baselineAllocs >= 0 && result.allocsPerOp >= 0
+				&& result.allocsPerOp > result.baselineAllocs + ALLOCATION_TOLERANCE;
+		}
+
+		const std::vector<CBenchmarkResult>& GetResults() const { return m_results; }
+
+		/**
+		 * ログに出力する内容(1 行ずつ)
+		 */
+		std::vector<std::wstring> FormatReport() const;
+
+	private:
+		Clock m_clock;
+		AllocationCounter m_allocations;
+		struct Baseline {
+			double nsPerOp;
+			double allocsPerOp;
+		};
+
+		std::map<std::wstring, Baseline> m_baselines;
+		double m_regressionRatio = REGRESSION_RATIO;
+		std::vector<CBenchmarkResult> m_results;
+		volatile std::uint64_t m_sink = 0;
+
+		void AddResult(const wchar_t* name, std::uint64_t ops, double nsPerOp, double allocsPerOp);
+	};
+}
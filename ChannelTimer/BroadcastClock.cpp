@@ -0,0 +1,81 @@
+#include "BroadcastClock.h"
+
+namespace ChannelTimer {
+	namespace {
+		// MJD 0 (1858/11/17) の FILETIME
+		constexpr TimeValue MJD_EPOCH = 94187LL * FILETIME_DAY;
+
+		int DecodeBcd(std::uint8_t v)
+		{
+			const int hi = v >> 4, lo = v & 0x0F;
+			return hi < 10 && lo < 10 ? hi * 10 + lo : -1;
+		}
+
+		TimeValue Abs(TimeValue v) { return v < 0 ? -v : v; }
+	}
+
+	bool CBroadcastClock::AddSample(TimeValue broadcastTime, TimeValue systemTime)
+	{
+		const TimeValue sample = broadcastTime - systemTime;
+		if (Abs(sample) > MAX_OFFSET)
+			return false;
+
+		if (!m_fValid.load(std::memory_order_relaxed)) {
+			Publish(sample);
+			m_fValid.store(true, std::memory_order_relaxed);
+		} else {
+			const TimeValue offset = GetOffset();
+			if (Abs(sample - offset) > OUTLIER_THRESHOLD) {
+				if (++m_outlierCount < OUTLIER_RESET_COUNT)
+					return false;
+				Publish(sample);
+			} else {
+				Publish(offset + (sample - offset) / (1 << SMOOTHING_SHIFT));
+			}
+		}
+		m_outlierCount = 0;
+
+		if (Abs(GetOffset() - m_notifiedOffset) < NOTIFY_THRESHOLD)
+			return false;
+		m_notifiedOffset = GetOffset();
+		return true;
+	}
+
+	void CBroadcastClock::Publish(TimeValue offset)
+	{
+		m_offset.store(offset, std::memory_order_relaxed);
+		m_epgOffset.store(EPG_TIME_OFFSET + offset, std::memory_order_relaxed);
+	}
+
+	TimeValue CTotWatcher::DecodeJstTime(const std::uint8_t* pData)
+	{
+		const int mjd = (pData[0] << 8) | pData[1];
+		const int hour = DecodeBcd(pData[2]);
+		const int minute = DecodeBcd(pData[3]);
+		const int second = DecodeBcd(pData[4]);
+		if (hour < 0 || hour > 23 || minute < 0 || minute > 59 || second < 0 || second > 60)
+			return -1;
+		return MJD_EPOCH + mjd * FILETIME_DAY
+			+ hour * FILETIME_HOUR + minute * FILETIME_MIN + second * FILETIME_SEC
+			- EPG_TIME_OFFSET;
+	}
+
+	bool CTotWatcher::AcceptTable(std::uint8_t tableID) const
+	{
+		return tableID == TABLE_ID_TDT || tableID == TABLE_ID_TOT;
+	}
+
+	void CTotWatcher::OnSection(const std::uint8_t* pSection, std::size_t size)
+	{
+		// table_id, section_length, JST_time(5 バイト)
+		if (size < 3 + 5)
+			return;
+		// TOT は CRC を持つ
+		if (pSection[0] == TABLE_ID_TOT && CSectionCollector::Crc32(pSection, size) != 0)
+			return;
+
+		const TimeValue time = DecodeJstTime(pSection + 3);
+		if (time >= 0 && m_pCallback != nullptr)
+			m_pCallback(m_pClientData, time);
+	}
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "Clock.h"
+#include "SectionCollector.h"
+
+namespace ChannelTimer {
+	/**
+	 * 放送局の時刻とシステム時刻の差を平滑化して持つ
+	 * AddSample は一つのスレッドから、変換は他のスレッドから呼んでよい
+	 * 変換は差を一度足すだけにする
+	 */
+	class CBroadcastClock {
+	public:
+		// これより大きな差は録画の再生などとみなして使わない
+		static constexpr TimeValue MAX_OFFSET = FILETIME_HOUR;
+		// 平滑化した値からこれ以上外れた標本は、続いた時だけ採る(システム時刻を合わせ直した時など)
+		static constexpr TimeValue OUTLIER_THRESHOLD = 30LL * FILETIME_SEC;
+		static constexpr int OUTLIER_RESET_COUNT = 3;
+		// 指数移動平均の重み(1/2^n)
+		static constexpr int SMOOTHING_SHIFT = 3;
+		// 差がこれ以上動いたら知らせる
+		static constexpr TimeValue NOTIFY_THRESHOLD = 200LL * FILETIME_MS;
+
+		/**
+		 * 同じ時点の放送局の時刻とシステム時刻(どちらも UTC)を渡す
+		 * 前回 true を返した時から差が NOTIFY_THRESHOLD 以上動いたら true を返す
+		 */
+		bool AddSample(TimeValue broadcastTime, TimeValue systemTime);
+
+		/**
+		 * 標本を受け取ったか。受け取るまで差は 0
+		 */
+		bool IsValid() const { return m_fValid.load(std::memory_order_relaxed); }
+
+		/**
+		 * 放送局の時刻 - システム時刻
+		 */
+		TimeValue GetOffset() const { return m_offset.load(std::memory_order_relaxed); }
+
+		/**
+		 * 放送局の時刻(UTC)をシステム時刻にする
+		 */
+		TimeValue BroadcastToSystem(TimeValue time) const { return time - m_offset.load(std::memory_order_relaxed); }
+
+		/**
+		 * EPG 日時(UTC+9、放送局の時刻)をシステム時刻(UTC)にする
+		 */
+		TimeValue EpgToSystem(TimeValue time) const { return time - m_epgOffset.load(std::memory_order_relaxed); }
+
+	private:
+		std::atomic<TimeValue> m_offset{ 0 };
+		std::atomic<TimeValue> m_epgOffset{ EPG_TIME_OFFSET };
+		std::atomic<bool> m_fValid{ false };
+
+		// 以下は AddSample を呼ぶスレッドだけが触る
+		TimeValue m_notifiedOffset = 0;
+		int m_outlierCount = 0;
+
+		void Publish(TimeValue offset);
+	};
+
+	/**
+	 * TS の TOT/TDT から放送局の時刻を読む
+	 * TOT/TDT 以外のパケットは PID を比べるだけで返す
+	 */
+	class CTotWatcher : private CSectionHandler {
+	public:
+		static const std::uint16_t PID_TOT = 0x0014;
+		static const std::uint8_t TABLE_ID_TDT = 0x70;
+		static const std::uint8_t TABLE_ID_TOT = 0x73;
+
+		/**
+		 * 放送局の時刻(UTC)を読んだ時に呼ばれる(OnPacket を呼んだスレッドから)
+		 */
+		typedef void (*TimeFunc)(void* pClientData, TimeValue broadcastTime);
+
+		CTotWatcher(TimeFunc pCallback, void* pClientData)
+			: m_pCallback(pCallback)
+			, m_pClientData(pClientData)
+		{}
+
+		/**
+		 * TS パケットを一つ渡す
+		 */
+		void OnPacket(const std::uint8_t* pPacket)
+		{
+			if (GetPacketPID(pPacket) == PID_TOT)
+				m_collector.OnPacket(pPacket);
+		}
+
+		/**
+		 * MJD と BCD の時分秒(JST)の 5 バイトを UTC にする。不正なら -1
+		 */
+		static TimeValue DecodeJstTime(const std::uint8_t* pData);
+
+	private:
+		TimeFunc m_pCallback;
+		void* m_pClientData;
+		CSectionCollector m_collector{ this };
+
+		bool AcceptTable(std::uint8_t tableID) const override;
+		void OnSection(const std::uint8_t* pSection, std::size_t size) override;
+	};
+}
@@ -0,0 +1,197 @@
+#include "Catalog.h"
+#include <shlwapi.h>
+#include "HostRange.h"
+#include "Model.h"
+
+namespace ChannelTimer {
+	const std::vector<std::wstring>& CChannelCatalog::GetDrivers(
+		/* const */ TVTest::CTVTestApp* pApp)
+	{
+		if (m_fDriversStale) {
+			m_drivers = ChannelTimer::GetDrivers(pApp);
+
+			// 無くなったチューナーのチャンネルは捨てる
+			std::unordered_map<std::wstring, Entry> entries;
+			for (const std::wstring& name : m_drivers) {
+				auto it = m_entries.find(name);
+				if (it != m_entries.end())
+					entries.emplace(name, std::move(it->second));
+			}
+			m_entries = std::move(entries);
+			m_fDriversStale = false;
+		}
+		return m_drivers;
+	}
+
+	std::shared_ptr<const CDriverChannels> CChannelCatalog::GetDriverChannels(
+		/* const */ TVTest::CTVTestApp* pApp,
+		const std::wstring& driverName)
+	{
+		// 読み込めなかったチューナーも、読み直しが必要になるまでは読み込まない
+		// (行ごと・ステータス項目の更新ごとに呼ばれるので、ホストに何度も尋ねない)
+		Entry& entry = m_entries[driverName];
+		if (entry.fStale) {
+			entry.channels = LoadDriverChannels(pApp, driverName);
+			entry.fStale = false;
+		}
+		return entry.channels;
+	}
+
+	void CChannelCatalog::InvalidateDriver(LPCWSTR pszDriverName)
+	{
+		Entry* pEntry = FindEntry(pszDriverName);
+		// 他のチューナーの読み込み中のものはそのまま使えるようにする
+		if (pEntry != nullptr) {
+			pEntry->fStale = true;
+			pEntry->generation = ++m_generation;
+		}
+	}
+
+	void CChannelCatalog::InvalidateAll()
+	{
+		m_fDriversStale = true;
+		m_generation++;
+		for (auto& entry : m_entries) {
+			entry.second.fStale = true;
+			entry.second.generation = m_generation;
+		}
+	}
+
+	std::size_t CChannelCatalog::GetLoadedServiceCount() const
+	{
+		std::size_t count = 0;
+		for (const auto& entry : m_entries) {
+			if (entry.second.channels)
+				count += entry.second.channels->services.Size();
+		}
+		return count;
+	}
+
+	std::size_t CChannelCatalog::GetMemoryUsage() const
+	{
+		std::size_t size = 0;
+		for (const auto& entry : m_entries) {
+			if (entry.second.channels)
+				size += entry.second.channels->MemoryUsage();
+		}
+		return size;
+	}
+
+	std::vector<std::wstring> CChannelCatalog::GetStaleDrivers() const
+	{
+		std::vector<std::wstring> drivers;
+		for (const std::wstring& name : m_drivers) {
+			const auto it = m_entries.find(name);
+			if (it == m_entries.end() || it->second.fStale)
+				drivers.push_back(name);
+		}
+		return drivers;
+	}
+
+	bool CChannelCatalog::IsStale(const std::wstring& driverName) const
+	{
+		const auto it = m_entries.find(driverName);
+		return it == m_entries.end() || it->second.fStale;
+	}
+
+	bool CChannelCatalog::SetDriverChannels(
+		const std::wstring& driverName,
+		std::shared_ptr<const CDriverChannels> channels,
+		unsigned int generation)
+	{
+		if (!channels)
+			return false;
+		// 読み込んでいる間に無くなったチューナーのものも捨てる
+		const auto it = m_entries.find(driverName);
+		if (it == m_entries.end() || it->second.generation != generation)
+			return false;
+		Entry& entry = it->second;
+		if (!entry.fStale && entry.channels)
+			return false;
+		entry.channels = std::move(channels);
+		entry.fStale = false;
+		return true;
+	}
+
+	CChannelCatalog::Entry* CChannelCatalog::FindEntry(LPCWSTR pszDriverName)
+	{
+		// GetDriverName はパスを返すことがあるので、ファイル名で比較する
+		LPCWSTR pszFileName = ::PathFindFileName(pszDriverName);
+		for (auto& entry : m_entries) {
+			if (::lstrcmpi(::PathFindFileName(entry.first.c_str()), pszFileName) == 0)
+				return &entry.second;
+		}
+		return nullptr;
+	}
+
+	std::shared_ptr<const CDriverChannels> LoadDriverChannels(
+		/* const */ TVTest::CTVTestApp* pApp,
+		const std::wstring& driverName)
+	{
+		const CDriverTuningSpaces tuningSpaces(pApp, driverName.c_str());
+		if (!tuningSpaces.IsLoaded())
+			return nullptr;
+
+		auto driver = std::make_shared<CDriverChannels>();
+		driver->driverName = driverName;
+		driver->spaces.reserve(tuningSpaces.Size());
+
+		for (int i = 0; i < tuningSpaces.Size(); i++) {
+			CTuningSpace& space = driver->AddSpace(tuningSpaces.GetName(i));
+			space.channels.Reserve(tuningSpaces.GetChannelCount(i));
+			// ホストの一覧から直接追加し、チャンネルごとに文字列を作らない
+			for (const CDriverTuningSpaces::ChannelRange::Item channel : tuningSpaces.Channels(i)) {
+				const TVTest::ChannelInfo& ChInfo = channel.info;
+				driver->AddChannel(i, ChInfo.NetworkID, ChInfo.TransportStreamID, ChInfo.ServiceID,
+					ChInfo.Channel, ChInfo.szChannelName);
+			}
+		}
+
+		return driver;
+	}
+
+	bool CopyDriverTuningSpaces(
+		/* const */ TVTest::CTVTestApp* pApp,
+		const std::wstring& driverName,
+		CDriverTuningSpaceCopy* pCopy)
+	{
+		pCopy->driverName = driverName;
+		pCopy->spaceNames.clear();
+		pCopy->channels.clear();
+
+		const CDriverTuningSpaces tuningSpaces(pApp, driverName.c_str());
+		if (!tuningSpaces.IsLoaded())
+			return false;
+
+		pCopy->spaceNames.reserve(tuningSpaces.Size());
+		pCopy->channels.resize(tuningSpaces.Size());
+		for (int i = 0; i < tuningSpaces.Size(); i++) {
+			pCopy->spaceNames.emplace_back(tuningSpaces.GetName(i));
+			std::vector<CServiceInfo>& channels = pCopy->channels[i];
+			channels.reserve(tuningSpaces.GetChannelCount(i));
+			for (const CDriverTuningSpaces::ChannelRange::Item channel : tuningSpaces.Channels(i)) {
+				const TVTest::ChannelInfo& ChInfo = channel.info;
+				channels.emplace_back(ChInfo.NetworkID, ChInfo.TransportStreamID, ChInfo.ServiceID,
+					ChInfo.Channel, ChInfo.szChannelName);
+			}
+		}
+
+		return true;
+	}
+
+	std::shared_ptr<const CDriverChannels> BuildDriverChannels(const CDriverTuningSpaceCopy& copy)
+	{
+		auto driver = std::make_shared<CDriverChannels>();
+		driver->driverName = copy.driverName;
+		driver->spaces.reserve(copy.spaceNames.size());
+
+		for (std::size_t i = 0; i < copy.spaceNames.size(); i++) {
+			CTuningSpace& space = driver->AddSpace(copy.spaceNames[i]);
+			space.channels.Reserve(copy.channels[i].size());
+			for (const CServiceInfo& service : copy.channels[i])
+				driver->AddChannel(static_cast<int>(i), service);
+		}
+
+		return driver;
+	}
+}
@@ -0,0 +1,134 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <windows.h>
+#include "TVTestPlugin.h"
+#include "Channels.h"
+
+namespace ChannelTimer {
+	/**
+	 * チューナー・チューニング空間・チャンネルの一覧のキャッシュ
+	 * プラグインが読み込まれている間保持し、ホストのイベントで古くなった部分だけを読み直す
+	 */
+	class CChannelCatalog {
+	public:
+		/**
+		 * チューナーの一覧
+		 */
+		const std::vector<std::wstring>& GetDrivers(/* const */ TVTest::CTVTestApp* pApp);
+
+		/**
+		 * チューナーのチューニング空間とチャンネル
+		 * 取得できなければ nullptr で、読み直しが必要になるまで再び取得しない
+		 */
+		std::shared_ptr<const CDriverChannels> GetDriverChannels(
+			/* const */ TVTest::CTVTestApp* pApp,
+			const std::wstring& driverName);
+
+		/**
+		 * チューナーのチャンネルを読み直す
+		 */
+		void InvalidateDriver(LPCWSTR pszDriverName);
+
+		/**
+		 * 全て読み直す
+		 */
+		void InvalidateAll();
+
+		/**
+		 * チャンネルを読み込む必要のあるチューナー
+		 */
+		std::vector<std::wstring> GetStaleDrivers() const;
+
+		/**
+		 * チャンネルを読み込む必要があるか
+		 */
+		bool IsStale(const std::wstring& driverName) const;
+
+		/**
+		 * 別スレッドで読み込んだチャンネルを入れる
+		 * 読み込み始めてからそのチューナーの読み直しが必要になっていれば(generation が違えば)捨てる
+		 */
+		bool SetDriverChannels(
+			const std::wstring& driverName,
+			std::shared_ptr<const CDriverChannels> channels,
+			unsigned int generation);
+
+		/**
+		 * チューナーの読み直しが必要になるたびに変わる番号
+		 * 読み込み始める時に取得して SetDriverChannels に渡す
+		 */
+		unsigned int GetGeneration(const std::wstring& driverName) { return m_entries[driverName].generation; }
+
+		/**
+		 * 読み込み済みのチューナーの全てのサービスを列挙する(同じサービスが複数回来ることがある)
+		 */
+		template<typename F>
+		void ForEachLoadedService(F func) const
+		{
+			for (const auto& entry : m_entries) {
+				if (!entry.second.channels)
+					continue;
+				for (const CTuningSpace& space : entry.second.channels->spaces) {
+					for (const CChannelView service : space.channels)
+						func(service);
+				}
+			}
+		}
+
+		/**
+		 * 読み込み済みのチューナーのサービスの数と、チャンネルの一覧が確保しているメモリの大きさ(バイト単位)
+		 */
+		std::size_t GetLoadedServiceCount() const;
+		std::size_t GetMemoryUsage() const;
+
+	private:
+		struct Entry {
+			std::shared_ptr<const CDriverChannels> channels;
+			bool fStale = true;		// 読み直しが必要か(読み込めなかった時も false にする)
+			unsigned int generation = 0;	// 読み直しが必要になった時の m_generation
+		};
+
+		std::vector<std::wstring> m_drivers;
+		bool m_fDriversStale = true;
+		std::unordered_map<std::wstring, Entry> m_entries;
+		unsigned int m_generation = 0;	// 読み直しが必要になるたびに増える
+
+		Entry* FindEntry(LPCWSTR pszDriverName);
+	};
+
+	/**
+	 * ホストから写したチューナーのチューニング空間とチャンネル(無効なチャンネルは含めない)
+	 * ホストの呼び出しは UI スレッドで行い、CDriverChannels は別スレッドで作るために使う
+	 */
+	struct CDriverTuningSpaceCopy {
+		std::wstring driverName;
+		std::vector<std::wstring> spaceNames;
+		std::vector<std::vector<CServiceInfo>> channels;
+	};
+
+	/**
+	 * チューナーのチューニング空間とチャンネルをホストから写す
+	 * ホストを呼ぶので UI スレッドで使う
+	 */
+	bool CopyDriverTuningSpaces(
+		/* const */ TVTest::CTVTestApp* pApp,
+		const std::wstring& driverName,
+		CDriverTuningSpaceCopy* pCopy);
+
+	/**
+	 * 写したチューニング空間とチャンネルから CDriverChannels を作る
+	 * ホストを呼ばないので別スレッドで使える
+	 */
+	std::shared_ptr<const CDriverChannels> BuildDriverChannels(const CDriverTuningSpaceCopy& copy);
+
+	/**
+	 * チューナーのチューニング空間とチャンネルをホストから読み込む
+	 */
+	std::shared_ptr<const CDriverChannels> LoadDriverChannels(
+		/* const */ TVTest::CTVTestApp* pApp,
+		const std::wstring& driverName);
+}
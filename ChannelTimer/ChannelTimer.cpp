@@ -8,18 +8,39 @@
 #include "resource.h"
 #include <windowsx.h>
 #include "Model.h"
+#include "HostRange.h"
+#include "Catalog.h"
+#include "TimerScheduler.h"
+#include "TunerPlanner.h"
+#include "Metrics.h"
+#include "LeadTime.h"
+#include "JournalFile.h"
+#include "EpgLoader.h"
+#include "EpgSearch.h"
+#include "EpgSnapshotFile.h"
+#include "ProgramKeySet.h"
+#include "StatusItem.h"
+#include "ScheduleRows.h"
+#include "SchedulePanel.h"
+#include "Prefetcher.h"
+#include "EitWatcher.h"
+#include "BroadcastClock.h"
+#include "StreamWorker.h"
+#include "Recurrence.h"
+#include "Benchmark.h"
+#include <algorithm>
+#include <climits>
+#include <unordered_map>
 
 #pragma comment(lib,"comctl32.lib")
 #pragma comment(lib,"shlwapi.lib")
 #pragma comment(lib,"powrprof.lib")
 
 using CServiceInfo = ChannelTimer::CServiceInfo;
-
-// FILETIME の単位
-static const LONGLONG FILETIME_MS   = 10000LL;
-static const LONGLONG FILETIME_SEC  = 1000LL * FILETIME_MS;
-static const LONGLONG FILETIME_MIN  = 60LL * FILETIME_SEC;
-static const LONGLONG FILETIME_HOUR = 60LL * FILETIME_MIN;
+using Timer = ChannelTimer::Timer;
+using ChannelTimer::FILETIME_MS;
+using ChannelTimer::FILETIME_SEC;
+using ChannelTimer::EPG_TIME_OFFSET;
 
 // FILETIME の時間差を求める
 static LONGLONG DiffFileTime(const FILETIME &ft1, const FILETIME &ft2)
@@ -34,6 +55,52 @@ static LONGLONG DiffFileTime(const FILETIME &ft1, const FILETIME &ft2)
 	return li1.QuadPart - li2.QuadPart;
 }
 
+// FILETIME を数値に変換する
+static LONGLONG FileTimeToValue(const FILETIME &ft)
+{
+	LARGE_INTEGER li;
+
+	li.LowPart = ft.dwLowDateTime;
+	li.HighPart = ft.dwHighDateTime;
+
+	return li.QuadPart;
+}
+
+// 数値を FILETIME に変換する
+static FILETIME ValueToFileTime(LONGLONG Value)
+{
+	LARGE_INTEGER li;
+	FILETIME ft;
+
+	li.QuadPart = Value;
+	ft.dwLowDateTime = li.LowPart;
+	ft.dwHighDateTime = li.HighPart;
+
+	return ft;
+}
+
+// 現在日時(UTC)を FILETIME 単位で取得する
+static LONGLONG GetCurrentTimeValue()
+{
+	FILETIME ft;
+
+	::GetSystemTimeAsFileTime(&ft);
+
+	return FileTimeToValue(ft);
+}
+
+// 経過時間の計測用の単調な時刻(µs単位)
+static LONGLONG GetTickValue()
+{
+	LARGE_INTEGER Frequency, Counter;
+
+	::QueryPerformanceFrequency(&Frequency);
+	::QueryPerformanceCounter(&Counter);
+
+	return Counter.QuadPart / Frequency.QuadPart * 1000000LL
+		+ Counter.QuadPart % Frequency.QuadPart * 1000000LL / Frequency.QuadPart;
+}
+
 // SYSTEMTIME の時間差を求める(ms単位)
 static LONGLONG DiffSystemTime(const SYSTEMTIME &st1, const SYSTEMTIME &st2)
 {
@@ -49,46 +116,73 @@ static LONGLONG DiffSystemTime(const SYSTEMTIME &st1, const SYSTEMTIME &st2)
 // ウィンドウクラス名
 #define SLEEPTIMER_WINDOW_CLASS TEXT("TVTest Timer Window")
 
-struct Timer
-{
-	// スリープ条件
-	enum class SleepCondition {
-		CONDITION_DURATION,	// 時間経過
-		CONDITION_DATETIME,	// 指定時刻
-		CONDITION_EVENTEND	// 番組終了
-	};
-
-	SleepCondition condition;			// スリープする条件
-	SYSTEMTIME dateToChange;
-	DWORD durationToChange = 0;			// スリープまでの時間(秒単位)
-	WORD eventID;						// 現在の番組の event_id
-	TVTest::ChannelSelectInfo channelInfo = {};
-	Timer() noexcept {
-		channelInfo.Size = sizeof(channelInfo);
-		channelInfo.Flags = 0;
-		channelInfo.Channel = -1;
-		channelInfo.Space = -1;
-	}
-};
-
 struct TuningSpaceInfo
 {
 	WCHAR Name[MAX_PATH];
 };
 
 // プラグインクラス
-class CChannelTimer : public TVTest::CTVTestPlugin
+class CChannelTimer : public TVTest::CTVTestPlugin, private ChannelTimer::CSchedulePanelHandler
 {
 	enum {
 		TIMER_ID_SLEEP = 1,
-		TIMER_ID_QUERY
+		TIMER_ID_QUERY,
+		TIMER_ID_EPG,
+		TIMER_ID_STATUS,
+		TIMER_ID_SNAPSHOT,
+		TIMER_ID_SERVICE,
+		TIMER_ID_PREFETCH
 	};
 
+	// 別スレッドで読み込んだチャンネルの通知
+	static const UINT WM_APP_PREFETCHED = WM_APP;
+	// ストリームで番組が変わったのを知った時の通知(wParam: service_id, lParam: event_id)
+	static const UINT WM_APP_EVENTCHANGED = WM_APP + 1;
+	// 放送局の時刻との差が変わった時の通知
+	static const UINT WM_APP_CLOCKCHANGED = WM_APP + 2;
+	// 番組表のスナップショットを書き込んだ時の通知(wParam: ファイルの番号, lParam: 書き込めたか)
+	static const UINT WM_APP_SNAPSHOTSAVED = WM_APP + 3;
+
+	enum {
+		COMMAND_CLEARTIMERS = 1,
+		COMMAND_SHOWSTATS,
+		COMMAND_BENCHMARK
+	};
+
+	// ステータス項目とパネル項目の識別子
+	static const int STATUS_ITEM_COUNTDOWN = 1;
+	static const int PANEL_ITEM_SCHEDULE = 1;
+
 	static const int DEFAULT_POS = INT_MIN;
+	// WM_TIMER が期限より早く来た時に許容する誤差
+	static const LONGLONG DEADLINE_TOLERANCE = 50LL * FILETIME_MS;
+	// 終了時刻未定の番組を確認する間隔(ms単位)
+	static const UINT QUERY_INTERVAL = 3000;
+	// 番組表を少しずつ読み直す間隔(ms単位)と、一度に読み直すサービスの数
+	static const UINT EPG_REFRESH_INTERVAL = 10000;
+	static const int EPG_REFRESH_BATCH = 8;
+	// 番組表を読み直すまでの時間
+	static const LONGLONG EPG_MAX_AGE = 5LL * ChannelTimer::FILETIME_MIN;
+	static const LONGLONG EPG_CURRENT_MAX_AGE = 1LL * ChannelTimer::FILETIME_MIN;
+	// チャンネルを先に読み込む時、ホストに一つのチューナーの一覧を尋ねる間隔(ms単位)
+	static const UINT PREFETCH_INTERVAL = 100;
+	// 番組表のスナップショットを書き直す間隔(ms単位)
+	static const UINT EPG_SNAPSHOT_INTERVAL = 10 * 60 * 1000;
+	// 番組表でタイマーを予約した番組に付ける印
+	static const int PROGRAM_MARK_WIDTH = 4;
+	static const COLORREF PROGRAM_MARK_COLOR = RGB(255, 128, 0);
+	// 条件に合った番組を探す、開始までの時間(分単位)の既定値
+	static const int DEFAULT_SEARCH_HORIZON = 10;
 
 	bool m_fInitialized = false;				// 初期化済みか?
 	TCHAR m_szIniFileName[MAX_PATH] = TEXT("");	// INIファイルのパス
-	Timer m_timer;
+	ChannelTimer::CTimerScheduler m_scheduler;	// 予約したタイマー
+	ChannelTimer::CScheduleJournal m_journal;	// 予約したタイマーの保存先
+	ChannelTimer::CTunerPlanner m_planner;		// タイマーの切り替えの重なり
+	std::uint32_t m_NextSerial = 1;				// 次に予約するタイマーの通し番号
+	LONGLONG m_QueryDeadline = 0;				// 番組確認の WM_TIMER が来るはずの日時
+	ChannelTimer::CSwitchMetrics m_metrics;		// タイマーと切り替えの遅延の計測値
+	Timer m_lastTimer;						// 最後に設定したタイマー(設定ダイアログの初期値)
 	bool m_fIgnoreRecStatus = true;			// 録画中でもスリープする
 	int m_ConfirmTimeout = 10;				// 確認のタイムアウト時間(秒単位)
 	bool m_fShowSettings = true;				// プラグイン有効時に設定表示
@@ -96,27 +190,100 @@ class CChannelTimer : public TVTest::CTVTestPlugin
 	POINT m_SettingsDialogPos;			// 設定ダイアログの位置
 	HWND m_hwnd = nullptr;						// ウィンドウハンドル
 	bool m_fEnabled = false;					// プラグインが有効か?
+	bool m_fEnabling = false;				// 有効にする途中の設定ダイアログを表示中か
+	bool m_fFiring = false;					// 期限の来たタイマーを実行中か(確認ダイアログの間に次を実行しない)
 	int m_ConfirmTimerCount = 0;			// 確認のタイマー
-	int m_offset = 5;						// チャンネル切り替えを時差(秒)。+ で早める
-	std::vector<std::wstring> m_drivers;
-	std::vector<std::wstring> m_tuningSpaces;
-	std::vector<CServiceInfo> m_channels;
+	WORD m_PendingServiceID = 0;				// 段階に分けた切り替えで、切り替える日時に選ぶサービス(0 なら無し)
+	LONGLONG m_PendingServiceTime = 0;			// そのサービスを選ぶ日時(0 ならすぐ)
+	std::wstring m_PendingServiceTuner;			// そのサービスを選ぶチューナー
+	int m_offset = 5;						// チャンネル切り替えを時差(秒)。+ で早める。計測値が無い時に使う
+	ChannelTimer::CLeadTimeEstimator m_leadTime;	// チューナーごとに計測した切り替えを早める時間
+	ChannelTimer::CChannelCatalog m_catalog;	// チューナーとチャンネルの一覧
+	ChannelTimer::CCatalogPrefetcher m_prefetcher;	// チャンネルを先に読み込んでおく
+	ChannelTimer::CEpgIndex m_epg;				// サービスごとの番組表
+	ChannelTimer::CEpgSearchIndex m_search;		// 番組名・番組内容・ジャンルの索引
+	ChannelTimer::CEpgSnapshotStore m_snapshotStore;	// 番組表のスナップショットの保存先
+	std::uint32_t m_SnapshotGeneration = 0;		// スナップショットに書いた番組表の世代
+	std::vector<ChannelTimer::CSearchRule> m_searchRules;	// 切り替える番組の条件
+	LONGLONG m_SearchHorizon = DEFAULT_SEARCH_HORIZON * ChannelTimer::FILETIME_MIN;	// 開始までこの時間の番組を探す
+	std::unordered_map<ChannelTimer::ProgramKey, LONGLONG> m_searchScheduled;	// タイマーを予約した番組 -> 開始日時
+	ChannelTimer::CProgramKeySet m_scheduledPrograms;	// 番組を指定して予約したタイマーの番組(番組表の印)
+	ChannelTimer::CCountdownStatusItem m_statusItem;	// 次の切り替えまでの残り時間のステータス項目
+	std::uint32_t m_StatusSerial = 0;			// ステータス項目に表示しているタイマーの通し番号
+	std::wstring m_StatusTarget;				// ステータス項目に表示している切り替え先
+	ChannelTimer::CScheduleRows m_scheduleRows;	// タイマーの一覧のパネル項目の行
+	ChannelTimer::CSchedulePanel m_schedulePanel{ this };	// タイマーの一覧のパネル項目
+	ChannelTimer::CEitPfWatcher m_eitWatcher{ OnEitEventChanged, this };	// ストリームの現在の番組
+	ChannelTimer::CBroadcastClock m_clock;		// 放送局の時刻とシステム時刻の差
+	ChannelTimer::CTotWatcher m_totWatcher{ OnBroadcastTime, this };	// ストリームの TOT/TDT
+	ChannelTimer::CStreamWorker m_streamWorker{ OnStreamPackets, this };	// ストリームの解析をするスレッド
+	std::vector<std::wstring> m_drivers;		// 設定ダイアログのチューナー
+	std::shared_ptr<const ChannelTimer::CDriverChannels> m_driverChannels;	// 設定ダイアログのチューナーのチャンネル
 
 	bool InitializePlugin();
 	bool OnEnablePlugin(bool fEnable);
-	bool BeginSleep();
-	bool DoSleep();
+	void EnableForTimers();
+	bool BeginSleep(const Timer &timer, LONGLONG SwitchTime);
+	bool DoSleep(const Timer &timer, LONGLONG SwitchTime);
+	bool SelectPendingService();
+	bool AddTimer(const Timer &timer);
+	void ClearTimers();
+	void LoadTimers();
+	void CompactJournal(bool fForce = false);
+	bool PlanTimer(ChannelTimer::TimerId id, std::vector<std::uint32_t> *pConflicts = nullptr);
+	void PlanAllTimers();
 	bool BeginTimer();
 	void EndTimer();
+	void UpdateEventEndTimers();
+	void RefreshEpg();
+	bool RefreshServiceEpg(WORD NetworkID, WORD TransportStreamID, WORD ServiceID, LONGLONG MaxAge);
+	void LoadEpgSnapshot();
+	void SaveEpgSnapshot(bool fWait);
+	void OnSleepTimer(bool fUpdateEventEnd = true);
 	bool ShowSettingsDialog(HWND hwndOwner);
+	void InvalidateCurrentDriver();
+	void StartPrefetch();
+	std::wstring GetCurrentDriverName() const;
+	void ShowStats();
+	void RunBenchmark();
 
 	static LRESULT CALLBACK EventCallback(UINT Event, LPARAM lParam1, LPARAM lParam2, void *pClientData);
+	static BOOL CALLBACK StreamCallback(BYTE *pData, void *pClientData);
+	static void OnStreamPackets(void *pClientData, const std::uint8_t *pPackets, std::size_t Count);
+	static void OnEitEventChanged(void *pClientData, std::uint16_t ServiceID, std::uint16_t EventID);
+	static void OnBroadcastTime(void *pClientData, LONGLONG BroadcastTime);
 	static CChannelTimer *GetThis(HWND hwnd);
 	static LRESULT CALLBACK WndProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 	static INT_PTR CALLBACK SettingsDlgProc(HWND hDlg, UINT uMsg, WPARAM wParam, LPARAM lParam, void *pClientData);
 	static INT_PTR CALLBACK ConfirmDlgProc(HWND hDlg, UINT uMsg, WPARAM wParam, LPARAM lParam, void *pClientData);
 
 	LONGLONG GetOffsetSecond() const;
+	LONGLONG GetSwitchLeadTime(const Timer &timer) const;
+	void LoadLeadTimes();
+	void LoadSearchRules();
+	void MatchSearchRules();
+	bool MakeProgramTimer(const std::wstring &DriverName, const ChannelTimer::CDriverChannels &Driver,
+		ChannelTimer::ServiceKey Key, std::uint16_t EventID, LONGLONG StartTime, Timer *pTimer) const;
+	void UpdateScheduledPrograms();
+	void UpdateSchedulePanel();
+	void OnTimersChanged();
+	void RemoveTimers(const std::vector<ChannelTimer::TimerId> &Timers);
+	int CancelProgramTimers(ChannelTimer::ProgramKey Key);
+	bool DrawProgramBackground(
+		const TVTest::ProgramGuideProgramInfo *pProgram, const TVTest::ProgramGuideProgramDrawBackgroundInfo *pInfo) const;
+	int InitializeProgramMenu(
+		const TVTest::ProgramGuideProgramInfo *pProgram, const TVTest::ProgramGuideProgramInitializeMenuInfo *pInfo) const;
+	bool OnProgramMenuSelected(const TVTest::ProgramGuideProgramInfo *pProgram, UINT Command);
+	void UpdateStatusItem();
+	std::wstring GetTargetName(const Timer &timer);
+
+	// CSchedulePanelHandler
+	void GetRowText(std::size_t Row, int Column, wchar_t *pszText, int MaxLength) override;
+	void CancelRows(const std::vector<std::size_t> &Rows) override;
+	bool IsRecurringRow(std::size_t Row) override;
+	void SkipRows(const std::vector<std::size_t> &Rows) override;
+	const Timer *GetRowTimer(std::size_t Row) const;
+	void OnChannelChange();
 	bool IsUpInSecond(LONGLONG timeRemainingSecond) const;
 	bool IsUpInMillisecond(LONGLONG timeRemainingMillisecond) const;
 
@@ -149,9 +316,31 @@ bool CChannelTimer::Initialize()
 {
 	// 初期化処理
 
+	// INIファイルのパスを取得
+	::GetModuleFileName(g_hinstDLL, m_szIniFileName, _countof(m_szIniFileName));
+	::PathRenameExtension(m_szIniFileName, TEXT(".ini"));
+	LoadLeadTimes();
+	LoadSearchRules();
+	LoadEpgSnapshot();
+	LoadTimers();
+
 	// アイコンを登録
 	m_pApp->RegisterPluginIconFromResource(g_hinstDLL, MAKEINTRESOURCE(IDB_ICON));
 
+	// コマンドを登録
+	m_pApp->RegisterCommand(COMMAND_CLEARTIMERS, L"ClearTimers", L"タイマーを全て取り消す");
+	m_pApp->RegisterCommand(COMMAND_SHOWSTATS, L"ShowStats", L"タイマーの遅延をログに表示");
+	m_pApp->RegisterCommand(COMMAND_BENCHMARK, L"Benchmark", L"処理時間を計測してログに表示");
+
+	// 番組表の番組からタイマーを予約し、予約した番組に印を付ける
+	m_pApp->EnableProgramGuideEvent(TVTest::PROGRAMGUIDE_EVENT_PROGRAM);
+
+	// ステータス項目を登録
+	m_statusItem.Register(m_pApp, STATUS_ITEM_COUNTDOWN);
+
+	// パネル項目を登録
+	m_schedulePanel.Register(m_pApp, g_hinstDLL, PANEL_ITEM_SCHEDULE);
+
 	// イベントコールバック関数を登録
 	m_pApp->SetEventCallback(EventCallback, this);
 
@@ -196,9 +385,22 @@ bool CChannelTimer::Finalize()
 {
 	// 終了処理
 
+	// 結果をウィンドウへ送ってくるスレッドを先に止める
+	m_pApp->SetStreamCallback(TVTest::STREAM_CALLBACK_REMOVE, StreamCallback);
+	m_streamWorker.Stop();
+	m_prefetcher.Stop();
+	m_journal.Close();
+	SaveEpgSnapshot(true);
+	m_snapshotStore.Wait();
+
 	// ウィンドウの破棄
-	if (m_hwnd)
+	if (m_hwnd) {
+		// 受け取っていないチャンネルの読み込み結果を捨てる
+		MSG msg;
+		while (::PeekMessage(&msg, m_hwnd, WM_APP_PREFETCHED, WM_APP_PREFETCHED, PM_REMOVE))
+			delete reinterpret_cast<ChannelTimer::CCatalogPrefetcher::Result*>(msg.lParam);
 		::DestroyWindow(m_hwnd);
+	}
 
 	return true;
 }
@@ -209,25 +411,66 @@ bool CChannelTimer::OnEnablePlugin(bool fEnable)
 {
 	InitializePlugin();
 
-	if (fEnable && m_fShowSettings) {
-		if (!ShowSettingsDialog(m_pApp->GetAppWindow()))
+	// 設定ダイアログでチューナーを選んだ時に待たないよう、チャンネルを先に読み込んでおく
+	if (fEnable) {
+		StartPrefetch();
+	} else {
+		::KillTimer(m_hwnd, TIMER_ID_PREFETCH);
+		m_prefetcher.Stop();
+	}
+
+	// 予約したタイマーが残っていれば(保存したものや番組表から予約したもの)、設定ダイアログを出さずに動かす
+	if (fEnable && m_fShowSettings && m_scheduler.Empty()) {
+		m_fEnabling = true;
+		const bool fOK = ShowSettingsDialog(m_pApp->GetAppWindow());
+		m_fEnabling = false;
+		if (!fOK)
 			return false;
 	}
 
 	m_fEnabled = fEnable;
 
-	if (m_fEnabled)
+	if (m_fEnabled) {
+		RefreshEpg();
+		::SetTimer(m_hwnd, TIMER_ID_EPG, EPG_REFRESH_INTERVAL, nullptr);
+		::SetTimer(m_hwnd, TIMER_ID_SNAPSHOT, EPG_SNAPSHOT_INTERVAL, nullptr);
+		// 番組の切り替わりと放送局の時刻をストリームの EIT と TOT/TDT から知る
+		m_streamWorker.Start();
+		m_pApp->SetStreamCallback(0, StreamCallback, this);
+		UpdateEventEndTimers();
 		BeginTimer();
-	else
+	} else {
+		m_pApp->SetStreamCallback(TVTest::STREAM_CALLBACK_REMOVE, StreamCallback);
+		m_streamWorker.Stop();
+		m_eitWatcher.SetService(0);
+		::KillTimer(m_hwnd, TIMER_ID_EPG);
+		::KillTimer(m_hwnd, TIMER_ID_SNAPSHOT);
+		SaveEpgSnapshot(false);
 		EndTimer();
+		UpdateStatusItem();
+	}
 
 	return true;
 }
 
+// 予約したタイマーがあるのに無効なら、有効にしてタイマーを動かす
+// 有効にする途中の設定ダイアログで予約した時は、その後で動かすので何もしない
+void CChannelTimer::EnableForTimers()
+{
+	if (!m_fEnabled && !m_fEnabling && !m_scheduler.Empty())
+		m_pApp->EnablePlugin(true);
+}
+
 LONGLONG CChannelTimer::GetOffsetSecond() const {
 	return 0LL + m_ConfirmTimeout + m_offset;
 }
 
+// チャンネル切り替えを早める時間(FILETIME 単位)
+// チューナーとチューニング空間の切り替え時間を計測していればそれから求める
+LONGLONG CChannelTimer::GetSwitchLeadTime(const Timer &timer) const {
+	return m_leadTime.Estimate(timer.tuner, timer.space, m_offset * FILETIME_SEC);
+}
+
 bool CChannelTimer::IsUpInSecond(LONGLONG timeRemainingSecond) const {
 	return timeRemainingSecond < GetOffsetSecond();
 }
@@ -237,12 +480,15 @@ bool CChannelTimer::IsUpInMillisecond(LONGLONG timeRemainingMillisecond) const {
 }
 
 // スリープ開始
-bool CChannelTimer::BeginSleep()
+// SwitchTime は切り替える日時(0 ならすぐ)
+bool CChannelTimer::BeginSleep(const Timer &timer, LONGLONG SwitchTime)
 {
 	m_pApp->AddLog(L"スリープを開始します。");
 
-	m_pApp->EnablePlugin(false);	// タイマーは一回限り有効
-	EndTimer();		// EventCallbackで呼ばれるはずだが、念のため
+	if (m_scheduler.Empty()) {
+		m_pApp->EnablePlugin(false);	// 予約したタイマーが全て済んだら無効にする
+		EndTimer();		// EventCallbackで呼ばれるはずだが、念のため
+	}
 
 	if (m_fConfirm) {
 		// 確認ダイアログを表示
@@ -276,43 +522,133 @@ bool CChannelTimer::BeginSleep()
 	}
 
 	// スリープ実行
-	return DoSleep();
+	return DoSleep(timer, SwitchTime);
+}
+
+
+// チューナー名が同じか(パスの有無と大文字小文字は問わない)
+static bool IsSameDriver(const std::wstring &Name1, const std::wstring &Name2)
+{
+	return ::lstrcmpi(::PathFindFileName(Name1.c_str()), ::PathFindFileName(Name2.c_str())) == 0;
 }
 
 
 // スリープ実行
-bool CChannelTimer::DoSleep()
+// チューナーが変わる時は段階に分け、時間のかかるチューナーの読み込みと選局を先に済ませて、サービスだけを SwitchTime に選ぶ
+// 読み込みの開始から選局の完了までを、切り替えを早める時間の計測値にする
+bool CChannelTimer::DoSleep(const Timer &timer, LONGLONG SwitchTime)
+{
+	TVTest::ChannelSelectInfo channelInfo = {};
+	channelInfo.Size = sizeof(channelInfo);
+	channelInfo.Flags = 0;
+	channelInfo.pszTuner = timer.tuner.c_str();
+	channelInfo.Space = timer.space;
+	channelInfo.Channel = timer.channel;
+	channelInfo.NetworkID = timer.networkID;
+	channelInfo.TransportStreamID = timer.transportStreamID;
+	channelInfo.ServiceID = timer.serviceID;
+
+	// 予約後にチャンネルファイルが変わっていても、サービスから切り替え先の空間を求める
+	const auto driver = m_catalog.GetDriverChannels(m_pApp, timer.tuner);
+	if (driver) {
+		channelInfo.Space = driver->ResolveSpace(
+			ChannelTimer::MakeServiceKey(timer.networkID, timer.transportStreamID, timer.serviceID),
+			timer.space);
+	}
+
+	// 前の切り替えでまだ選んでいないサービスは、もう選ばない
+	m_PendingServiceID = 0;
+	::KillTimer(m_hwnd, TIMER_ID_SERVICE);
+
+	if (timer.tuner.empty() || timer.serviceID == 0 || IsSameDriver(timer.tuner, GetCurrentDriverName())) {
+		m_metrics.BeginSelect(timer.tuner, channelInfo.Space, GetTickValue());
+		const bool fResult = m_pApp->SelectChannel(&channelInfo);
+		m_metrics.EndSelect(GetTickValue());
+		return fResult;
+	}
+
+	// チューナーの読み込み
+	const LONGLONG DriverStart = GetTickValue();
+	if (!m_pApp->SetDriverName(timer.tuner.c_str())) {
+		m_pApp->AddLog((std::wstring(L"チューナーを読み込めません: ") + timer.tuner).c_str(), TVTest::LOG_TYPE_WARNING);
+		return false;
+	}
+	const LONGLONG TuneStart = GetTickValue();
+	m_metrics.RecordStage(timer.tuner, ChannelTimer::SwitchStage::STAGE_DRIVER, TuneStart - DriverStart);
+
+	// 読み込んだチューナーで選局する。サービスはまだ選ばない
+	// 読み込みの間に来た EVENT_CHANNELCHANGE は数えないよう、ここから待つ(時間は読み込みの開始から測る)
+	channelInfo.pszTuner = nullptr;
+	channelInfo.ServiceID = 0;
+	m_metrics.BeginSelect(timer.tuner, channelInfo.Space, DriverStart);
+	const bool fTuned = m_pApp->SelectChannel(&channelInfo);
+	const LONGLONG TuneEnd = GetTickValue();
+	m_metrics.EndSelect(TuneEnd);
+	m_metrics.RecordStage(timer.tuner, ChannelTimer::SwitchStage::STAGE_TUNE, TuneEnd - TuneStart);
+	if (!fTuned)
+		return false;
+
+	// サービスは切り替える日時に選ぶ
+	m_PendingServiceID = timer.serviceID;
+	m_PendingServiceTime = SwitchTime;
+	m_PendingServiceTuner = timer.tuner;
+	const LONGLONG Wait = SwitchTime != 0 ? (SwitchTime - GetCurrentTimeValue()) / FILETIME_MS : 0;
+	if (Wait > 0 && ::SetTimer(m_hwnd, TIMER_ID_SERVICE, static_cast<UINT>(Wait), nullptr) != 0)
+		return true;
+	return SelectPendingService();
+}
+
+
+// 段階に分けた切り替えの最後に、サービスを選ぶ
+// それまでにチューナーが変わっていれば(ユーザーが切り替えたなど)選ばない
+bool CChannelTimer::SelectPendingService()
 {
-	return m_pApp->SelectChannel(&m_timer.channelInfo);
+	::KillTimer(m_hwnd, TIMER_ID_SERVICE);
+	if (m_PendingServiceID == 0)
+		return false;
+	const WORD ServiceID = m_PendingServiceID;
+	m_PendingServiceID = 0;
+
+	if (!IsSameDriver(m_PendingServiceTuner, GetCurrentDriverName())) {
+		m_pApp->AddLog(L"チューナーが変わったので、サービスを選びませんでした。");
+		return false;
+	}
+
+	if (m_PendingServiceTime != 0)
+		m_metrics.RecordServiceDelay(m_PendingServiceTuner, (GetCurrentTimeValue() - m_PendingServiceTime) / 10);
+	const LONGLONG Start = GetTickValue();
+	const bool fResult = m_pApp->SetService(ServiceID, true);
+	m_metrics.RecordStage(m_PendingServiceTuner, ChannelTimer::SwitchStage::STAGE_SERVICE, GetTickValue() - Start);
+	return fResult;
 }
 
 
-// タイマー開始
-bool CChannelTimer::BeginTimer()
+// タイマーを予約する
+bool CChannelTimer::AddTimer(const Timer &timer)
 {
-	UINT_PTR Result;
 	WCHAR szLog[256];
-	const Timer::SleepCondition& condition = this->m_timer.condition;
+	Timer newTimer = timer;
+	const LONGLONG SwitchLeadTime = GetSwitchLeadTime(timer);
+	newTimer.leadTime = m_ConfirmTimeout * FILETIME_SEC + SwitchLeadTime;
 
-	if (condition == Timer::SleepCondition::CONDITION_DURATION) {
-		int timer = (this->m_timer.durationToChange - GetOffsetSecond()) * 1000;
-		std::wstring log =
-			std::to_wstring(this->m_timer.durationToChange - m_offset) + std::wstring(L" 秒後にチャンネル切り替え、")
-			+ std::to_wstring(timer / 1000) + std::wstring(L" 秒後に確認画面を表示します。");
-		m_pApp->AddLog(log.c_str());
-		Result = ::SetTimer(m_hwnd, TIMER_ID_SLEEP, timer > 0 ? timer : 0, nullptr);
-	}
-	else if (condition == Timer::SleepCondition::CONDITION_DATETIME || condition == Timer::SleepCondition::CONDITION_EVENTEND) {
-		if (condition == Timer::SleepCondition::CONDITION_DATETIME) {
+	switch (timer.condition) {
+	case Timer::SleepCondition::CONDITION_DURATION:
+		{
+			const LONGLONG Duration = timer.durationToChange * FILETIME_SEC;
+			const LONGLONG confirmSecond = (Duration - newTimer.leadTime) / FILETIME_SEC;
+			std::wstring log =
+				std::to_wstring((Duration - SwitchLeadTime) / FILETIME_SEC) + std::wstring(L" 秒後にチャンネル切り替え、")
+				+ std::to_wstring(confirmSecond) + std::wstring(L" 秒後に確認画面を表示します。");
+			m_pApp->AddLog(log.c_str());
+		}
+		break;
+
+	case Timer::SleepCondition::CONDITION_DATETIME:
+		{
 			// offset 分の時刻を差し引きます
-			FILETIME ftOffsetedUtc;
-			::SystemTimeToFileTime(&m_timer.dateToChange, &ftOffsetedUtc);
+			const FILETIME ftOffsetedUtc = ValueToFileTime(timer.dateToChange - SwitchLeadTime);
 			FILETIME ftOffsetedLocal;
 			::FileTimeToLocalFileTime(&ftOffsetedUtc, &ftOffsetedLocal);
-			ULARGE_INTEGER secs = {};
-			secs.QuadPart = m_offset * 10000000ULL;
-			ftOffsetedLocal.dwHighDateTime -= secs.HighPart;
-			ftOffsetedLocal.dwLowDateTime -= secs.LowPart;
 			SYSTEMTIME stOffseted;
 			::FileTimeToSystemTime(&ftOffsetedLocal, &stOffseted);
 
@@ -320,17 +656,146 @@ bool CChannelTimer::BeginTimer()
 				stOffseted.wYear, stOffseted.wMonth, stOffseted.wDay,
 				stOffseted.wHour, stOffseted.wMinute, stOffseted.wSecond);
 			m_pApp->AddLog(szLog);
+
+			switch (timer.recurrence.rule) {
+			case ChannelTimer::Recurrence::Rule::RULE_DAILY:
+				m_pApp->AddLog(L"毎日繰り返します。");
+				break;
+			case ChannelTimer::Recurrence::Rule::RULE_WEEKDAYS:
+				m_pApp->AddLog(L"平日に繰り返します。");
+				break;
+			case ChannelTimer::Recurrence::Rule::RULE_WEEKLY:
+				m_pApp->AddLog(L"毎週繰り返します。");
+				break;
+			default:
+				break;
+			}
 		}
-		else {
-			this->m_timer.eventID = 0;
-		}
-		Result = ::SetTimer(m_hwnd, TIMER_ID_QUERY, 3000, nullptr);
-	}
-	else {
+		break;
+
+	case Timer::SleepCondition::CONDITION_EVENTEND:
+		break;
+
+	default:
 		return false;
 	}
 
-	return Result != 0;
+	newTimer.serial = m_NextSerial++;
+	const ChannelTimer::TimerId id = m_scheduler.Add(newTimer, GetCurrentTimeValue());
+	m_journal.AppendAdd(*m_scheduler.Get(id));
+	CompactJournal();
+
+	std::vector<std::uint32_t> Conflicts;
+	if (!PlanTimer(id, &Conflicts)) {
+		const std::wstring log =
+			std::wstring(L"切り替えの時刻が ") + std::to_wstring(Conflicts.size())
+			+ std::wstring(L" 件のタイマーと重なっています。");
+		m_pApp->AddLog(log.c_str(), TVTest::LOG_TYPE_WARNING);
+	}
+	OnTimersChanged();
+	if (timer.condition == Timer::SleepCondition::CONDITION_EVENTEND)
+		UpdateEventEndTimers();
+
+	if (m_fEnabled)
+		return BeginTimer();
+	EnableForTimers();
+	return true;
+}
+
+
+// 予約したタイマーを全て取り消す
+void CChannelTimer::ClearTimers()
+{
+	EndTimer();
+	m_scheduler.Clear();
+	m_planner.Clear();
+	m_journal.AppendClear();
+	CompactJournal();
+	OnTimersChanged();
+	m_pApp->AddLog(L"タイマーを全て取り消しました。");
+
+	if (m_fEnabled)
+		m_pApp->EnablePlugin(false);
+}
+
+
+// タイマー開始
+// 最も期限の早いタイマーだけを設定する
+bool CChannelTimer::BeginTimer()
+{
+	// 実行中は、終わってから設定し直す
+	if (m_fFiring)
+		return true;
+
+	EndTimer();
+	UpdateStatusItem();
+	UpdateSchedulePanel();
+
+	if (m_scheduler.Empty())
+		return true;
+
+	bool fResult = true;
+
+	const LONGLONG Deadline = m_scheduler.NextDeadline();
+	if (Deadline != ChannelTimer::CTimerScheduler::DEADLINE_UNKNOWN) {
+		const LONGLONG Wait = (Deadline - GetCurrentTimeValue()) / FILETIME_MS;
+		const UINT Elapse =
+			Wait <= 0 ? 0 :
+			Wait >= USER_TIMER_MAXIMUM ? USER_TIMER_MAXIMUM :	// 期限に届かなければ発火時に設定し直す
+			static_cast<UINT>(Wait);
+		if (::SetTimer(m_hwnd, TIMER_ID_SLEEP, Elapse, nullptr) == 0)
+			fResult = false;
+	}
+
+	// 終了時刻未定の番組がある時だけ定期的に確認する
+	if (m_scheduler.NeedsPolling()) {
+		if (::SetTimer(m_hwnd, TIMER_ID_QUERY, QUERY_INTERVAL, nullptr) == 0)
+			fResult = false;
+		m_QueryDeadline = GetCurrentTimeValue() + QUERY_INTERVAL * FILETIME_MS;
+	}
+
+	return fResult;
+}
+
+
+// ステータス項目の切り替え先と残り時間を更新し、次に表示が変わる時に更新するタイマーを設定する
+void CChannelTimer::UpdateStatusItem()
+{
+	if (m_hwnd == nullptr)
+		return;
+	::KillTimer(m_hwnd, TIMER_ID_STATUS);
+
+	const ChannelTimer::TimerId Top = m_scheduler.Top();
+	const Timer *pTop = m_fEnabled ? m_scheduler.Get(Top) : nullptr;
+	if (pTop == nullptr) {
+		m_StatusSerial = 0;
+		m_statusItem.GetCountdown().ClearTarget();
+	} else {
+		// 切り替え先の名前はタイマーが変わった時だけ引く
+		if (pTop->serial != m_StatusSerial) {
+			m_StatusSerial = pTop->serial;
+			m_StatusTarget = GetTargetName(*pTop);
+		}
+		m_statusItem.GetCountdown().SetTarget(m_StatusTarget, m_scheduler.GetDeadline(Top));
+	}
+
+	const UINT Elapse = m_statusItem.Update(GetCurrentTimeValue());
+	if (Elapse > 0)
+		::SetTimer(m_hwnd, TIMER_ID_STATUS, Elapse, nullptr);
+}
+
+
+// タイマーの切り替え先のチャンネル名
+std::wstring CChannelTimer::GetTargetName(const Timer &timer)
+{
+	const auto Driver = m_catalog.GetDriverChannels(m_pApp, timer.tuner);
+	if (Driver) {
+		const ChannelTimer::CServiceLocation *pLocation = Driver->FindService(
+			ChannelTimer::MakeServiceKey(timer.networkID, timer.transportStreamID, timer.serviceID));
+		if (pLocation != nullptr)
+			return Driver->spaces[pLocation->space].channels[pLocation->index].channelName;
+	}
+	return std::wstring();
 }
 
 
@@ -341,6 +806,288 @@ void CChannelTimer::EndTimer()
 	::KillTimer(m_hwnd, TIMER_ID_QUERY);
 }
 
+
+// 期限の来たタイマーを実行する
+// fUpdateEventEnd が true なら、番組終了待ちのタイマーの期限を実行前に求め直す
+// 確認ダイアログの間にもメッセージが来るので、期限の来たタイマーを先に全て取り出してから実行し、
+// 実行中は次の実行もタイマーの設定もしない
+void CChannelTimer::OnSleepTimer(bool fUpdateEventEnd)
+{
+	if (m_fFiring)
+		return;
+
+	const LONGLONG ArrivalTime = GetCurrentTimeValue();
+
+	::KillTimer(m_hwnd, TIMER_ID_SLEEP);
+
+	// 番組終了待ちのタイマーは実行前に終了時刻の変更を確認する
+	const Timer *pTop = m_scheduler.Get(m_scheduler.Top());
+	if (fUpdateEventEnd && pTop != nullptr && pTop->condition == Timer::SleepCondition::CONDITION_EVENTEND)
+		UpdateEventEndTimers();
+
+	const LONGLONG CurrentTime = GetCurrentTimeValue();
+	Timer timer;
+	LONGLONG Deadline;
+	struct DueTimer {
+		Timer timer;
+		LONGLONG SwitchTime;
+	};
+	std::vector<DueTimer> DueTimers;
+
+	while (m_fEnabled && m_scheduler.PopDue(CurrentTime + DEADLINE_TOLERANCE, &timer, &Deadline)) {
+		m_metrics.RecordFire(timer.tuner, (ArrivalTime - Deadline) / 10);
+		m_journal.AppendRemove(timer.serial);
+		m_planner.Remove(timer.serial);
+		// 繰り返すタイマーは次の回だけを予約する
+		Timer Next = timer;
+		if (timer.condition == Timer::SleepCondition::CONDITION_DATETIME
+				&& ChannelTimer::NextOccurrence(&Next.recurrence, &Next.dateToChange, CurrentTime + Next.leadTime)) {
+			const ChannelTimer::TimerId id = m_scheduler.Add(Next, CurrentTime);
+			m_journal.AppendAdd(*m_scheduler.Get(id));
+			PlanTimer(id);
+		}
+		// 番組終了待ちは番組が変わった時点で期限になることがあるので、すぐに切り替える
+		DueTimers.push_back(DueTimer{ timer,
+			timer.condition != Timer::SleepCondition::CONDITION_EVENTEND ? Deadline + timer.leadTime : 0 });
+	}
+
+	CompactJournal();
+	OnTimersChanged();
+
+	// 指定時間が経過したか番組が終了したのでスリープ開始
+	m_fFiring = true;
+	for (const DueTimer &Due : DueTimers)
+		BeginSleep(Due.timer, Due.SwitchTime);
+	m_fFiring = false;
+
+	if (m_fEnabled)
+		BeginTimer();
+}
+
+
+// 保存したタイマーを読み込む
+// プラグインが無効の間に期限の過ぎたタイマー(対象の番組が終わった番組終了待ちを含む)は捨てる
+void CChannelTimer::LoadTimers()
+{
+	WCHAR szFileName[MAX_PATH];
+	::lstrcpyn(szFileName, m_szIniFileName, _countof(szFileName));
+	::PathRenameExtension(szFileName, TEXT(".timers"));
+
+	ChannelTimer::CJournalCodec::ReplayResult Result;
+	if (!m_journal.Open(szFileName, &Result)) {
+		m_pApp->AddLog(L"タイマーの保存先を開けません。", TVTest::LOG_TYPE_WARNING);
+		return;
+	}
+
+	const LONGLONG CurrentTime = GetCurrentTimeValue();
+	int Restored = 0, Expired = 0;
+
+	for (auto &Entry : Result.timers) {
+		Timer &timer = Entry.second;
+		const LONGLONG Deadline = ChannelTimer::ComputeDeadline(timer, timer.addedTime);
+		if (Deadline != ChannelTimer::CTimerScheduler::DEADLINE_UNKNOWN && Deadline < CurrentTime) {
+			// 繰り返すタイマーは過ぎた回を飛ばす
+			if (timer.condition != Timer::SleepCondition::CONDITION_DATETIME
+					|| !ChannelTimer::NextOccurrence(&timer.recurrence, &timer.dateToChange, CurrentTime + timer.leadTime)) {
+				Expired++;
+				continue;
+			}
+		}
+		m_scheduler.Restore(timer);
+		Restored++;
+	}
+	m_NextSerial = Result.maxSerial + 1;
+
+	CompactJournal(Expired > 0);
+	PlanAllTimers();
+	OnTimersChanged();
+
+	if (Restored > 0 || Expired > 0) {
+		m_pApp->AddLog((std::to_wstring(Restored) + L" 件のタイマーを読み込みました。").c_str());
+		if (Expired > 0)
+			m_pApp->AddLog((std::to_wstring(Expired) + L" 件のタイマーは期限が過ぎているので取り消しました。").c_str());
+	}
+}
+
+
+// 不要なレコードが増えていれば、保存先を残っているタイマーだけで書き直す
+void CChannelTimer::CompactJournal(bool fForce)
+{
+	if (!fForce && !m_journal.NeedsCompaction(m_scheduler.Size()))
+		return;
+
+	std::vector<Timer> Timers;
+	Timers.reserve(m_scheduler.Size());
+	m_scheduler.ForEach([&](ChannelTimer::TimerId, const Timer &timer, LONGLONG) {
+		Timers.push_back(timer);
+	});
+	m_journal.Compact(Timers);
+}
+
+
+// タイマーの切り替えの区間を置き、他のタイマーと重なるか確かめる
+// 一つの TVTest は一度に一つしか切り替えられず、切り替えた後のチューナーは次のタイマーまで使うだけなので、
+// 期限(確認の表示とチューナーの読み込み)から切り替える日時までを全てのタイマーで一つのレーンに置く
+// 20:00 と 20:30 のように続けて予約したタイマーは重ならず、確認や切り替えの途中に次が来るものだけが重なる
+// 期限の決まらない番組終了待ちのタイマーは置かない
+bool CChannelTimer::PlanTimer(ChannelTimer::TimerId id, std::vector<std::uint32_t> *pConflicts)
+{
+	const Timer *pTimer = m_scheduler.Get(id);
+	const LONGLONG Deadline = m_scheduler.GetDeadline(id);
+	if (pTimer == nullptr || Deadline == ChannelTimer::CTimerScheduler::DEADLINE_UNKNOWN)
+		return true;
+
+	ChannelTimer::CTunerPlanner::Request Request;
+	Request.serial = pTimer->serial;
+	Request.begin = Deadline;
+	Request.end = Deadline + pTimer->leadTime;
+	Request.tuners.emplace_back();	// レーンは一つなので名前は無くてよい
+	return m_planner.Add(Request, pConflicts);
+}
+
+
+// 全てのタイマーの切り替えの区間を期限順に置き直す
+void CChannelTimer::PlanAllTimers()
+{
+	std::vector<std::pair<LONGLONG, ChannelTimer::TimerId>> Timers;
+	Timers.reserve(m_scheduler.Size());
+	m_scheduler.ForEach([&](ChannelTimer::TimerId id, const Timer &, LONGLONG Deadline) {
+		Timers.emplace_back(Deadline, id);
+	});
+	std::sort(Timers.begin(), Timers.end());
+
+	m_planner.Clear();
+	for (const auto &Entry : Timers)
+		PlanTimer(Entry.second);
+
+	if (m_planner.ConflictCount() > 0) {
+		m_pApp->AddLog((std::to_wstring(m_planner.ConflictCount()) + L" 件のタイマーは切り替えの時刻が他のタイマーと重なっています。").c_str(),
+			TVTest::LOG_TYPE_WARNING);
+	}
+}
+
+
+// 番組終了待ちのタイマーの期限を現在の番組から求め直す
+// タイマーの追加時と、サービスやチャンネルが変わった時などに呼ぶ
+void CChannelTimer::UpdateEventEndTimers()
+{
+	if (!m_scheduler.HasEventEndTimers())
+		return;
+
+	TVTest::ProgramInfo Info = {};
+	WCHAR szEventName[128];
+
+	// 現在の番組の情報を取得
+	Info.pszEventName = szEventName;
+	Info.MaxEventName = _countof(szEventName);
+	if (!m_pApp->GetCurrentProgramInfo(&Info))
+		return;
+	m_eitWatcher.SetService(Info.ServiceID);
+
+	ChannelTimer::ProgramState Program;
+	Program.serviceID = Info.ServiceID;
+	Program.eventID = Info.EventID;
+	Program.endTime = ChannelTimer::CTimerScheduler::DEADLINE_UNKNOWN;	// 終了時刻未定
+	FILETIME ft;
+	::SystemTimeToFileTime(&Info.StartTime, &ft);
+	const LONGLONG EpgStartTime = FileTimeToValue(ft);
+	if (Info.Duration != 0) {
+		// 終了時刻(EPG日時 -> システム時刻)
+		Program.endTime = m_clock.EpgToSystem(EpgStartTime + Info.Duration * FILETIME_SEC);
+	} else {
+		// 長さ未定なら、番組表の次の番組の開始を終了時刻とする
+		TVTest::ChannelInfo ChInfo;
+		if (m_pApp->GetCurrentChannelInfo(&ChInfo)) {
+			RefreshServiceEpg(ChInfo.NetworkID, ChInfo.TransportStreamID, Info.ServiceID, EPG_CURRENT_MAX_AGE);
+			const ChannelTimer::CEpgEvent *pNext = m_epg.FindNext(
+				ChannelTimer::MakeServiceKey(ChInfo.NetworkID, ChInfo.TransportStreamID, Info.ServiceID),
+				EpgStartTime - EPG_TIME_OFFSET);
+			if (pNext != nullptr)
+				Program.endTime = m_clock.BroadcastToSystem(pNext->startTime);
+		}
+	}
+
+	std::vector<ChannelTimer::TimerId> Changed;
+	if (m_scheduler.UpdateEventEnd(Program, GetCurrentTimeValue(), &Changed) > 0) {
+		m_pApp->AddLog(L"この番組が終了したらします。");
+		m_pApp->AddLog(szEventName);
+	}
+	// 再起動しても同じ番組の終了を待つように、対象の番組を保存しておく
+	for (const ChannelTimer::TimerId id : Changed)
+		m_journal.AppendEvent(*m_scheduler.Get(id));
+	if (!Changed.empty())
+		CompactJournal();
+}
+
+
+// 読み込み済みのチューナーのサービスのうち、古くなった番組表を少しずつ読み直す
+void CChannelTimer::RefreshEpg()
+{
+	int Count = 0;
+
+	m_catalog.ForEachLoadedService([&](const ChannelTimer::CChannelView &service) {
+		if (Count < EPG_REFRESH_BATCH
+				&& RefreshServiceEpg(service.NetworkID, service.TransportStreamID, service.ServiceID, EPG_MAX_AGE))
+			Count++;
+	});
+
+	MatchSearchRules();
+}
+
+
+// サービスの番組表が MaxAge より古ければ読み直す
+// 読み直そうとしたら true
+bool CChannelTimer::RefreshServiceEpg(WORD NetworkID, WORD TransportStreamID, WORD ServiceID, LONGLONG MaxAge)
+{
+	const ChannelTimer::ServiceKey Key = ChannelTimer::MakeServiceKey(NetworkID, TransportStreamID, ServiceID);
+	const LONGLONG CurrentTime = GetCurrentTimeValue();
+	if (!m_epg.NeedsRefresh(Key, CurrentTime, MaxAge))
+		return false;
+	if (!ChannelTimer::LoadServiceEpg(m_pApp, NetworkID, TransportStreamID, ServiceID, &m_epg, &m_search, CurrentTime))
+		m_epg.Touch(Key, CurrentTime);
+	return true;
+}
+
+
+// 前回保存した番組表のスナップショットを写し、番組表を読み込むまではそれを引く
+void CChannelTimer::LoadEpgSnapshot()
+{
+	WCHAR szFileName[MAX_PATH];
+	::lstrcpyn(szFileName, m_szIniFileName, _countof(szFileName));
+	::PathRenameExtension(szFileName, TEXT(".epg"));
+	m_snapshotStore.SetFileName(szFileName);
+
+	std::shared_ptr<const ChannelTimer::CEpgSnapshot> Snapshot = m_snapshotStore.Load();
+	if (!Snapshot)
+		return;
+	// 条件に合う番組を探すのは、番組表を読み込む前からできるようにしておく
+	if (!m_searchRules.empty())
+		ChannelTimer::IndexSnapshot(*Snapshot, &m_search);
+	m_epg.SetSnapshot(std::move(Snapshot));
+	m_SnapshotGeneration = m_epg.GetGeneration();
+}
+
+
+// 番組表が変わっていればスナップショットを書き直す
+// 普段は別スレッドで書き込み、終わったら写し直す。fWait なら(終了時)ここで書き込む
+void CChannelTimer::SaveEpgSnapshot(bool fWait)
+{
+	const std::uint32_t Generation = m_epg.GetGeneration();
+	if (Generation == m_SnapshotGeneration || (!fWait && m_snapshotStore.IsSaving()))
+		return;
+
+	std::vector<std::uint8_t> Data;
+	m_epg.WriteSnapshot(GetCurrentTimeValue(), &Data);
+	if (fWait) {
+		m_snapshotStore.Wait();
+		if (m_snapshotStore.Save(Data))
+			m_SnapshotGeneration = Generation;
+	} else if (m_snapshotStore.StartSave(std::move(Data), m_hwnd, WM_APP_SNAPSHOTSAVED)) {
+		m_SnapshotGeneration = Generation;
+	}
+}
+
+
 // 設定ダイアログを表示
 bool CChannelTimer::ShowSettingsDialog(HWND hwndOwner)
 {
@@ -361,6 +1108,563 @@ bool CChannelTimer::ShowSettingsDialog(HWND hwndOwner)
 }
 
 
+// 現在のチューナーのチャンネルの一覧を古いものとする
+void CChannelTimer::InvalidateCurrentDriver()
+{
+	WCHAR szDriverName[MAX_PATH];
+	if (m_pApp->GetDriverName(szDriverName, _countof(szDriverName)) > 0)
+		m_catalog.InvalidateDriver(szDriverName);
+	// 読み込み中に捨てられたものを読み直す
+	if (m_fEnabled)
+		StartPrefetch();
+}
+
+
+// まだ読み込んでいないチューナーのチャンネルを先に読み込む
+// ホストには WM_TIMER ごとに一つのチューナーだけを尋ね、一覧は別スレッドで作る
+void CChannelTimer::StartPrefetch()
+{
+	m_catalog.GetDrivers(m_pApp);
+	m_prefetcher.Start(m_pApp, &m_catalog, m_hwnd, WM_APP_PREFETCHED, m_catalog.GetStaleDrivers());
+	::SetTimer(m_hwnd, TIMER_ID_PREFETCH, PREFETCH_INTERVAL, nullptr);
+}
+
+
+// 現在のチューナー名
+std::wstring CChannelTimer::GetCurrentDriverName() const
+{
+	WCHAR szDriverName[MAX_PATH];
+	if (m_pApp->GetDriverName(szDriverName, _countof(szDriverName)) <= 0)
+		return std::wstring();
+	return szDriverName;
+}
+
+
+// 保存した切り替え時間を読み込む
+void CChannelTimer::LoadLeadTimes()
+{
+	std::vector<WCHAR> Buffer(32 * 1024);
+	const DWORD Length = ::GetPrivateProfileSection(
+		TEXT("LeadTime"), Buffer.data(), static_cast<DWORD>(Buffer.size()), m_szIniFileName);
+
+	// "名前=値" が '\0' 区切りで並ぶ
+	for (LPCWSTR p = Buffer.data(); p < Buffer.data() + Length && *p != L'\0'; p += ::lstrlenW(p) + 1) {
+		const std::wstring Entry(p);
+		const std::size_t Sep = Entry.find(L'=');
+		if (Sep != std::wstring::npos)
+			m_leadTime.Parse(Entry.substr(0, Sep), Entry.substr(Sep + 1));
+	}
+}
+
+
+// 番組を探す条件を読み込む
+// [AutoSwitch] に "Horizon=開始までの時間(分)" と "Rule1=ジャンル:キーワード" のように書く
+void CChannelTimer::LoadSearchRules()
+{
+	m_SearchHorizon = ::GetPrivateProfileInt(
+		TEXT("AutoSwitch"), TEXT("Horizon"), DEFAULT_SEARCH_HORIZON, m_szIniFileName) * ChannelTimer::FILETIME_MIN;
+
+	m_searchRules.clear();
+	for (int i = 1;; i++) {
+		WCHAR szKey[16], szRule[256];
+		::wsprintfW(szKey, L"Rule%d", i);
+		if (::GetPrivateProfileString(TEXT("AutoSwitch"), szKey, TEXT(""), szRule, _countof(szRule), m_szIniFileName) == 0)
+			break;
+		ChannelTimer::CSearchRule Rule;
+		if (ChannelTimer::CSearchRule::Parse(szRule, &Rule))
+			m_searchRules.push_back(std::move(Rule));
+		else
+			m_pApp->AddLog((std::wstring(L"番組を探す条件が読めません: ") + szRule).c_str(), TVTest::LOG_TYPE_WARNING);
+	}
+}
+
+
+// 間もなく始まる番組から条件に合うものを探し、現在のチューナーで選べるサービスならその開始に切り替えるタイマーを予約する
+void CChannelTimer::MatchSearchRules()
+{
+	if (m_searchRules.empty())
+		return;
+
+	const LONGLONG CurrentTime = GetCurrentTimeValue();
+	for (auto it = m_searchScheduled.begin(); it != m_searchScheduled.end();) {
+		if (it->second < CurrentTime)
+			it = m_searchScheduled.erase(it);
+		else
+			++it;
+	}
+
+	// 番組表の日時は放送局の時刻なので、探す範囲も放送局の時刻にする
+	const LONGLONG From = CurrentTime + m_clock.GetOffset();
+	std::vector<ChannelTimer::CSearchMatch> Matches;
+	for (const ChannelTimer::CSearchRule &Rule : m_searchRules)
+		m_search.Match(Rule, From, From + m_SearchHorizon, &Matches);
+	if (Matches.empty())
+		return;
+
+	const std::wstring DriverName = GetCurrentDriverName();
+	const auto Driver = m_catalog.GetDriverChannels(m_pApp, DriverName);
+	if (!Driver)
+		return;
+	TVTest::ChannelInfo ChInfo;
+	TVTest::ServiceInfo ServiceInfo;
+	ChannelTimer::ServiceKey CurrentKey = 0;
+	if (m_pApp->GetCurrentChannelInfo(&ChInfo) && m_pApp->GetServiceInfo(m_pApp->GetService(), &ServiceInfo))
+		CurrentKey = ChannelTimer::MakeServiceKey(ChInfo.NetworkID, ChInfo.TransportStreamID, ServiceInfo.ServiceID);
+
+	for (const ChannelTimer::CSearchMatch &Match : Matches) {
+		if (Match.key == CurrentKey)
+			continue;
+		const ChannelTimer::CServiceLocation *pLocation = Driver->FindService(Match.key);
+		if (pLocation == nullptr)
+			continue;
+		// 番組表から予約済みの番組と、一度予約した番組(取り消したものも)は除く
+		const ChannelTimer::ProgramKey EventKey = ChannelTimer::MakeProgramKey(Match.key, Match.eventID);
+		if (m_scheduledPrograms.Contains(EventKey)
+				|| !m_searchScheduled.emplace(EventKey, m_clock.BroadcastToSystem(Match.startTime)).second)
+			continue;
+
+		Timer timer;
+		if (!MakeProgramTimer(DriverName, *Driver, Match.key, Match.eventID, Match.startTime, &timer))
+			continue;
+		const ChannelTimer::CChannelView Service = Driver->spaces[pLocation->space].channels[pLocation->index];
+		const ChannelTimer::CEpgEvent *pEvent = m_epg.FindAt(Match.key, Match.startTime);
+		std::wstring log = std::wstring(L"条件に合う番組に切り替えます: ") + Service.channelName;
+		if (pEvent != nullptr && pEvent->eventID == Match.eventID)
+			log += L" " + m_epg.GetEventName(Match.key, *pEvent);
+		m_pApp->AddLog(log.c_str());
+		AddTimer(timer);
+	}
+}
+
+
+// 番組の開始にそのサービスへ切り替えるタイマーを作る
+// StartTime は放送局の時刻(UTC)。チューナーにサービスが無ければ false
+bool CChannelTimer::MakeProgramTimer(const std::wstring &DriverName, const ChannelTimer::CDriverChannels &Driver,
+	ChannelTimer::ServiceKey Key, std::uint16_t EventID, LONGLONG StartTime, Timer *pTimer) const
+{
+	const ChannelTimer::CServiceLocation *pLocation = Driver.FindService(Key);
+	if (pLocation == nullptr)
+		return false;
+
+	const ChannelTimer::CChannelView Service = Driver.spaces[pLocation->space].channels[pLocation->index];
+	pTimer->condition = Timer::SleepCondition::CONDITION_DATETIME;
+	pTimer->dateToChange = StartTime;
+	pTimer->broadcastTime = true;
+	pTimer->tuner = DriverName;
+	pTimer->space = pLocation->space;
+	pTimer->channel = Service.channel;
+	pTimer->networkID = Service.NetworkID;
+	pTimer->transportStreamID = Service.TransportStreamID;
+	pTimer->serviceID = Service.ServiceID;
+	pTimer->programEventID = EventID;
+	return true;
+}
+
+
+// 番組を指定して予約したタイマーの番組を集め直す
+// タイマーが増減した時に呼ぶ。番組表の描画では m_scheduledPrograms を引くだけにする
+void CChannelTimer::UpdateScheduledPrograms()
+{
+	m_scheduledPrograms.Clear();
+	m_scheduler.ForEach([&](ChannelTimer::TimerId, const Timer &timer, LONGLONG) {
+		if (timer.programEventID != 0) {
+			m_scheduledPrograms.Insert(ChannelTimer::MakeProgramKey(
+				ChannelTimer::MakeServiceKey(timer.networkID, timer.transportStreamID, timer.serviceID),
+				timer.programEventID));
+		}
+	});
+}
+
+
+// タイマーが増減した時に、番組表の印とパネル項目の一覧を更新する
+void CChannelTimer::OnTimersChanged()
+{
+	UpdateScheduledPrograms();
+	UpdateSchedulePanel();
+}
+
+
+// パネル項目の一覧の行を作り直し、変わった行だけを描画し直す
+// タイマーの期限が変われば順番も変わるので、期限を求め直した後にも呼ぶ
+void CChannelTimer::UpdateSchedulePanel()
+{
+	std::vector<ChannelTimer::CScheduleRow> Rows;
+	Rows.reserve(m_scheduler.Size());
+	m_scheduler.ForEach([&](ChannelTimer::TimerId id, const Timer &timer, LONGLONG Deadline) {
+		Rows.push_back(ChannelTimer::CScheduleRow{ id, timer.serial, Deadline });
+	});
+	const std::size_t FirstChanged = m_scheduleRows.Assign(std::move(Rows));
+	m_schedulePanel.SetRowCount(m_scheduleRows.Size(), FirstChanged);
+}
+
+
+// パネル項目の一覧の行の文字列(見えている行だけ呼ばれる)
+void CChannelTimer::GetRowText(std::size_t Row, int Column, wchar_t *pszText, int MaxLength)
+{
+	const ChannelTimer::CScheduleRow &Entry = m_scheduleRows[Row];
+	const Timer *pTimer = m_scheduler.Get(Entry.id);
+	if (pTimer == nullptr || pTimer->serial != Entry.serial)
+		return;
+
+	std::wstring Text;
+	switch (Column) {
+	case COLUMN_TARGET:
+		Text = GetTargetName(*pTimer);
+		if (Text.empty())
+			Text = pTimer->tuner;
+		break;
+
+	case COLUMN_CONDITION:
+		switch (pTimer->condition) {
+		case Timer::SleepCondition::CONDITION_DURATION:
+			Text = L"時間経過";
+			break;
+
+		case Timer::SleepCondition::CONDITION_DATETIME:
+			{
+				const FILETIME ftUtc = ValueToFileTime(pTimer->dateToChange);
+				FILETIME ftLocal;
+				SYSTEMTIME st;
+				::FileTimeToLocalFileTime(&ftUtc, &ftLocal);
+				::FileTimeToSystemTime(&ftLocal, &st);
+				WCHAR szTime[32];
+				::wsprintfW(szTime, L"%d/%d %02d:%02d", st.wMonth, st.wDay, st.wHour, st.wMinute);
+				Text = szTime;
+				switch (pTimer->recurrence.rule) {
+				case ChannelTimer::Recurrence::Rule::RULE_DAILY:
+					Text += L" 毎日";
+					break;
+				case ChannelTimer::Recurrence::Rule::RULE_WEEKDAYS:
+					Text += L" 平日";
+					break;
+				case ChannelTimer::Recurrence::Rule::RULE_WEEKLY:
+					Text += L" 毎週";
+					break;
+				default:
+					break;
+				}
+			}
+			break;
+
+		case Timer::SleepCondition::CONDITION_EVENTEND:
+			Text = L"番組終了";
+			break;
+		}
+		break;
+
+	case COLUMN_REMAINING:
+		{
+			const LONGLONG Deadline = m_scheduler.GetDeadline(Entry.id);
+			if (Deadline == ChannelTimer::CTimerScheduler::DEADLINE_UNKNOWN) {
+				Text = L"-";
+			} else {
+				const LONGLONG Remaining = Deadline - GetCurrentTimeValue();
+				Text = ChannelTimer::CCountdown::FormatSeconds(
+					Remaining > 0 ? (Remaining + FILETIME_SEC - 1) / FILETIME_SEC : 0);
+			}
+		}
+		break;
+	}
+
+	::lstrcpynW(pszText, Text.c_str(), MaxLength);
+}
+
+
+// パネル項目の一覧の行のタイマー
+// 行を作ってから取り消されたり実行されたりしていれば nullptr
+const Timer *CChannelTimer::GetRowTimer(std::size_t Row) const
+{
+	if (Row >= m_scheduleRows.Size())
+		return nullptr;
+	const ChannelTimer::CScheduleRow &Entry = m_scheduleRows[Row];
+	const Timer *pTimer = m_scheduler.Get(Entry.id);
+	return pTimer != nullptr && pTimer->serial == Entry.serial ? pTimer : nullptr;
+}
+
+
+// パネル項目の一覧で選んだタイマーを取り消す
+void CChannelTimer::CancelRows(const std::vector<std::size_t> &Rows)
+{
+	std::vector<ChannelTimer::TimerId> Timers;
+	for (const std::size_t Row : Rows) {
+		if (GetRowTimer(Row) != nullptr)
+			Timers.push_back(m_scheduleRows[Row].id);
+	}
+	RemoveTimers(Timers);
+	if (!Timers.empty())
+		m_pApp->AddLog((std::to_wstring(Timers.size()) + L" 件のタイマーを取り消しました。").c_str());
+}
+
+
+// パネル項目の一覧の行のタイマーが繰り返すか
+bool CChannelTimer::IsRecurringRow(std::size_t Row)
+{
+	const Timer *pTimer = GetRowTimer(Row);
+	return pTimer != nullptr
+		&& pTimer->condition == Timer::SleepCondition::CONDITION_DATETIME
+		&& ChannelTimer::GetRecurrenceWeekdays(pTimer->recurrence) != 0;
+}
+
+
+// パネル項目の一覧で選んだ繰り返すタイマーの次の回を休む
+// 休む日を例外の日に加え、その次の回を予約し直す
+void CChannelTimer::SkipRows(const std::vector<std::size_t> &Rows)
+{
+	std::vector<ChannelTimer::TimerId> Timers;
+	for (const std::size_t Row : Rows) {
+		if (IsRecurringRow(Row))
+			Timers.push_back(m_scheduleRows[Row].id);
+	}
+	if (Timers.empty())
+		return;
+
+	const LONGLONG CurrentTime = GetCurrentTimeValue();
+	for (const ChannelTimer::TimerId id : Timers) {
+		Timer Next = *m_scheduler.Get(id);
+		if (!ChannelTimer::SkipOccurrence(&Next.recurrence, &Next.dateToChange, CurrentTime + Next.leadTime))
+			continue;
+		m_journal.AppendRemove(Next.serial);
+		m_planner.Remove(Next.serial);
+		m_scheduler.Remove(id);
+		const ChannelTimer::TimerId NewId = m_scheduler.Add(Next, CurrentTime);
+		m_journal.AppendAdd(*m_scheduler.Get(NewId));
+		PlanTimer(NewId);
+	}
+	CompactJournal();
+	OnTimersChanged();
+	if (m_fEnabled)
+		BeginTimer();
+	m_pApp->AddLog((std::to_wstring(Timers.size()) + L" 件のタイマーの次の回を休みます。").c_str());
+}
+
+
+// 番組を指定して予約したタイマーを取り消す
+// 取り消した数を返す
+int CChannelTimer::CancelProgramTimers(ChannelTimer::ProgramKey Key)
+{
+	std::vector<ChannelTimer::TimerId> Timers;
+	m_scheduler.ForEach([&](ChannelTimer::TimerId id, const Timer &timer, LONGLONG) {
+		if (timer.programEventID != 0
+				&& ChannelTimer::MakeProgramKey(
+					ChannelTimer::MakeServiceKey(timer.networkID, timer.transportStreamID, timer.serviceID),
+					timer.programEventID) == Key)
+			Timers.push_back(id);
+	});
+
+	RemoveTimers(Timers);
+	return static_cast<int>(Timers.size());
+}
+
+
+// タイマーを取り消す
+void CChannelTimer::RemoveTimers(const std::vector<ChannelTimer::TimerId> &Timers)
+{
+	if (Timers.empty())
+		return;
+
+	for (const ChannelTimer::TimerId id : Timers) {
+		m_journal.AppendRemove(m_scheduler.Get(id)->serial);
+		m_planner.Remove(m_scheduler.Get(id)->serial);
+		m_scheduler.Remove(id);
+	}
+	CompactJournal();
+	OnTimersChanged();
+	if (m_fEnabled)
+		BeginTimer();
+}
+
+
+// 番組表の番組の背景を描画する
+// タイマーを予約した番組だけ、背景を塗って左端に印を付ける。描画しなければ false
+bool CChannelTimer::DrawProgramBackground(
+	const TVTest::ProgramGuideProgramInfo *pProgram, const TVTest::ProgramGuideProgramDrawBackgroundInfo *pInfo) const
+{
+	const ChannelTimer::ProgramKey Key = ChannelTimer::MakeProgramKey(
+		ChannelTimer::MakeServiceKey(pProgram->NetworkID, pProgram->TransportStreamID, pProgram->ServiceID),
+		pProgram->EventID);
+	if (!m_scheduledPrograms.Contains(Key))
+		return false;
+
+	// 番組ごとに呼ばれるので、ブラシを作らず DC ブラシの色を変えて塗る
+	const HBRUSH hbr = static_cast<HBRUSH>(::GetStockObject(DC_BRUSH));
+	const COLORREF OldColor = ::SetDCBrushColor(pInfo->hdc, pInfo->BackgroundColor);
+	::FillRect(pInfo->hdc, &pInfo->ItemRect, hbr);
+	RECT rcMark = pInfo->ItemRect;
+	if (rcMark.right - rcMark.left > PROGRAM_MARK_WIDTH)
+		rcMark.right = rcMark.left + PROGRAM_MARK_WIDTH;
+	::SetDCBrushColor(pInfo->hdc, PROGRAM_MARK_COLOR);
+	::FillRect(pInfo->hdc, &rcMark, hbr);
+	::SetDCBrushColor(pInfo->hdc, OldColor);
+	return true;
+}
+
+
+// 番組表の番組のメニューに項目を加える
+// 加えた項目の数を返す
+int CChannelTimer::InitializeProgramMenu(
+	const TVTest::ProgramGuideProgramInfo *pProgram, const TVTest::ProgramGuideProgramInitializeMenuInfo *pInfo) const
+{
+	const ChannelTimer::ProgramKey Key = ChannelTimer::MakeProgramKey(
+		ChannelTimer::MakeServiceKey(pProgram->NetworkID, pProgram->TransportStreamID, pProgram->ServiceID),
+		pProgram->EventID);
+	::AppendMenu(pInfo->hmenu, MF_STRING | MF_ENABLED, pInfo->Command,
+		m_scheduledPrograms.Contains(Key) ? L"この番組への切り替えを取り消す" : L"この番組の開始に切り替える");
+	return 1;
+}
+
+
+// 番組表の番組のメニューが選択された
+// 予約していなければ番組の開始に切り替えるタイマーを予約し、予約していれば取り消す
+bool CChannelTimer::OnProgramMenuSelected(const TVTest::ProgramGuideProgramInfo *pProgram, UINT Command)
+{
+	if (Command != 0)
+		return false;
+
+	const ChannelTimer::ServiceKey ServiceKey =
+		ChannelTimer::MakeServiceKey(pProgram->NetworkID, pProgram->TransportStreamID, pProgram->ServiceID);
+	const ChannelTimer::ProgramKey Key = ChannelTimer::MakeProgramKey(ServiceKey, pProgram->EventID);
+	if (m_scheduledPrograms.Contains(Key)) {
+		CancelProgramTimers(Key);
+		m_pApp->AddLog(L"番組への切り替えを取り消しました。");
+		return true;
+	}
+
+	// 開始日時(EPG日時 -> 放送局の時刻(UTC))
+	FILETIME ft;
+	if (!::SystemTimeToFileTime(&pProgram->StartTime, &ft))
+		return false;
+	const LONGLONG StartTime = FileTimeToValue(ft) - EPG_TIME_OFFSET;
+	if (m_clock.BroadcastToSystem(StartTime) <= GetCurrentTimeValue()) {
+		m_pApp->AddLog(L"番組は既に始まっています。", TVTest::LOG_TYPE_WARNING);
+		return true;
+	}
+
+	const std::wstring DriverName = GetCurrentDriverName();
+	const auto Driver = m_catalog.GetDriverChannels(m_pApp, DriverName);
+	Timer timer;
+	if (!Driver || !MakeProgramTimer(DriverName, *Driver, ServiceKey, pProgram->EventID, StartTime, &timer)) {
+		m_pApp->AddLog(L"現在のチューナーでは番組のサービスを選べません。", TVTest::LOG_TYPE_WARNING);
+		return true;
+	}
+	AddTimer(timer);
+	return true;
+}
+
+
+// チャンネルが変わった
+// タイマーで切り替えていれば、かかった時間を記録して以降のタイマーの切り替えを早める時間に使う
+void CChannelTimer::OnChannelChange()
+{
+	ChannelTimer::CSwitchSample Sample;
+	if (!m_metrics.OnChannelChange(GetTickValue(), &Sample))
+		return;
+
+	m_leadTime.AddSample(Sample.tuner, Sample.space, Sample.latency * 10);
+	::WritePrivateProfileString(
+		TEXT("LeadTime"),
+		m_leadTime.FormatKey(Sample.tuner, Sample.space).c_str(),
+		m_leadTime.FormatValue(Sample.tuner, Sample.space).c_str(),
+		m_szIniFileName);
+}
+
+
+// タイマーと切り替えの遅延をログに表示する
+void CChannelTimer::ShowStats()
+{
+	for (const std::wstring &line : m_metrics.FormatReport())
+		m_pApp->AddLog(line.c_str());
+
+	const ChannelTimer::CPacketRing &Ring = m_streamWorker.GetRing();
+	const std::wstring log =
+		std::wstring(L"ストリーム: ") + std::to_wstring(Ring.GetPushedCount()) + std::wstring(L" パケット、取りこぼし ")
+		+ std::to_wstring(Ring.GetDroppedCount()) + std::wstring(L"、最大 ")
+		+ std::to_wstring(Ring.GetHighWater()) + std::wstring(L"/") + std::to_wstring(Ring.Capacity());
+	m_pApp->AddLog(log.c_str());
+
+	const std::wstring searchLog =
+		std::wstring(L"番組の索引: ") + std::to_wstring(m_search.EventCount()) + std::wstring(L" 番組、")
+		+ std::to_wstring(m_search.TermCount()) + std::wstring(L" 語、条件 ") + std::to_wstring(m_searchRules.size());
+	m_pApp->AddLog(searchLog.c_str());
+
+	const std::shared_ptr<const ChannelTimer::CEpgSnapshot> &Snapshot = m_epg.GetSnapshot();
+	const std::wstring epgLog =
+		std::wstring(L"番組表: ") + std::to_wstring(m_epg.ServiceCount()) + std::wstring(L" サービス、スナップショット ")
+		+ std::to_wstring(Snapshot ? Snapshot->ServiceCount() : 0) + std::wstring(L" サービス ")
+		+ std::to_wstring(Snapshot ? Snapshot->EventCount() : 0) + std::wstring(L" 番組");
+	m_pApp->AddLog(epgLog.c_str());
+
+	const std::wstring planLog =
+		std::wstring(L"切り替えの区間: ") + std::to_wstring(m_planner.Size()) + std::wstring(L" 件、重なり ")
+		+ std::to_wstring(m_planner.ConflictCount()) + std::wstring(L" 件");
+	m_pApp->AddLog(planLog.c_str());
+
+	const std::wstring catalogLog =
+		std::wstring(L"チャンネルの一覧: ") + std::to_wstring(m_catalog.GetLoadedServiceCount()) + std::wstring(L" サービス、")
+		+ std::to_wstring((m_catalog.GetMemoryUsage() + 1023) / 1024) + std::wstring(L" KB");
+	m_pApp->AddLog(catalogLog.c_str());
+}
+
+
+static void SetChannelList(HWND hwndChannels, const ChannelTimer::CTuningSpace *pSpace, const ChannelTimer::CEpgIndex &Epg);
+
+// チャンネルの一覧・文字列の組み立て・予定表の処理時間を計測してログに表示する
+// [Benchmark] に "名前=ns/op" で基準値を保存し、次からはそれより遅くなったケースを知らせる
+// 基準値を取り直す時は、その行を消す
+void CChannelTimer::RunBenchmark()
+{
+	ChannelTimer::CBenchmark Bench(GetTickValue);
+
+	std::vector<WCHAR> Buffer(32 * 1024);
+	const DWORD Length = ::GetPrivateProfileSection(
+		TEXT("Benchmark"), Buffer.data(), static_cast<DWORD>(Buffer.size()), m_szIniFileName);
+	for (LPCWSTR p = Buffer.data(); p < Buffer.data() + Length && *p != L'\0'; p += ::lstrlenW(p) + 1) {
+		const std::wstring Entry(p);
+		const std::size_t Sep = Entry.find(L'=');
+		if (Sep != std::wstring::npos)
+			Bench.ParseBaseline(Entry.substr(0, Sep), Entry.substr(Sep + 1));
+	}
+
+	Bench.RunCore();
+
+	// ホストからの取得は現在のチューナーで測る
+	const std::wstring DriverName = GetCurrentDriverName();
+	if (!DriverName.empty())
+		Bench.RunHost(m_pApp, DriverName);
+
+	// 設定ダイアログのチャンネルのコンボボックスを埋める
+	const HWND hwndCombo = ::CreateWindowEx(
+		0, WC_COMBOBOX, nullptr, WS_POPUP | CBS_DROPDOWNLIST,
+		0, 0, 0, 0, nullptr, nullptr, g_hinstDLL, nullptr);
+	if (hwndCombo != nullptr) {
+		ChannelTimer::CTuningSpace Space;
+		for (const CServiceInfo &Service : ChannelTimer::CBenchmark::MakeServices(ChannelTimer::CBenchmark::CHANNEL_COUNT))
+			Space.channels.Add(Service);
+		Bench.Run(L"Settings.SetChannelList", Space.channels.Size(),
+			[]() { return 0; },
+			[&](int) { SetChannelList(hwndCombo, &Space, m_epg); });
+		::DestroyWindow(hwndCombo);
+	}
+
+	int Regressions = 0;
+	for (const ChannelTimer::CBenchmarkResult &Result : Bench.GetResults()) {
+		if (Result.baseline <= 0) {
+			::WritePrivateProfileString(
+				TEXT("Benchmark"), Result.name.c_str(),
+				ChannelTimer::CBenchmark::FormatValue(Result).c_str(), m_szIniFileName);
+		} else if (Bench.IsRegression(Result)) {
+			Regressions++;
+		}
+	}
+	for (const std::wstring &line : Bench.FormatReport())
+		m_pApp->AddLog(line.c_str());
+	if (Regressions > 0) {
+		const std::wstring log =
+			std::wstring(L"基準値より遅くなったケース: ") + std::to_wstring(Regressions);
+		m_pApp->AddLog(log.c_str(), TVTest::LOG_TYPE_WARNING);
+	}
+}
+
+
 // イベントコールバック関数
 // 何かイベントが起きると呼ばれる
 LRESULT CALLBACK CChannelTimer::EventCallback(UINT Event, LPARAM lParam1, LPARAM lParam2, void *pClientData)
@@ -372,16 +1676,147 @@ LRESULT CALLBACK CChannelTimer::EventCallback(UINT Event, LPARAM lParam1, LPARAM
 		// プラグインの有効状態が変化した
 		return pThis->OnEnablePlugin(lParam1 != 0);
 
+	case TVTest::EVENT_STARTUPDONE:
+		// 保存したタイマーがあれば動かす
+		pThis->EnableForTimers();
+		return 0;
+
 	case TVTest::EVENT_PLUGINSETTINGS:
 		// プラグインの設定を行う
 		pThis->InitializePlugin();
 		return pThis->ShowSettingsDialog(reinterpret_cast<HWND>(lParam1));
+
+	case TVTest::EVENT_DRIVERCHANGE:
+	case TVTest::EVENT_FAVORITESCHANGED:
+		// 現在のチューナーのチャンネルを読み直す
+		pThis->InvalidateCurrentDriver();
+		return 0;
+
+	case TVTest::EVENT_SETTINGSCHANGE:
+		// 設定が変わったので、チューナーとチャンネルを全て読み直す
+		pThis->m_catalog.InvalidateAll();
+		if (pThis->m_fEnabled)
+			pThis->StartPrefetch();
+		return 0;
+
+	case TVTest::EVENT_SERVICEUPDATE:
+		// チャンネルスキャンなどでサービスが変わった可能性がある
+		pThis->InvalidateCurrentDriver();
+		[[fallthrough]];
+	case TVTest::EVENT_CHANNELCHANGE:
+		if (Event == TVTest::EVENT_CHANNELCHANGE)
+			pThis->OnChannelChange();
+		[[fallthrough]];
+	case TVTest::EVENT_SERVICECHANGE:
+		// 番組が変わった可能性があるので、番組終了待ちのタイマーを確認する
+		if (pThis->m_fEnabled && pThis->m_scheduler.HasEventEndTimers()) {
+			pThis->UpdateEventEndTimers();
+			pThis->BeginTimer();
+		}
+		return 0;
+
+	case TVTest::EVENT_COMMAND:
+		// コマンドが選択された
+		switch (static_cast<int>(lParam1)) {
+		case COMMAND_CLEARTIMERS:
+			pThis->ClearTimers();
+			return TRUE;
+
+		case COMMAND_SHOWSTATS:
+			pThis->ShowStats();
+			return TRUE;
+
+		case COMMAND_BENCHMARK:
+			pThis->RunBenchmark();
+			return TRUE;
+		}
+		return FALSE;
+
+	case TVTest::EVENT_STATUSITEM_DRAW:
+		// ステータス項目を描画する
+		{
+			const TVTest::StatusItemDrawInfo *pInfo = reinterpret_cast<const TVTest::StatusItemDrawInfo*>(lParam1);
+			return pInfo->ID == pThis->m_statusItem.GetID() && pThis->m_statusItem.Draw(pInfo);
+		}
+
+	case TVTest::EVENT_STATUSITEM_NOTIFY:
+		// ステータス項目の通知。見えるようになったら表示を更新する
+		{
+			const TVTest::StatusItemEventInfo *pInfo = reinterpret_cast<const TVTest::StatusItemEventInfo*>(lParam1);
+			if (pInfo->ID == pThis->m_statusItem.GetID() && pThis->m_statusItem.OnNotify(pInfo))
+				pThis->UpdateStatusItem();
+		}
+		return TRUE;
+
+	case TVTest::EVENT_PANELITEM_NOTIFY:
+		// パネル項目の通知
+		{
+			const TVTest::PanelItemEventInfo *pInfo = reinterpret_cast<const TVTest::PanelItemEventInfo*>(lParam1);
+			return pInfo->ID == pThis->m_schedulePanel.GetID() && pThis->m_schedulePanel.OnNotify(pInfo);
+		}
+
+	case TVTest::EVENT_PROGRAMGUIDE_PROGRAM_DRAWBACKGROUND:
+		// 番組表の番組の背景を描画する
+		return pThis->DrawProgramBackground(
+			reinterpret_cast<const TVTest::ProgramGuideProgramInfo*>(lParam1),
+			reinterpret_cast<const TVTest::ProgramGuideProgramDrawBackgroundInfo*>(lParam2));
+
+	case TVTest::EVENT_PROGRAMGUIDE_PROGRAM_INITIALIZEMENU:
+		// 番組表の番組のメニューを設定する
+		return pThis->InitializeProgramMenu(
+			reinterpret_cast<const TVTest::ProgramGuideProgramInfo*>(lParam1),
+			reinterpret_cast<const TVTest::ProgramGuideProgramInitializeMenuInfo*>(lParam2));
+
+	case TVTest::EVENT_PROGRAMGUIDE_PROGRAM_MENUSELECTED:
+		// 番組表の番組のメニューが選択された
+		return pThis->OnProgramMenuSelected(
+			reinterpret_cast<const TVTest::ProgramGuideProgramInfo*>(lParam1), static_cast<UINT>(lParam2));
 	}
 
 	return 0;
 }
 
 
+// ストリームコールバック関数
+// ストリームのスレッドから TS パケットごとに呼ばれるので、EIT と TOT/TDT を別スレッドへ渡すだけにする
+BOOL CALLBACK CChannelTimer::StreamCallback(BYTE *pData, void *pClientData)
+{
+	const std::uint16_t PID = ChannelTimer::GetPacketPID(pData);
+	if (PID == ChannelTimer::CEitPfWatcher::PID_EIT || PID == ChannelTimer::CTotWatcher::PID_TOT)
+		static_cast<CChannelTimer*>(pClientData)->m_streamWorker.Push(pData);
+	return TRUE;
+}
+
+
+// ストリームコールバックで受け取ったパケットを解析する(ストリームの解析をするスレッドから呼ばれる)
+void CChannelTimer::OnStreamPackets(void *pClientData, const std::uint8_t *pPackets, std::size_t Count)
+{
+	CChannelTimer *pThis = static_cast<CChannelTimer*>(pClientData);
+	for (std::size_t i = 0; i < Count; i++) {
+		const std::uint8_t *pPacket = pPackets + i * ChannelTimer::TS_PACKET_SIZE;
+		pThis->m_eitWatcher.OnPacket(pPacket);
+		pThis->m_totWatcher.OnPacket(pPacket);
+	}
+}
+
+
+// ストリームで番組が変わった(ストリームの解析をするスレッドから呼ばれる)
+void CChannelTimer::OnEitEventChanged(void *pClientData, std::uint16_t ServiceID, std::uint16_t EventID)
+{
+	CChannelTimer *pThis = static_cast<CChannelTimer*>(pClientData);
+	::PostMessage(pThis->m_hwnd, WM_APP_EVENTCHANGED, ServiceID, EventID);
+}
+
+
+// ストリームで放送局の時刻を読んだ(ストリームの解析をするスレッドから呼ばれる)
+void CChannelTimer::OnBroadcastTime(void *pClientData, LONGLONG BroadcastTime)
+{
+	CChannelTimer *pThis = static_cast<CChannelTimer*>(pClientData);
+	if (pThis->m_clock.AddSample(BroadcastTime, GetCurrentTimeValue()))
+		::PostMessage(pThis->m_hwnd, WM_APP_CLOCKCHANGED, 0, 0);
+}
+
+
 // ウィンドウハンドルからthisを取得する
 CChannelTimer *CChannelTimer::GetThis(HWND hwnd)
 {
@@ -406,64 +1841,89 @@ LRESULT CALLBACK CChannelTimer::WndProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPA
 	case WM_TIMER:
 		{
 			CChannelTimer *pThis = GetThis(hwnd);
-			Timer &timer = pThis->m_timer;
 
 			if (wParam == TIMER_ID_SLEEP) {
 				// 指定時間が経過したのでスリープ開始
-				pThis->BeginSleep();
+				pThis->OnSleepTimer();
+			} else if (wParam == TIMER_ID_STATUS) {
+				// ステータス項目の残り時間の表示が変わる
+				pThis->UpdateStatusItem();
+			} else if (wParam == TIMER_ID_EPG) {
+				// 古くなった番組表を読み直す
+				pThis->RefreshEpg();
+			} else if (wParam == TIMER_ID_SERVICE) {
+				// 段階に分けた切り替えで、切り替える日時になった
+				pThis->SelectPendingService();
+			} else if (wParam == TIMER_ID_SNAPSHOT) {
+				// 読み直した番組表をスナップショットに書く
+				pThis->SaveEpgSnapshot(false);
+			} else if (wParam == TIMER_ID_PREFETCH) {
+				// 次のチューナーのチャンネルを読み込む
+				if (!pThis->m_prefetcher.FetchNext())
+					::KillTimer(hwnd, TIMER_ID_PREFETCH);
 			} else if (wParam == TIMER_ID_QUERY) {
-				if (timer.condition == Timer::SleepCondition::CONDITION_DATETIME) {
-					SYSTEMTIME st;
+				pThis->m_metrics.RecordQuery(pThis->GetCurrentDriverName(),
+					(GetCurrentTimeValue() - pThis->m_QueryDeadline) / 10);
+				// 終了時刻未定の番組が変わったか確認
+				pThis->UpdateEventEndTimers();
+				pThis->BeginTimer();
+			}
+		}
+		return 0;
 
-					::GetSystemTime(&st);
-					if (pThis->IsUpInMillisecond(DiffSystemTime(timer.dateToChange, st))) {
-						// 指定時刻が来たのでスリープ開始
-						pThis->BeginSleep();
-					}
-				} else if (timer.condition == Timer::SleepCondition::CONDITION_EVENTEND) {
-					TVTest::ProgramInfo Info = {};
-					WCHAR szEventName[128];
-
-					// 現在の番組の情報を取得
-					Info.pszEventName = szEventName;
-					Info.MaxEventName = _countof(szEventName);
-					if (pThis->m_pApp->GetCurrentProgramInfo(&Info)) {
-						if (timer.eventID == 0) {
-							bool fSet = false;
-
-							if (Info.Duration == 0) {
-								// 終了時刻未定
-								fSet = true;
-							} else {
-								FILETIME ft;
-								::SystemTimeToFileTime(&Info.StartTime, &ft);
-								LARGE_INTEGER li;
-								li.LowPart = ft.dwLowDateTime;
-								li.HighPart = ft.dwHighDateTime;
-								li.QuadPart -= 9LL * FILETIME_HOUR;				// EPG日時(UTC+9) -> UTC
-								li.QuadPart += Info.Duration * FILETIME_SEC;	// 終了時刻
-								li.QuadPart -= 0LL + pThis->m_ConfirmTimeout + pThis->m_offset;			// 確認時間
-								ft.dwLowDateTime = li.LowPart;
-								ft.dwHighDateTime = li.HighPart;
-								FILETIME CurrentTime;
-								::GetSystemTimeAsFileTime(&CurrentTime);
-								// 番組終了が2分以内の場合は、次の番組を対象にする
-								if (DiffFileTime(ft, CurrentTime) > 2LL * FILETIME_MIN)
-									fSet = true;
-							}
-
-							if (fSet) {
-								timer.eventID = Info.EventID;
-								pThis->m_pApp->AddLog(L"この番組が終了したらします。");
-								pThis->m_pApp->AddLog(szEventName);
-							}
-						} else if (timer.eventID != Info.EventID) {
-							// 番組が変わったのでスリープ開始
-							pThis->BeginSleep();
-						}
-					}
-				}
+	case WM_APP_EVENTCHANGED:
+		{
+			// 番組が変わったので、その番組の終了を待っていたタイマーを直ちに実行する
+			CChannelTimer *pThis = GetThis(hwnd);
+
+			if (pThis->m_fEnabled
+					&& pThis->m_scheduler.OnEventChanged(
+						static_cast<std::uint16_t>(wParam), static_cast<std::uint16_t>(lParam), GetCurrentTimeValue()) > 0) {
+				// ホストの番組情報はまだ前の番組のことがあるので、期限を求め直さない
+				pThis->OnSleepTimer(false);
+			}
+		}
+		return 0;
+
+	case WM_APP_CLOCKCHANGED:
+		{
+			// 放送局の時刻に合わせるタイマーと番組終了の期限を求め直す
+			CChannelTimer *pThis = GetThis(hwnd);
+			const LONGLONG Offset = pThis->m_clock.GetOffset();
+
+			if (pThis->m_scheduler.SetBroadcastOffset(Offset) > 0 || pThis->m_scheduler.HasEventEndTimers()) {
+				WCHAR szLog[64];
+				::wsprintfW(szLog, L"放送局の時刻との差: %d ms", static_cast<int>(Offset / FILETIME_MS));
+				pThis->m_pApp->AddLog(szLog);
 			}
+			if (pThis->m_fEnabled) {
+				pThis->UpdateEventEndTimers();
+				pThis->BeginTimer();
+			}
+		}
+		return 0;
+
+	case WM_APP_SNAPSHOTSAVED:
+		{
+			// 書き込んだスナップショットに差し替える。前のものは誰も使わなくなった時に閉じられる
+			CChannelTimer *pThis = GetThis(hwnd);
+			std::shared_ptr<const ChannelTimer::CEpgSnapshot> Snapshot = pThis->m_snapshotStore.OnSaved(wParam, lParam);
+
+			if (Snapshot)
+				pThis->m_epg.SetSnapshot(std::move(Snapshot));
+			else
+				pThis->m_pApp->AddLog(L"番組表のスナップショットを保存できません。", TVTest::LOG_TYPE_WARNING);
+		}
+		return 0;
+
+	case WM_APP_PREFETCHED:
+		{
+			// 別スレッドで読み込んだチャンネルを受け取る
+			CChannelTimer *pThis = GetThis(hwnd);
+			std::unique_ptr<ChannelTimer::CCatalogPrefetcher::Result> Result(
+				reinterpret_cast<ChannelTimer::CCatalogPrefetcher::Result*>(lParam));
+
+			pThis->m_catalog.SetDriverChannels(Result->driverName, std::move(Result->channels), Result->generation);
 		}
 		return 0;
 	}
@@ -483,6 +1943,33 @@ static void EnableDlgItems(HWND hDlg, int FirstID, int LastID, BOOL fEnable)
 		EnableDlgItem(hDlg, i, fEnable);
 }
 
+// チューニング空間のリストを設定する
+static void SetTuningSpaceList(HWND hwndTuningSpaces, const ChannelTimer::CDriverChannels *pDriver)
+{
+	ComboBox_ResetContent(hwndTuningSpaces);
+	if (pDriver == nullptr)
+		return;
+	for (const ChannelTimer::CTuningSpace &space : pDriver->spaces)
+		ComboBox_AddString(hwndTuningSpaces, space.name.c_str());
+}
+
+// チャンネルのリストを設定する
+// 番組表があれば現在の番組名を添える
+static void SetChannelList(HWND hwndChannels, const ChannelTimer::CTuningSpace *pSpace, const ChannelTimer::CEpgIndex &Epg)
+{
+	ComboBox_ResetContent(hwndChannels);
+	if (pSpace == nullptr)
+		return;
+	const LONGLONG CurrentTime = GetCurrentTimeValue();
+	for (const ChannelTimer::CChannelView chInfo : pSpace->channels) {
+		std::wstring Text = chInfo.toString();
+		const ChannelTimer::CEpgEvent *pEvent = Epg.FindAt(chInfo.GetKey(), CurrentTime);
+		if (pEvent != nullptr && pEvent->nameLength > 0)
+			Text += L" - " + Epg.GetEventName(chInfo.GetKey(), *pEvent);
+		ComboBox_AddString(hwndChannels, Text.c_str());
+	}
+}
+
 // 設定ダイアログプロシージャ
 INT_PTR CALLBACK CChannelTimer::SettingsDlgProc(HWND hDlg, UINT uMsg, WPARAM wParam, LPARAM lParam, void *pClientData)
 {
@@ -490,7 +1977,7 @@ INT_PTR CALLBACK CChannelTimer::SettingsDlgProc(HWND hDlg, UINT uMsg, WPARAM wPa
 	case WM_INITDIALOG:
 		{
 			CChannelTimer *pThis = static_cast<CChannelTimer*>(pClientData);
-			const Timer &timer = pThis->m_timer;
+			const Timer &timer = pThis->m_lastTimer;
 
 			::CheckRadioButton(
 				hDlg, IDC_SETTINGS_CONDITION_DURATION, IDC_SETTINGS_CONDITION_EVENTEND,
@@ -500,6 +1987,19 @@ INT_PTR CALLBACK CChannelTimer::SettingsDlgProc(HWND hDlg, UINT uMsg, WPARAM wPa
 				timer.condition == Timer::SleepCondition::CONDITION_DURATION);
 			EnableDlgItem(
 				hDlg, IDC_SETTINGS_DATETIME, timer.condition == Timer::SleepCondition::CONDITION_DATETIME);
+			EnableDlgItem(
+				hDlg, IDC_SETTINGS_BROADCASTTIME, timer.condition == Timer::SleepCondition::CONDITION_DATETIME);
+			::CheckDlgButton(hDlg, IDC_SETTINGS_BROADCASTTIME, timer.broadcastTime ? BST_CHECKED : BST_UNCHECKED);
+
+			// 繰り返し(Recurrence::Rule の順)
+			HWND hwndRecurrence = ::GetDlgItem(hDlg, IDC_SETTINGS_RECURRENCE);
+			ComboBox_AddString(hwndRecurrence, TEXT("繰り返さない"));
+			ComboBox_AddString(hwndRecurrence, TEXT("毎日"));
+			ComboBox_AddString(hwndRecurrence, TEXT("平日(月-金)"));
+			ComboBox_AddString(hwndRecurrence, TEXT("毎週"));
+			ComboBox_SetCurSel(hwndRecurrence, static_cast<int>(timer.recurrence.rule));
+			EnableDlgItem(
+				hDlg, IDC_SETTINGS_RECURRENCE, timer.condition == Timer::SleepCondition::CONDITION_DATETIME);
 
 			::SetDlgItemInt(hDlg, IDC_SETTINGS_DURATION_HOURS, timer.durationToChange / (60 * 60), FALSE);
 			::SendDlgItemMessage(hDlg, IDC_SETTINGS_DURATION_HOURS_UD, UDM_SETRANGE32, 0, 24 * 24);
@@ -521,34 +2021,34 @@ INT_PTR CALLBACK CChannelTimer::SettingsDlgProc(HWND hDlg, UINT uMsg, WPARAM wPa
 			pApp->GetDriverName(curDriverName, _countof(curDriverName));
 
 			HWND hwndDevices = ::GetDlgItem(hDlg, IDC_SETTINGS_DRIVERS);
-			pThis->m_drivers = ChannelTimer::GetDrivers(pApp, [&](const std::wstring &nameString, int _) {
-				const WCHAR* driverName = nameString.c_str();
-				ComboBox_AddString(hwndDevices, driverName);
-			});
-			ComboBox_SelectItemData(hwndDevices, -1, curDriverName);
+			pThis->m_drivers = pThis->m_catalog.GetDrivers(pApp);
+			for (const std::wstring &driverName : pThis->m_drivers) {
+				ComboBox_AddString(hwndDevices, driverName.c_str());
+			}
+			const int curDriver = ComboBox_SelectItemData(hwndDevices, -1, curDriverName);
+			pThis->m_driverChannels =
+				curDriver >= 0 ? pThis->m_catalog.GetDriverChannels(pApp, pThis->m_drivers[curDriver]) : nullptr;
 
 			// チューニング空間
 			HWND hwndTuningSpaces = ::GetDlgItem(hDlg, IDC_SETTINGS_TUNING_SPACE);
-			pThis->m_tuningSpaces = ChannelTimer::GetTuningSpaces(pApp, [&](const std::wstring &nameString, int _) {
-				const WCHAR* name = nameString.c_str();
-				ComboBox_AddString(hwndTuningSpaces, name);
-			});
+			SetTuningSpaceList(hwndTuningSpaces, pThis->m_driverChannels.get());
 			// 現在開いているチューニング空間を選ぶ
 			const int curTuningSpace = pApp->GetTuningSpace();
 			ComboBox_SetCurSel(hwndTuningSpaces, curTuningSpace);
 
 			// チャンネル
-			if (curTuningSpace >= 0) {
+			if (curTuningSpace >= 0 && pThis->m_driverChannels
+					&& curTuningSpace < static_cast<int>(pThis->m_driverChannels->spaces.size())) {
 				HWND hwndChannels = ::GetDlgItem(hDlg, IDC_SETTINGS_CHANNELS);
-				pThis->m_channels = ChannelTimer::GetChannels(pApp, curTuningSpace, [&](const CServiceInfo &chInfo, int _) {
-					ComboBox_AddString(hwndChannels, chInfo.toString().c_str());
-				});
+				SetChannelList(hwndChannels, &pThis->m_driverChannels->spaces[curTuningSpace], pThis->m_epg);
 
 				// 現在開いているチャンネルを選ぶ
 				TVTest::ChannelInfo curChInfo;
-				pApp->GetCurrentChannelInfo(&curChInfo);
-				const CServiceInfo pCurServiceInfo = CServiceInfo(curChInfo);
-				ComboBox_SelectItemData(hwndChannels, -1, pCurServiceInfo.toString().c_str());
+				if (pApp->GetCurrentChannelInfo(&curChInfo)) {
+					const int curChannel = pThis->m_driverChannels->spaces[curTuningSpace].FindService(
+						ChannelTimer::MakeServiceKey(curChInfo.NetworkID, curChInfo.TransportStreamID, curChInfo.ServiceID));
+					ComboBox_SetCurSel(hwndChannels, curChannel);
+				}
 			}
 		}
 		return TRUE;
@@ -562,9 +2062,10 @@ INT_PTR CALLBACK CChannelTimer::SettingsDlgProc(HWND hDlg, UINT uMsg, WPARAM wPa
 				EnableDlgItems(
 					hDlg, IDC_SETTINGS_DURATION_HOURS, IDC_SETTINGS_DURATION_SECONDS_UD,
 					::IsDlgButtonChecked(hDlg, IDC_SETTINGS_CONDITION_DURATION) == BST_CHECKED);
-				EnableDlgItem(
-					hDlg, IDC_SETTINGS_DATETIME,
-					::IsDlgButtonChecked(hDlg, IDC_SETTINGS_CONDITION_DATETIME) == BST_CHECKED);
+				const bool fDateTime = ::IsDlgButtonChecked(hDlg, IDC_SETTINGS_CONDITION_DATETIME) == BST_CHECKED;
+				EnableDlgItem(hDlg, IDC_SETTINGS_DATETIME, fDateTime);
+				EnableDlgItem(hDlg, IDC_SETTINGS_BROADCASTTIME, fDateTime);
+				EnableDlgItem(hDlg, IDC_SETTINGS_RECURRENCE, fDateTime);
 			}
 			return TRUE;
 
@@ -577,53 +2078,46 @@ INT_PTR CALLBACK CChannelTimer::SettingsDlgProc(HWND hDlg, UINT uMsg, WPARAM wPa
 					return TRUE;
 				}
 				const std::wstring &cur = pThis->m_drivers[ComboBox_GetCurSel(hwndDevices)];
+				pThis->m_driverChannels = pThis->m_catalog.GetDriverChannels(pApp, cur);
 
 				// チューニング空間
-				TVTest::DriverTuningSpaceList tuningList;
-				pApp->GetDriverTuningSpaceList(cur.c_str(), &tuningList);
-
 				HWND hwndTuningSpaces = ::GetDlgItem(hDlg, IDC_SETTINGS_TUNING_SPACE);
-				ComboBox_ResetContent(hwndTuningSpaces);
-				pThis->m_tuningSpaces = ChannelTimer::GetTuningSpaces(pApp, cur, [&](std::wstring name, int _) {
-					ComboBox_AddString(hwndTuningSpaces, name.c_str());
-				});
-				if (pThis->m_tuningSpaces.size() == 1) {
-					ComboBox_SetCurSel(hwndTuningSpaces, 1);
-				}
+				SetTuningSpaceList(hwndTuningSpaces, pThis->m_driverChannels.get());
 
-				// チャンネルをリセット
+				// チャンネル(チューニング空間が一つだけならそれを選ぶ)
 				HWND hwndChannels = ::GetDlgItem(hDlg, IDC_SETTINGS_CHANNELS);
-				pThis->m_channels.clear();
-				ComboBox_ResetContent(hwndChannels);
+				if (pThis->m_driverChannels && pThis->m_driverChannels->spaces.size() == 1) {
+					ComboBox_SetCurSel(hwndTuningSpaces, 0);
+					SetChannelList(hwndChannels, &pThis->m_driverChannels->spaces[0], pThis->m_epg);
+				} else {
+					SetChannelList(hwndChannels, nullptr, pThis->m_epg);
+				}
 			}
 			return TRUE;
 
 		case IDC_SETTINGS_TUNING_SPACE:
 			if (HIWORD(wParam) == CBN_SELCHANGE) {
 				CChannelTimer* pThis = static_cast<CChannelTimer*>(pClientData);
-				TVTest::CTVTestApp* pApp = pThis->m_pApp;
 
-				HWND hwndDevices = ::GetDlgItem(hDlg, IDC_SETTINGS_DRIVERS);
-				if (ComboBox_GetCurSel(hwndDevices) < 0) {
+				if (!pThis->m_driverChannels) {
 					return TRUE;
 				}
-				const std::wstring &cur = pThis->m_drivers[ComboBox_GetCurSel(hwndDevices)];
 
 				// チャンネル
 				HWND hwndChannels = ::GetDlgItem(hDlg, IDC_SETTINGS_CHANNELS);
-				ComboBox_ResetContent(hwndChannels);
 				HWND hwndTuningSpaces = ::GetDlgItem(hDlg, IDC_SETTINGS_TUNING_SPACE);
-				pThis->m_channels = ChannelTimer::GetChannels(pApp, cur.c_str(), ComboBox_GetCurSel(hwndTuningSpaces),
-					[&](const CServiceInfo &chInfo, int index) {
-						ComboBox_AddString(hwndChannels, chInfo.toString().c_str());
-					});
+				const int spaceIndex = ComboBox_GetCurSel(hwndTuningSpaces);
+				SetChannelList(hwndChannels,
+					spaceIndex >= 0 && spaceIndex < static_cast<int>(pThis->m_driverChannels->spaces.size()) ?
+						&pThis->m_driverChannels->spaces[spaceIndex] : nullptr,
+					pThis->m_epg);
 			}
 			return TRUE;
 
 		case IDOK:
 			{
 				CChannelTimer *pThis = static_cast<CChannelTimer*>(pClientData);
-				Timer *timer = &pThis->m_timer;
+				Timer timer = pThis->m_lastTimer;
 				Timer::SleepCondition Condition;
 
 				if (::IsDlgButtonChecked(hDlg, IDC_SETTINGS_CONDITION_DURATION)) {
@@ -656,6 +2150,11 @@ INT_PTR CALLBACK CChannelTimer::SettingsDlgProc(HWND hDlg, UINT uMsg, WPARAM wPa
 					}
 				}
 
+				const int RecurrenceRule = ComboBox_GetCurSel(::GetDlgItem(hDlg, IDC_SETTINGS_RECURRENCE));
+				ChannelTimer::Recurrence Recurrence;
+				if (Condition == Timer::SleepCondition::CONDITION_DATETIME && RecurrenceRule > 0)
+					Recurrence.rule = static_cast<ChannelTimer::Recurrence::Rule>(RecurrenceRule);
+
 				SYSTEMTIME DateTime;
 				DWORD Result = DateTime_GetSystemtime(::GetDlgItem(hDlg, IDC_SETTINGS_DATETIME), &DateTime);
 				if (Condition == Timer::SleepCondition::CONDITION_DATETIME) {
@@ -665,45 +2164,65 @@ INT_PTR CALLBACK CChannelTimer::SettingsDlgProc(HWND hDlg, UINT uMsg, WPARAM wPa
 					}
 					SYSTEMTIME UTCTime;
 					::TzSpecificLocalTimeToSystemTime(nullptr, &DateTime, &UTCTime);
+					// 繰り返しの日付と曜日は指定した時刻の地方時で数える
+					Recurrence.localOffset = DiffSystemTime(DateTime, UTCTime) * FILETIME_MS;
 					DateTime = UTCTime;
 					SYSTEMTIME CurTime;
 					::GetSystemTime(&CurTime);
-					if (DiffSystemTime(DateTime, CurTime) <= 0) {
+					// 繰り返す場合は過ぎていれば次の回にする
+					if (Recurrence.rule == ChannelTimer::Recurrence::Rule::RULE_NONE
+							&& DiffSystemTime(DateTime, CurTime) <= 0) {
 						::MessageBox(hDlg, TEXT("指定された時刻を既に過ぎています。"), nullptr, MB_OK | MB_ICONEXCLAMATION);
 						return TRUE;
 					}
 				}
 
-				timer->condition = Condition;
-				timer->durationToChange = (DWORD)Duration;
-				timer->dateToChange = DateTime;
+				timer.condition = Condition;
+				timer.durationToChange = (DWORD)Duration;
+				FILETIME ftDateTime;
+				::SystemTimeToFileTime(&DateTime, &ftDateTime);
+				timer.dateToChange = FileTimeToValue(ftDateTime);
+				timer.broadcastTime = ::IsDlgButtonChecked(hDlg, IDC_SETTINGS_BROADCASTTIME) == BST_CHECKED;
+				timer.recurrence = Recurrence;
+				if (Recurrence.rule == ChannelTimer::Recurrence::Rule::RULE_WEEKLY)
+					timer.recurrence.weekdays = static_cast<std::uint8_t>(
+						1 << ChannelTimer::GetWeekday(ChannelTimer::GetLocalDay(timer.dateToChange, Recurrence.localOffset)));
+				if (Recurrence.rule != ChannelTimer::Recurrence::Rule::RULE_NONE)
+					ChannelTimer::AlignOccurrence(&timer.recurrence, &timer.dateToChange, GetCurrentTimeValue());
 
 				int driverIndex = ComboBox_GetCurSel(::GetDlgItem(hDlg, IDC_SETTINGS_DRIVERS));
 				if (driverIndex < 0) {
 					::MessageBox(hDlg, TEXT("ng"), nullptr, MB_OK | MB_ICONEXCLAMATION);
 					return TRUE;
 				}
-				timer->channelInfo.pszTuner = pThis->m_drivers.at(driverIndex).c_str();
+				timer.tuner = pThis->m_drivers.at(driverIndex);
 
 				int spaceIndex = ComboBox_GetCurSel(::GetDlgItem(hDlg, IDC_SETTINGS_TUNING_SPACE));
 				if (spaceIndex < 0) {
 					::MessageBox(hDlg, TEXT("ng"), nullptr, MB_OK | MB_ICONEXCLAMATION);
 					return TRUE;
 				}
-				timer->channelInfo.Space = spaceIndex;
+				timer.space = spaceIndex;
 
 				int channelIndex = ComboBox_GetCurSel(::GetDlgItem(hDlg, IDC_SETTINGS_CHANNELS));
 				if (channelIndex < 0) {
 					::MessageBox(hDlg, TEXT("ng"), nullptr, MB_OK | MB_ICONEXCLAMATION);
 					return TRUE;
 				}
-				const auto& ch = pThis->m_channels.at(channelIndex);
-				timer->channelInfo.NetworkID = ch.NetworkID;
-				timer->channelInfo.ServiceID = ch.ServiceID;
-
-				// タイマー設定
-				if (pThis->m_fEnabled)
-					pThis->BeginTimer();
+				if (!pThis->m_driverChannels
+						|| spaceIndex >= static_cast<int>(pThis->m_driverChannels->spaces.size())
+						|| channelIndex >= static_cast<int>(pThis->m_driverChannels->spaces[spaceIndex].channels.Size())) {
+					::MessageBox(hDlg, TEXT("ng"), nullptr, MB_OK | MB_ICONEXCLAMATION);
+					return TRUE;
+				}
+				const ChannelTimer::CChannelView ch = pThis->m_driverChannels->spaces[spaceIndex].channels[channelIndex];
+				timer.networkID = ch.NetworkID;
+				timer.transportStreamID = ch.TransportStreamID;
+				timer.serviceID = ch.ServiceID;
+
+				// タイマー予約
+				pThis->m_lastTimer = timer;
+				pThis->AddTimer(timer);
 			}
 			[[fallthrough]];
 		case IDCANCEL:
@@ -0,0 +1,136 @@
+#include "Channels.h"
+
+namespace ChannelTimer {
+	namespace {
+		// 上位のビットまで混ぜる(splitmix64 の仕上げ)
+		std::size_t HashServiceKey(ServiceKey key)
+		{
+			key ^= key >> 30;
+			key *= 0xBF58476D1CE4E5B9ULL;
+			key ^= key >> 27;
+			key *= 0x94D049BB133111EBULL;
+			key ^= key >> 31;
+			return static_cast<std::size_t>(key);
+		}
+	}
+
+	std::wstring CChannelView::toString() const {
+		const std::wstring ws = L" ";
+		return std::to_wstring(ServiceID)
+			+ ws
+			+ std::to_wstring(NetworkID)
+			+ ws
+			+ channelName;
+	}
+
+	void CChannelTable::Reserve(std::size_t count)
+	{
+		m_networkIDs.reserve(count);
+		m_transportStreamIDs.reserve(count);
+		m_serviceIDs.reserve(count);
+		m_channels.reserve(count);
+		m_channelNames.reserve(count);
+	}
+
+	void CChannelTable::Add(std::uint16_t NetworkID, std::uint16_t TransportStreamID, std::uint16_t ServiceID,
+		int channel, const wchar_t* channelName)
+	{
+		m_networkIDs.push_back(NetworkID);
+		m_transportStreamIDs.push_back(TransportStreamID);
+		m_serviceIDs.push_back(ServiceID);
+		m_channels.push_back(channel);
+		m_channelNames.push_back(m_names->Intern(channelName));
+		m_index.Insert(MakeServiceKey(NetworkID, TransportStreamID, ServiceID),
+			CServiceLocation{ 0, static_cast<int>(m_serviceIDs.size() - 1) });
+	}
+
+	int CChannelTable::Find(ServiceKey key) const
+	{
+		const CServiceLocation* pLocation = m_index.Find(key);
+		return pLocation != nullptr ? pLocation->index : -1;
+	}
+
+	std::size_t CChannelTable::MemoryUsage() const
+	{
+		return m_networkIDs.capacity() * sizeof(std::uint16_t)
+			+ m_transportStreamIDs.capacity() * sizeof(std::uint16_t)
+			+ m_serviceIDs.capacity() * sizeof(std::uint16_t)
+			+ m_channels.capacity() * sizeof(std::int32_t)
+			+ m_channelNames.capacity() * sizeof(CStringPool::Ref)
+			+ m_index.MemoryUsage();
+	}
+
+	constexpr std::size_t CServiceIndex::MIN_CAPACITY;
+
+	bool CServiceIndex::Insert(ServiceKey key, const CServiceLocation& location)
+	{
+		if ((m_count + 1) * 4 > m_slots.size() * 3)
+			Rehash(m_slots.empty() ? MIN_CAPACITY : m_slots.size() * 2);
+		std::size_t i = HashServiceKey(key) & m_mask;
+		while (m_slots[i].location.space >= 0) {
+			if (m_slots[i].key == key)
+				return false;
+			i = (i + 1) & m_mask;
+		}
+		m_slots[i].key = key;
+		m_slots[i].location = location;
+		m_count++;
+		return true;
+	}
+
+	const CServiceLocation* CServiceIndex::Find(ServiceKey key) const
+	{
+		if (m_count == 0)
+			return nullptr;
+		for (std::size_t i = HashServiceKey(key) & m_mask;; i = (i + 1) & m_mask) {
+			if (m_slots[i].location.space < 0)
+				return nullptr;
+			if (m_slots[i].key == key)
+				return &m_slots[i].location;
+		}
+	}
+
+	void CServiceIndex::Rehash(std::size_t capacity)
+	{
+		std::vector<Slot> old(capacity, Slot{ 0, CServiceLocation{ -1, -1 } });
+		old.swap(m_slots);
+		m_mask = m_slots.size() - 1;
+		m_count = 0;
+		for (const Slot& slot : old) {
+			if (slot.location.space >= 0)
+				Insert(slot.key, slot.location);
+		}
+	}
+
+	CTuningSpace& CDriverChannels::AddSpace(const std::wstring& name)
+	{
+		spaces.push_back(CTuningSpace{ name, CChannelTable(names) });
+		return spaces.back();
+	}
+
+	void CDriverChannels::AddChannel(int space, std::uint16_t NetworkID, std::uint16_t TransportStreamID, std::uint16_t ServiceID,
+		int channel, const wchar_t* channelName)
+	{
+		CTuningSpace& tuningSpace = spaces[space];
+		const int index = static_cast<int>(tuningSpace.channels.Size());
+		tuningSpace.channels.Add(NetworkID, TransportStreamID, ServiceID, channel, channelName);
+		services.Insert(MakeServiceKey(NetworkID, TransportStreamID, ServiceID), CServiceLocation{ space, index });
+	}
+
+	int CDriverChannels::ResolveSpace(ServiceKey key, int space) const
+	{
+		if (space >= 0 && space < static_cast<int>(spaces.size())
+				&& spaces[space].FindService(key) >= 0)
+			return space;
+		const CServiceLocation* pLocation = FindService(key);
+		return pLocation != nullptr ? pLocation->space : space;
+	}
+
+	std::size_t CDriverChannels::MemoryUsage() const
+	{
+		std::size_t size = spaces.capacity() * sizeof(CTuningSpace) + services.MemoryUsage() + names->MemoryUsage();
+		for (const CTuningSpace& space : spaces)
+			size += space.channels.MemoryUsage();
+		return size;
+	}
+}
@@ -0,0 +1,235 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "StringPool.h"
+
+namespace ChannelTimer {
+	/**
+	 * サービスを一意に表すキー(NetworkID, TransportStreamID, ServiceID)
+	 */
+	using ServiceKey = std::uint64_t;
+
+	inline ServiceKey MakeServiceKey(std::uint16_t NetworkID, std::uint16_t TransportStreamID, std::uint16_t ServiceID) {
+		return (static_cast<ServiceKey>(NetworkID) << 32)
+			| (static_cast<ServiceKey>(TransportStreamID) << 16)
+			| ServiceID;
+	}
+
+	/**
+	 * ホストから得たサービス
+	 */
+	struct CServiceInfo {
+		std::uint16_t NetworkID;
+		std::uint16_t TransportStreamID;
+		std::uint16_t ServiceID;
+		int channel;
+		std::wstring channelName;
+
+		CServiceInfo(std::uint16_t NetworkID, std::uint16_t TransportStreamID, std::uint16_t ServiceID,
+				int channel, const wchar_t* channelName)
+			: NetworkID(NetworkID)
+			, TransportStreamID(TransportStreamID)
+			, ServiceID(ServiceID)
+			, channel(channel)
+			, channelName(channelName)
+		{}
+
+		bool operator==(const CServiceInfo& rhs) const {
+			return this->ServiceID == rhs.ServiceID && this->NetworkID == rhs.NetworkID;
+		}
+
+		ServiceKey GetKey() const {
+			return MakeServiceKey(NetworkID, TransportStreamID, ServiceID);
+		}
+	};
+
+	/**
+	 * CChannelTable のチャンネル
+	 * channelName は表の文字列の置き場を指すので、表に追加したり表を捨てたりした後は使えない
+	 */
+	struct CChannelView {
+		std::uint16_t NetworkID;
+		std::uint16_t TransportStreamID;
+		std::uint16_t ServiceID;
+		int channel;
+		const wchar_t* channelName;
+
+		ServiceKey GetKey() const {
+			return MakeServiceKey(NetworkID, TransportStreamID, ServiceID);
+		}
+
+		std::wstring toString() const;
+	};
+
+	/**
+	 * サービスの位置
+	 */
+	struct CServiceLocation {
+		int space;	// チューニング空間のインデックス
+		int index;	// チャンネルのインデックス
+	};
+
+	/**
+	 * サービスから位置を引く表
+	 * 開番地法の表で、埋まり具合が 3/4 を超えたら広げる。空きは space が -1
+	 */
+	class CServiceIndex {
+	public:
+		static constexpr std::size_t MIN_CAPACITY = 16;
+
+		/**
+		 * 追加する。既にあれば追加せずに false
+		 */
+		bool Insert(ServiceKey key, const CServiceLocation& location);
+
+		/**
+		 * 無ければ nullptr
+		 */
+		const CServiceLocation* Find(ServiceKey key) const;
+
+		std::size_t Size() const { return m_count; }
+		std::size_t MemoryUsage() const { return m_slots.capacity() * sizeof(Slot); }
+
+	private:
+		struct Slot {
+			ServiceKey key;
+			CServiceLocation location;
+		};
+
+		std::vector<Slot> m_slots;
+		std::size_t m_mask = 0;
+		std::size_t m_count = 0;
+
+		void Rehash(std::size_t capacity);
+	};
+
+	/**
+	 * チャンネルの一覧
+	 * 数値は項目ごとの配列に並べ、名前は文字列の置き場に一度だけ持つ
+	 * 置き場はチューナーの全てのチューニング空間で共有できる
+	 * サービスからインデックスを引く表も持つ
+	 */
+	class CChannelTable {
+	public:
+		class Iterator {
+		public:
+			Iterator(const CChannelTable* pTable, std::size_t index)
+				: m_pTable(pTable)
+				, m_index(index)
+			{}
+
+			CChannelView operator*() const { return (*m_pTable)[m_index]; }
+			Iterator& operator++() { m_index++; return *this; }
+			bool operator!=(const Iterator& rhs) const { return m_index != rhs.m_index; }
+
+		private:
+			const CChannelTable* m_pTable;
+			std::size_t m_index;
+		};
+
+		CChannelTable()
+			: m_names(std::make_shared<CStringPool>())
+		{}
+		explicit CChannelTable(std::shared_ptr<CStringPool> names)
+			: m_names(std::move(names))
+		{}
+
+		void Reserve(std::size_t count);
+		void Add(std::uint16_t NetworkID, std::uint16_t TransportStreamID, std::uint16_t ServiceID,
+			int channel, const wchar_t* channelName);
+		void Add(const CServiceInfo& service) {
+			Add(service.NetworkID, service.TransportStreamID, service.ServiceID, service.channel, service.channelName.c_str());
+		}
+
+		std::size_t Size() const { return m_serviceIDs.size(); }
+		bool Empty() const { return m_serviceIDs.empty(); }
+
+		CChannelView operator[](std::size_t i) const {
+			return CChannelView{
+				m_networkIDs[i], m_transportStreamIDs[i], m_serviceIDs[i], m_channels[i], m_names->Get(m_channelNames[i]) };
+		}
+
+		Iterator begin() const { return Iterator(this, 0); }
+		Iterator end() const { return Iterator(this, Size()); }
+
+		/**
+		 * サービスのインデックス(同じサービスが複数あれば最初のもの)
+		 * 無ければ -1
+		 */
+		int Find(ServiceKey key) const;
+
+		/**
+		 * 確保しているメモリの大きさ(バイト単位、文字列の置き場は除く)
+		 */
+		std::size_t MemoryUsage() const;
+
+	private:
+		std::shared_ptr<CStringPool> m_names;
+		std::vector<std::uint16_t> m_networkIDs;
+		std::vector<std::uint16_t> m_transportStreamIDs;
+		std::vector<std::uint16_t> m_serviceIDs;
+		std::vector<std::int32_t> m_channels;
+		std::vector<CStringPool::Ref> m_channelNames;
+		CServiceIndex m_index;	// サービス -> インデックス(location.index を使う)
+	};
+
+	/**
+	 * チューニング空間とそのチャンネル
+	 */
+	struct CTuningSpace {
+		std::wstring name;
+		CChannelTable channels;
+
+		/**
+		 * サービスの channels でのインデックス
+		 * 無ければ -1
+		 */
+		int FindService(ServiceKey key) const { return channels.Find(key); }
+	};
+
+	/**
+	 * チューナーのチューニング空間の一覧
+	 */
+	struct CDriverChannels {
+		std::wstring driverName;
+		std::vector<CTuningSpace> spaces;
+		CServiceIndex services;	// 複数の空間にあれば最初のもの
+		std::shared_ptr<CStringPool> names = std::make_shared<CStringPool>();	// 全ての空間のチャンネル名
+
+		/**
+		 * サービスの位置
+		 * 無ければ nullptr
+		 */
+		const CServiceLocation* FindService(ServiceKey key) const { return services.Find(key); }
+
+		/**
+		 * チューニング空間を追加する
+		 * チャンネル名は names に置く
+		 */
+		CTuningSpace& AddSpace(const std::wstring& name);
+
+		/**
+		 * チャンネルを追加する
+		 */
+		void AddChannel(int space, std::uint16_t NetworkID, std::uint16_t TransportStreamID, std::uint16_t ServiceID,
+			int channel, const wchar_t* channelName);
+		void AddChannel(int space, const CServiceInfo& service) {
+			AddChannel(space, service.NetworkID, service.TransportStreamID, service.ServiceID,
+				service.channel, service.channelName.c_str());
+		}
+
+		/**
+		 * サービスを含むチューニング空間
+		 * space にサービスがあればそのまま、無ければサービスのある空間、どこにも無ければ space を返す
+		 */
+		int ResolveSpace(ServiceKey key, int space) const;
+
+		/**
+		 * 確保しているメモリの大きさ(バイト単位)
+		 */
+		std::size_t MemoryUsage() const;
+	};
+}
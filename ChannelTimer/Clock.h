@@ -0,0 +1,19 @@
+#pragma once
+#include <cstdint>
+
+namespace ChannelTimer {
+	/**
+	 * 日時(1601/1/1 からの 100ns 単位、UTC)。FILETIME と同じ単位
+	 */
+	using TimeValue = std::int64_t;
+
+	// FILETIME の単位
+	static constexpr TimeValue FILETIME_MS   = 10000LL;
+	static constexpr TimeValue FILETIME_SEC  = 1000LL * FILETIME_MS;
+	static constexpr TimeValue FILETIME_MIN  = 60LL * FILETIME_SEC;
+	static constexpr TimeValue FILETIME_HOUR = 60LL * FILETIME_MIN;
+	static constexpr TimeValue FILETIME_DAY  = 24LL * FILETIME_HOUR;
+
+	// EPG 日時(UTC+9)と UTC の差
+	static constexpr TimeValue EPG_TIME_OFFSET = 9LL * FILETIME_HOUR;
+}
@@ -0,0 +1,123 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "Clock.h"
+
+namespace ChannelTimer {
+	/**
+	 * 次のタイマーまでの残り時間の表示
+	 * 表示は秒単位なので文字列が変わるのは 1 秒に 1 回までで、変わった時だけ描画し直せばよい
+	 */
+	class CCountdown {
+	public:
+		// 期限が決まっていない(番組終了待ち)
+		static constexpr TimeValue NO_DEADLINE = INT64_MAX;
+
+		/**
+		 * 表示する切り替え先と期限(UTC)
+		 */
+		void SetTarget(const std::wstring& name, TimeValue deadline)
+		{
+			if (m_fActive && name == m_name && deadline == m_deadline)
+				return;
+			m_fActive = true;
+			m_name = name;
+			m_deadline = deadline;
+			m_fDirty = true;
+		}
+
+		/**
+		 * 予約したタイマーが無い
+		 */
+		void ClearTarget()
+		{
+			if (!m_fActive)
+				return;
+			m_fActive = false;
+			m_name.clear();
+			m_fDirty = true;
+		}
+
+		/**
+		 * now の表示を求める。文字列が変わったら true
+		 */
+		bool Update(TimeValue now)
+		{
+			const std::int64_t seconds = RemainingSeconds(now);
+			if (!m_fDirty && seconds == m_seconds)
+				return false;
+			m_fDirty = false;
+			m_seconds = seconds;
+
+			std::wstring text;
+			if (!m_fActive) {
+				text = L"タイマーなし";
+			} else {
+				text = m_name;
+				if (!text.empty())
+					text += L' ';
+				if (m_deadline == NO_DEADLINE)
+					text += L"番組終了時";
+				else if (seconds <= 0)
+					text += L"まもなく";
+				else
+					text += L"あと " + FormatSeconds(seconds);
+			}
+			if (text == m_text)
+				return false;
+			m_text.swap(text);
+			return true;
+		}
+
+		const std::wstring& GetText() const { return m_text; }
+
+		/**
+		 * now から次に表示が変わるまでの時間。残り時間を数えていなければ 0
+		 */
+		TimeValue NextChange(TimeValue now) const
+		{
+			if (!m_fActive || m_deadline == NO_DEADLINE || m_deadline <= now)
+				return 0;
+			// 残り r で表示は ceil(r) 秒、r が (ceil(r) - 1) 秒になった時に変わる
+			const TimeValue remaining = m_deadline - now;
+			const TimeValue fraction = remaining % FILETIME_SEC;
+			return fraction != 0 ? fraction : FILETIME_SEC;
+		}
+
+		/**
+		 * 時間の表示(h:mm:ss か m:ss)
+		 */
+		static std::wstring FormatSeconds(std::int64_t seconds)
+		{
+			const std::int64_t hours = seconds / 3600;
+			const int minutes = static_cast<int>(seconds / 60 % 60);
+			const int secs = static_cast<int>(seconds % 60);
+			std::wstring text;
+			if (hours > 0) {
+				text = std::to_wstring(hours) + L':';
+				if (minutes < 10)
+					text += L'0';
+			}
+			text += std::to_wstring(minutes) + L':';
+			if (secs < 10)
+				text += L'0';
+			text += std::to_wstring(secs);
+			return text;
+		}
+
+	private:
+		bool m_fActive = false;
+		bool m_fDirty = true;		// 対象が変わって、表示を求め直す必要がある
+		std::wstring m_name;
+		TimeValue m_deadline = NO_DEADLINE;
+		std::int64_t m_seconds = -1;	// 表示している残り秒数
+		std::wstring m_text;
+
+		std::int64_t RemainingSeconds(TimeValue now) const
+		{
+			if (!m_fActive || m_deadline == NO_DEADLINE || m_deadline <= now)
+				return 0;
+			return (m_deadline - now + FILETIME_SEC - 1) / FILETIME_SEC;
+		}
+	};
+}
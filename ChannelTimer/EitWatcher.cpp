@@ -0,0 +1,44 @@
+#include "EitWatcher.h"
+
+namespace ChannelTimer {
+	CEitPfWatcher::CEitPfWatcher(EventChangedFunc pCallback, void* pClientData)
+		: m_pCallback(pCallback)
+		, m_pClientData(pClientData)
+	{}
+
+	void CEitPfWatcher::SetService(std::uint16_t serviceID)
+	{
+		const std::uint32_t service = static_cast<std::uint32_t>(serviceID) << 16;
+		if (m_service.exchange(service) != service)
+			m_present = service;	// サービスが変わったら現在の番組は分からなくなる
+	}
+
+	bool CEitPfWatcher::AcceptTable(std::uint8_t tableID) const
+	{
+		return tableID == TABLE_ID_EIT_PF_ACTUAL;
+	}
+
+	void CEitPfWatcher::OnSection(const std::uint8_t* pSection, std::size_t size)
+	{
+		// table_id から last_table_id までの 14 バイトと、最初のイベントの event_id、CRC
+		if (size < 14 + 2 + 4)
+			return;
+
+		const std::uint32_t service = m_service.load();
+		const std::uint16_t serviceID = static_cast<std::uint16_t>((pSection[3] << 8) | pSection[4]);
+		if (service == 0 || serviceID != (service >> 16))
+			return;
+		if ((pSection[5] & 0x01) == 0 || pSection[6] != 0)	// current_next_indicator, section_number(present)
+			return;
+		if (CSectionCollector::Crc32(pSection, size) != 0)
+			return;
+
+		const std::uint16_t eventID = static_cast<std::uint16_t>((pSection[14] << 8) | pSection[15]);
+		const std::uint32_t present = service | eventID;
+		const std::uint32_t old = m_present.exchange(present);
+
+		// 同じサービスで前の番組を知っていた時だけ知らせる
+		if (old != present && (old & 0xFFFF) != 0 && (old >> 16) == (service >> 16) && m_pCallback != nullptr)
+			m_pCallback(m_pClientData, serviceID, eventID);
+	}
+}
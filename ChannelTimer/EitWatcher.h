@@ -0,0 +1,57 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "SectionCollector.h"
+
+namespace ChannelTimer {
+	/**
+	 * TS の EIT(present/following, 自ストリーム)を見て、サービスの現在の番組が変わったのを知らせる
+	 * OnPacket は一つのスレッドから、SetService は他のスレッドから呼んでよい
+	 * EIT 以外のパケットは PID を比べるだけで返す
+	 */
+	class CEitPfWatcher : private CSectionHandler {
+	public:
+		static const std::uint16_t PID_EIT = 0x0012;
+		static const std::uint8_t TABLE_ID_EIT_PF_ACTUAL = 0x4E;
+
+		/**
+		 * 番組が変わった時に呼ばれる(OnPacket を呼んだスレッドから)
+		 */
+		typedef void (*EventChangedFunc)(void* pClientData, std::uint16_t serviceID, std::uint16_t eventID);
+
+		CEitPfWatcher(EventChangedFunc pCallback, void* pClientData);
+
+		/**
+		 * 見るサービスを設定する。0 なら何もしない
+		 */
+		void SetService(std::uint16_t serviceID);
+
+		/**
+		 * TS パケットを一つ渡す
+		 */
+		void OnPacket(const std::uint8_t* pPacket)
+		{
+			// ほとんどのパケットはここで返す
+			if (GetPacketPID(pPacket) == PID_EIT)
+				m_collector.OnPacket(pPacket);
+		}
+
+		/**
+		 * 最後に知った現在の番組の event_id。まだ無ければ 0
+		 */
+		std::uint16_t GetPresentEventID() const { return static_cast<std::uint16_t>(m_present.load() & 0xFFFF); }
+
+	private:
+		EventChangedFunc m_pCallback;
+		void* m_pClientData;
+		CSectionCollector m_collector{ this };
+
+		// 上位 16 ビットがサービス、下位 16 ビットがそのサービスの現在の event_id
+		std::atomic<std::uint32_t> m_service{ 0 };
+		std::atomic<std::uint32_t> m_present{ 0 };
+
+		bool AcceptTable(std::uint8_t tableID) const override;
+		void OnSection(const std::uint8_t* pSection, std::size_t size) override;
+	};
+}
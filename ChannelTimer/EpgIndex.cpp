@@ -0,0 +1,175 @@
+#include "EpgIndex.h"
+#include <algorithm>
+#include <cwchar>
+#include "EpgSnapshot.h"
+
+namespace ChannelTimer {
+	constexpr int CEpgEvent::MAX_GENRES;
+
+	void CEpgIndex::UpdateService(ServiceKey key, const std::vector<EventSource>& events, TimeValue now)
+	{
+		m_generation++;
+		Service& service = m_services[key];
+		service.events.clear();
+		service.events.reserve(events.size());
+		service.names.clear();
+		service.loadedTime = now;
+
+		for (const EventSource& source : events) {
+			CEpgEvent event;
+			event.startTime = source.startTime;
+			event.duration = source.duration;
+			event.eventID = source.eventID;
+			event.nameOffset = static_cast<std::uint32_t>(service.names.size());
+			event.nameLength = 0;
+			if (source.pszName != nullptr) {
+				const std::size_t length = std::min<std::size_t>(std::wcslen(source.pszName), 0xFFFF);
+				service.names.append(source.pszName, length);
+				event.nameLength = static_cast<std::uint16_t>(length);
+			}
+			event.genreCount = std::min<std::uint8_t>(source.genreCount, CEpgEvent::MAX_GENRES);
+			std::fill(std::copy(source.genres, source.genres + event.genreCount, event.genres),
+				event.genres + CEpgEvent::MAX_GENRES, 0);
+			service.events.push_back(event);
+		}
+
+		// ホストからは開始日時順に来るが、念のため
+		const auto less = [](const CEpgEvent& a, const CEpgEvent& b) { return a.startTime < b.startTime; };
+		if (!std::is_sorted(service.events.begin(), service.events.end(), less))
+			std::stable_sort(service.events.begin(), service.events.end(), less);
+	}
+
+	void CEpgIndex::Touch(ServiceKey key, TimeValue now)
+	{
+		m_services[key].loadedTime = now;
+	}
+
+	void CEpgIndex::RemoveService(ServiceKey key)
+	{
+		if (m_services.erase(key) != 0)
+			m_generation++;
+	}
+
+	void CEpgIndex::Clear()
+	{
+		m_services.clear();
+		m_generation++;
+	}
+
+	bool CEpgIndex::NeedsRefresh(ServiceKey key, TimeValue now, TimeValue maxAge) const
+	{
+		const Service* pService = FindService(key);
+		return pService == nullptr || now - pService->loadedTime >= maxAge;
+	}
+
+	const CEpgEvent* CEpgIndex::FindAt(ServiceKey key, TimeValue time) const
+	{
+		const CEpgEvent* pBegin;
+		const CEpgEvent* pEnd;
+		if (!GetEvents(key, &pBegin, &pEnd))
+			return nullptr;
+
+		// time 以前に始まった最後の番組
+		const CEpgEvent* p = std::upper_bound(pBegin, pEnd, time,
+			[](TimeValue t, const CEpgEvent& event) { return t < event.startTime; });
+		if (p == pBegin)
+			return nullptr;
+		--p;
+		// 長さ未定の番組は次の番組の開始まで
+		const bool fInside =
+			p->duration != 0 ? time < p->EndTime() :
+			p + 1 == pEnd || time < (p + 1)->startTime;
+		return fInside ? p : nullptr;
+	}
+
+	const CEpgEvent* CEpgIndex::FindNext(ServiceKey key, TimeValue time) const
+	{
+		const CEpgEvent* pBegin;
+		const CEpgEvent* pEnd;
+		if (!GetEvents(key, &pBegin, &pEnd))
+			return nullptr;
+
+		const CEpgEvent* p = std::upper_bound(pBegin, pEnd, time,
+			[](TimeValue t, const CEpgEvent& event) { return t < event.startTime; });
+		return p != pEnd ? p : nullptr;
+	}
+
+	std::pair<const CEpgEvent*, const CEpgEvent*> CEpgIndex::FindRange(ServiceKey key, TimeValue from, TimeValue to) const
+	{
+		const CEpgEvent* pBegin;
+		const CEpgEvent* pEnd;
+		if (!GetEvents(key, &pBegin, &pEnd))
+			return std::make_pair(nullptr, nullptr);
+
+		// 番組は重ならないので、from を含むか from 以降の最初の番組から、to より前に始まる番組まで
+		const CEpgEvent* pFirst = std::upper_bound(pBegin, pEnd, from,
+			[](TimeValue t, const CEpgEvent& event) { return t < event.startTime; });
+		if (pFirst != pBegin) {
+			const CEpgEvent* pPrev = pFirst - 1;
+			if (pPrev->duration == 0 || from < pPrev->EndTime())
+				pFirst = pPrev;
+		}
+		const CEpgEvent* pLast = std::lower_bound(pFirst, pEnd, to,
+			[](const CEpgEvent& event, TimeValue t) { return event.startTime < t; });
+		return std::make_pair(pFirst, pLast);
+	}
+
+	std::wstring CEpgIndex::GetEventName(ServiceKey key, const CEpgEvent& event) const
+	{
+		const Service* pService = FindService(key);
+		if (pService != nullptr && !pService->events.empty()) {
+			if (event.nameOffset + event.nameLength > pService->names.size())
+				return std::wstring();
+			return pService->names.substr(event.nameOffset, event.nameLength);
+		}
+		CEpgSnapshot::Service snapshotService;
+		if (m_snapshot != nullptr && m_snapshot->FindService(key, &snapshotService))
+			return CEpgSnapshot::GetEventName(snapshotService, event);
+		return std::wstring();
+	}
+
+	void CEpgIndex::WriteSnapshot(TimeValue now, std::vector<std::uint8_t>* pData) const
+	{
+		CEpgSnapshotBuilder builder(now);
+		for (const auto& entry : m_services) {
+			const Service& service = entry.second;
+			if (!service.events.empty()) {
+				const CEpgEvent* pBegin = service.events.data();
+				builder.AddService(entry.first, service.loadedTime, pBegin, pBegin + service.events.size(), service.names);
+			}
+		}
+		if (m_snapshot != nullptr) {
+			for (std::size_t i = 0; i < m_snapshot->ServiceCount(); i++) {
+				const CEpgSnapshot::Service service = m_snapshot->GetService(i);
+				const Service* pService = FindService(service.key);
+				if (pService == nullptr || pService->events.empty())
+					builder.AddService(service);
+			}
+		}
+		builder.Build(pData);
+	}
+
+	const CEpgIndex::Service* CEpgIndex::FindService(ServiceKey key) const
+	{
+		const auto it = m_services.find(key);
+		return it != m_services.end() ? &it->second : nullptr;
+	}
+
+	bool CEpgIndex::GetEvents(ServiceKey key, const CEpgEvent** ppFirst, const CEpgEvent** ppLast) const
+	{
+		const Service* pService = FindService(key);
+		if (pService != nullptr && !pService->events.empty()) {
+			*ppFirst = pService->events.data();
+			*ppLast = *ppFirst + pService->events.size();
+			return true;
+		}
+		CEpgSnapshot::Service snapshotService;
+		if (m_snapshot != nullptr && m_snapshot->FindService(key, &snapshotService)
+				&& snapshotService.first != snapshotService.last) {
+			*ppFirst = snapshotService.first;
+			*ppLast = snapshotService.last;
+			return true;
+		}
+		return false;
+	}
+}
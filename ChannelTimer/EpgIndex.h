@@ -0,0 +1,129 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "Channels.h"
+#include "Clock.h"
+
+namespace ChannelTimer {
+	class CEpgSnapshot;
+
+	/**
+	 * 番組の区間(固定長)
+	 * 番組名はサービスごとの文字列にまとめて持ち、位置と長さだけを持つ
+	 * スナップショットのファイルにもこのまま書く
+	 */
+	struct CEpgEvent {
+		static constexpr int MAX_GENRES = 3;
+
+		TimeValue startTime;		// 開始日時(UTC)
+		std::uint32_t duration;		// 長さ(秒単位)。0 なら未定
+		std::uint16_t eventID;
+		std::uint16_t nameLength;
+		std::uint32_t nameOffset;
+		std::uint8_t genreCount;
+		std::uint8_t genres[MAX_GENRES];	// 先頭の 3 つまで(末尾の空きに収まる分だけ)
+
+		TimeValue EndTime() const { return startTime + duration * FILETIME_SEC; }
+	};
+	static_assert(sizeof(CEpgEvent) == 24, "CEpgEvent はスナップショットの形式の一部");
+
+	/**
+	 * サービスごとの番組の区間の索引
+	 * 番組は開始日時順に並べ、時刻から番組を引くのは O(log n)
+	 * 読み込みはサービス単位で置き換える
+	 * 読み込んでいない(番組の無い)サービスは、スナップショットがあればそちらから引く
+	 */
+	class CEpgIndex {
+	public:
+		/**
+		 * 読み込む番組
+		 */
+		struct EventSource {
+			static constexpr int MAX_GENRES = 4;
+
+			TimeValue startTime;
+			std::uint32_t duration;
+			std::uint16_t eventID;
+			const wchar_t* pszName;	// nullptr 可
+			const wchar_t* pszText;	// nullptr 可(検索の索引だけが使う)
+			std::uint8_t genreCount;
+			std::uint8_t genres[MAX_GENRES];	// content_nibble_level_1 << 4 | content_nibble_level_2
+		};
+
+		/**
+		 * サービスの番組を置き換える
+		 */
+		void UpdateService(ServiceKey key, const std::vector<EventSource>& events, TimeValue now);
+
+		/**
+		 * 読み込めなかったサービスも、しばらく読み直さないよう読み込んだ日時だけ更新する
+		 */
+		void Touch(ServiceKey key, TimeValue now);
+
+		void RemoveService(ServiceKey key);
+		void Clear();
+
+		/**
+		 * 読み込んでから maxAge 以上経っているか、読み込んでいないか
+		 */
+		bool NeedsRefresh(ServiceKey key, TimeValue now, TimeValue maxAge) const;
+
+		/**
+		 * time に放送している番組。無ければ nullptr
+		 */
+		const CEpgEvent* FindAt(ServiceKey key, TimeValue time) const;
+
+		/**
+		 * time より後に始まる最初の番組。無ければ nullptr
+		 */
+		const CEpgEvent* FindNext(ServiceKey key, TimeValue time) const;
+
+		/**
+		 * [from, to) と重なる番組の範囲 [first, last)
+		 */
+		std::pair<const CEpgEvent*, const CEpgEvent*> FindRange(ServiceKey key, TimeValue from, TimeValue to) const;
+
+		/**
+		 * 番組名
+		 */
+		std::wstring GetEventName(ServiceKey key, const CEpgEvent& event) const;
+
+		std::size_t ServiceCount() const { return m_services.size(); }
+
+		/**
+		 * 読み込んだ番組が変わるたびに増える値(スナップショットを書き直すかの判断に使う)
+		 */
+		std::uint32_t GetGeneration() const { return m_generation; }
+
+		/**
+		 * 読み込んでいないサービスを引くスナップショットを置き換える
+		 */
+		void SetSnapshot(std::shared_ptr<const CEpgSnapshot> snapshot) { m_snapshot = std::move(snapshot); }
+		const std::shared_ptr<const CEpgSnapshot>& GetSnapshot() const { return m_snapshot; }
+
+		/**
+		 * 読み込んだ番組と、読み込んでいないサービスのスナップショットの番組を合わせてスナップショットを作る
+		 * now より前に終わった番組は捨てる
+		 */
+		void WriteSnapshot(TimeValue now, std::vector<std::uint8_t>* pData) const;
+
+	private:
+		struct Service {
+			std::vector<CEpgEvent> events;	// 開始日時順
+			std::wstring names;
+			TimeValue loadedTime = 0;
+		};
+
+		std::unordered_map<ServiceKey, Service> m_services;
+		std::shared_ptr<const CEpgSnapshot> m_snapshot;
+		std::uint32_t m_generation = 0;
+
+		const Service* FindService(ServiceKey key) const;
+		// サービスの番組 [first, last)。読み込んだものが無ければスナップショットから
+		bool GetEvents(ServiceKey key, const CEpgEvent** ppFirst, const CEpgEvent** ppLast) const;
+	};
+}
@@ -0,0 +1,50 @@
+#include "EpgLoader.h"
+
+namespace ChannelTimer {
+	bool LoadServiceEpg(
+		/* const */ TVTest::CTVTestApp* pApp,
+		WORD NetworkID, WORD TransportStreamID, WORD ServiceID,
+		CEpgIndex* pIndex, CEpgSearchIndex* pSearch, TimeValue now)
+	{
+		TVTest::EpgEventList EventList;
+		EventList.NetworkID = NetworkID;
+		EventList.TransportStreamID = TransportStreamID;
+		EventList.ServiceID = ServiceID;
+		if (!pApp->GetEpgEventList(&EventList))
+			return false;
+
+		std::vector<CEpgIndex::EventSource> events;
+		events.reserve(EventList.NumEvents);
+		for (WORD i = 0; i < EventList.NumEvents; i++) {
+			const TVTest::EpgEventInfo& Info = *EventList.EventList[i];
+			FILETIME ft;
+			if (!::SystemTimeToFileTime(&Info.StartTime, &ft))
+				continue;
+			ULARGE_INTEGER Start;
+			Start.LowPart = ft.dwLowDateTime;
+			Start.HighPart = ft.dwHighDateTime;
+
+			CEpgIndex::EventSource source;
+			source.startTime = static_cast<TimeValue>(Start.QuadPart) - EPG_TIME_OFFSET;	// EPG日時(UTC+9) -> UTC
+			source.duration = Info.Duration;
+			source.eventID = Info.EventID;
+			source.pszName = Info.pszEventName;
+			source.pszText = Info.pszEventText;
+			source.genreCount = 0;
+			for (BYTE j = 0; j < Info.ContentListLength && source.genreCount < CEpgIndex::EventSource::MAX_GENRES; j++) {
+				const TVTest::EpgEventContentInfo& Content = Info.ContentList[j];
+				source.genres[source.genreCount++] =
+					static_cast<std::uint8_t>((Content.ContentNibbleLevel1 & 0x0F) << 4 | (Content.ContentNibbleLevel2 & 0x0F));
+			}
+			events.push_back(source);
+		}
+
+		// 名前と内容は解放前に索引へ写す
+		const ServiceKey key = MakeServiceKey(NetworkID, TransportStreamID, ServiceID);
+		pIndex->UpdateService(key, events, now);
+		if (pSearch != nullptr)
+			pSearch->UpdateService(key, events);
+		pApp->FreeEpgEventList(&EventList);
+		return true;
+	}
+}
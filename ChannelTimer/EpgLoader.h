@@ -0,0 +1,17 @@
+#pragma once
+#include <windows.h>
+#include "TVTestPlugin.h"
+#include "EpgIndex.h"
+#include "EpgSearch.h"
+
+namespace ChannelTimer {
+	/**
+	 * サービスの番組表をホストから読み込んで索引を置き換える
+	 * pSearch があれば検索の索引も更新する
+	 * 取得できなければ false
+	 */
+	bool LoadServiceEpg(
+		/* const */ TVTest::CTVTestApp* pApp,
+		WORD NetworkID, WORD TransportStreamID, WORD ServiceID,
+		CEpgIndex* pIndex, CEpgSearchIndex* pSearch, TimeValue now);
+}
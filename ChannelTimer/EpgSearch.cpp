@@ -0,0 +1,322 @@
+#include "EpgSearch.h"
+#include <algorithm>
+#include <cwchar>
+
+namespace ChannelTimer {
+	namespace {
+		int HexDigit(wchar_t c)
+		{
+			if (c >= L'0' && c <= L'9')
+				return c - L'0';
+			if (c >= L'a' && c <= L'f')
+				return c - L'a' + 10;
+			if (c >= L'A' && c <= L'F')
+				return c - L'A' + 10;
+			return -1;
+		}
+
+		void SetBit(std::vector<std::uint64_t>* pBitmap, std::uint32_t id)
+		{
+			if (id / 64 >= pBitmap->size())
+				pBitmap->resize(id / 64 + 1);
+			(*pBitmap)[id / 64] |= std::uint64_t(1) << (id % 64);
+		}
+
+		// 昇順の列の共通部分
+		void Intersect(std::vector<std::uint32_t>* pIds, const std::vector<std::uint32_t>& other)
+		{
+			std::vector<std::uint32_t>& ids = *pIds;
+			auto out = ids.begin();
+			auto it = other.begin();
+			for (const std::uint32_t id : ids) {
+				it = std::lower_bound(it, other.end(), id);
+				if (it == other.end())
+					break;
+				if (*it == id)
+					*out++ = id;
+			}
+			ids.erase(out, ids.end());
+		}
+	}
+
+	bool CSearchRule::Parse(const std::wstring& text, CSearchRule* pRule)
+	{
+		CSearchRule rule;
+		std::wstring keywords = text;
+
+		const std::size_t colon = text.find(L':');
+		if (colon != std::wstring::npos && colon <= 2) {
+			if (colon >= 1) {
+				const int major = HexDigit(text[0]);
+				const int minor = colon == 2 ? HexDigit(text[1]) : 0;
+				if (major < 0 || minor < 0)
+					return false;
+				rule.genre = static_cast<std::uint8_t>(major << 4 | minor);
+				rule.genreMask = colon == 2 ? 0xFF : 0xF0;
+			}
+			keywords = text.substr(colon + 1);
+		}
+
+		const std::wstring normalized = CEpgSearchIndex::Normalize(keywords.c_str());
+		std::size_t pos = 0;
+		while (pos < normalized.size()) {
+			const std::size_t end = std::min(normalized.find(L' ', pos), normalized.size());
+			if (end > pos)
+				rule.keywords.push_back(normalized.substr(pos, end - pos));
+			pos = end + 1;
+		}
+
+		if (rule.keywords.empty() && rule.genreMask == 0)
+			return false;
+		*pRule = std::move(rule);
+		return true;
+	}
+
+	std::wstring CEpgSearchIndex::Normalize(const wchar_t* pszText)
+	{
+		std::wstring text;
+		if (pszText == nullptr)
+			return text;
+		text.reserve(std::wcslen(pszText));
+		for (const wchar_t* p = pszText; *p != L'\0'; p++) {
+			wchar_t c = *p;
+			if (c >= 0xFF01 && c <= 0xFF5E)	// 全角英数字と記号
+				c = static_cast<wchar_t>(c - 0xFF01 + 0x21);
+			else if (c == 0x3000 || c < 0x20)
+				c = L' ';
+			if (c >= L'A' && c <= L'Z')
+				c = static_cast<wchar_t>(c - L'A' + L'a');
+			text.push_back(c);
+		}
+		return text;
+	}
+
+	void CEpgSearchIndex::GetBigrams(const std::wstring& text, std::vector<std::uint32_t>* pBigrams)
+	{
+		pBigrams->clear();
+		for (std::size_t i = 1; i < text.size(); i++) {
+			// 語は空白で区切るので、空白を含む組は要らない
+			if (text[i - 1] == L' ' || text[i] == L' ')
+				continue;
+			pBigrams->push_back((static_cast<std::uint32_t>(text[i - 1] & 0xFFFF) << 16) | (text[i] & 0xFFFF));
+		}
+		std::sort(pBigrams->begin(), pBigrams->end());
+		pBigrams->erase(std::unique(pBigrams->begin(), pBigrams->end()), pBigrams->end());
+	}
+
+	std::uint32_t CEpgSearchIndex::HashSource(const CEpgIndex::EventSource& source)
+	{
+		// FNV-1a
+		std::uint32_t hash = 2166136261U;
+		const auto mix = [&hash](std::uint32_t v) {
+			hash ^= v;
+			hash *= 16777619U;
+		};
+		mix(static_cast<std::uint32_t>(source.startTime / FILETIME_SEC));
+		mix(source.duration);
+		for (int i = 0; i < source.genreCount; i++)
+			mix(source.genres[i]);
+		for (const wchar_t* psz : { source.pszName, source.pszText }) {
+			mix(0xFFFFFFFFU);
+			if (psz != nullptr) {
+				for (const wchar_t* p = psz; *p != L'\0'; p++)
+					mix(static_cast<std::uint32_t>(*p));
+			}
+		}
+		return hash;
+	}
+
+	void CEpgSearchIndex::UpdateService(ServiceKey key, const std::vector<CEpgIndex::EventSource>& events)
+	{
+		std::unordered_map<std::uint16_t, DocId>& docs = m_services[key];
+		std::unordered_map<std::uint16_t, DocId> current;
+		current.reserve(events.size());
+
+		for (const CEpgIndex::EventSource& source : events) {
+			if (current.count(source.eventID) != 0)
+				continue;
+			const std::uint32_t hash = HashSource(source);
+			const auto it = docs.find(source.eventID);
+			if (it != docs.end() && m_docs[it->second].hash == hash) {
+				// 変わっていない
+				current.emplace(source.eventID, it->second);
+				docs.erase(it);
+				continue;
+			}
+
+			Doc doc;
+			doc.key = key;
+			doc.startTime = source.startTime;
+			doc.hash = hash;
+			doc.eventID = source.eventID;
+			doc.fAlive = true;
+			doc.genreCount = std::min<std::uint8_t>(source.genreCount, CEpgIndex::EventSource::MAX_GENRES);
+			std::copy(source.genres, source.genres + doc.genreCount, doc.genres);
+			doc.text = Normalize(source.pszName);
+			doc.text.push_back(L' ');
+			doc.text += Normalize(source.pszText);
+			current.emplace(source.eventID, AddDoc(std::move(doc)));
+		}
+
+		// 無くなったか変わった番組
+		for (const auto& entry : docs)
+			KillDoc(entry.second);
+		docs.swap(current);
+
+		if (m_deadCount >= COMPACT_MIN_DEAD && m_deadCount * 2 > m_docs.size())
+			Compact();
+	}
+
+	void CEpgSearchIndex::RemoveService(ServiceKey key)
+	{
+		const auto it = m_services.find(key);
+		if (it == m_services.end())
+			return;
+		for (const auto& entry : it->second)
+			KillDoc(entry.second);
+		m_services.erase(it);
+	}
+
+	void CEpgSearchIndex::Clear()
+	{
+		m_docs.clear();
+		m_deadCount = 0;
+		m_services.clear();
+		m_postings.clear();
+		m_byTime.clear();
+		for (Bitmap& bitmap : m_majorGenres)
+			bitmap.clear();
+		for (Bitmap& bitmap : m_genres)
+			bitmap.clear();
+	}
+
+	CEpgSearchIndex::DocId CEpgSearchIndex::AddDoc(Doc&& doc)
+	{
+		const DocId id = static_cast<DocId>(m_docs.size());
+		m_docs.push_back(std::move(doc));
+		m_docs[id].byTime = m_byTime.emplace(m_docs[id].startTime, id);
+		IndexDoc(id);
+		return id;
+	}
+
+	void CEpgSearchIndex::IndexDoc(DocId id)
+	{
+		const Doc& doc = m_docs[id];
+		std::vector<std::uint32_t> bigrams;
+		GetBigrams(doc.text, &bigrams);
+		// 番号は増えていくので、末尾に足せば昇順のまま
+		for (const std::uint32_t bigram : bigrams)
+			m_postings[bigram].push_back(id);
+		for (int i = 0; i < doc.genreCount; i++) {
+			SetBit(&m_majorGenres[doc.genres[i] >> 4], id);
+			SetBit(&m_genres[doc.genres[i]], id);
+		}
+	}
+
+	void CEpgSearchIndex::KillDoc(DocId id)
+	{
+		// 索引からは詰める時に消す
+		Doc& doc = m_docs[id];
+		doc.fAlive = false;
+		std::wstring().swap(doc.text);
+		m_byTime.erase(doc.byTime);
+		m_deadCount++;
+	}
+
+	void CEpgSearchIndex::Compact()
+	{
+		std::vector<Doc> docs;
+		docs.reserve(m_docs.size() - m_deadCount);
+		for (Doc& doc : m_docs) {
+			if (doc.fAlive)
+				docs.push_back(std::move(doc));
+		}
+
+		m_docs.clear();
+		m_deadCount = 0;
+		m_services.clear();
+		m_postings.clear();
+		m_byTime.clear();
+		for (Bitmap& bitmap : m_majorGenres)
+			bitmap.clear();
+		for (Bitmap& bitmap : m_genres)
+			bitmap.clear();
+
+		for (Doc& doc : docs) {
+			const ServiceKey key = doc.key;
+			const std::uint16_t eventID = doc.eventID;
+			m_services[key].emplace(eventID, AddDoc(std::move(doc)));
+		}
+	}
+
+	void CEpgSearchIndex::Match(const CSearchRule& rule, TimeValue from, TimeValue to, std::vector<CSearchMatch>* pMatches) const
+	{
+		// 2 文字以上の語の組の番組の共通部分を候補にする(短い列から)
+		std::vector<const std::vector<DocId>*> lists;
+		std::vector<std::uint32_t> bigrams;
+		for (const std::wstring& keyword : rule.keywords) {
+			GetBigrams(keyword, &bigrams);
+			for (const std::uint32_t bigram : bigrams) {
+				const auto it = m_postings.find(bigram);
+				if (it == m_postings.end())
+					return;
+				lists.push_back(&it->second);
+			}
+		}
+		std::sort(lists.begin(), lists.end(),
+			[](const std::vector<DocId>* a, const std::vector<DocId>* b) { return a->size() < b->size(); });
+
+		const Bitmap* pGenre = nullptr;
+		if (rule.genreMask == 0xFF)
+			pGenre = &m_genres[rule.genre];
+		else if (rule.genreMask != 0)
+			pGenre = &m_majorGenres[rule.genre >> 4];
+
+		const auto test = [&](DocId id) {
+			const Doc& doc = m_docs[id];
+			if (!doc.fAlive || doc.startTime < from || doc.startTime >= to)
+				return;
+			if (pGenre != nullptr && !TestBit(*pGenre, id))
+				return;
+			for (const std::wstring& keyword : rule.keywords) {
+				if (doc.text.find(keyword) == std::wstring::npos)
+					return;
+			}
+			pMatches->push_back(CSearchMatch{ doc.key, doc.eventID, doc.startTime });
+		};
+
+		// 期間の番組の方が少なければ、それを直接確かめる
+		const std::size_t candidates =
+			!lists.empty() ? lists[0]->size() : pGenre != nullptr ? pGenre->size() * 64 / 8 : m_docs.size();
+		const TimeMap::const_iterator first = m_byTime.lower_bound(from);
+		const TimeMap::const_iterator last = m_byTime.lower_bound(to);
+		std::size_t windowCount = 0;
+		for (auto it = first; it != last && windowCount <= candidates; ++it)
+			windowCount++;
+		if (windowCount <= candidates) {
+			for (auto it = first; it != last; ++it)
+				test(it->second);
+			return;
+		}
+
+		if (!lists.empty()) {
+			std::vector<DocId> ids(*lists[0]);
+			for (std::size_t i = 1; i < lists.size() && !ids.empty(); i++)
+				Intersect(&ids, *lists[i]);
+			for (const DocId id : ids)
+				test(id);
+		} else if (pGenre != nullptr) {
+			for (std::size_t word = 0; word < pGenre->size(); word++) {
+				const std::uint64_t bits = (*pGenre)[word];
+				for (int bit = 0; bit < 64 && bits >> bit != 0; bit++) {
+					if ((bits >> bit) & 1)
+						test(static_cast<DocId>(word * 64 + bit));
+				}
+			}
+		} else {
+			// 1 文字の語だけ
+			for (DocId id = 0; id < m_docs.size(); id++)
+				test(id);
+		}
+	}
+}
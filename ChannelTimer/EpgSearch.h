@@ -0,0 +1,106 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Channels.h"
+#include "Clock.h"
+#include "EpgIndex.h"
+
+namespace ChannelTimer {
+	/**
+	 * 番組を探す条件
+	 * キーワードは空白で区切った全ての語を番組名か番組内容に含むもの
+	 */
+	struct CSearchRule {
+		std::vector<std::wstring> keywords;	// 正規化済み
+		std::uint8_t genre = 0;				// content_nibble_level_1 << 4 | content_nibble_level_2
+		std::uint8_t genreMask = 0;			// 0 ならジャンルを問わない、0xF0 なら大分類だけ、0xFF なら中分類まで
+
+		/**
+		 * "ジャンル:キーワード" の形式を読む
+		 * ジャンルは 16 進で 1 桁なら大分類、2 桁なら中分類まで。省略すれば ':' も要らない
+		 */
+		static bool Parse(const std::wstring& text, CSearchRule* pRule);
+	};
+
+	/**
+	 * 条件に合った番組
+	 */
+	struct CSearchMatch {
+		ServiceKey key;
+		std::uint16_t eventID;
+		TimeValue startTime;
+	};
+
+	/**
+	 * 番組名と番組内容の転置索引と、ジャンルのビットマップ索引
+	 * 日本語は語に区切れないので 2 文字ずつの組を索引にし、候補を文字列で確かめる
+	 * 読み込みはサービス単位で、変わった番組だけを入れ替える
+	 * 探す期間の番組が索引の候補より少なければ、期間の番組を直接確かめる
+	 */
+	class CEpgSearchIndex {
+	public:
+		/**
+		 * サービスの番組を置き換える。event_id と内容が同じ番組はそのままにする
+		 */
+		void UpdateService(ServiceKey key, const std::vector<CEpgIndex::EventSource>& events);
+
+		void RemoveService(ServiceKey key);
+		void Clear();
+
+		/**
+		 * 開始日時が [from, to) で条件に合う番組を pMatches に足す
+		 */
+		void Match(const CSearchRule& rule, TimeValue from, TimeValue to, std::vector<CSearchMatch>* pMatches) const;
+
+		std::size_t EventCount() const { return m_docs.size() - m_deadCount; }
+		std::size_t TermCount() const { return m_postings.size(); }
+
+		/**
+		 * 全角英数字を半角に、英大文字を小文字に、制御文字と全角空白を空白にする
+		 */
+		static std::wstring Normalize(const wchar_t* pszText);
+
+	private:
+		// 無効になった番組がこれ以上あり、半分を超えたら詰める
+		static constexpr std::size_t COMPACT_MIN_DEAD = 1024;
+
+		using DocId = std::uint32_t;
+		using Bitmap = std::vector<std::uint64_t>;
+		using TimeMap = std::multimap<TimeValue, DocId>;
+
+		struct Doc {
+			ServiceKey key;
+			TimeValue startTime;
+			std::uint32_t hash;
+			std::uint16_t eventID;
+			bool fAlive;
+			std::uint8_t genreCount;
+			std::uint8_t genres[CEpgIndex::EventSource::MAX_GENRES];
+			std::wstring text;	// 正規化した番組名と番組内容
+			TimeMap::iterator byTime;
+		};
+
+		std::vector<Doc> m_docs;
+		std::size_t m_deadCount = 0;
+		std::unordered_map<ServiceKey, std::unordered_map<std::uint16_t, DocId>> m_services;
+		std::unordered_map<std::uint32_t, std::vector<DocId>> m_postings;	// 2 文字の組 -> 番組(昇順)
+		TimeMap m_byTime;	// 開始日時 -> 番組(有効なものだけ)
+		Bitmap m_majorGenres[16];
+		Bitmap m_genres[256];
+
+		DocId AddDoc(Doc&& doc);
+		void IndexDoc(DocId id);
+		void KillDoc(DocId id);
+		void Compact();
+
+		static std::uint32_t HashSource(const CEpgIndex::EventSource& source);
+		static void GetBigrams(const std::wstring& text, std::vector<std::uint32_t>* pBigrams);
+		static bool TestBit(const Bitmap& bitmap, DocId id)
+		{
+			return id / 64 < bitmap.size() && (bitmap[id / 64] >> (id % 64)) & 1;
+		}
+	};
+}
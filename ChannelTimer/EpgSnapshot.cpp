@@ -0,0 +1,206 @@
+#include "EpgSnapshot.h"
+#include <algorithm>
+#include <cstring>
+#include "EpgSearch.h"
+
+namespace ChannelTimer {
+	constexpr std::uint8_t CEpgSnapshotFormat::MAGIC[4];
+	constexpr std::uint32_t CEpgSnapshotFormat::VERSION;
+
+	namespace {
+		std::uint64_t AlignUp(std::uint64_t offset)
+		{
+			return (offset + 7) & ~static_cast<std::uint64_t>(7);
+		}
+
+		// [offset, offset + count * recordSize) がファイルに収まり、alignment の境界から始まるか
+		bool IsValidArray(std::uint64_t offset, std::uint64_t count, std::size_t recordSize,
+			std::size_t alignment, std::uint64_t fileSize)
+		{
+			return offset % alignment == 0
+				&& offset <= fileSize
+				&& count <= (fileSize - offset) / recordSize;
+		}
+	}
+
+	bool CEpgSnapshot::Attach(const void* pData, std::size_t size)
+	{
+		using Format = CEpgSnapshotFormat;
+
+		m_pHeader = nullptr;
+		const std::uint8_t* pBytes = static_cast<const std::uint8_t*>(pData);
+		if (pBytes == nullptr || size < sizeof(Format::Header)
+				|| reinterpret_cast<std::uintptr_t>(pBytes) % alignof(Format::Header) != 0)
+			return false;
+
+		const Format::Header* pHeader = reinterpret_cast<const Format::Header*>(pBytes);
+		if (std::memcmp(pHeader->magic, Format::MAGIC, sizeof(Format::MAGIC)) != 0
+				|| pHeader->version != Format::VERSION
+				|| pHeader->headerSize != sizeof(Format::Header)
+				|| pHeader->fileSize < sizeof(Format::Header)
+				|| pHeader->fileSize > size)
+			return false;
+		const std::uint64_t fileSize = pHeader->fileSize;
+		if (!IsValidArray(pHeader->servicesOffset, pHeader->serviceCount, sizeof(Format::Service), alignof(Format::Service), fileSize)
+				|| !IsValidArray(pHeader->eventsOffset, pHeader->eventCount, sizeof(CEpgEvent), alignof(CEpgEvent), fileSize)
+				|| !IsValidArray(pHeader->namesOffset, pHeader->nameLength, sizeof(std::uint16_t), alignof(std::uint16_t), fileSize))
+			return false;
+
+		const Format::Service* pServices = reinterpret_cast<const Format::Service*>(pBytes + pHeader->servicesOffset);
+		for (std::uint32_t i = 0; i < pHeader->serviceCount; i++) {
+			const Format::Service& service = pServices[i];
+			if (static_cast<std::uint64_t>(service.firstEvent) + service.eventCount > pHeader->eventCount
+					|| static_cast<std::uint64_t>(service.firstName) + service.nameLength > pHeader->nameLength
+					|| (i > 0 && pServices[i - 1].key >= service.key))
+				return false;
+		}
+
+		m_pHeader = pHeader;
+		m_pServices = pServices;
+		m_pEvents = reinterpret_cast<const CEpgEvent*>(pBytes + pHeader->eventsOffset);
+		m_pNames = reinterpret_cast<const std::uint16_t*>(pBytes + pHeader->namesOffset);
+		return true;
+	}
+
+	CEpgSnapshot::Service CEpgSnapshot::GetService(std::size_t index) const
+	{
+		const CEpgSnapshotFormat::Service& service = m_pServices[index];
+		Service result;
+		result.key = service.key;
+		result.loadedTime = service.loadedTime;
+		result.first = m_pEvents + service.firstEvent;
+		result.last = result.first + service.eventCount;
+		result.names = m_pNames + service.firstName;
+		result.nameLength = service.nameLength;
+		return result;
+	}
+
+	bool CEpgSnapshot::FindService(ServiceKey key, Service* pService) const
+	{
+		if (m_pHeader == nullptr)
+			return false;
+		const CEpgSnapshotFormat::Service* pEnd = m_pServices + m_pHeader->serviceCount;
+		const CEpgSnapshotFormat::Service* p = std::lower_bound(m_pServices, pEnd, key,
+			[](const CEpgSnapshotFormat::Service& service, ServiceKey k) { return service.key < k; });
+		if (p == pEnd || p->key != key)
+			return false;
+		*pService = GetService(p - m_pServices);
+		return true;
+	}
+
+	std::wstring CEpgSnapshot::GetEventName(const Service& service, const CEpgEvent& event)
+	{
+		if (static_cast<std::size_t>(event.nameOffset) + event.nameLength > service.nameLength)
+			return std::wstring();
+		const std::uint16_t* p = service.names + event.nameOffset;
+		return std::wstring(p, p + event.nameLength);
+	}
+
+	void CEpgSnapshotBuilder::AddService(ServiceKey key, TimeValue loadedTime,
+		const CEpgEvent* first, const CEpgEvent* last, const std::wstring& names)
+	{
+		Add(key, loadedTime, first, last, names.data(), names.size());
+	}
+
+	void CEpgSnapshotBuilder::AddService(const CEpgSnapshot::Service& service)
+	{
+		Add(service.key, service.loadedTime, service.first, service.last, service.names, service.nameLength);
+	}
+
+	template<typename Char>
+	void CEpgSnapshotBuilder::Add(ServiceKey key, TimeValue loadedTime,
+		const CEpgEvent* first, const CEpgEvent* last, const Char* names, std::size_t nameLength)
+	{
+		CEpgSnapshotFormat::Service service;
+		service.key = key;
+		service.loadedTime = loadedTime;
+		service.firstEvent = static_cast<std::uint32_t>(m_events.size());
+		service.firstName = static_cast<std::uint32_t>(m_names.size());
+
+		for (const CEpgEvent* p = first; p != last; p++) {
+			// 終わった番組は要らない。長さ未定の番組は次の番組が始まるまで
+			const bool fEnded =
+				p->duration != 0 ? p->EndTime() <= m_now :
+				p + 1 != last && (p + 1)->startTime <= m_now;
+			if (fEnded)
+				continue;
+			CEpgEvent event = *p;
+			event.nameOffset = static_cast<std::uint32_t>(m_names.size() - service.firstName);
+			if (static_cast<std::size_t>(p->nameOffset) + p->nameLength <= nameLength) {
+				for (std::size_t i = 0; i < p->nameLength; i++)
+					m_names.push_back(static_cast<std::uint16_t>(names[p->nameOffset + i]));
+			} else {
+				event.nameLength = 0;
+			}
+			m_events.push_back(event);
+		}
+
+		service.eventCount = static_cast<std::uint32_t>(m_events.size() - service.firstEvent);
+		service.nameLength = static_cast<std::uint32_t>(m_names.size() - service.firstName);
+		if (service.eventCount > 0)
+			m_services.push_back(service);
+	}
+
+	void CEpgSnapshotBuilder::Build(std::vector<std::uint8_t>* pData) const
+	{
+		using Format = CEpgSnapshotFormat;
+
+		std::vector<Format::Service> services = m_services;
+		std::sort(services.begin(), services.end(),
+			[](const Format::Service& a, const Format::Service& b) { return a.key < b.key; });
+
+		Format::Header header;
+		std::memcpy(header.magic, Format::MAGIC, sizeof(Format::MAGIC));
+		header.version = Format::VERSION;
+		header.headerSize = sizeof(Format::Header);
+		header.serviceCount = static_cast<std::uint32_t>(services.size());
+		header.eventCount = static_cast<std::uint32_t>(m_events.size());
+		header.nameLength = static_cast<std::uint32_t>(m_names.size());
+		header.createdTime = m_now;
+		header.servicesOffset = sizeof(Format::Header);
+		header.eventsOffset = AlignUp(header.servicesOffset + services.size() * sizeof(Format::Service));
+		header.namesOffset = AlignUp(header.eventsOffset + m_events.size() * sizeof(CEpgEvent));
+		header.fileSize = AlignUp(header.namesOffset + m_names.size() * sizeof(std::uint16_t));
+
+		pData->assign(static_cast<std::size_t>(header.fileSize), 0);
+		std::uint8_t* p = pData->data();
+		std::memcpy(p, &header, sizeof(header));
+		if (!services.empty())
+			std::memcpy(p + header.servicesOffset, services.data(), services.size() * sizeof(Format::Service));
+		if (!m_events.empty())
+			std::memcpy(p + header.eventsOffset, m_events.data(), m_events.size() * sizeof(CEpgEvent));
+		if (!m_names.empty())
+			std::memcpy(p + header.namesOffset, m_names.data(), m_names.size() * sizeof(std::uint16_t));
+	}
+
+	void IndexSnapshot(const CEpgSnapshot& snapshot, CEpgSearchIndex* pSearch)
+	{
+		std::vector<std::wstring> names;
+		std::vector<CEpgIndex::EventSource> events;
+		for (std::size_t i = 0; i < snapshot.ServiceCount(); i++) {
+			const CEpgSnapshot::Service service = snapshot.GetService(i);
+			const std::size_t count = service.last - service.first;
+			// EventSource が名前を指すので、先に全て作っておく
+			names.clear();
+			names.reserve(count);
+			for (const CEpgEvent* p = service.first; p != service.last; p++)
+				names.push_back(CEpgSnapshot::GetEventName(service, *p));
+
+			events.clear();
+			events.reserve(count);
+			for (std::size_t j = 0; j < count; j++) {
+				const CEpgEvent& event = service.first[j];
+				CEpgIndex::EventSource source;
+				source.startTime = event.startTime;
+				source.duration = event.duration;
+				source.eventID = event.eventID;
+				source.pszName = names[j].c_str();
+				source.pszText = nullptr;
+				source.genreCount = std::min<std::uint8_t>(event.genreCount, CEpgEvent::MAX_GENRES);
+				std::copy(event.genres, event.genres + source.genreCount, source.genres);
+				events.push_back(source);
+			}
+			pSearch->UpdateService(service.key, events);
+		}
+	}
+}
@@ -0,0 +1,139 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Channels.h"
+#include "Clock.h"
+#include "EpgIndex.h"
+
+namespace ChannelTimer {
+	class CEpgSearchIndex;
+
+	/**
+	 * 番組表のスナップショットのファイルの形式
+	 * ヘッダ、サービス(キー順)、番組(CEpgEvent、サービスごとに開始日時順)、番組名(UTF-16)の順に並べる
+	 * 位置は全てファイルの先頭からのバイト数なので、どこに写してもそのまま読める
+	 * 値はリトルエンディアンで、それぞれの並びは 8 バイト境界から始める
+	 */
+	struct CEpgSnapshotFormat {
+		static constexpr std::uint8_t MAGIC[4] = { 'C', 'T', 'E', 'P' };
+		static constexpr std::uint32_t VERSION = 1;
+
+		struct Header {
+			std::uint8_t magic[4];
+			std::uint32_t version;
+			std::uint32_t headerSize;
+			std::uint32_t serviceCount;
+			std::uint32_t eventCount;
+			std::uint32_t nameLength;		// 番組名の全体の長さ(UTF-16 の単位)
+			TimeValue createdTime;
+			std::uint64_t servicesOffset;
+			std::uint64_t eventsOffset;
+			std::uint64_t namesOffset;
+			std::uint64_t fileSize;
+		};
+		static_assert(sizeof(Header) == 64, "Header はファイルの形式の一部");
+
+		struct Service {
+			ServiceKey key;
+			TimeValue loadedTime;
+			std::uint32_t firstEvent;
+			std::uint32_t eventCount;
+			std::uint32_t firstName;		// 番組の nameOffset はここからの位置
+			std::uint32_t nameLength;
+		};
+		static_assert(sizeof(Service) == 32, "Service はファイルの形式の一部");
+	};
+
+	/**
+	 * 番組表のスナップショット(読み込み専用)
+	 * 渡されたメモリを検査してそのまま引き、番組はコピーせずに返す。メモリは捨てるまで持っておくこと
+	 */
+	class CEpgSnapshot {
+	public:
+		/**
+		 * サービスの番組
+		 */
+		struct Service {
+			ServiceKey key;
+			TimeValue loadedTime;
+			const CEpgEvent* first;			// 開始日時順 [first, last)
+			const CEpgEvent* last;
+			const std::uint16_t* names;
+			std::size_t nameLength;
+		};
+
+		CEpgSnapshot() = default;
+		CEpgSnapshot(const CEpgSnapshot&) = delete;
+		CEpgSnapshot& operator=(const CEpgSnapshot&) = delete;
+		virtual ~CEpgSnapshot() = default;
+
+		/**
+		 * メモリを検査して使う。形式が違えば false
+		 */
+		bool Attach(const void* pData, std::size_t size);
+
+		bool IsAttached() const { return m_pHeader != nullptr; }
+		TimeValue GetCreatedTime() const { return m_pHeader != nullptr ? m_pHeader->createdTime : 0; }
+		std::size_t ServiceCount() const { return m_pHeader != nullptr ? m_pHeader->serviceCount : 0; }
+		std::size_t EventCount() const { return m_pHeader != nullptr ? m_pHeader->eventCount : 0; }
+
+		Service GetService(std::size_t index) const;
+
+		/**
+		 * サービスを探す(二分探索)。無ければ false
+		 */
+		bool FindService(ServiceKey key, Service* pService) const;
+
+		/**
+		 * 番組名。位置が範囲外なら空
+		 */
+		static std::wstring GetEventName(const Service& service, const CEpgEvent& event);
+
+	private:
+		const CEpgSnapshotFormat::Header* m_pHeader = nullptr;
+		const CEpgSnapshotFormat::Service* m_pServices = nullptr;
+		const CEpgEvent* m_pEvents = nullptr;
+		const std::uint16_t* m_pNames = nullptr;
+	};
+
+	/**
+	 * スナップショットを組み立てる
+	 * 組み立てる日時より前に終わった番組は捨て、番組の無くなったサービスは書かない
+	 */
+	class CEpgSnapshotBuilder {
+	public:
+		explicit CEpgSnapshotBuilder(TimeValue now)
+			: m_now(now)
+		{}
+
+		/**
+		 * サービスを足す。同じサービスを二度足さないこと
+		 */
+		void AddService(ServiceKey key, TimeValue loadedTime,
+			const CEpgEvent* first, const CEpgEvent* last, const std::wstring& names);
+		void AddService(const CEpgSnapshot::Service& service);
+
+		/**
+		 * ファイルの内容を作る
+		 */
+		void Build(std::vector<std::uint8_t>* pData) const;
+
+	private:
+		TimeValue m_now;
+		std::vector<CEpgSnapshotFormat::Service> m_services;
+		std::vector<CEpgEvent> m_events;
+		std::vector<std::uint16_t> m_names;
+
+		template<typename Char>
+		void Add(ServiceKey key, TimeValue loadedTime,
+			const CEpgEvent* first, const CEpgEvent* last, const Char* names, std::size_t nameLength);
+	};
+
+	/**
+	 * スナップショットの番組名とジャンルを検索の索引に入れる
+	 * 番組内容は持っていないので、番組表を読み込み直すまでは番組名とジャンルだけで探す
+	 */
+	void IndexSnapshot(const CEpgSnapshot& snapshot, CEpgSearchIndex* pSearch);
+}
@@ -0,0 +1,179 @@
+#include "EpgSnapshotFile.h"
+
+namespace ChannelTimer {
+	namespace {
+		bool WriteAll(HANDLE hFile, const std::uint8_t* pData, std::size_t size)
+		{
+			while (size > 0) {
+				const DWORD Size = static_cast<DWORD>(size < 0x10000000 ? size : 0x10000000);
+				DWORD Written = 0;
+				if (!::WriteFile(hFile, pData, Size, &Written, nullptr) || Written != Size)
+					return false;
+				pData += Size;
+				size -= Size;
+			}
+			return true;
+		}
+	}
+
+	CMappedEpgSnapshot::~CMappedEpgSnapshot()
+	{
+		Close();
+	}
+
+	bool CMappedEpgSnapshot::Open(LPCWSTR pszFileName)
+	{
+		Close();
+		m_hFile = ::CreateFile(pszFileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (m_hFile == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER Size;
+		if (!::GetFileSizeEx(m_hFile, &Size) || Size.QuadPart < static_cast<LONGLONG>(sizeof(CEpgSnapshotFormat::Header))
+				|| static_cast<ULONGLONG>(Size.QuadPart) > static_cast<SIZE_T>(-1)) {
+			Close();
+			return false;
+		}
+
+		m_hMapping = ::CreateFileMapping(m_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (m_hMapping != nullptr)
+			m_pView = ::MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+		if (m_pView == nullptr || !Attach(m_pView, static_cast<std::size_t>(Size.QuadPart))) {
+			Close();
+			return false;
+		}
+		return true;
+	}
+
+	void CMappedEpgSnapshot::Close()
+	{
+		Attach(nullptr, 0);
+		if (m_pView != nullptr) {
+			::UnmapViewOfFile(m_pView);
+			m_pView = nullptr;
+		}
+		if (m_hMapping != nullptr) {
+			::CloseHandle(m_hMapping);
+			m_hMapping = nullptr;
+		}
+		if (m_hFile != INVALID_HANDLE_VALUE) {
+			::CloseHandle(m_hFile);
+			m_hFile = INVALID_HANDLE_VALUE;
+		}
+	}
+
+	CEpgSnapshotStore::~CEpgSnapshotStore()
+	{
+		Wait();
+	}
+
+	void CEpgSnapshotStore::SetFileName(const std::wstring& baseName)
+	{
+		m_fileNames[0] = baseName + L".0";
+		m_fileNames[1] = baseName + L".1";
+	}
+
+	std::shared_ptr<const CEpgSnapshot> CEpgSnapshotStore::Load()
+	{
+		std::shared_ptr<CMappedEpgSnapshot> snapshots[2];
+		for (int i = 0; i < 2; i++) {
+			snapshots[i] = std::make_shared<CMappedEpgSnapshot>();
+			if (!snapshots[i]->Open(m_fileNames[i].c_str()))
+				snapshots[i].reset();
+		}
+
+		if (snapshots[0] && snapshots[1])
+			m_mappedSlot = snapshots[1]->GetCreatedTime() > snapshots[0]->GetCreatedTime() ? 1 : 0;
+		else if (snapshots[0] || snapshots[1])
+			m_mappedSlot = snapshots[0] ? 0 : 1;
+		else
+			m_mappedSlot = -1;
+		return m_mappedSlot >= 0 ? snapshots[m_mappedSlot] : nullptr;
+	}
+
+	bool CEpgSnapshotStore::StartSave(std::vector<std::uint8_t> data, HWND hwndNotify, UINT Message)
+	{
+		if (m_fPending)
+			return false;
+		Wait();
+
+		m_saveSlot = GetFreeSlot();
+		m_data = std::move(data);
+		m_hwndNotify = hwndNotify;
+		m_Message = Message;
+
+		m_hThread = ::CreateThread(nullptr, 0, ThreadProc, this, 0, nullptr);
+		if (m_hThread == nullptr)
+			return false;
+		m_fPending = true;
+		return true;
+	}
+
+	std::shared_ptr<const CEpgSnapshot> CEpgSnapshotStore::OnSaved(WPARAM wParam, LPARAM lParam)
+	{
+		m_fPending = false;
+		Wait();
+		const int slot = static_cast<int>(wParam);
+		if (lParam == FALSE || slot < 0 || slot > 1)
+			return nullptr;
+
+		std::shared_ptr<CMappedEpgSnapshot> snapshot = std::make_shared<CMappedEpgSnapshot>();
+		if (!snapshot->Open(m_fileNames[slot].c_str()))
+			return nullptr;
+		// 前のファイルは、使っている人が手放した時に閉じられる
+		m_mappedSlot = slot;
+		return snapshot;
+	}
+
+	void CEpgSnapshotStore::Wait()
+	{
+		if (m_hThread == nullptr)
+			return;
+		// ファイルに書き込むだけで、このスレッドへは何も送ってこない
+		::WaitForSingleObject(m_hThread, INFINITE);
+		::CloseHandle(m_hThread);
+		m_hThread = nullptr;
+		m_data.clear();
+		m_data.shrink_to_fit();
+	}
+
+	bool CEpgSnapshotStore::Save(const std::vector<std::uint8_t>& data)
+	{
+		return WriteSnapshotFile(m_fileNames[GetFreeSlot()], data);
+	}
+
+	DWORD WINAPI CEpgSnapshotStore::ThreadProc(LPVOID pParameter)
+	{
+		CEpgSnapshotStore* pThis = static_cast<CEpgSnapshotStore*>(pParameter);
+		const bool fSucceeded = WriteSnapshotFile(pThis->m_fileNames[pThis->m_saveSlot], pThis->m_data);
+		::PostMessage(pThis->m_hwndNotify, pThis->m_Message, pThis->m_saveSlot, fSucceeded);
+		return 0;
+	}
+
+	bool CEpgSnapshotStore::WriteSnapshotFile(const std::wstring& fileName, const std::vector<std::uint8_t>& data)
+	{
+		const std::size_t HeaderSize = sizeof(CEpgSnapshotFormat::Header);
+		if (data.size() < HeaderSize)
+			return false;
+
+		// 読み込みも共有しない。写している方には書き込まない
+		HANDLE hFile = ::CreateFile(fileName.c_str(), GENERIC_WRITE, 0, nullptr,
+			CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (hFile == INVALID_HANDLE_VALUE)
+			return false;
+
+		// ヘッダを空けて中身を書き、書けてからヘッダを書く
+		const std::uint8_t Zero[HeaderSize] = {};
+		LARGE_INTEGER Begin = {};
+		const bool fSucceeded =
+			WriteAll(hFile, Zero, HeaderSize)
+			&& WriteAll(hFile, data.data() + HeaderSize, data.size() - HeaderSize)
+			&& ::FlushFileBuffers(hFile)
+			&& ::SetFilePointerEx(hFile, Begin, nullptr, FILE_BEGIN)
+			&& WriteAll(hFile, data.data(), HeaderSize)
+			&& ::FlushFileBuffers(hFile);
+		::CloseHandle(hFile);
+		return fSucceeded;
+	}
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <windows.h>
+#include "EpgSnapshot.h"
+
+namespace ChannelTimer {
+	/**
+	 * ファイルを読み込み専用で写したスナップショット
+	 * 写している間は他から書き込めない
+	 */
+	class CMappedEpgSnapshot : public CEpgSnapshot {
+	public:
+		~CMappedEpgSnapshot();
+
+		/**
+		 * ファイルを写して検査する。無いか形式が違えば false
+		 */
+		bool Open(LPCWSTR pszFileName);
+
+	private:
+		HANDLE m_hFile = INVALID_HANDLE_VALUE;
+		HANDLE m_hMapping = nullptr;
+		LPCVOID m_pView = nullptr;
+
+		void Close();
+	};
+
+	/**
+	 * 番組表のスナップショットの保存先
+	 * 二つのファイルを交互に使い、写している方には書き込まない
+	 * 書き込みは中身の後でヘッダを書くので、途中で止まったファイルは読み込まれない
+	 * 別スレッドで書き込んだら、通知先のウィンドウへ Message(wParam: ファイルの番号、lParam: 書き込めたか)を送る
+	 */
+	class CEpgSnapshotStore {
+	public:
+		~CEpgSnapshotStore();
+
+		/**
+		 * ファイル名を決める(baseName に ".0" と ".1" を付ける)
+		 */
+		void SetFileName(const std::wstring& baseName);
+
+		/**
+		 * 新しい方のファイルを写す。どちらも読めなければ nullptr
+		 */
+		std::shared_ptr<const CEpgSnapshot> Load();
+
+		/**
+		 * 別スレッドで書き込みを始める。書き込み中か、通知を処理していなければ false
+		 */
+		bool StartSave(std::vector<std::uint8_t> data, HWND hwndNotify, UINT Message);
+
+		/**
+		 * 書き込みの通知を受け取った時に呼ぶ。書き込んだファイルを写して返す(失敗すれば nullptr)
+		 */
+		std::shared_ptr<const CEpgSnapshot> OnSaved(WPARAM wParam, LPARAM lParam);
+
+		/**
+		 * 書き込み中か、通知を処理していないか
+		 */
+		bool IsSaving() const { return m_fPending; }
+
+		/**
+		 * 書き込み中なら終わるまで待つ
+		 */
+		void Wait();
+
+		/**
+		 * このスレッドで書き込む(終了時用)。先に Wait() しておくこと
+		 */
+		bool Save(const std::vector<std::uint8_t>& data);
+
+	private:
+		std::wstring m_fileNames[2];
+		int m_mappedSlot = -1;		// 写しているファイル。無ければ -1
+		bool m_fPending = false;	// 通知を処理するまで次の書き込みをしない
+		HANDLE m_hThread = nullptr;
+		int m_saveSlot = 0;
+		std::vector<std::uint8_t> m_data;
+		HWND m_hwndNotify = nullptr;
+		UINT m_Message = 0;
+
+		int GetFreeSlot() const { return m_mappedSlot == 0 ? 1 : 0; }
+
+		static DWORD WINAPI ThreadProc(LPVOID pParameter);
+		static bool WriteSnapshotFile(const std::wstring& fileName, const std::vector<std::uint8_t>& data);
+	};
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace ChannelTimer {
+	/**
+	 * 固定サイズの対数線形ヒストグラム
+	 * 2 の冪ごとの区間を SUB_BUCKET_COUNT 個に等分し、相対誤差 1/SUB_BUCKET_COUNT 以内で分位点を求める
+	 * 記録は O(1) でメモリを確保しない
+	 */
+	class CLatencyHistogram {
+	public:
+		static constexpr int SUB_BUCKET_BITS = 4;
+		static constexpr int SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+		static constexpr std::size_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+		/**
+		 * 値を記録する。負の値は 0 とする
+		 */
+		void Record(std::int64_t value)
+		{
+			const std::uint64_t v = value < 0 ? 0 : static_cast<std::uint64_t>(value);
+			m_counts[BucketIndex(v)]++;
+			m_count++;
+			if (v > m_max)
+				m_max = v;
+		}
+
+		/**
+		 * 分位点(0.0 - 1.0)。記録が無ければ 0
+		 * 該当するバケットの上端を返すが、最大値は超えない
+		 */
+		std::int64_t Percentile(double p) const
+		{
+			if (m_count == 0)
+				return 0;
+			std::uint64_t rank = static_cast<std::uint64_t>(p * m_count + 0.5);
+			if (rank < 1)
+				rank = 1;
+			std::uint64_t seen = 0;
+			for (std::size_t i = 0; i < BUCKET_COUNT; i++) {
+				seen += m_counts[i];
+				if (seen >= rank) {
+					const std::uint64_t upper = BucketUpper(i);
+					return static_cast<std::int64_t>(upper < m_max ? upper : m_max);
+				}
+			}
+			return static_cast<std::int64_t>(m_max);
+		}
+
+		std::int64_t Max() const { return static_cast<std::int64_t>(m_max); }
+		std::uint64_t Count() const { return m_count; }
+
+	private:
+		std::array<std::uint32_t, BUCKET_COUNT> m_counts{};
+		std::uint64_t m_count = 0;
+		std::uint64_t m_max = 0;
+
+		static int Log2(std::uint64_t v)
+		{
+			int n = 0;
+			while (v >>= 1)
+				n++;
+			return n;
+		}
+
+		static std::size_t BucketIndex(std::uint64_t v)
+		{
+			if (v < SUB_BUCKET_COUNT)
+				return static_cast<std::size_t>(v);
+			const int shift = Log2(v) - SUB_BUCKET_BITS;
+			const std::size_t sub = static_cast<std::size_t>(v >> shift) & (SUB_BUCKET_COUNT - 1);
+			return static_cast<std::size_t>(shift + 1) * SUB_BUCKET_COUNT + sub;
+		}
+
+		static std::uint64_t BucketUpper(std::size_t i)
+		{
+			if (i < SUB_BUCKET_COUNT)
+				return i;
+			const int shift = static_cast<int>(i / SUB_BUCKET_COUNT) - 1;
+			const std::uint64_t lower = static_cast<std::uint64_t>(SUB_BUCKET_COUNT + i % SUB_BUCKET_COUNT) << shift;
+			return lower + ((std::uint64_t(1) << shift) - 1);
+		}
+	};
+}
@@ -0,0 +1,52 @@
+#include "Benchmark.h"
+#include <memory>
+#include "Catalog.h"
+#include "HostRange.h"
+#include "Model.h"
+
+namespace ChannelTimer {
+	void CBenchmark::RunHost(/* const */ TVTest::CTVTestApp* pApp, const std::wstring& driverName)
+	{
+		const int calls = 100;
+		const std::vector<std::wstring> spaces = GetTuningSpaces(pApp, driverName);
+		if (spaces.empty())
+			return;
+		Run(L"Model.GetTuningSpaces", calls,
+			[]() { return 0; },
+			[&](int) {
+				for (int i = 0; i < calls; i++)
+					Consume(GetTuningSpaces(pApp, driverName).size());
+			});
+
+		std::size_t channelCount = 0;
+		for (int i = 0; i < static_cast<int>(spaces.size()); i++)
+			channelCount += GetChannels(pApp, driverName, i).size();
+		Run(L"Model.GetChannels", channelCount,
+			[]() { return 0; },
+			[&](int) {
+				for (int i = 0; i < static_cast<int>(spaces.size()); i++)
+					Consume(GetChannels(pApp, driverName, i).size());
+			});
+		Run(L"HostRange.Channels", channelCount,
+			[]() { return 0; },
+			[&](int) {
+				const CDriverTuningSpaces tuningSpaces(pApp, driverName.c_str());
+				for (int i = 0; i < tuningSpaces.Size(); i++) {
+					for (const CDriverTuningSpaces::ChannelRange::Item channel : tuningSpaces.Channels(i))
+						Consume(channel.info.ServiceID);
+				}
+			});
+
+		// 先読みで UI スレッドに残るのは写す方だけ
+		Run(L"Catalog.CopyDriverTuningSpaces", channelCount,
+			[]() { return std::unique_ptr<CDriverTuningSpaceCopy>(new CDriverTuningSpaceCopy); },
+			[&](std::unique_ptr<CDriverTuningSpaceCopy>& copy) {
+				Consume(CopyDriverTuningSpaces(pApp, driverName, copy.get()));
+			});
+		CDriverTuningSpaceCopy copy;
+		CopyDriverTuningSpaces(pApp, driverName, &copy);
+		Run(L"Catalog.BuildDriverChannels", channelCount,
+			[]() { return 0; },
+			[&](int) { Consume(BuildDriverChannels(copy)->services.Size()); });
+	}
+}
@@ -0,0 +1,257 @@
+#pragma once
+#include <cstddef>
+#include <windows.h>
+#include "TVTestPlugin.h"
+
+namespace ChannelTimer {
+	/**
+	 * ホストのチューナーを順に辿る(EnumDriver)
+	 * 名前はイテレータの持つバッファを指すので、次に進めるまでしか使えない
+	 */
+	class CDriverRange {
+	public:
+		struct Item {
+			int index;
+			LPCWSTR pszName;
+		};
+
+		class Iterator {
+		public:
+			Iterator(/* const */ TVTest::CTVTestApp* pApp, int index)
+				: m_pApp(pApp)
+				, m_index(index)
+			{
+				Load();
+			}
+
+			Item operator*() const { return Item{ m_index, m_szName }; }
+			Iterator& operator++() { m_index++; Load(); return *this; }
+			bool operator!=(const Iterator& rhs) const { return m_index != rhs.m_index; }
+
+		private:
+			/* const */ TVTest::CTVTestApp* m_pApp;
+			int m_index;
+			WCHAR m_szName[MAX_PATH];
+
+			void Load() {
+				if (m_index >= 0 && m_pApp->EnumDriver(m_index, m_szName, _countof(m_szName)) <= 0)
+					m_index = -1;
+			}
+		};
+
+		explicit CDriverRange(/* const */ TVTest::CTVTestApp* pApp)
+			: m_pApp(pApp)
+		{}
+
+		Iterator begin() const { return Iterator(m_pApp, 0); }
+		Iterator end() const { return Iterator(m_pApp, -1); }
+
+	private:
+		/* const */ TVTest::CTVTestApp* m_pApp;
+	};
+
+	/**
+	 * 現在のチューナーのチューニング空間を順に辿る(GetTuningSpaceName)
+	 * 名前はイテレータの持つバッファを指すので、次に進めるまでしか使えない
+	 */
+	class CTuningSpaceRange {
+	public:
+		struct Item {
+			int index;
+			LPCWSTR pszName;
+		};
+
+		class Iterator {
+		public:
+			Iterator(/* const */ TVTest::CTVTestApp* pApp, int index, int count)
+				: m_pApp(pApp)
+				, m_index(index)
+				, m_count(count)
+			{
+				Load();
+			}
+
+			Item operator*() const { return Item{ m_index, m_szName }; }
+			Iterator& operator++() { m_index++; Load(); return *this; }
+			bool operator!=(const Iterator& rhs) const { return m_index != rhs.m_index; }
+
+		private:
+			/* const */ TVTest::CTVTestApp* m_pApp;
+			int m_index;
+			int m_count;
+			WCHAR m_szName[MAX_PATH];
+
+			void Load() {
+				m_szName[0] = L'\0';
+				if (m_index < m_count)
+					m_pApp->GetTuningSpaceName(m_index, m_szName, _countof(m_szName));
+			}
+		};
+
+		explicit CTuningSpaceRange(/* const */ TVTest::CTVTestApp* pApp)
+			: m_pApp(pApp)
+		{
+			m_pApp->GetTuningSpace(&m_NumSpaces);
+			if (m_NumSpaces < 0)
+				m_NumSpaces = 0;
+		}
+
+		int Size() const { return m_NumSpaces; }
+		Iterator begin() const { return Iterator(m_pApp, 0, m_NumSpaces); }
+		Iterator end() const { return Iterator(m_pApp, m_NumSpaces, m_NumSpaces); }
+
+	private:
+		/* const */ TVTest::CTVTestApp* m_pApp;
+		int m_NumSpaces = 0;
+	};
+
+	/**
+	 * 現在のチューナーのチューニング空間のチャンネルを順に辿る(GetChannelInfo)
+	 * 無効なチャンネルは飛ばす。情報はイテレータが持つので、次に進めるまでしか使えない
+	 */
+	class CChannelRange {
+	public:
+		struct Item {
+			int index;
+			const TVTest::ChannelInfo& info;
+		};
+
+		class Iterator {
+		public:
+			Iterator(/* const */ TVTest::CTVTestApp* pApp, int space, int index)
+				: m_pApp(pApp)
+				, m_space(space)
+				, m_index(index)
+			{
+				Load();
+			}
+
+			Item operator*() const { return Item{ m_index, m_info }; }
+			Iterator& operator++() { m_index++; Load(); return *this; }
+			bool operator!=(const Iterator& rhs) const { return m_index != rhs.m_index; }
+
+		private:
+			/* const */ TVTest::CTVTestApp* m_pApp;
+			int m_space;
+			int m_index;
+			TVTest::ChannelInfo m_info;
+
+			void Load() {
+				for (; m_index >= 0; m_index++) {
+					if (!m_pApp->GetChannelInfo(m_space, m_index, &m_info)) {
+						m_index = -1;
+						break;
+					}
+					if (!(m_info.Flags & TVTest::CHANNEL_FLAG_DISABLED))
+						break;
+				}
+			}
+		};
+
+		CChannelRange(/* const */ TVTest::CTVTestApp* pApp, int space)
+			: m_pApp(pApp)
+			, m_space(space)
+		{}
+
+		Iterator begin() const { return Iterator(m_pApp, m_space, 0); }
+		Iterator end() const { return Iterator(m_pApp, m_space, -1); }
+
+	private:
+		/* const */ TVTest::CTVTestApp* m_pApp;
+		int m_space;
+	};
+
+	/**
+	 * チューナー名指定のチューニング空間とチャンネルの一覧(DriverTuningSpaceList)
+	 * ホストの作った一覧をそのまま辿り、捨てる時に解放する
+	 */
+	class CDriverTuningSpaces {
+	public:
+		/**
+		 * チューニング空間のチャンネルを順に辿る
+		 * 無効なチャンネルは飛ばす
+		 */
+		class ChannelRange {
+		public:
+			struct Item {
+				int index;
+				const TVTest::ChannelInfo& info;
+			};
+
+			class Iterator {
+			public:
+				Iterator(const TVTest::DriverTuningSpaceInfo* pSpace, int index)
+					: m_pSpace(pSpace)
+					, m_index(index)
+				{
+					Skip();
+				}
+
+				Item operator*() const { return Item{ m_index, *m_pSpace->ChannelList[m_index] }; }
+				Iterator& operator++() { m_index++; Skip(); return *this; }
+				bool operator!=(const Iterator& rhs) const { return m_index != rhs.m_index; }
+
+			private:
+				const TVTest::DriverTuningSpaceInfo* m_pSpace;
+				int m_index;
+
+				void Skip() {
+					while (m_pSpace != nullptr && m_index < static_cast<int>(m_pSpace->NumChannels)
+							&& (m_pSpace->ChannelList[m_index]->Flags & TVTest::CHANNEL_FLAG_DISABLED))
+						m_index++;
+				}
+			};
+
+			explicit ChannelRange(const TVTest::DriverTuningSpaceInfo* pSpace)
+				: m_pSpace(pSpace)
+			{}
+
+			Iterator begin() const { return Iterator(m_pSpace, 0); }
+			Iterator end() const { return Iterator(nullptr, m_pSpace != nullptr ? static_cast<int>(m_pSpace->NumChannels) : 0); }
+
+		private:
+			const TVTest::DriverTuningSpaceInfo* m_pSpace;
+		};
+
+		CDriverTuningSpaces(/* const */ TVTest::CTVTestApp* pApp, LPCWSTR pszDriverName)
+			: m_pApp(pApp)
+		{
+			m_list.Flags = 0;
+			m_list.NumSpaces = 0;
+			m_list.SpaceList = nullptr;
+			m_fLoaded = m_pApp->GetDriverTuningSpaceList(pszDriverName, &m_list);
+			if (!m_fLoaded)
+				m_list.NumSpaces = 0;
+		}
+
+		~CDriverTuningSpaces()
+		{
+			if (m_fLoaded)
+				m_pApp->FreeDriverTuningSpaceList(&m_list);
+		}
+
+		CDriverTuningSpaces(const CDriverTuningSpaces&) = delete;
+		CDriverTuningSpaces& operator=(const CDriverTuningSpaces&) = delete;
+
+		/**
+		 * 取得できたか
+		 */
+		bool IsLoaded() const { return m_fLoaded; }
+
+		int Size() const { return static_cast<int>(m_list.NumSpaces); }
+		LPCWSTR GetName(int space) const { return m_list.SpaceList[space]->pInfo->szName; }
+		DWORD GetChannelCount(int space) const { return m_list.SpaceList[space]->NumChannels; }
+
+		/**
+		 * チューニング空間のチャンネル。範囲外なら空
+		 */
+		ChannelRange Channels(int space) const {
+			return ChannelRange(space >= 0 && space < Size() ? m_list.SpaceList[space] : nullptr);
+		}
+
+	private:
+		/* const */ TVTest::CTVTestApp* m_pApp;
+		TVTest::DriverTuningSpaceList m_list;
+		bool m_fLoaded;
+	};
+}
@@ -0,0 +1,297 @@
+#include "Journal.h"
+#include <cstring>
+
+namespace ChannelTimer {
+	constexpr std::uint8_t CJournalCodec::MAGIC[4];
+
+	namespace {
+		// 8 バイトずつ処理する(slicing-by-8)ための CRC-32 のテーブル
+		class CCrc32Table {
+		public:
+			std::uint32_t table[8][256];
+
+			CCrc32Table()
+			{
+				for (std::uint32_t i = 0; i < 256; i++) {
+					std::uint32_t c = i;
+					for (int k = 0; k < 8; k++)
+						c = (c & 1) ? 0xEDB88320U ^ (c >> 1) : c >> 1;
+					table[0][i] = c;
+				}
+				for (std::uint32_t i = 0; i < 256; i++) {
+					for (int t = 1; t < 8; t++)
+						table[t][i] = (table[t - 1][i] >> 8) ^ table[0][table[t - 1][i] & 0xFF];
+				}
+			}
+		};
+
+		// ペイロードを書き込む
+		class CWriter {
+		public:
+			explicit CWriter(std::vector<std::uint8_t>* pBuffer)
+				: m_pBuffer(pBuffer)
+				, m_start(pBuffer->size())
+			{
+				m_pBuffer->resize(m_start + CJournalCodec::RECORD_HEADER_SIZE);
+			}
+
+			void U8(std::uint8_t v) { m_pBuffer->push_back(v); }
+			void U16(std::uint16_t v) { Unsigned(v, 2); }
+			void U32(std::uint32_t v) { Unsigned(v, 4); }
+			void I32(std::int32_t v) { Unsigned(static_cast<std::uint32_t>(v), 4); }
+			void I64(std::int64_t v) { Unsigned(static_cast<std::uint64_t>(v), 8); }
+
+			// 長さと CRC を埋める
+			void Finish()
+			{
+				const std::size_t payload = m_start + CJournalCodec::RECORD_HEADER_SIZE;
+				const std::uint32_t length = static_cast<std::uint32_t>(m_pBuffer->size() - payload);
+				const std::uint32_t crc = CJournalCodec::Crc32(m_pBuffer->data() + payload, length);
+				for (int i = 0; i < 4; i++) {
+					(*m_pBuffer)[m_start + i] = static_cast<std::uint8_t>(length >> (i * 8));
+					(*m_pBuffer)[m_start + 4 + i] = static_cast<std::uint8_t>(crc >> (i * 8));
+				}
+			}
+
+		private:
+			std::vector<std::uint8_t>* m_pBuffer;
+			std::size_t m_start;
+
+			void Unsigned(std::uint64_t v, int bytes)
+			{
+				for (int i = 0; i < bytes; i++)
+					m_pBuffer->push_back(static_cast<std::uint8_t>(v >> (i * 8)));
+			}
+		};
+
+		// ペイロードを読む。足りなければ以降の値は 0 で、Ok() が false になる
+		class CReader {
+		public:
+			CReader(const std::uint8_t* pData, std::size_t size)
+				: m_p(pData)
+				, m_end(pData + size)
+			{}
+
+			std::uint8_t U8() { return static_cast<std::uint8_t>(Unsigned(1)); }
+			std::uint16_t U16() { return static_cast<std::uint16_t>(Unsigned(2)); }
+			std::uint32_t U32() { return static_cast<std::uint32_t>(Unsigned(4)); }
+			std::int32_t I32() { return static_cast<std::int32_t>(static_cast<std::uint32_t>(Unsigned(4))); }
+			std::int64_t I64() { return static_cast<std::int64_t>(Unsigned(8)); }
+			bool Ok() const { return m_fOk; }
+			bool AtEnd() const { return m_p == m_end; }
+
+		private:
+			const std::uint8_t* m_p;
+			const std::uint8_t* m_end;
+			bool m_fOk = true;
+
+			std::uint64_t Unsigned(int bytes)
+			{
+				if (m_end - m_p < bytes) {
+					m_fOk = false;
+					m_p = m_end;
+					return 0;
+				}
+				std::uint64_t v = 0;
+				for (int i = 0; i < bytes; i++)
+					v |= static_cast<std::uint64_t>(m_p[i]) << (i * 8);
+				m_p += bytes;
+				return v;
+			}
+		};
+
+		std::uint32_t ReadU32(const std::uint8_t* p)
+		{
+			return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+		}
+	}
+
+	std::uint32_t CJournalCodec::Crc32(const std::uint8_t* pData, std::size_t size)
+	{
+		static const CCrc32Table crcTable;
+		const auto& t = crcTable.table;
+		std::uint32_t c = 0xFFFFFFFFU;
+		std::size_t i = 0;
+		for (; i + 8 <= size; i += 8) {
+			const std::uint32_t lo = c ^ ReadU32(pData + i);
+			const std::uint32_t hi = ReadU32(pData + i + 4);
+			c = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24]
+				^ t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+		}
+		for (; i < size; i++)
+			c = t[0][(c ^ pData[i]) & 0xFF] ^ (c >> 8);
+		return c ^ 0xFFFFFFFFU;
+	}
+
+	void CJournalCodec::AppendHeader(std::vector<std::uint8_t>* pBuffer)
+	{
+		pBuffer->insert(pBuffer->end(), MAGIC, MAGIC + HEADER_SIZE);
+	}
+
+	void CJournalCodec::AppendAdd(std::vector<std::uint8_t>* pBuffer, const Timer& timer)
+	{
+		CWriter writer(pBuffer);
+		writer.U8(static_cast<std::uint8_t>(RecordType::ADD));
+		writer.U32(timer.serial);
+		writer.U8(static_cast<std::uint8_t>(timer.condition));
+		writer.I64(timer.addedTime);
+		writer.I64(timer.dateToChange);
+		writer.U32(timer.durationToChange);
+		writer.I64(timer.leadTime);
+		writer.I32(timer.space);
+		writer.I32(timer.channel);
+		writer.U16(timer.networkID);
+		writer.U16(timer.transportStreamID);
+		writer.U16(timer.serviceID);
+		writer.U16(static_cast<std::uint16_t>(timer.tuner.size()));
+		for (const wchar_t c : timer.tuner)
+			writer.U16(static_cast<std::uint16_t>(c));
+		// 後から加えた項目は末尾に置く
+		writer.U8(timer.broadcastTime ? 1 : 0);
+		writer.U8(static_cast<std::uint8_t>(timer.recurrence.rule));
+		writer.U8(timer.recurrence.weekdays);
+		writer.I64(timer.recurrence.localOffset);
+		writer.U16(static_cast<std::uint16_t>(timer.recurrence.exceptions.size()));
+		for (const std::int32_t day : timer.recurrence.exceptions)
+			writer.I32(day);
+		writer.U16(timer.programEventID);
+		writer.U16(timer.eventServiceID);
+		writer.U16(timer.eventID);
+		writer.I64(timer.eventEndTime);
+		writer.Finish();
+	}
+
+	void CJournalCodec::AppendRemove(std::vector<std::uint8_t>* pBuffer, std::uint32_t serial)
+	{
+		CWriter writer(pBuffer);
+		writer.U8(static_cast<std::uint8_t>(RecordType::REMOVE));
+		writer.U32(serial);
+		writer.Finish();
+	}
+
+	void CJournalCodec::AppendClear(std::vector<std::uint8_t>* pBuffer)
+	{
+		CWriter writer(pBuffer);
+		writer.U8(static_cast<std::uint8_t>(RecordType::CLEAR));
+		writer.Finish();
+	}
+
+	void CJournalCodec::AppendEvent(std::vector<std::uint8_t>* pBuffer, const Timer& timer)
+	{
+		CWriter writer(pBuffer);
+		writer.U8(static_cast<std::uint8_t>(RecordType::EVENT));
+		writer.U32(timer.serial);
+		writer.U16(timer.eventServiceID);
+		writer.U16(timer.eventID);
+		writer.I64(timer.eventEndTime);
+		writer.Finish();
+	}
+
+	CJournalCodec::ReplayResult CJournalCodec::Replay(const std::uint8_t* pData, std::size_t size)
+	{
+		ReplayResult result;
+		if (size < HEADER_SIZE || std::memcmp(pData, MAGIC, HEADER_SIZE) != 0)
+			return result;
+
+		std::size_t pos = HEADER_SIZE;
+		result.validSize = pos;
+
+		while (size - pos >= RECORD_HEADER_SIZE) {
+			const std::uint32_t length = ReadU32(pData + pos);
+			const std::uint32_t crc = ReadU32(pData + pos + 4);
+			const std::uint8_t* pPayload = pData + pos + RECORD_HEADER_SIZE;
+			if (length == 0 || length > size - pos - RECORD_HEADER_SIZE || Crc32(pPayload, length) != crc)
+				break;
+
+			CReader reader(pPayload, length);
+			switch (static_cast<RecordType>(reader.U8())) {
+			case RecordType::ADD:
+				{
+					Timer timer;
+					timer.serial = reader.U32();
+					timer.condition = static_cast<Timer::SleepCondition>(reader.U8());
+					timer.addedTime = reader.I64();
+					timer.dateToChange = reader.I64();
+					timer.durationToChange = reader.U32();
+					timer.leadTime = reader.I64();
+					timer.space = reader.I32();
+					timer.channel = reader.I32();
+					timer.networkID = reader.U16();
+					timer.transportStreamID = reader.U16();
+					timer.serviceID = reader.U16();
+					const std::uint16_t tunerLength = reader.U16();
+					timer.tuner.resize(tunerLength);
+					for (std::uint16_t i = 0; i < tunerLength; i++)
+						timer.tuner[i] = static_cast<wchar_t>(reader.U16());
+					// 古いレコードには無い
+					if (!reader.AtEnd())
+						timer.broadcastTime = reader.U8() != 0;
+					if (!reader.AtEnd()) {
+						timer.recurrence.rule = static_cast<Recurrence::Rule>(reader.U8());
+						timer.recurrence.weekdays = reader.U8();
+						timer.recurrence.localOffset = reader.I64();
+						const std::uint16_t exceptionCount = reader.U16();
+						timer.recurrence.exceptions.resize(exceptionCount);
+						for (std::uint16_t i = 0; i < exceptionCount; i++)
+							timer.recurrence.exceptions[i] = reader.I32();
+					}
+					if (!reader.AtEnd())
+						timer.programEventID = reader.U16();
+					if (!reader.AtEnd()) {
+						timer.eventServiceID = reader.U16();
+						timer.eventID = reader.U16();
+						timer.eventEndTime = reader.I64();
+					}
+					if (!reader.Ok())
+						return result;
+					if (timer.serial > result.maxSerial)
+						result.maxSerial = timer.serial;
+					// 通し番号は増えていくので、ほとんどは末尾に入る
+					const std::uint32_t serial = timer.serial;
+					result.timers.emplace_hint(result.timers.end(), serial, std::move(timer));
+				}
+				break;
+
+			case RecordType::REMOVE:
+				{
+					const std::uint32_t serial = reader.U32();
+					if (!reader.Ok())
+						return result;
+					result.timers.erase(serial);
+				}
+				break;
+
+			case RecordType::CLEAR:
+				result.timers.clear();
+				break;
+
+			case RecordType::EVENT:
+				{
+					const std::uint32_t serial = reader.U32();
+					const std::uint16_t serviceID = reader.U16();
+					const std::uint16_t eventID = reader.U16();
+					const std::int64_t endTime = reader.I64();
+					if (!reader.Ok())
+						return result;
+					const auto it = result.timers.find(serial);
+					if (it != result.timers.end()) {
+						it->second.eventServiceID = serviceID;
+						it->second.eventID = eventID;
+						it->second.eventEndTime = endTime;
+					}
+				}
+				break;
+
+			default:
+				// 知らない種類のレコードはここまでとする
+				return result;
+			}
+
+			pos += RECORD_HEADER_SIZE + length;
+			result.validSize = pos;
+			result.recordCount++;
+		}
+
+		return result;
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+#include "Timer.h"
+
+namespace ChannelTimer {
+	/**
+	 * 予約したタイマーの追記型ジャーナルの符号化
+	 *
+	 * ファイルは MAGIC の後にレコードが並ぶ。レコードは
+	 *   u32 ペイロード長, u32 ペイロードの CRC-32, ペイロード
+	 * で、数値はリトルエンディアン。ペイロードの先頭 1 バイトが種類
+	 * 書き込み途中で落ちた末尾のレコードは長さか CRC が合わないので読み飛ばす
+	 */
+	class CJournalCodec {
+	public:
+		static constexpr std::uint8_t MAGIC[4] = { 'C', 'T', 'J', '1' };
+		static constexpr std::size_t HEADER_SIZE = sizeof(MAGIC);
+		static constexpr std::size_t RECORD_HEADER_SIZE = 8;
+
+		enum class RecordType : std::uint8_t {
+			ADD = 1,	// タイマーの予約
+			REMOVE,		// タイマーの実行・取り消し
+			CLEAR,		// 全て取り消し
+			EVENT		// 番組終了待ちのタイマーの対象の番組
+		};
+
+		static void AppendHeader(std::vector<std::uint8_t>* pBuffer);
+		static void AppendAdd(std::vector<std::uint8_t>* pBuffer, const Timer& timer);
+		static void AppendRemove(std::vector<std::uint8_t>* pBuffer, std::uint32_t serial);
+		static void AppendClear(std::vector<std::uint8_t>* pBuffer);
+		static void AppendEvent(std::vector<std::uint8_t>* pBuffer, const Timer& timer);
+
+		/**
+		 * 読み込んだ結果
+		 */
+		struct ReplayResult {
+			std::map<std::uint32_t, Timer> timers;	// 残っているタイマー(通し番号順)
+			std::size_t validSize = 0;				// 正しく読めた末尾の位置。これ以降は切り捨てる
+			std::size_t recordCount = 0;			// 正しく読めたレコードの数
+			std::uint32_t maxSerial = 0;			// 使われた最大の通し番号
+		};
+
+		/**
+		 * ジャーナルを先頭から読む
+		 * ヘッダが無ければ validSize は 0
+		 */
+		static ReplayResult Replay(const std::uint8_t* pData, std::size_t size);
+
+		static std::uint32_t Crc32(const std::uint8_t* pData, std::size_t size);
+	};
+}
@@ -0,0 +1,150 @@
+#include "JournalFile.h"
+
+namespace ChannelTimer {
+	CScheduleJournal::~CScheduleJournal()
+	{
+		Close();
+	}
+
+	bool CScheduleJournal::Open(LPCWSTR pszFileName, CJournalCodec::ReplayResult* pResult)
+	{
+		Close();
+		m_fileName = pszFileName;
+		m_hFile = ::CreateFile(pszFileName, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+			OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (m_hFile == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER Size;
+		if (!::GetFileSizeEx(m_hFile, &Size) || Size.QuadPart > 64 * 1024 * 1024) {
+			Close();
+			return false;
+		}
+
+		std::vector<std::uint8_t> data(static_cast<std::size_t>(Size.QuadPart));
+		DWORD Read = 0;
+		if (!data.empty()
+				&& (!::ReadFile(m_hFile, data.data(), static_cast<DWORD>(data.size()), &Read, nullptr)
+					|| Read != data.size())) {
+			Close();
+			return false;
+		}
+
+		*pResult = CJournalCodec::Replay(data.data(), data.size());
+		m_recordCount = pResult->recordCount;
+
+		if (pResult->validSize == 0) {
+			// 新しいファイルか、ジャーナルではないので作り直す
+			m_buffer.clear();
+			CJournalCodec::AppendHeader(&m_buffer);
+			LARGE_INTEGER Zero = {};
+			if (!::SetFilePointerEx(m_hFile, Zero, nullptr, FILE_BEGIN)
+					|| !::SetEndOfFile(m_hFile)
+					|| !WriteAll(m_hFile, m_buffer)) {
+				Close();
+				return false;
+			}
+			return true;
+		}
+
+		// 書き込み途中のレコードを切り捨てて、その後ろに追記する
+		LARGE_INTEGER Valid;
+		Valid.QuadPart = static_cast<LONGLONG>(pResult->validSize);
+		if (!::SetFilePointerEx(m_hFile, Valid, nullptr, FILE_BEGIN)
+				|| (pResult->validSize != data.size() && !::SetEndOfFile(m_hFile))) {
+			Close();
+			return false;
+		}
+		return true;
+	}
+
+	void CScheduleJournal::Close()
+	{
+		if (m_hFile != INVALID_HANDLE_VALUE) {
+			::CloseHandle(m_hFile);
+			m_hFile = INVALID_HANDLE_VALUE;
+		}
+	}
+
+	bool CScheduleJournal::AppendAdd(const Timer& timer)
+	{
+		m_buffer.clear();
+		CJournalCodec::AppendAdd(&m_buffer, timer);
+		return Append();
+	}
+
+	bool CScheduleJournal::AppendRemove(std::uint32_t serial)
+	{
+		m_buffer.clear();
+		CJournalCodec::AppendRemove(&m_buffer, serial);
+		return Append();
+	}
+
+	bool CScheduleJournal::AppendClear()
+	{
+		m_buffer.clear();
+		CJournalCodec::AppendClear(&m_buffer);
+		return Append();
+	}
+
+	bool CScheduleJournal::AppendEvent(const Timer& timer)
+	{
+		m_buffer.clear();
+		CJournalCodec::AppendEvent(&m_buffer, timer);
+		return Append();
+	}
+
+	bool CScheduleJournal::NeedsCompaction(std::size_t liveCount) const
+	{
+		return m_recordCount > liveCount + COMPACT_MIN_GARBAGE;
+	}
+
+	bool CScheduleJournal::Compact(const std::vector<Timer>& timers)
+	{
+		if (m_fileName.empty())
+			return false;
+
+		m_buffer.clear();
+		CJournalCodec::AppendHeader(&m_buffer);
+		for (const Timer& timer : timers)
+			CJournalCodec::AppendAdd(&m_buffer, timer);
+
+		// 一時ファイルに書いてから置き換え、途中で落ちても元のファイルが残るようにする
+		const std::wstring tempName = m_fileName + L".tmp";
+		HANDLE hTemp = ::CreateFile(tempName.c_str(), GENERIC_WRITE, 0, nullptr,
+			CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (hTemp == INVALID_HANDLE_VALUE)
+			return false;
+		const bool fWritten = WriteAll(hTemp, m_buffer) && ::FlushFileBuffers(hTemp);
+		::CloseHandle(hTemp);
+		if (!fWritten) {
+			::DeleteFile(tempName.c_str());
+			return false;
+		}
+
+		Close();
+		if (!::MoveFileEx(tempName.c_str(), m_fileName.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+			::DeleteFile(tempName.c_str());
+		}
+
+		CJournalCodec::ReplayResult result;
+		return Open(m_fileName.c_str(), &result);
+	}
+
+	bool CScheduleJournal::Append()
+	{
+		if (m_hFile == INVALID_HANDLE_VALUE)
+			return false;
+		if (!WriteAll(m_hFile, m_buffer))
+			return false;
+		m_recordCount++;
+		return true;
+	}
+
+	bool CScheduleJournal::WriteAll(HANDLE hFile, const std::vector<std::uint8_t>& data)
+	{
+		DWORD Written = 0;
+		return ::WriteFile(hFile, data.data(), static_cast<DWORD>(data.size()), &Written, nullptr)
+			&& Written == data.size();
+	}
+}
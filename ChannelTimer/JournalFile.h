@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <windows.h>
+#include "Journal.h"
+
+namespace ChannelTimer {
+	/**
+	 * 予約したタイマーのジャーナルファイル
+	 * 変更のたびにレコードを追記し、不要なレコードが増えたら残っているタイマーだけで書き直す
+	 */
+	class CScheduleJournal {
+	public:
+		// 書き直すまでに許す、残っているタイマーより多いレコードの数
+		static const std::size_t COMPACT_MIN_GARBAGE = 64;
+
+		~CScheduleJournal();
+
+		/**
+		 * ファイルを開いて読み込む
+		 * 末尾の壊れたレコードは切り捨てる
+		 */
+		bool Open(LPCWSTR pszFileName, CJournalCodec::ReplayResult* pResult);
+		void Close();
+
+		bool AppendAdd(const Timer& timer);
+		bool AppendRemove(std::uint32_t serial);
+		bool AppendClear();
+		bool AppendEvent(const Timer& timer);
+
+		/**
+		 * 書き直した方がよいか
+		 */
+		bool NeedsCompaction(std::size_t liveCount) const;
+
+		/**
+		 * 残っているタイマーだけで書き直す
+		 */
+		bool Compact(const std::vector<Timer>& timers);
+
+	private:
+		HANDLE m_hFile = INVALID_HANDLE_VALUE;
+		std::wstring m_fileName;
+		std::size_t m_recordCount = 0;
+		std::vector<std::uint8_t> m_buffer;
+
+		bool Append();
+		static bool WriteAll(HANDLE hFile, const std::vector<std::uint8_t>& data);
+	};
+}
@@ -0,0 +1,87 @@
+#include "LeadTime.h"
+#include <algorithm>
+#include <cwchar>
+
+namespace ChannelTimer {
+	void CLeadTimeEstimator::Window::Add(TimeValue latency)
+	{
+		samples[next] = latency;
+		next = (next + 1) % WINDOW_SIZE;
+		if (count < WINDOW_SIZE)
+			count++;
+	}
+
+	void CLeadTimeEstimator::AddSample(const std::wstring& tuner, int space, TimeValue latency)
+	{
+		if (latency < 0)
+			return;
+		m_windows[Key(tuner, space)].Add(latency);
+	}
+
+	TimeValue CLeadTimeEstimator::Estimate(const std::wstring& tuner, int space, TimeValue defaultLeadTime) const
+	{
+		const auto it = m_windows.find(Key(tuner, space));
+		if (it == m_windows.end() || it->second.count == 0)
+			return defaultLeadTime;
+
+		const Window& window = it->second;
+		TimeValue sorted[WINDOW_SIZE];
+		std::copy(window.samples, window.samples + window.count, sorted);
+		std::sort(sorted, sorted + window.count);
+		std::size_t rank = static_cast<std::size_t>(PERCENTILE * window.count + 0.5);
+		if (rank < 1)
+			rank = 1;
+		const TimeValue lead = sorted[rank - 1] + MARGIN;
+		return lead < MIN_LEAD_TIME ? MIN_LEAD_TIME : lead > MAX_LEAD_TIME ? MAX_LEAD_TIME : lead;
+	}
+
+	std::wstring CLeadTimeEstimator::FormatKey(const std::wstring& tuner, int space) const
+	{
+		return tuner + L":" + std::to_wstring(space);
+	}
+
+	std::wstring CLeadTimeEstimator::FormatValue(const std::wstring& tuner, int space) const
+	{
+		std::wstring value;
+		const auto it = m_windows.find(Key(tuner, space));
+		if (it == m_windows.end())
+			return value;
+
+		const Window& window = it->second;
+		const std::size_t first = window.count < WINDOW_SIZE ? 0 : window.next;
+		for (std::size_t i = 0; i < window.count; i++) {
+			if (i > 0)
+				value += L',';
+			value += std::to_wstring(window.samples[(first + i) % WINDOW_SIZE] / FILETIME_MS);
+		}
+		return value;
+	}
+
+	bool CLeadTimeEstimator::Parse(const std::wstring& key, const std::wstring& value)
+	{
+		// チューナー名にパスが含まれることがあるので、最後の ':' で区切る
+		const std::size_t sep = key.rfind(L':');
+		if (sep == std::wstring::npos || sep == 0)
+			return false;
+		wchar_t* pEnd;
+		const long space = std::wcstol(key.c_str() + sep + 1, &pEnd, 10);
+		if (*pEnd != L'\0' || pEnd == key.c_str() + sep + 1)
+			return false;
+
+		Window window;
+		const wchar_t* p = value.c_str();
+		while (*p != L'\0') {
+			const long long ms = std::wcstoll(p, &pEnd, 10);
+			if (pEnd == p || ms < 0)
+				return false;
+			window.Add(ms * FILETIME_MS);
+			p = pEnd;
+			if (*p == L',')
+				p++;
+		}
+		if (window.count == 0)
+			return false;
+		m_windows[Key(key.substr(0, sep), static_cast<int>(space))] = window;
+		return true;
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Clock.h"
+
+namespace ChannelTimer {
+	/**
+	 * チューナーとチューニング空間ごとの切り替え時間から、切り替えを早める時間を見積もる
+	 * 直近 WINDOW_SIZE 回の SelectChannel から EVENT_CHANNELCHANGE までの時間の PERCENTILE 分位点に余裕を足す
+	 */
+	class CLeadTimeEstimator {
+	public:
+		static constexpr std::size_t WINDOW_SIZE = 16;
+		static constexpr double PERCENTILE = 0.9;
+		static constexpr TimeValue MARGIN = 500LL * FILETIME_MS;
+		static constexpr TimeValue MIN_LEAD_TIME = 1LL * FILETIME_SEC;
+		static constexpr TimeValue MAX_LEAD_TIME = 60LL * FILETIME_SEC;
+
+		/**
+		 * 切り替えにかかった時間を記録する
+		 */
+		void AddSample(const std::wstring& tuner, int space, TimeValue latency);
+
+		/**
+		 * 切り替えを早める時間
+		 * 計測値が無ければ defaultLeadTime
+		 */
+		TimeValue Estimate(const std::wstring& tuner, int space, TimeValue defaultLeadTime) const;
+
+		/**
+		 * 保存用の名前と値(計測値を ms 単位でカンマ区切り、古い順)
+		 */
+		std::wstring FormatKey(const std::wstring& tuner, int space) const;
+		std::wstring FormatValue(const std::wstring& tuner, int space) const;
+
+		/**
+		 * 保存した名前と値を読み込む。読めなければ false
+		 */
+		bool Parse(const std::wstring& key, const std::wstring& value);
+
+	private:
+		using Key = std::pair<std::wstring, int>;
+
+		// 古い計測値から上書きするリングバッファ
+		struct Window {
+			TimeValue samples[WINDOW_SIZE] = {};
+			std::size_t count = 0;
+			std::size_t next = 0;
+
+			void Add(TimeValue latency);
+		};
+
+		std::map<Key, Window> m_windows;
+	};
+}
@@ -0,0 +1,103 @@
+#include "Metrics.h"
+#include <cwchar>
+
+namespace ChannelTimer {
+	void CSwitchMetrics::RecordFire(const std::wstring& tuner, std::int64_t delay)
+	{
+		m_stats[tuner].fireDelay.Record(delay);
+	}
+
+	void CSwitchMetrics::RecordQuery(const std::wstring& tuner, std::int64_t delay)
+	{
+		m_stats[tuner].queryDelay.Record(delay);
+	}
+
+	void CSwitchMetrics::RecordStage(const std::wstring& tuner, SwitchStage stage, std::int64_t time)
+	{
+		m_stats[tuner].stageTime[static_cast<int>(stage)].Record(time);
+	}
+
+	void CSwitchMetrics::RecordServiceDelay(const std::wstring& tuner, std::int64_t delay)
+	{
+		m_stats[tuner].serviceDelay.Record(delay);
+	}
+
+	void CSwitchMetrics::BeginSelect(const std::wstring& tuner, int space, std::int64_t now)
+	{
+		m_pending.tuner = tuner;
+		m_pending.space = space;
+		m_pending.start = now;
+		m_pending.fSelecting = true;
+		m_pending.fWaiting = true;
+	}
+
+	void CSwitchMetrics::EndSelect(std::int64_t now)
+	{
+		if (!m_pending.fSelecting)
+			return;
+		m_stats[m_pending.tuner].selectTime.Record(now - m_pending.start);
+		m_pending.fSelecting = false;
+	}
+
+	bool CSwitchMetrics::OnChannelChange(std::int64_t now, CSwitchSample* pSample)
+	{
+		// SelectChannel の中でイベントが送られることもあるので、呼び出し時点から測る
+		if (!m_pending.fWaiting)
+			return false;
+		const std::int64_t latency = now - m_pending.start;
+		m_stats[m_pending.tuner].switchTime.Record(latency);
+		m_pending.fWaiting = false;
+		pSample->tuner = m_pending.tuner;
+		pSample->space = m_pending.space;
+		pSample->latency = latency;
+		return true;
+	}
+
+	const CSwitchStats* CSwitchMetrics::Get(const std::wstring& tuner) const
+	{
+		const auto it = m_stats.find(tuner);
+		return it != m_stats.end() ? &it->second : nullptr;
+	}
+
+	static std::wstring FormatHistogram(const wchar_t* pszName, const CLatencyHistogram& histogram)
+	{
+		wchar_t szText[128];
+		std::swprintf(szText, sizeof(szText) / sizeof(szText[0]),
+			L"  %ls: n=%llu p50=%.1fms p99=%.1fms max=%.1fms",
+			pszName,
+			static_cast<unsigned long long>(histogram.Count()),
+			histogram.Percentile(0.50) / 1000.0,
+			histogram.Percentile(0.99) / 1000.0,
+			histogram.Max() / 1000.0);
+		return szText;
+	}
+
+	std::vector<std::wstring> CSwitchMetrics::FormatReport() const
+	{
+		std::vector<std::wstring> lines;
+		if (m_stats.empty()) {
+			lines.push_back(L"計測値はまだありません。");
+			return lines;
+		}
+		for (const auto& entry : m_stats) {
+			const CSwitchStats& stats = entry.second;
+			lines.push_back(entry.first.empty() ? L"(チューナー不明)" : entry.first);
+			if (stats.fireDelay.Count() > 0)
+				lines.push_back(FormatHistogram(L"タイマーの遅れ", stats.fireDelay));
+			if (stats.queryDelay.Count() > 0)
+				lines.push_back(FormatHistogram(L"番組確認の遅れ", stats.queryDelay));
+			if (stats.selectTime.Count() > 0)
+				lines.push_back(FormatHistogram(L"SelectChannel", stats.selectTime));
+			if (stats.switchTime.Count() > 0)
+				lines.push_back(FormatHistogram(L"切り替え完了まで", stats.switchTime));
+			static const wchar_t* const STAGE_NAMES[] = { L"チューナーの読み込み", L"選局", L"サービスの選択" };
+			for (int i = 0; i < static_cast<int>(SwitchStage::STAGE_COUNT); i++) {
+				if (stats.stageTime[i].Count() > 0)
+					lines.push_back(FormatHistogram(STAGE_NAMES[i], stats.stageTime[i]));
+			}
+			if (stats.serviceDelay.Count() > 0)
+				lines.push_back(FormatHistogram(L"サービス選択の遅れ", stats.serviceDelay));
+		}
+		return lines;
+	}
+}
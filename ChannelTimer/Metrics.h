@@ -0,0 +1,86 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "Histogram.h"
+
+namespace ChannelTimer {
+	/**
+	 * チューナーを変える時に分けて行う切り替えの段階
+	 */
+	enum class SwitchStage {
+		STAGE_DRIVER,	// チューナーの読み込み(SetDriverName)
+		STAGE_TUNE,		// チューニング空間とチャンネルの選局(SelectChannel)
+		STAGE_SERVICE,	// サービスの選択(SetService)
+		STAGE_COUNT
+	};
+
+	/**
+	 * チューナーごとのタイマーと切り替えの計測値(µs 単位)
+	 */
+	struct CSwitchStats {
+		CLatencyHistogram fireDelay;	// 期限から WM_TIMER が来るまで
+		CLatencyHistogram queryDelay;	// 番組確認の WM_TIMER の遅れ
+		CLatencyHistogram selectTime;	// SelectChannel の呼び出しから戻るまで
+		CLatencyHistogram switchTime;	// SelectChannel の呼び出しから EVENT_CHANNELCHANGE まで
+		CLatencyHistogram stageTime[static_cast<int>(SwitchStage::STAGE_COUNT)];	// 段階ごとの呼び出しから戻るまで
+		CLatencyHistogram serviceDelay;	// 切り替える日時からサービスを選ぶまでの遅れ
+	};
+
+	/**
+	 * 完了したチャンネル切り替え
+	 */
+	struct CSwitchSample {
+		std::wstring tuner;
+		int space;
+		std::int64_t latency;	// SelectChannel の呼び出しから EVENT_CHANNELCHANGE まで
+	};
+
+	/**
+	 * タイマーの発火とチャンネル切り替えの遅延の計測
+	 * 時刻は呼び出し側の単調な時計(µs 単位)で渡す
+	 */
+	class CSwitchMetrics {
+	public:
+		void RecordFire(const std::wstring& tuner, std::int64_t delay);
+		void RecordQuery(const std::wstring& tuner, std::int64_t delay);
+		void RecordStage(const std::wstring& tuner, SwitchStage stage, std::int64_t time);
+		void RecordServiceDelay(const std::wstring& tuner, std::int64_t delay);
+
+		/**
+		 * SelectChannel を呼ぶ直前に呼ぶ
+		 */
+		void BeginSelect(const std::wstring& tuner, int space, std::int64_t now);
+
+		/**
+		 * SelectChannel から戻った時に呼ぶ
+		 */
+		void EndSelect(std::int64_t now);
+
+		/**
+		 * EVENT_CHANNELCHANGE で呼ぶ
+		 * 切り替え中であれば pSample に結果を入れて true を返す
+		 */
+		bool OnChannelChange(std::int64_t now, CSwitchSample* pSample);
+
+		const CSwitchStats* Get(const std::wstring& tuner) const;
+
+		/**
+		 * ログに出力する内容(1 行ずつ)
+		 */
+		std::vector<std::wstring> FormatReport() const;
+
+	private:
+		struct PendingSwitch {
+			std::wstring tuner;
+			int space = -1;
+			std::int64_t start = 0;
+			bool fSelecting = false;	// SelectChannel から戻っていない
+			bool fWaiting = false;		// EVENT_CHANNELCHANGE を待っている
+		};
+
+		std::map<std::wstring, CSwitchStats> m_stats;	// チューナー名順に出力する
+		PendingSwitch m_pending;
+	};
+}
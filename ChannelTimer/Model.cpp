@@ -1,25 +1,16 @@
 #include "Model.h"
+#include "HostRange.h"
 
 namespace ChannelTimer {
-	std::wstring CServiceInfo::toString() const {
-		const std::wstring ws = L" ";
-		return std::to_wstring(ServiceID)
-			+ ws
-			+ std::to_wstring(NetworkID)
-			+ ws
-			+ channelName;
-	}
-
 	std::vector<std::wstring> GetDrivers(
 		/* const */ TVTest::CTVTestApp* pApp,
 		std::function<void(std::wstring name, int index)> func)
 	{
 		std::vector<std::wstring> drivers;
-		WCHAR driverName[MAX_PATH];
-		for (int i = 0; pApp->EnumDriver(i, driverName, _countof(driverName)); i++) {
-			drivers.push_back(driverName);
+		for (const CDriverRange::Item driver : CDriverRange(pApp)) {
+			drivers.push_back(driver.pszName);
 			if (func) {
-				func(driverName, i);
+				func(drivers.back(), driver.index);
 			}
 		}
 		return drivers;
@@ -29,16 +20,14 @@ namespace ChannelTimer {
 		/* const */ TVTest::CTVTestApp* pApp,
 		const std::function<void(const std::wstring& name, int index)> action)
 	{
-		int NumSpaces = 0;
-		const int _ = pApp->GetTuningSpace(&NumSpaces);
-		std::vector<std::wstring> spaces(NumSpaces);
+		const CTuningSpaceRange range(pApp);
+		std::vector<std::wstring> spaces;
+		spaces.reserve(range.Size());
 
-		for (int i = 0; i < NumSpaces; i++) {
-			WCHAR name[MAX_PATH];
-			pApp->GetTuningSpaceName(i, name, _countof(name));
-			spaces.push_back(name);
+		for (const CTuningSpaceRange::Item space : range) {
+			spaces.push_back(space.pszName);
 			if (action) {
-				action(name, i);
+				action(spaces.back(), space.index);
 			}
 		}
 		return spaces;
@@ -49,19 +38,16 @@ namespace ChannelTimer {
 		const std::wstring driverNameString,
 		const std::function<void(const std::wstring& name, int index)> action)
 	{
-		TVTest::DriverTuningSpaceList tuningList;
-		pApp->GetDriverTuningSpaceList(driverNameString.c_str(), &tuningList);
-		std::vector<std::wstring> spaces(tuningList.NumSpaces);
+		const CDriverTuningSpaces tuningSpaces(pApp, driverNameString.c_str());
+		std::vector<std::wstring> spaces;
+		spaces.reserve(tuningSpaces.Size());
 
-		for (int i = 0; i < tuningList.NumSpaces; i++) {
-			const WCHAR* name = tuningList.SpaceList[i]->pInfo->szName;
-			spaces.push_back(name);
+		for (int i = 0; i < tuningSpaces.Size(); i++) {
+			spaces.push_back(tuningSpaces.GetName(i));
 			if (action) {
-				action(name, i);
+				action(spaces.back(), i);
 			}
 		}
-		pApp->FreeDriverTuningSpaceList(&tuningList);
-
 		return spaces;
 	}
 
@@ -73,15 +59,10 @@ namespace ChannelTimer {
 		std::vector<CServiceInfo> channels;
 
 		// ݂̃`[jOԂ̃`l擾
-		TVTest::ChannelInfo ChInfo;
-		for (int Channel = 0; pApp->GetChannelInfo(curTuningSpace, Channel, &ChInfo); Channel++) {
-			if (ChInfo.Flags & TVTest::CHANNEL_FLAG_DISABLED)
-				continue;
-
-			const CServiceInfo pServiceInfo = CServiceInfo(ChInfo);
-			channels.push_back(pServiceInfo);
+		for (const CChannelRange::Item channel : CChannelRange(pApp, curTuningSpace)) {
+			channels.push_back(MakeServiceInfo(channel.info));
 			if (action) {
-				action(pServiceInfo, Channel);
+				action(channels.back(), channel.index);
 			}
 		}
 		return channels;
@@ -95,26 +76,16 @@ namespace ChannelTimer {
 	{
 		std::vector<CServiceInfo> channels;
 
-		TVTest::DriverTuningSpaceList tuningList;
-		pApp->GetDriverTuningSpaceList(driverNameString.c_str(), &tuningList);
-
 		// `l
-		if (tuningList.NumSpaces >= 0) {
-			const auto& spaceList = *tuningList.SpaceList[curTuningSpace];
-
-			for (int Channel = 0; Channel < spaceList.NumChannels; Channel++) {
-				const TVTest::ChannelInfo& ChInfo = *spaceList.ChannelList[Channel];
-				if (ChInfo.Flags & TVTest::CHANNEL_FLAG_DISABLED)
-					continue;
-
-				const CServiceInfo pServiceInfo = CServiceInfo(ChInfo);
-				channels.push_back(pServiceInfo);
-				if (action) {
-					action(pServiceInfo, Channel);
-				}
+		const CDriverTuningSpaces tuningSpaces(pApp, driverNameString.c_str());
+		if (curTuningSpace >= 0 && curTuningSpace < tuningSpaces.Size())
+			channels.reserve(tuningSpaces.GetChannelCount(curTuningSpace));
+		for (const CDriverTuningSpaces::ChannelRange::Item channel : tuningSpaces.Channels(curTuningSpace)) {
+			channels.push_back(MakeServiceInfo(channel.info));
+			if (action) {
+				action(channels.back(), channel.index);
 			}
 		}
-		pApp->FreeDriverTuningSpaceList(&tuningList);
 		return channels;
 	}
 }
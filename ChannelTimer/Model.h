@@ -4,27 +4,16 @@
 #include <vector>
 #include <windows.h>
 #include "TVTestPlugin.h"
+#include "Channels.h"
 
 namespace ChannelTimer {
-	struct CServiceInfo {
-		const WORD NetworkID;
-		const WORD ServiceID;
-		const int channel;
-		const std::wstring channelName;
-
-		CServiceInfo(const TVTest::ChannelInfo& ChInfo)
-			: NetworkID(ChInfo.NetworkID)
-			, ServiceID(ChInfo.ServiceID)
-			, channel(ChInfo.Channel)
-			, channelName(ChInfo.szChannelName)
-		{}
-
-		bool operator==(const CServiceInfo& rhs) const {
-			return this->ServiceID == rhs.ServiceID && this->NetworkID == rhs.NetworkID;
-		}
-
-		std::wstring toString() const;
-	};
+	/**
+	 * zXg̃`l񂩂T[rX̏
+	 */
+	inline CServiceInfo MakeServiceInfo(const TVTest::ChannelInfo& ChInfo) {
+		return CServiceInfo(ChInfo.NetworkID, ChInfo.TransportStreamID, ChInfo.ServiceID,
+			ChInfo.Channel, ChInfo.szChannelName);
+	}
 
 	std::vector<std::wstring> GetDrivers(
 		/* const */ TVTest::CTVTestApp* pApp,
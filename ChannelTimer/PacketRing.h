@@ -0,0 +1,115 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include "SectionCollector.h"
+
+namespace ChannelTimer {
+	/**
+	 * TS パケットを一つのスレッドから別の一つのスレッドへ渡すリングバッファ
+	 * 領域は最初に確保し、Push はロックもメモリの確保もしない。満杯なら捨てて数える
+	 * 読む側は連続した領域をコピーせずにまとめて受け取る
+	 */
+	class CPacketRing {
+	public:
+		/**
+		 * capacity は 2 の冪に切り上げる
+		 */
+		explicit CPacketRing(std::size_t capacity)
+			: m_capacity(RoundUpPow2(capacity))
+			, m_packets(new std::uint8_t[m_capacity * TS_PACKET_SIZE])
+		{}
+
+		CPacketRing(const CPacketRing&) = delete;
+		CPacketRing& operator=(const CPacketRing&) = delete;
+
+		/**
+		 * パケットを一つ入れる(書く側のスレッドから)。満杯なら false
+		 */
+		bool Push(const std::uint8_t* pPacket)
+		{
+			const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+			const std::size_t size = tail - m_head.load(std::memory_order_acquire);
+			if (size >= m_capacity) {
+				m_dropped.store(m_dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+				return false;
+			}
+			std::memcpy(&m_packets[(tail & (m_capacity - 1)) * TS_PACKET_SIZE], pPacket, TS_PACKET_SIZE);
+			m_tail.store(tail + 1, std::memory_order_release);
+
+			m_pushed.store(m_pushed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			if (size + 1 > m_highWater.load(std::memory_order_relaxed))
+				m_highWater.store(size + 1, std::memory_order_relaxed);
+			return true;
+		}
+
+		/**
+		 * 入っているパケットの数
+		 */
+		std::size_t Size() const
+		{
+			return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+		}
+
+		/**
+		 * 先頭から連続して読めるパケットを返す(読む側のスレッドから)
+		 * 末尾で折り返す場合は手前までを返すので、Consume した後にもう一度呼ぶ
+		 */
+		std::size_t Peek(const std::uint8_t** ppPackets) const
+		{
+			const std::size_t head = m_head.load(std::memory_order_relaxed);
+			const std::size_t size = m_tail.load(std::memory_order_acquire) - head;
+			const std::size_t index = head & (m_capacity - 1);
+			*ppPackets = &m_packets[index * TS_PACKET_SIZE];
+			return size < m_capacity - index ? size : m_capacity - index;
+		}
+
+		/**
+		 * Peek で受け取ったパケットを count 個読み終えた
+		 */
+		void Consume(std::size_t count)
+		{
+			m_head.store(m_head.load(std::memory_order_relaxed) + count, std::memory_order_release);
+		}
+
+		/**
+		 * 空にする。どちらのスレッドも触っていない時に呼ぶ
+		 */
+		void Reset()
+		{
+			m_head.store(0);
+			m_tail.store(0);
+		}
+
+		std::size_t Capacity() const { return m_capacity; }
+		std::uint64_t GetPushedCount() const { return m_pushed.load(std::memory_order_relaxed); }
+		std::uint64_t GetDroppedCount() const { return m_dropped.load(std::memory_order_relaxed); }
+		std::size_t GetHighWater() const { return m_highWater.load(std::memory_order_relaxed); }
+
+	private:
+		static constexpr std::size_t CACHE_LINE_SIZE = 64;
+
+		const std::size_t m_capacity;
+		const std::unique_ptr<std::uint8_t[]> m_packets;
+
+		// 読む側と書く側で別のキャッシュラインにする
+		char m_pad0[CACHE_LINE_SIZE];
+		std::atomic<std::size_t> m_head{ 0 };	// 読む側だけが進める
+		char m_pad1[CACHE_LINE_SIZE - sizeof(std::atomic<std::size_t>)];
+		std::atomic<std::size_t> m_tail{ 0 };	// 書く側だけが進める
+		// 以下は書く側だけが書く
+		std::atomic<std::uint64_t> m_pushed{ 0 };
+		std::atomic<std::uint64_t> m_dropped{ 0 };
+		std::atomic<std::size_t> m_highWater{ 0 };
+
+		static std::size_t RoundUpPow2(std::size_t n)
+		{
+			std::size_t v = 1;
+			while (v < n)
+				v <<= 1;
+			return v;
+		}
+	};
+}
@@ -0,0 +1,78 @@
+#include "Prefetcher.h"
+
+namespace ChannelTimer {
+	CCatalogPrefetcher::~CCatalogPrefetcher()
+	{
+		Stop();
+	}
+
+	void CCatalogPrefetcher::Start(
+		/* const */ TVTest::CTVTestApp* pApp,
+		CChannelCatalog* pCatalog,
+		HWND hwndNotify, UINT Message,
+		std::vector<std::wstring> drivers)
+	{
+		m_pApp = pApp;
+		m_pCatalog = pCatalog;
+		m_hwndNotify = hwndNotify;
+		m_Message = Message;
+		m_drivers = std::move(drivers);
+		m_next = 0;
+	}
+
+	bool CCatalogPrefetcher::FetchNext()
+	{
+		if (!WaitThread(0))
+			return true;
+		while (m_next < m_drivers.size() && !m_pCatalog->IsStale(m_drivers[m_next]))
+			m_next++;
+		if (m_next >= m_drivers.size())
+			return false;
+
+		// ホストの呼び出しはここ(UI スレッド)で、一度に一つのチューナーだけ
+		const std::wstring& driverName = m_drivers[m_next++];
+		m_generation = m_pCatalog->GetGeneration(driverName);
+		if (CopyDriverTuningSpaces(m_pApp, driverName, &m_copy)) {
+			m_hThread = ::CreateThread(nullptr, 0, ThreadProc, this, 0, nullptr);
+			if (m_hThread == nullptr)
+				return false;
+		}
+		return true;
+	}
+
+	void CCatalogPrefetcher::Stop()
+	{
+		m_drivers.clear();
+		m_next = 0;
+		// スレッドはホストを呼ばないので、そのまま待てる
+		WaitThread(INFINITE);
+	}
+
+	bool CCatalogPrefetcher::WaitThread(DWORD Timeout)
+	{
+		if (m_hThread == nullptr)
+			return true;
+		if (::WaitForSingleObject(m_hThread, Timeout) != WAIT_OBJECT_0)
+			return false;
+		::CloseHandle(m_hThread);
+		m_hThread = nullptr;
+		return true;
+	}
+
+	DWORD WINAPI CCatalogPrefetcher::ThreadProc(LPVOID pParameter)
+	{
+		static_cast<CCatalogPrefetcher*>(pParameter)->Run();
+		return 0;
+	}
+
+	void CCatalogPrefetcher::Run()
+	{
+		std::unique_ptr<Result> result(new Result);
+		result->driverName = m_copy.driverName;
+		result->channels = BuildDriverChannels(m_copy);
+		result->generation = m_generation;
+
+		if (::PostMessage(m_hwndNotify, m_Message, 0, reinterpret_cast<LPARAM>(result.get())))
+			result.release();
+	}
+}
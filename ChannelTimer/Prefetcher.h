@@ -0,0 +1,65 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include <windows.h>
+#include "TVTestPlugin.h"
+#include "Catalog.h"
+#include "Channels.h"
+
+namespace ChannelTimer {
+	/**
+	 * チューナーのチューニング空間とチャンネルを先に読み込んでおく
+	 * ホストの呼び出しは UI スレッドで一つずつ行い(FetchNext)、CDriverChannels だけを別スレッドで作る
+	 * 作ったものは Result を lParam にして通知先のウィンドウへ送る(受け取った側で delete する)
+	 */
+	class CCatalogPrefetcher {
+	public:
+		struct Result {
+			std::wstring driverName;
+			std::shared_ptr<const CDriverChannels> channels;
+			unsigned int generation;
+		};
+
+		~CCatalogPrefetcher();
+
+		/**
+		 * 読み込むチューナーを設定する(前に設定した残りは捨てる)
+		 * 読み込み中のものは pCatalog の読み直しが必要になったチューナーだけが捨てられるので、
+		 * 読み直しが必要になったら再び呼べばよい
+		 */
+		void Start(
+			/* const */ TVTest::CTVTestApp* pApp,
+			CChannelCatalog* pCatalog,
+			HWND hwndNotify, UINT Message,
+			std::vector<std::wstring> drivers);
+
+		/**
+		 * 次のチューナーのチャンネルをホストから写し、別スレッドで CDriverChannels を作り始める
+		 * 既に読み込まれたチューナーは飛ばす
+		 * UI スレッドから呼ぶ。前のスレッドが終わっていなければ次の呼び出しまで待つ
+		 * 読み込むチューナーが残っていなければ false
+		 */
+		bool FetchNext();
+
+		/**
+		 * 残りを捨ててスレッドの終了を待つ
+		 */
+		void Stop();
+
+	private:
+		HANDLE m_hThread = nullptr;
+		TVTest::CTVTestApp* m_pApp = nullptr;
+		CChannelCatalog* m_pCatalog = nullptr;
+		HWND m_hwndNotify = nullptr;
+		UINT m_Message = 0;
+		std::vector<std::wstring> m_drivers;
+		std::size_t m_next = 0;
+		unsigned int m_generation = 0;
+		CDriverTuningSpaceCopy m_copy;	// スレッドが動いている間はスレッドだけが使う
+
+		bool WaitThread(DWORD Timeout);
+		static DWORD WINAPI ThreadProc(LPVOID pParameter);
+		void Run();
+	};
+}
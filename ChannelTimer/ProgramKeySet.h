@@ -0,0 +1,96 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Channels.h"
+
+namespace ChannelTimer {
+	/**
+	 * 番組を一意に表すキー(NetworkID, TransportStreamID, ServiceID, EventID)
+	 * event_id は 0 にならないので、キーも 0 にならない
+	 */
+	using ProgramKey = std::uint64_t;
+
+	inline ProgramKey MakeProgramKey(ServiceKey service, std::uint16_t EventID) {
+		return (service << 16) | EventID;
+	}
+
+	/**
+	 * 番組のキーの集合
+	 * 番組表の描画で番組ごとに引くので、開番地法の表にして検索ではメモリの確保もロックもしない
+	 * 表は 2 の冪の大きさで、埋まり具合が半分を超えたら広げる。空きは 0 で表す
+	 */
+	class CProgramKeySet {
+	public:
+		static constexpr std::size_t MIN_CAPACITY = 64;
+
+		void Insert(ProgramKey key)
+		{
+			if (key == 0)
+				return;
+			if ((m_count + 1) * 2 > m_slots.size())
+				Grow();
+			std::size_t i = Hash(key) & m_mask;
+			while (m_slots[i] != 0) {
+				if (m_slots[i] == key)
+					return;
+				i = (i + 1) & m_mask;
+			}
+			m_slots[i] = key;
+			m_count++;
+		}
+
+		bool Contains(ProgramKey key) const
+		{
+			if (m_count == 0 || key == 0)
+				return false;
+			for (std::size_t i = Hash(key) & m_mask;; i = (i + 1) & m_mask) {
+				if (m_slots[i] == key)
+					return true;
+				if (m_slots[i] == 0)
+					return false;
+			}
+		}
+
+		/**
+		 * 全て取り除く。表の大きさはそのままにして、作り直す時に確保し直さない
+		 */
+		void Clear()
+		{
+			std::fill(m_slots.begin(), m_slots.end(), 0);
+			m_count = 0;
+		}
+
+		std::size_t Size() const { return m_count; }
+
+	private:
+		std::vector<ProgramKey> m_slots;
+		std::size_t m_mask = 0;
+		std::size_t m_count = 0;
+
+		static std::size_t Hash(ProgramKey key)
+		{
+			// 上位のビットまで混ぜる(splitmix64 の仕上げ)
+			key ^= key >> 30;
+			key *= 0xBF58476D1CE4E5B9ULL;
+			key ^= key >> 27;
+			key *= 0x94D049BB133111EBULL;
+			key ^= key >> 31;
+			return static_cast<std::size_t>(key);
+		}
+
+		void Grow()
+		{
+			std::vector<ProgramKey> old;
+			old.swap(m_slots);
+			m_slots.assign(old.empty() ? MIN_CAPACITY : old.size() * 2, 0);
+			m_mask = m_slots.size() - 1;
+			m_count = 0;
+			for (const ProgramKey key : old) {
+				if (key != 0)
+					Insert(key);
+			}
+		}
+	};
+}
@@ -0,0 +1,84 @@
+#include "Recurrence.h"
+#include <algorithm>
+#include <functional>
+
+namespace ChannelTimer {
+	namespace {
+		// 例外の日か。過ぎた例外の日は取り除く
+		bool IsException(Recurrence* pRecurrence, std::int32_t day)
+		{
+			std::vector<std::int32_t>& exceptions = pRecurrence->exceptions;
+			while (!exceptions.empty() && exceptions.back() < day)
+				exceptions.pop_back();
+			return !exceptions.empty() && exceptions.back() == day;
+		}
+	}
+
+	std::uint8_t GetRecurrenceWeekdays(const Recurrence& recurrence)
+	{
+		switch (recurrence.rule) {
+		case Recurrence::Rule::RULE_DAILY:
+			return 0x7F;
+		case Recurrence::Rule::RULE_WEEKDAYS:
+			return 0x3E;
+		case Recurrence::Rule::RULE_WEEKLY:
+			return recurrence.weekdays & 0x7F;
+		case Recurrence::Rule::RULE_NONE:
+		default:
+			return 0;
+		}
+	}
+
+	bool NextOccurrence(Recurrence* pRecurrence, TimeValue* pTime, TimeValue after)
+	{
+		const std::uint8_t weekdays = GetRecurrenceWeekdays(*pRecurrence);
+		if (weekdays == 0)
+			return false;
+
+		TimeValue time = *pTime;
+		// 長く止まっていた時は週単位で飛ばす(曜日は変わらない)
+		if (time < after - FILETIME_WEEK)
+			time += (after - time) / FILETIME_WEEK * FILETIME_WEEK - FILETIME_WEEK;
+
+		for (;;) {
+			// 次の繰り返す曜日まで進める(高々 7 日)
+			const int weekday = GetWeekday(GetLocalDay(time, pRecurrence->localOffset));
+			int days = 1;
+			while ((weekdays & (1 << ((weekday + days) % 7))) == 0)
+				days++;
+			time += days * FILETIME_DAY;
+
+			if (time > after && !IsException(pRecurrence, GetLocalDay(time, pRecurrence->localOffset)))
+				break;
+		}
+
+		*pTime = time;
+		return true;
+	}
+
+	bool AlignOccurrence(Recurrence* pRecurrence, TimeValue* pTime, TimeValue after)
+	{
+		const std::uint8_t weekdays = GetRecurrenceWeekdays(*pRecurrence);
+		if (weekdays == 0)
+			return false;
+
+		const std::int32_t day = GetLocalDay(*pTime, pRecurrence->localOffset);
+		if (*pTime > after && (weekdays & (1 << GetWeekday(day))) != 0 && !IsException(pRecurrence, day))
+			return true;
+		return NextOccurrence(pRecurrence, pTime, after);
+	}
+
+	bool SkipOccurrence(Recurrence* pRecurrence, TimeValue* pTime, TimeValue after)
+	{
+		if (GetRecurrenceWeekdays(*pRecurrence) == 0)
+			return false;
+
+		// 例外の日は降順(最も近い日が末尾)
+		const std::int32_t day = GetLocalDay(*pTime, pRecurrence->localOffset);
+		std::vector<std::int32_t>& exceptions = pRecurrence->exceptions;
+		const auto it = std::lower_bound(exceptions.begin(), exceptions.end(), day, std::greater<std::int32_t>());
+		if (it == exceptions.end() || *it != day)
+			exceptions.insert(it, day);
+		return AlignOccurrence(pRecurrence, pTime, after);
+	}
+}
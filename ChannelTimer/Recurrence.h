@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include "Clock.h"
+#include "Timer.h"
+
+namespace ChannelTimer {
+	static constexpr TimeValue FILETIME_WEEK = 7LL * FILETIME_DAY;
+
+	/**
+	 * 地方時の日付(1601/1/1 からの日数)
+	 */
+	inline std::int32_t GetLocalDay(TimeValue time, TimeValue localOffset)
+	{
+		const TimeValue local = time + localOffset;
+		return static_cast<std::int32_t>(local >= 0 ? local / FILETIME_DAY : (local - FILETIME_DAY + 1) / FILETIME_DAY);
+	}
+
+	/**
+	 * 日付の曜日(0 が日曜)。1601/1/1 は月曜
+	 */
+	inline int GetWeekday(std::int32_t day)
+	{
+		return static_cast<int>(((day + 1) % 7 + 7) % 7);
+	}
+
+	/**
+	 * 繰り返す曜日(ビット 0 が日曜)。繰り返さなければ 0
+	 */
+	std::uint8_t GetRecurrenceWeekdays(const Recurrence& recurrence);
+
+	/**
+	 * *pTime を次の回にする。after 以前の回は飛ばす
+	 * 通常は一度で求まり、過ぎた例外の日は取り除く
+	 * 繰り返さないか曜日が無ければ false
+	 */
+	bool NextOccurrence(Recurrence* pRecurrence, TimeValue* pTime, TimeValue after);
+
+	/**
+	 * *pTime が after より後の繰り返しの日ならそのままにし、そうでなければ次の回にする
+	 */
+	bool AlignOccurrence(Recurrence* pRecurrence, TimeValue* pTime, TimeValue after);
+
+	/**
+	 * *pTime の回の日を例外の日に加え、*pTime を after より後の次の回にする
+	 * 繰り返さないか曜日が無ければ何もせず false
+	 */
+	bool SkipOccurrence(Recurrence* pRecurrence, TimeValue* pTime, TimeValue after);
+}
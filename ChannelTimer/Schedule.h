@@ -0,0 +1,172 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace ChannelTimer {
+	// タイマーの識別子
+	using TimerId = std::uint32_t;
+	static constexpr TimerId INVALID_TIMER_ID = 0xFFFFFFFFU;
+
+	/**
+	 * 期限順に並べたタイマーの予定表
+	 * 期限をキーにした最小ヒープで、追加・取り消し・期限変更は O(log n)
+	 * 期限の単位は呼び出し側で決める(FILETIME 単位など)
+	 */
+	template<typename T>
+	class CSchedule {
+	public:
+		using Deadline = std::int64_t;
+
+		TimerId Add(T value, Deadline deadline)
+		{
+			TimerId id;
+			if (!m_free.empty()) {
+				id = m_free.back();
+				m_free.pop_back();
+			} else {
+				id = static_cast<TimerId>(m_slots.size());
+				m_slots.emplace_back();
+			}
+			Slot& slot = m_slots[id];
+			slot.value = std::move(value);
+			slot.used = true;
+			m_heap.push_back(Node{ deadline, id });
+			SiftUp(m_heap.size() - 1);
+			return id;
+		}
+
+		bool Cancel(TimerId id)
+		{
+			if (!Contains(id))
+				return false;
+			const std::size_t i = m_slots[id].heapIndex;
+			const Node last = m_heap.back();
+			m_heap.pop_back();
+			if (i < m_heap.size()) {
+				Place(i, last);
+				SiftDown(SiftUp(i));
+			}
+			m_slots[id] = Slot();
+			m_free.push_back(id);
+			return true;
+		}
+
+		bool Reschedule(TimerId id, Deadline deadline)
+		{
+			if (!Contains(id))
+				return false;
+			const std::size_t i = m_slots[id].heapIndex;
+			m_heap[i].deadline = deadline;
+			SiftDown(SiftUp(i));
+			return true;
+		}
+
+		// 時刻を進める。ヒープでは何もしない(CTimingWheel と同じ使い方にするため)
+		void Advance(Deadline) {}
+
+		bool Contains(TimerId id) const
+		{
+			return id < m_slots.size() && m_slots[id].used;
+		}
+
+		T* Get(TimerId id)
+		{
+			return Contains(id) ? &m_slots[id].value : nullptr;
+		}
+
+		const T* Get(TimerId id) const
+		{
+			return Contains(id) ? &m_slots[id].value : nullptr;
+		}
+
+		Deadline GetDeadline(TimerId id) const
+		{
+			return m_heap[m_slots[id].heapIndex].deadline;
+		}
+
+		bool Empty() const { return m_heap.empty(); }
+		std::size_t Size() const { return m_heap.size(); }
+
+		// 最も期限の早いタイマー
+		TimerId Top() const { return m_heap.empty() ? INVALID_TIMER_ID : m_heap.front().id; }
+		Deadline TopDeadline() const { return m_heap.front().deadline; }
+
+		// 全てのタイマーを列挙する(順序は不定)
+		template<typename F>
+		void ForEach(F func) const
+		{
+			for (const Node& node : m_heap)
+				func(node.id, m_slots[node.id].value, node.deadline);
+		}
+
+		void Clear()
+		{
+			m_slots.clear();
+			m_free.clear();
+			m_heap.clear();
+		}
+
+	private:
+		struct Slot {
+			T value = T();
+			std::size_t heapIndex = 0;
+			bool used = false;
+		};
+
+		// 比較時にスロットを参照しないよう、期限はヒープ側に持つ
+		struct Node {
+			Deadline deadline;
+			TimerId id;
+		};
+
+		std::vector<Slot> m_slots;
+		std::vector<TimerId> m_free;
+		std::vector<Node> m_heap;
+
+		static bool Less(const Node& a, const Node& b)
+		{
+			return a.deadline < b.deadline || (a.deadline == b.deadline && a.id < b.id);
+		}
+
+		void Place(std::size_t i, const Node& node)
+		{
+			m_heap[i] = node;
+			m_slots[node.id].heapIndex = i;
+		}
+
+		std::size_t SiftUp(std::size_t i)
+		{
+			const Node node = m_heap[i];
+			while (i > 0) {
+				const std::size_t parent = (i - 1) / 2;
+				if (!Less(node, m_heap[parent]))
+					break;
+				Place(i, m_heap[parent]);
+				i = parent;
+			}
+			Place(i, node);
+			return i;
+		}
+
+		std::size_t SiftDown(std::size_t i)
+		{
+			const Node node = m_heap[i];
+			const std::size_t size = m_heap.size();
+			for (;;) {
+				std::size_t child = i * 2 + 1;
+				if (child >= size)
+					break;
+				if (child + 1 < size && Less(m_heap[child + 1], m_heap[child]))
+					child++;
+				if (!Less(m_heap[child], node))
+					break;
+				Place(i, m_heap[child]);
+				i = child;
+			}
+			Place(i, node);
+			return i;
+		}
+	};
+}
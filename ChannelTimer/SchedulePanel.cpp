@@ -0,0 +1,316 @@
+#include "SchedulePanel.h"
+#include <algorithm>
+#include <commctrl.h>
+
+// パネル項目のウィンドウクラス名
+#define SCHEDULEPANEL_WINDOW_CLASS TEXT("TVTest Timer Schedule Panel")
+
+namespace ChannelTimer {
+	namespace {
+		const UINT_PTR TIMER_ID_REFRESH = 1;
+
+		struct ColumnInfo {
+			LPCWSTR pszTitle;
+			int width;	// 96 DPI での幅(ピクセル単位)
+		};
+
+		const ColumnInfo COLUMNS[CSchedulePanelHandler::COLUMN_COUNT] = {
+			{ L"切り替え先", 120 },
+			{ L"条件", 140 },
+			{ L"残り", 70 },
+		};
+	}
+
+	CSchedulePanel::~CSchedulePanel()
+	{
+		if (m_hwnd != nullptr)
+			::DestroyWindow(m_hwnd);
+		if (m_hfont != nullptr)
+			::DeleteObject(m_hfont);
+	}
+
+	bool CSchedulePanel::Register(/* const */ TVTest::CTVTestApp* pApp, HINSTANCE hinst, int id)
+	{
+		m_pApp = pApp;
+		m_hinst = hinst;
+		m_id = id;
+
+		TVTest::PanelItemInfo Info;
+		Info.Size = sizeof(Info);
+		Info.Flags = 0;
+		Info.Style = TVTest::PANEL_ITEM_STYLE_NEEDFOCUS;	// Delete キーで取り消す
+		Info.ID = id;
+		Info.pszIDText = L"Schedule";
+		Info.pszTitle = L"タイマー";
+		Info.hbmIcon = nullptr;
+		return m_pApp->RegisterPanelItem(&Info);
+	}
+
+	bool CSchedulePanel::OnNotify(const TVTest::PanelItemEventInfo* pInfo)
+	{
+		switch (pInfo->Event) {
+		case TVTest::PANEL_ITEM_EVENT_CREATE:
+			{
+				TVTest::PanelItemCreateEventInfo* pCreateInfo =
+					reinterpret_cast<TVTest::PanelItemCreateEventInfo*>(const_cast<TVTest::PanelItemEventInfo*>(pInfo));
+				if (!Create(pCreateInfo->hwndParent, pCreateInfo->ItemRect))
+					return false;
+				pCreateInfo->hwndItem = m_hwnd;
+			}
+			return true;
+
+		case TVTest::PANEL_ITEM_EVENT_ACTIVATE:
+			m_fActive = true;
+			// 非アクティブの間は描画し直していないので、全て描画し直す
+			RedrawRows(0);
+			UpdateRefreshTimer();
+			return true;
+
+		case TVTest::PANEL_ITEM_EVENT_DEACTIVATE:
+			m_fActive = false;
+			UpdateRefreshTimer();
+			return true;
+
+		case TVTest::PANEL_ITEM_EVENT_STYLECHANGED:
+		case TVTest::PANEL_ITEM_EVENT_FONTCHANGED:
+			ApplyFont();
+			return true;
+		}
+		return false;
+	}
+
+	void CSchedulePanel::SetRowCount(std::size_t count, std::size_t firstChanged)
+	{
+		const bool fCountChanged = count != m_RowCount;
+		m_RowCount = count;
+		if (m_hwndList == nullptr)
+			return;
+
+		if (fCountChanged) {
+			// 行の数だけを渡す。全体を無効にせず、変わった行以降だけを描画し直す
+			ListView_SetItemCountEx(m_hwndList, static_cast<int>(count), LVSICF_NOINVALIDATEALL | LVSICF_NOSCROLL);
+		}
+		if (m_fActive && firstChanged < count)
+			RedrawRows(firstChanged);
+		UpdateRefreshTimer();
+	}
+
+	bool CSchedulePanel::Create(HWND hwndParent, const RECT& rc)
+	{
+		static bool fRegistered = false;
+		if (!fRegistered) {
+			WNDCLASS wc;
+			wc.style = 0;
+			wc.lpfnWndProc = WndProc;
+			wc.cbClsExtra = 0;
+			wc.cbWndExtra = 0;
+			wc.hInstance = m_hinst;
+			wc.hIcon = nullptr;
+			wc.hCursor = ::LoadCursor(nullptr, IDC_ARROW);
+			wc.hbrBackground = nullptr;
+			wc.lpszMenuName = nullptr;
+			wc.lpszClassName = SCHEDULEPANEL_WINDOW_CLASS;
+			if (::RegisterClass(&wc) == 0)
+				return false;
+			fRegistered = true;
+		}
+
+		m_hwnd = ::CreateWindowEx(
+			0, SCHEDULEPANEL_WINDOW_CLASS, nullptr, WS_CHILD | WS_CLIPCHILDREN,
+			rc.left, rc.top, rc.right - rc.left, rc.bottom - rc.top,
+			hwndParent, nullptr, m_hinst, this);
+		if (m_hwnd == nullptr)
+			return false;
+
+		// 行の中身を持たない仮想リストビュー(LVS_OWNERDATA)
+		m_hwndList = ::CreateWindowEx(
+			0, WC_LISTVIEW, nullptr,
+			WS_CHILD | WS_VISIBLE | WS_CLIPSIBLINGS | LVS_REPORT | LVS_OWNERDATA | LVS_SHOWSELALWAYS | LVS_NOSORTHEADER,
+			0, 0, rc.right - rc.left, rc.bottom - rc.top,
+			m_hwnd, nullptr, m_hinst, nullptr);
+		if (m_hwndList == nullptr)
+			return false;
+		ListView_SetExtendedListViewStyle(m_hwndList, LVS_EX_FULLROWSELECT | LVS_EX_DOUBLEBUFFER);
+
+		const int DPI = m_pApp->GetDPIFromWindow(m_hwnd);
+		for (int i = 0; i < CSchedulePanelHandler::COLUMN_COUNT; i++) {
+			LVCOLUMN Column;
+			Column.mask = LVCF_FMT | LVCF_WIDTH | LVCF_TEXT;
+			Column.fmt = i == CSchedulePanelHandler::COLUMN_REMAINING ? LVCFMT_RIGHT : LVCFMT_LEFT;
+			Column.cx = DPI > 0 ? ::MulDiv(COLUMNS[i].width, DPI, 96) : COLUMNS[i].width;
+			Column.pszText = const_cast<LPWSTR>(COLUMNS[i].pszTitle);
+			ListView_InsertColumn(m_hwndList, i, &Column);
+		}
+		ApplyFont();
+		ListView_SetItemCountEx(m_hwndList, static_cast<int>(m_RowCount), LVSICF_NOSCROLL);
+		return true;
+	}
+
+	// パネルのフォントを DPI に合わせて作り直す
+	void CSchedulePanel::ApplyFont()
+	{
+		if (m_hwndList == nullptr)
+			return;
+		LOGFONTW lf;
+		if (!m_pApp->GetFont(L"PanelFont", &lf, m_pApp->GetDPIFromWindow(m_hwnd)))
+			return;
+		const HFONT hfont = ::CreateFontIndirectW(&lf);
+		if (hfont == nullptr)
+			return;
+		::SendMessage(m_hwndList, WM_SETFONT, reinterpret_cast<WPARAM>(hfont), TRUE);
+		if (m_hfont != nullptr)
+			::DeleteObject(m_hfont);
+		m_hfont = hfont;
+	}
+
+	// アクティブで行がある間だけ、残り時間を描画し直すタイマーを動かす
+	void CSchedulePanel::UpdateRefreshTimer()
+	{
+		if (m_hwnd == nullptr)
+			return;
+		if (m_fActive && m_RowCount > 0)
+			::SetTimer(m_hwnd, TIMER_ID_REFRESH, REFRESH_INTERVAL, nullptr);
+		else
+			::KillTimer(m_hwnd, TIMER_ID_REFRESH);
+	}
+
+	// first 以降の見えている行を描画し直す
+	void CSchedulePanel::RedrawRows(std::size_t first)
+	{
+		if (m_hwndList == nullptr || m_RowCount == 0)
+			return;
+		const int Top = ListView_GetTopIndex(m_hwndList);
+		const int Last = (std::min)(Top + ListView_GetCountPerPage(m_hwndList), static_cast<int>(m_RowCount) - 1);
+		const int First = (std::max)(Top, static_cast<int>(first));
+		if (First <= Last)
+			ListView_RedrawItems(m_hwndList, First, Last);
+	}
+
+	std::vector<std::size_t> CSchedulePanel::GetSelectedRows() const
+	{
+		std::vector<std::size_t> Rows;
+		for (int i = ListView_GetNextItem(m_hwndList, -1, LVNI_SELECTED);
+				i >= 0;
+				i = ListView_GetNextItem(m_hwndList, i, LVNI_SELECTED))
+			Rows.push_back(static_cast<std::size_t>(i));
+		return Rows;
+	}
+
+	void CSchedulePanel::CancelSelected()
+	{
+		const std::vector<std::size_t> Rows = GetSelectedRows();
+		if (Rows.empty())
+			return;
+		// 行が詰まるので、選択は消しておく
+		ListView_SetItemState(m_hwndList, -1, 0, LVIS_SELECTED);
+		m_pHandler->CancelRows(Rows);
+	}
+
+	void CSchedulePanel::SkipSelected()
+	{
+		// 次の回にすると行の位置が変わるので、選択は消しておく
+		const std::vector<std::size_t> Rows = GetSelectedRows();
+		if (Rows.empty())
+			return;
+		ListView_SetItemState(m_hwndList, -1, 0, LVIS_SELECTED);
+		m_pHandler->SkipRows(Rows);
+	}
+
+	LRESULT CSchedulePanel::OnListNotify(const NMHDR* pnmh)
+	{
+		switch (pnmh->code) {
+		case LVN_GETDISPINFO:
+			{
+				// 見えている行の文字列だけをここで求める
+				NMLVDISPINFO* pInfo = reinterpret_cast<NMLVDISPINFO*>(const_cast<NMHDR*>(pnmh));
+				if ((pInfo->item.mask & LVIF_TEXT) != 0 && pInfo->item.cchTextMax > 0) {
+					pInfo->item.pszText[0] = L'\0';
+					if (pInfo->item.iItem >= 0 && static_cast<std::size_t>(pInfo->item.iItem) < m_RowCount) {
+						m_pHandler->GetRowText(
+							static_cast<std::size_t>(pInfo->item.iItem), pInfo->item.iSubItem,
+							pInfo->item.pszText, pInfo->item.cchTextMax);
+					}
+				}
+			}
+			return 0;
+
+		case LVN_KEYDOWN:
+			if (reinterpret_cast<const NMLVKEYDOWN*>(pnmh)->wVKey == VK_DELETE)
+				CancelSelected();
+			return 0;
+
+		case NM_RCLICK:
+			{
+				if (ListView_GetSelectedCount(m_hwndList) == 0)
+					return 0;
+				// 選んだ行に繰り返すタイマーがあれば、次の回だけを休める
+				bool fRecurring = false;
+				for (const std::size_t Row : GetSelectedRows()) {
+					if (m_pHandler->IsRecurringRow(Row)) {
+						fRecurring = true;
+						break;
+					}
+				}
+				const HMENU hmenu = ::CreatePopupMenu();
+				::AppendMenu(hmenu, MF_STRING | MF_ENABLED, COMMAND_CANCEL, L"タイマーを取り消す(&D)");
+				::AppendMenu(hmenu, MF_STRING | (fRecurring ? MF_ENABLED : MF_GRAYED), COMMAND_SKIP, L"次の回だけ休む(&S)");
+				POINT pt;
+				::GetCursorPos(&pt);
+				const UINT Command = ::TrackPopupMenu(
+					hmenu, TPM_RIGHTBUTTON | TPM_RETURNCMD | TPM_NONOTIFY, pt.x, pt.y, 0, m_hwnd, nullptr);
+				::DestroyMenu(hmenu);
+				if (Command == COMMAND_CANCEL)
+					CancelSelected();
+				else if (Command == COMMAND_SKIP)
+					SkipSelected();
+			}
+			return 0;
+		}
+		return 0;
+	}
+
+	LRESULT CALLBACK CSchedulePanel::WndProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
+	{
+		CSchedulePanel* pThis = reinterpret_cast<CSchedulePanel*>(::GetWindowLongPtr(hwnd, GWLP_USERDATA));
+
+		switch (uMsg) {
+		case WM_CREATE:
+			{
+				LPCREATESTRUCT pcs = reinterpret_cast<LPCREATESTRUCT>(lParam);
+				::SetWindowLongPtr(hwnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(pcs->lpCreateParams));
+			}
+			return 0;
+
+		case WM_SIZE:
+			if (pThis != nullptr && pThis->m_hwndList != nullptr)
+				::MoveWindow(pThis->m_hwndList, 0, 0, LOWORD(lParam), HIWORD(lParam), TRUE);
+			return 0;
+
+		case WM_SETFOCUS:
+			if (pThis != nullptr && pThis->m_hwndList != nullptr)
+				::SetFocus(pThis->m_hwndList);
+			return 0;
+
+		case WM_TIMER:
+			// 残り時間が変わるので、見えている行を描画し直す
+			if (pThis != nullptr && wParam == TIMER_ID_REFRESH)
+				pThis->RedrawRows(0);
+			return 0;
+
+		case WM_NOTIFY:
+			if (pThis != nullptr && reinterpret_cast<const NMHDR*>(lParam)->hwndFrom == pThis->m_hwndList)
+				return pThis->OnListNotify(reinterpret_cast<const NMHDR*>(lParam));
+			break;
+
+		case WM_DESTROY:
+			if (pThis != nullptr) {
+				::KillTimer(hwnd, TIMER_ID_REFRESH);
+				pThis->m_hwnd = nullptr;
+				pThis->m_hwndList = nullptr;
+			}
+			return 0;
+		}
+
+		return ::DefWindowProc(hwnd, uMsg, wParam, lParam);
+	}
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include <windows.h>
+#include "TVTestPlugin.h"
+
+namespace ChannelTimer {
+	/**
+	 * タイマーの一覧の行の表示と取り消し・次の回を休む操作をする側
+	 */
+	class CSchedulePanelHandler {
+	public:
+		enum {
+			COLUMN_TARGET,		// 切り替え先
+			COLUMN_CONDITION,	// 条件
+			COLUMN_REMAINING,	// 残り時間
+			COLUMN_COUNT
+		};
+
+		/**
+		 * 行の列の文字列を pszText に書く(表示する行だけ、描画の度に呼ばれる)
+		 */
+		virtual void GetRowText(std::size_t row, int column, wchar_t* pszText, int maxLength) = 0;
+
+		/**
+		 * 選んだ行のタイマーを取り消す
+		 */
+		virtual void CancelRows(const std::vector<std::size_t>& rows) = 0;
+
+		/**
+		 * 行のタイマーが繰り返すか(次の回を休めるか)
+		 */
+		virtual bool IsRecurringRow(std::size_t row) = 0;
+
+		/**
+		 * 選んだ行の繰り返すタイマーの次の回を休む
+		 */
+		virtual void SkipRows(const std::vector<std::size_t>& rows) = 0;
+
+	protected:
+		~CSchedulePanelHandler() = default;
+	};
+
+	/**
+	 * 予約したタイマーの一覧のパネル項目
+	 * 行の数だけを持つ仮想リストビューで、見えている行の文字列だけをその都度 CSchedulePanelHandler に求める
+	 * 行が変わった時は変わった行以降の見えている分だけを描画し直し、残り時間はアクティブな間だけ 1 秒ごとに描画し直す
+	 */
+	class CSchedulePanel {
+	public:
+		// 残り時間を描画し直す間隔(ms単位)
+		static const UINT REFRESH_INTERVAL = 1000;
+		// 右クリックのメニューの項目
+		static const UINT COMMAND_CANCEL = 1;
+		static const UINT COMMAND_SKIP = 2;
+
+		explicit CSchedulePanel(CSchedulePanelHandler* pHandler)
+			: m_pHandler(pHandler)
+		{}
+		~CSchedulePanel();
+
+		bool Register(/* const */ TVTest::CTVTestApp* pApp, HINSTANCE hinst, int id);
+		int GetID() const { return m_id; }
+
+		/**
+		 * EVENT_PANELITEM_NOTIFY
+		 */
+		bool OnNotify(const TVTest::PanelItemEventInfo* pInfo);
+
+		/**
+		 * 行の数を設定し、firstChanged 以降の見えている行を描画し直す
+		 */
+		void SetRowCount(std::size_t count, std::size_t firstChanged);
+
+	private:
+		CSchedulePanelHandler* m_pHandler;
+		/* const */ TVTest::CTVTestApp* m_pApp = nullptr;
+		HINSTANCE m_hinst = nullptr;
+		int m_id = 0;
+		HWND m_hwnd = nullptr;
+		HWND m_hwndList = nullptr;
+		HFONT m_hfont = nullptr;
+		std::size_t m_RowCount = 0;
+		bool m_fActive = false;
+
+		bool Create(HWND hwndParent, const RECT& rc);
+		void ApplyFont();
+		void UpdateRefreshTimer();
+		void RedrawRows(std::size_t first);
+		std::vector<std::size_t> GetSelectedRows() const;
+		void CancelSelected();
+		void SkipSelected();
+		LRESULT OnListNotify(const NMHDR* pnmh);
+
+		static LRESULT CALLBACK WndProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
+	};
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Clock.h"
+#include "Schedule.h"
+
+namespace ChannelTimer {
+	/**
+	 * 一覧に表示するタイマー
+	 * 識別子は使い回されるので、通し番号で同じタイマーか確かめる
+	 */
+	struct CScheduleRow {
+		TimerId id;
+		std::uint32_t serial;
+		TimeValue deadline;
+
+		bool operator==(const CScheduleRow& rhs) const {
+			return id == rhs.id && serial == rhs.serial && deadline == rhs.deadline;
+		}
+		bool operator!=(const CScheduleRow& rhs) const { return !(*this == rhs); }
+	};
+
+	/**
+	 * 予約したタイマーの一覧の行
+	 * 期限順(同じなら通し番号順)に並べ、入れ替えた時に変わった最初の行を返して、それ以降だけを描画し直せるようにする
+	 */
+	class CScheduleRows {
+	public:
+		/**
+		 * 行を入れ替える
+		 * 前と変わった最初の行を返す。変わらなければ Size()
+		 */
+		std::size_t Assign(std::vector<CScheduleRow> rows)
+		{
+			std::sort(rows.begin(), rows.end(), [](const CScheduleRow& a, const CScheduleRow& b) {
+				return a.deadline != b.deadline ? a.deadline < b.deadline : a.serial < b.serial;
+			});
+
+			const std::size_t common = std::min(rows.size(), m_rows.size());
+			std::size_t first = 0;
+			while (first < common && rows[first] == m_rows[first])
+				first++;
+			if (first == common && rows.size() == m_rows.size())
+				first = rows.size();
+			m_rows.swap(rows);
+			return first;
+		}
+
+		void Clear() { m_rows.clear(); }
+
+		std::size_t Size() const { return m_rows.size(); }
+		bool Empty() const { return m_rows.empty(); }
+		const CScheduleRow& operator[](std::size_t i) const { return m_rows[i]; }
+
+	private:
+		std::vector<CScheduleRow> m_rows;
+	};
+}
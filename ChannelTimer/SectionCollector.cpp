@@ -0,0 +1,103 @@
+#include "SectionCollector.h"
+#include <cstring>
+
+namespace ChannelTimer {
+	void CSectionCollector::OnPacket(const std::uint8_t* pPacket)
+	{
+		if (pPacket[0] != 0x47 || (pPacket[1] & 0x80) != 0)	// sync_byte, transport_error_indicator
+			return;
+
+		const bool fUnitStart = (pPacket[1] & 0x40) != 0;
+		const int adaptation = (pPacket[3] >> 4) & 0x03;
+		const int continuity = pPacket[3] & 0x0F;
+		if ((adaptation & 0x01) == 0)	// ペイロード無し
+			return;
+
+		std::size_t pos = 4;
+		if (adaptation & 0x02)
+			pos += 1 + pPacket[4];
+		if (pos >= TS_PACKET_SIZE)
+			return;
+
+		// パケットが抜けたら集めているセクションは捨てる
+		if (m_continuity >= 0 && continuity != ((m_continuity + 1) & 0x0F))
+			m_fCollecting = false;
+		m_continuity = continuity;
+
+		const std::uint8_t* pPayload = pPacket + pos;
+		std::size_t size = TS_PACKET_SIZE - pos;
+
+		if (fUnitStart) {
+			const std::size_t pointer = pPayload[0];
+			pPayload++;
+			size--;
+			if (pointer > size)
+				return;
+			// 前のセクションの残り
+			if (m_fCollecting)
+				Collect(pPayload, pointer);
+			pPayload += pointer;
+			size -= pointer;
+			m_fCollecting = false;
+
+			// 一つのパケットに複数のセクションが入っていることがある
+			while (size > 0 && pPayload[0] != 0xFF) {
+				m_fCollecting = true;
+				m_sectionSize = 0;
+				m_sectionLength = 0;
+				const std::size_t used = Collect(pPayload, size);
+				pPayload += used;
+				size -= used;
+				if (m_fCollecting)
+					break;	// 次のパケットに続く
+			}
+		} else if (m_fCollecting) {
+			Collect(pPayload, size);
+		}
+	}
+
+	std::size_t CSectionCollector::Collect(const std::uint8_t* pData, std::size_t size)
+	{
+		std::size_t used = 0;
+
+		if (m_sectionLength == 0) {
+			// section_length までのヘッダを揃える
+			const std::size_t header = 3 - m_sectionSize < size ? 3 - m_sectionSize : size;
+			std::memcpy(m_section + m_sectionSize, pData, header);
+			m_sectionSize += header;
+			used += header;
+			if (m_sectionSize < 3)
+				return used;
+			m_sectionLength = 3 + (((m_section[1] & 0x0F) << 8) | m_section[2]);
+			if (!m_pHandler->AcceptTable(m_section[0]) || m_sectionLength > MAX_SECTION_SIZE) {
+				// 他のテーブルは中身を集めずに読み飛ばす
+				m_fCollecting = false;
+				const std::size_t skip = m_sectionLength - 3;
+				return used + (skip < size - used ? skip : size - used);
+			}
+		}
+
+		const std::size_t rest = m_sectionLength - m_sectionSize;
+		const std::size_t length = rest < size - used ? rest : size - used;
+		std::memcpy(m_section + m_sectionSize, pData + used, length);
+		m_sectionSize += length;
+		used += length;
+
+		if (m_sectionSize == m_sectionLength) {
+			m_fCollecting = false;
+			m_pHandler->OnSection(m_section, m_sectionSize);
+		}
+		return used;
+	}
+
+	std::uint32_t CSectionCollector::Crc32(const std::uint8_t* pData, std::size_t size)
+	{
+		std::uint32_t crc = 0xFFFFFFFFU;
+		for (std::size_t i = 0; i < size; i++) {
+			crc ^= static_cast<std::uint32_t>(pData[i]) << 24;
+			for (int k = 0; k < 8; k++)
+				crc = (crc & 0x80000000U) ? (crc << 1) ^ 0x04C11DB7U : crc << 1;
+		}
+		return crc;
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace ChannelTimer {
+	static const std::size_t TS_PACKET_SIZE = 188;
+
+	/**
+	 * TS パケットの PID
+	 */
+	inline std::uint16_t GetPacketPID(const std::uint8_t* pPacket)
+	{
+		return static_cast<std::uint16_t>(((pPacket[1] & 0x1F) << 8) | pPacket[2]);
+	}
+
+	/**
+	 * 集めたセクションの受け取り側
+	 */
+	class CSectionHandler {
+	public:
+		/**
+		 * 中身を集めるテーブルか。false なら読み飛ばす
+		 */
+		virtual bool AcceptTable(std::uint8_t tableID) const = 0;
+		virtual void OnSection(const std::uint8_t* pSection, std::size_t size) = 0;
+
+	protected:
+		~CSectionHandler() = default;
+	};
+
+	/**
+	 * 一つの PID の TS パケットから PSI/SI のセクションを組み立てる
+	 */
+	class CSectionCollector {
+	public:
+		static const std::size_t MAX_SECTION_SIZE = 4096;
+
+		explicit CSectionCollector(CSectionHandler* pHandler)
+			: m_pHandler(pHandler)
+		{}
+
+		/**
+		 * PID の合った TS パケットを渡す
+		 */
+		void OnPacket(const std::uint8_t* pPacket);
+
+		/**
+		 * MPEG-2 の CRC-32。CRC を含めたセクション全体なら 0 になる
+		 */
+		static std::uint32_t Crc32(const std::uint8_t* pData, std::size_t size);
+
+	private:
+		CSectionHandler* m_pHandler;
+		std::uint8_t m_section[MAX_SECTION_SIZE];
+		std::size_t m_sectionSize = 0;		// 集めたバイト数
+		std::size_t m_sectionLength = 0;	// セクション全体の長さ(ヘッダが揃うまで 0)
+		bool m_fCollecting = false;
+		int m_continuity = -1;
+
+		// 集めているセクションにデータを足す。使ったバイト数を返す
+		std::size_t Collect(const std::uint8_t* pData, std::size_t size);
+	};
+}
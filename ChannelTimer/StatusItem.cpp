@@ -0,0 +1,97 @@
+#include "StatusItem.h"
+
+namespace ChannelTimer {
+	CCountdownStatusItem::~CCountdownStatusItem()
+	{
+		ResetFont();
+	}
+
+	bool CCountdownStatusItem::Register(/* const */ TVTest::CTVTestApp* pApp, int id)
+	{
+		m_pApp = pApp;
+		m_id = id;
+
+		TVTest::StatusItemInfo Info;
+		Info.Size = sizeof(Info);
+		Info.Flags = 0;		// 定期的な更新はせず、表示が変わる時だけ Update から要求する
+		Info.Style = 0;
+		Info.ID = id;
+		Info.pszIDText = L"Countdown";
+		Info.pszName = L"タイマーの残り時間";
+		Info.MinWidth = 0;
+		Info.MaxWidth = -1;
+		Info.DefaultWidth = TVTest::StatusItemWidthByFontSize(12);
+		Info.MinHeight = 0;
+		return m_pApp->RegisterStatusItem(&Info);
+	}
+
+	UINT CCountdownStatusItem::Update(TimeValue now)
+	{
+		if (m_pApp == nullptr)
+			return 0;
+		if (m_countdown.Update(now) && m_fVisible)
+			m_pApp->StatusItemNotify(m_id, TVTest::STATUS_ITEM_NOTIFY_REDRAW);
+		if (!m_fVisible)
+			return 0;
+		const TimeValue next = m_countdown.NextChange(now);
+		return static_cast<UINT>((next + FILETIME_MS - 1) / FILETIME_MS);
+	}
+
+	bool CCountdownStatusItem::Draw(const TVTest::StatusItemDrawInfo* pInfo)
+	{
+		if (m_hfont == nullptr) {
+			if (m_DPI == 0 && m_hwnd != nullptr)
+				m_DPI = m_pApp->GetDPIFromWindow(m_hwnd);
+			LOGFONTW lf;
+			if (m_pApp->GetFont(L"StatusBarFont", &lf, m_DPI))
+				m_hfont = ::CreateFontIndirectW(&lf);
+		}
+
+		LPCWSTR pszText =
+			(pInfo->Flags & TVTest::STATUS_ITEM_DRAW_FLAG_PREVIEW) != 0 ? L"チャンネル あと 4:56" :
+			m_countdown.GetText().c_str();
+		const HGDIOBJ hOldFont = m_hfont != nullptr ? ::SelectObject(pInfo->hdc, m_hfont) : nullptr;
+		m_pApp->ThemeDrawText(pInfo->pszStyle, pInfo->hdc, pszText, pInfo->DrawRect,
+			DT_LEFT | DT_VCENTER | DT_SINGLELINE | DT_NOPREFIX | DT_END_ELLIPSIS, pInfo->Color);
+		if (hOldFont != nullptr)
+			::SelectObject(pInfo->hdc, hOldFont);
+		return true;
+	}
+
+	bool CCountdownStatusItem::OnNotify(const TVTest::StatusItemEventInfo* pInfo)
+	{
+		switch (pInfo->Event) {
+		case TVTest::STATUS_ITEM_EVENT_CREATED:
+			{
+				TVTest::StatusItemGetInfo Info;
+				Info.Mask = TVTest::STATUS_ITEM_GET_INFO_MASK_STATE | TVTest::STATUS_ITEM_GET_INFO_MASK_HWND;
+				Info.ID = m_id;
+				if (m_pApp->GetStatusItemInfo(&Info)) {
+					m_hwnd = Info.hwnd;
+					m_fVisible = (Info.State & TVTest::STATUS_ITEM_STATE_VISIBLE) != 0;
+				}
+				ResetFont();
+			}
+			return m_fVisible;
+
+		case TVTest::STATUS_ITEM_EVENT_VISIBILITYCHANGED:
+			m_fVisible = pInfo->Param != 0;
+			return m_fVisible;
+
+		case TVTest::STATUS_ITEM_EVENT_STYLECHANGED:
+		case TVTest::STATUS_ITEM_EVENT_FONTCHANGED:
+			ResetFont();
+			return false;
+		}
+		return false;
+	}
+
+	void CCountdownStatusItem::ResetFont()
+	{
+		if (m_hfont != nullptr) {
+			::DeleteObject(m_hfont);
+			m_hfont = nullptr;
+		}
+		m_DPI = 0;
+	}
+}
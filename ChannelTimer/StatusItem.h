@@ -0,0 +1,50 @@
+#pragma once
+#include <string>
+#include <windows.h>
+#include "TVTestPlugin.h"
+#include "Countdown.h"
+
+namespace ChannelTimer {
+	/**
+	 * 次の切り替え先と残り時間を表示するステータス項目
+	 * 表示の文字列が変わった時だけ再描画を要求し、見えていない間や数えるものが無い間は何もしない
+	 * フォントは DPI ごとに作って、DPI かフォントが変わるまで使い回す
+	 */
+	class CCountdownStatusItem {
+	public:
+		~CCountdownStatusItem();
+
+		bool Register(/* const */ TVTest::CTVTestApp* pApp, int id);
+		int GetID() const { return m_id; }
+
+		CCountdown& GetCountdown() { return m_countdown; }
+
+		/**
+		 * 表示を now に合わせ、変わっていて見えていれば再描画を要求する
+		 * 次に更新する時間(ms単位)を返す。更新が要らなければ 0
+		 */
+		UINT Update(TimeValue now);
+
+		/**
+		 * EVENT_STATUSITEM_DRAW
+		 */
+		bool Draw(const TVTest::StatusItemDrawInfo* pInfo);
+
+		/**
+		 * EVENT_STATUSITEM_NOTIFY
+		 * 見えるようになったら true(呼び出し側で Update し直す)
+		 */
+		bool OnNotify(const TVTest::StatusItemEventInfo* pInfo);
+
+	private:
+		/* const */ TVTest::CTVTestApp* m_pApp = nullptr;
+		int m_id = 0;
+		CCountdown m_countdown;
+		bool m_fVisible = false;
+		HWND m_hwnd = nullptr;
+		int m_DPI = 0;			// 0 なら求め直す
+		HFONT m_hfont = nullptr;
+
+		void ResetFont();
+	};
+}
@@ -0,0 +1,71 @@
+#include "StreamWorker.h"
+
+namespace ChannelTimer {
+	CStreamWorker::CStreamWorker(BatchFunc pCallback, void* pClientData)
+		: m_pCallback(pCallback)
+		, m_pClientData(pClientData)
+	{}
+
+	CStreamWorker::~CStreamWorker()
+	{
+		Stop();
+		if (m_hEvent != nullptr)
+			::CloseHandle(m_hEvent);
+	}
+
+	bool CStreamWorker::Start()
+	{
+		Stop();
+
+		if (m_hEvent == nullptr) {
+			m_hEvent = ::CreateEvent(nullptr, FALSE, FALSE, nullptr);
+			if (m_hEvent == nullptr)
+				return false;
+		}
+		m_ring.Reset();
+		m_fStop = false;
+		m_fWaiting = false;
+
+		m_hThread = ::CreateThread(nullptr, 0, ThreadProc, this, 0, nullptr);
+		return m_hThread != nullptr;
+	}
+
+	void CStreamWorker::Stop()
+	{
+		if (m_hThread == nullptr)
+			return;
+
+		m_fStop = true;
+		::SetEvent(m_hEvent);
+		// 処理するスレッドはメッセージを送らない(PostMessage のみ)ので、そのまま待てる
+		::WaitForSingleObject(m_hThread, INFINITE);
+		::CloseHandle(m_hThread);
+		m_hThread = nullptr;
+	}
+
+	DWORD WINAPI CStreamWorker::ThreadProc(LPVOID pParameter)
+	{
+		static_cast<CStreamWorker*>(pParameter)->Run();
+		return 0;
+	}
+
+	void CStreamWorker::Run()
+	{
+		for (;;) {
+			const std::uint8_t* pPackets;
+			std::size_t count;
+			while ((count = m_ring.Peek(&pPackets)) > 0) {
+				m_pCallback(m_pClientData, pPackets, count);
+				m_ring.Consume(count);
+			}
+			if (m_fStop)
+				break;
+
+			// 書く側が m_fWaiting を見てから起こすので、先に立ててから溜まった数を確かめる
+			m_fWaiting = true;
+			if (m_ring.Size() < WAKE_THRESHOLD)
+				::WaitForSingleObject(m_hEvent, MAX_LATENCY);
+			m_fWaiting = false;
+		}
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <windows.h>
+#include "PacketRing.h"
+
+namespace ChannelTimer {
+	/**
+	 * ストリームコールバックで受け取った TS パケットを別スレッドで処理する
+	 * コールバックではリングバッファに入れるだけにして、パイプラインを待たせない
+	 */
+	class CStreamWorker {
+	public:
+		// リングバッファのパケット数
+		static const std::size_t RING_CAPACITY = 1024;
+		// これだけ溜まったら処理するスレッドを起こす
+		static const std::size_t WAKE_THRESHOLD = 64;
+		// 溜まらなくても処理する間隔(ms単位)
+		static const DWORD MAX_LATENCY = 20;
+
+		/**
+		 * 連続した count 個のパケットを処理する(処理するスレッドから呼ばれる)
+		 */
+		typedef void (*BatchFunc)(void* pClientData, const std::uint8_t* pPackets, std::size_t count);
+
+		CStreamWorker(BatchFunc pCallback, void* pClientData);
+		~CStreamWorker();
+
+		bool Start();
+
+		/**
+		 * 止めてスレッドの終了を待つ。パケットを入れる側は先に止めておく
+		 */
+		void Stop();
+
+		/**
+		 * パケットを一つ入れる(ストリームのスレッドから)。満杯なら捨てて false
+		 */
+		bool Push(const std::uint8_t* pPacket)
+		{
+			if (!m_ring.Push(pPacket))
+				return false;
+			if (m_fWaiting.load() && m_ring.Size() >= WAKE_THRESHOLD && m_fWaiting.exchange(false))
+				::SetEvent(m_hEvent);
+			return true;
+		}
+
+		const CPacketRing& GetRing() const { return m_ring; }
+
+	private:
+		BatchFunc m_pCallback;
+		void* m_pClientData;
+		CPacketRing m_ring{ RING_CAPACITY };
+		HANDLE m_hThread = nullptr;
+		HANDLE m_hEvent = nullptr;
+		std::atomic<bool> m_fWaiting{ false };
+		std::atomic<bool> m_fStop{ false };
+
+		static DWORD WINAPI ThreadProc(LPVOID pParameter);
+		void Run();
+	};
+}
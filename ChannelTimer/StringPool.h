@@ -0,0 +1,95 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cwchar>
+#include <vector>
+
+namespace ChannelTimer {
+	/**
+	 * 同じ文字列を一度だけ持つ置き場
+	 * 文字列は一つの配列に '\0' 終端で続けて並べ、番号で指す
+	 * 文字列から番号を引く表は開番地法で、埋まり具合が半分を超えたら広げる。空きは 0 で表す(番号 + 1 を入れる)
+	 * 追加すると配列が移ることがあるので、Get で得たポインタは次の Intern までしか使えない
+	 */
+	class CStringPool {
+	public:
+		using Ref = std::uint32_t;
+
+		static constexpr std::size_t MIN_CAPACITY = 64;
+
+		CStringPool()
+			: m_offsets(1, 0)
+		{}
+
+		/**
+		 * 文字列の番号。無ければ追加する
+		 */
+		Ref Intern(const wchar_t* text, std::size_t length)
+		{
+			if ((Size() + 1) * 2 > m_slots.size())
+				Grow();
+			std::size_t i = Hash(text, length) & m_mask;
+			while (m_slots[i] != 0) {
+				const Ref ref = m_slots[i] - 1;
+				if (Length(ref) == length && std::wmemcmp(Get(ref), text, length) == 0)
+					return ref;
+				i = (i + 1) & m_mask;
+			}
+			const Ref ref = static_cast<Ref>(Size());
+			m_chars.insert(m_chars.end(), text, text + length);
+			m_chars.push_back(L'\0');
+			m_offsets.push_back(static_cast<std::uint32_t>(m_chars.size()));
+			m_slots[i] = ref + 1;
+			return ref;
+		}
+
+		Ref Intern(const wchar_t* text) { return Intern(text, std::wcslen(text)); }
+
+		const wchar_t* Get(Ref ref) const { return m_chars.data() + m_offsets[ref]; }
+		std::size_t Length(Ref ref) const { return m_offsets[ref + 1] - m_offsets[ref] - 1; }
+
+		/**
+		 * 文字列の数
+		 */
+		std::size_t Size() const { return m_offsets.size() - 1; }
+
+		/**
+		 * 確保しているメモリの大きさ(バイト単位)
+		 */
+		std::size_t MemoryUsage() const
+		{
+			return m_chars.capacity() * sizeof(wchar_t)
+				+ m_offsets.capacity() * sizeof(std::uint32_t)
+				+ m_slots.capacity() * sizeof(Ref);
+		}
+
+	private:
+		std::vector<wchar_t> m_chars;
+		std::vector<std::uint32_t> m_offsets;	// 文字列の先頭の位置。末尾は次の文字列の位置
+		std::vector<Ref> m_slots;
+		std::size_t m_mask = 0;
+
+		// FNV-1a
+		static std::size_t Hash(const wchar_t* text, std::size_t length)
+		{
+			std::uint32_t hash = 2166136261u;
+			for (std::size_t i = 0; i < length; i++) {
+				hash ^= static_cast<std::uint16_t>(text[i]);
+				hash *= 16777619u;
+			}
+			return hash;
+		}
+
+		void Grow()
+		{
+			m_slots.assign(m_slots.empty() ? MIN_CAPACITY : m_slots.size() * 2, 0);
+			m_mask = m_slots.size() - 1;
+			for (Ref ref = 0; ref < Size(); ref++) {
+				std::size_t i = Hash(Get(ref), Length(ref)) & m_mask;
+				while (m_slots[i] != 0)
+					i = (i + 1) & m_mask;
+				m_slots[i] = ref + 1;
+			}
+		}
+	};
+}
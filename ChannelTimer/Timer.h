@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Clock.h"
+
+namespace ChannelTimer {
+	/**
+	 * 指定時刻のタイマーの繰り返し
+	 * 予定表には次の回だけを置き、実行した時にその次を求める
+	 */
+	struct Recurrence
+	{
+		enum class Rule : std::uint8_t {
+			RULE_NONE,		// 繰り返さない
+			RULE_DAILY,		// 毎日
+			RULE_WEEKDAYS,	// 平日(月曜から金曜)
+			RULE_WEEKLY		// 毎週(weekdays の曜日)
+		};
+
+		Rule rule = Rule::RULE_NONE;
+		std::uint8_t weekdays = 0;				// RULE_WEEKLY の曜日(ビット 0 が日曜)
+		TimeValue localOffset = 0;				// 日付と曜日を決める地方時と UTC の差
+		std::vector<std::int32_t> exceptions;	// 実行しない日(地方時の 1601/1/1 からの日数)。降順で、最も近い日が末尾
+	};
+
+	/**
+	 * 予約するタイマー
+	 */
+	struct Timer
+	{
+		// スリープ条件
+		enum class SleepCondition {
+			CONDITION_DURATION,	// 時間経過
+			CONDITION_DATETIME,	// 指定時刻
+			CONDITION_EVENTEND	// 番組終了
+		};
+
+		SleepCondition condition = SleepCondition::CONDITION_DURATION;	// スリープする条件
+		TimeValue dateToChange = 0;			// スリープする日時(UTC)
+		bool broadcastTime = false;			// dateToChange を放送局の時刻(TOT)で数える
+		Recurrence recurrence;				// 指定時刻の繰り返し
+		std::uint32_t durationToChange = 0;	// スリープまでの時間(秒単位)
+		TimeValue leadTime = 0;				// 確認と切り替えのために早める時間
+		std::uint16_t eventID = 0;			// 現在の番組の event_id
+		std::uint16_t eventServiceID = 0;	// 現在の番組の service_id
+		TimeValue eventEndTime = 0;			// 現在の番組の終了日時(UTC、未定なら 0)
+		TimeValue addedTime = 0;			// 予約した日時(UTC)
+		std::uint32_t serial = 0;			// 保存用の通し番号
+
+		// 切り替え先
+		std::wstring tuner;					// チューナー
+		int space = -1;						// チューニング空間(-1 で指定なし)
+		int channel = -1;					// チャンネル(-1 で指定なし)
+		std::uint16_t networkID = 0;
+		std::uint16_t transportStreamID = 0;
+		std::uint16_t serviceID = 0;
+		std::uint16_t programEventID = 0;	// 番組表から予約した切り替え先の番組の event_id(0 なら無し)
+	};
+}
@@ -0,0 +1,226 @@
+#include "TimerScheduler.h"
+
+namespace ChannelTimer {
+	namespace {
+		bool IsBroadcastAnchored(const Timer& timer)
+		{
+			return timer.condition == Timer::SleepCondition::CONDITION_DATETIME && timer.broadcastTime;
+		}
+	}
+
+	TimeValue ComputeDeadline(const Timer& timer, TimeValue now, TimeValue broadcastOffset)
+	{
+		switch (timer.condition) {
+		case Timer::SleepCondition::CONDITION_DURATION:
+			return now + timer.durationToChange * FILETIME_SEC - timer.leadTime;
+		case Timer::SleepCondition::CONDITION_DATETIME:
+			if (timer.broadcastTime)
+				return timer.dateToChange - broadcastOffset - timer.leadTime;
+			return timer.dateToChange - timer.leadTime;
+		case Timer::SleepCondition::CONDITION_EVENTEND:
+			if (timer.eventID != 0 && timer.eventEndTime != 0)
+				return timer.eventEndTime - timer.leadTime;
+			// 期限は現在の番組から求める
+			return CTimerScheduler::DEADLINE_UNKNOWN;
+		default:
+			return CTimerScheduler::DEADLINE_UNKNOWN;
+		}
+	}
+
+	template<typename Schedule>
+	TimerId CBasicTimerScheduler<Schedule>::Add(const Timer& timer, TimeValue now)
+	{
+		Timer newTimer = timer;
+		newTimer.eventID = 0;
+		newTimer.eventServiceID = 0;
+		newTimer.eventEndTime = 0;
+		newTimer.addedTime = now;
+		return Insert(std::move(newTimer), now);
+	}
+
+	template<typename Schedule>
+	TimerId CBasicTimerScheduler<Schedule>::Restore(const Timer& timer)
+	{
+		Timer newTimer = timer;
+		return Insert(std::move(newTimer), timer.addedTime);
+	}
+
+	template<typename Schedule>
+	TimerId CBasicTimerScheduler<Schedule>::Insert(Timer&& timer, TimeValue now)
+	{
+		m_schedule.Advance(now);
+
+		const TimeValue deadline = ComputeDeadline(timer, now, m_BroadcastOffset);
+		if (deadline == DEADLINE_UNKNOWN)
+			m_PollingCount++;
+		if (timer.condition == Timer::SleepCondition::CONDITION_EVENTEND)
+			m_EventEndCount++;
+		if (IsBroadcastAnchored(timer))
+			m_BroadcastCount++;
+
+		return m_schedule.Add(std::move(timer), deadline);
+	}
+
+	template<typename Schedule>
+	bool CBasicTimerScheduler<Schedule>::Remove(TimerId id)
+	{
+		const Timer* pTimer = m_schedule.Get(id);
+		if (pTimer == nullptr)
+			return false;
+		if (pTimer->condition == Timer::SleepCondition::CONDITION_EVENTEND)
+			m_EventEndCount--;
+		if (IsBroadcastAnchored(*pTimer))
+			m_BroadcastCount--;
+		if (m_schedule.GetDeadline(id) == DEADLINE_UNKNOWN)
+			m_PollingCount--;
+		return m_schedule.Cancel(id);
+	}
+
+	template<typename Schedule>
+	void CBasicTimerScheduler<Schedule>::Clear()
+	{
+		m_schedule.Clear();
+		m_EventEndCount = 0;
+		m_PollingCount = 0;
+		m_BroadcastCount = 0;
+	}
+
+	template<typename Schedule>
+	TimeValue CBasicTimerScheduler<Schedule>::NextDeadline() const
+	{
+		return m_schedule.Empty() ? DEADLINE_UNKNOWN : m_schedule.TopDeadline();
+	}
+
+	template<typename Schedule>
+	int CBasicTimerScheduler<Schedule>::UpdateEventEnd(const ProgramState& program, TimeValue now, std::vector<TimerId>* pChanged)
+	{
+		m_schedule.Advance(now);
+		if (m_EventEndCount == 0)
+			return 0;
+
+		std::vector<TimerId> timers;
+		m_schedule.ForEach([&](TimerId id, const Timer& timer, TimeValue) {
+			if (timer.condition == Timer::SleepCondition::CONDITION_EVENTEND)
+				timers.push_back(id);
+		});
+
+		int latched = 0;
+
+		for (const TimerId id : timers) {
+			Timer& timer = *m_schedule.Get(id);
+			// 確認時間を差し引いた切り替えの期限
+			const TimeValue switchTime =
+				program.endTime == DEADLINE_UNKNOWN ? DEADLINE_UNKNOWN : program.endTime - timer.leadTime;
+			const TimeValue endTime = program.endTime == DEADLINE_UNKNOWN ? 0 : program.endTime;
+			TimeValue deadline;
+
+			if (timer.eventID == 0) {
+				// 番組終了が近い場合は、次の番組が始まってから対象を決める
+				// それまでは期限を決めず、番組の確認を続ける
+				if (switchTime != DEADLINE_UNKNOWN && switchTime - now <= EVENTEND_MIN_REMAINING) {
+					deadline = DEADLINE_UNKNOWN;
+				} else {
+					timer.eventID = program.eventID;
+					timer.eventServiceID = program.serviceID;
+					timer.eventEndTime = endTime;
+					deadline = switchTime;
+					latched++;
+					if (pChanged != nullptr)
+						pChanged->push_back(id);
+				}
+			} else if (timer.eventID == program.eventID) {
+				// 延長などで終了時刻が変わっていれば期限を合わせる
+				if (timer.eventEndTime != endTime) {
+					timer.eventEndTime = endTime;
+					if (pChanged != nullptr)
+						pChanged->push_back(id);
+				}
+				deadline = switchTime;
+			} else if (timer.eventServiceID != program.serviceID) {
+				// 別のサービスを視聴中なので、求めておいた期限のままにする
+				continue;
+			} else {
+				// 番組が変わったので直ちに実行する
+				deadline = now;
+			}
+
+			SetDeadline(id, deadline);
+		}
+
+		return latched;
+	}
+
+	template<typename Schedule>
+	int CBasicTimerScheduler<Schedule>::OnEventChanged(std::uint16_t serviceID, std::uint16_t eventID, TimeValue now)
+	{
+		m_schedule.Advance(now);
+		if (m_EventEndCount == 0)
+			return 0;
+
+		std::vector<TimerId> timers;
+		m_schedule.ForEach([&](TimerId id, const Timer& timer, TimeValue deadline) {
+			if (timer.condition == Timer::SleepCondition::CONDITION_EVENTEND
+					&& timer.eventID != 0 && timer.eventID != eventID
+					&& timer.eventServiceID == serviceID
+					&& deadline > now)
+				timers.push_back(id);
+		});
+
+		for (const TimerId id : timers)
+			SetDeadline(id, now);
+		return static_cast<int>(timers.size());
+	}
+
+	template<typename Schedule>
+	int CBasicTimerScheduler<Schedule>::SetBroadcastOffset(TimeValue offset)
+	{
+		const TimeValue delta = offset - m_BroadcastOffset;
+		m_BroadcastOffset = offset;
+		if (m_BroadcastCount == 0 || delta == 0)
+			return 0;
+
+		std::vector<TimerId> timers;
+		m_schedule.ForEach([&](TimerId id, const Timer& timer, TimeValue) {
+			if (IsBroadcastAnchored(timer))
+				timers.push_back(id);
+		});
+
+		// 放送局の時計が進んでいれば、システム時刻ではその分早く切り替える
+		for (const TimerId id : timers)
+			SetDeadline(id, m_schedule.GetDeadline(id) - delta);
+		return static_cast<int>(timers.size());
+	}
+
+	template<typename Schedule>
+	bool CBasicTimerScheduler<Schedule>::PopDue(TimeValue time, Timer* pTimer, TimeValue* pDeadline)
+	{
+		m_schedule.Advance(time);
+		const TimeValue deadline = NextDeadline();
+		if (deadline == DEADLINE_UNKNOWN || deadline > time)
+			return false;
+		if (pDeadline != nullptr)
+			*pDeadline = deadline;
+
+		const TimerId id = m_schedule.Top();
+		*pTimer = *m_schedule.Get(id);
+		Remove(id);
+		return true;
+	}
+
+	template<typename Schedule>
+	void CBasicTimerScheduler<Schedule>::SetDeadline(TimerId id, TimeValue deadline)
+	{
+		const TimeValue oldDeadline = m_schedule.GetDeadline(id);
+		if (oldDeadline == deadline)
+			return;
+		if (oldDeadline == DEADLINE_UNKNOWN)
+			m_PollingCount--;
+		else if (deadline == DEADLINE_UNKNOWN)
+			m_PollingCount++;
+		m_schedule.Reschedule(id, deadline);
+	}
+
+	// どちらの予定表でも使えるようにしておく
+	template class CBasicTimerScheduler<CSchedule<Timer>>;
+	template class CBasicTimerScheduler<CTimingWheel<Timer>>;
+}
@@ -0,0 +1,132 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Clock.h"
+#include "Schedule.h"
+#include "TimingWheel.h"
+#include "Timer.h"
+
+namespace ChannelTimer {
+	/**
+	 * 現在視聴中の番組
+	 */
+	struct ProgramState {
+		std::uint16_t serviceID;
+		std::uint16_t eventID;
+		TimeValue endTime;		// 終了日時(UTC)。未定なら CTimerScheduler::DEADLINE_UNKNOWN
+	};
+
+	/**
+	 * タイマーの予約と条件の判定
+	 * Win32 に依存せず、現在日時は呼び出し側から渡す
+	 * Schedule は期限順の予定表(CSchedule か CTimingWheel)
+	 */
+	template<typename Schedule>
+	class CBasicTimerScheduler {
+	public:
+		// 期限が決まっていないタイマー(番組終了待ち)の期限
+		static constexpr TimeValue DEADLINE_UNKNOWN = INT64_MAX;
+		// 番組終了がこれより近ければ、次の番組を対象にする
+		static constexpr TimeValue EVENTEND_MIN_REMAINING = 2LL * FILETIME_MIN;
+
+		/**
+		 * タイマーを予約する
+		 * 期限は条件と timer.leadTime から求める
+		 * now は予約した日時として timer.addedTime に残る
+		 */
+		TimerId Add(const Timer& timer, TimeValue now);
+
+		/**
+		 * 保存しておいたタイマーを戻す
+		 * Add と違い、timer.addedTime と番組終了待ちの対象の番組をそのまま使う
+		 */
+		TimerId Restore(const Timer& timer);
+
+		bool Remove(TimerId id);
+		void Clear();
+
+		bool Empty() const { return m_schedule.Empty(); }
+		std::size_t Size() const { return m_schedule.Size(); }
+		const Timer* Get(TimerId id) const { return m_schedule.Get(id); }
+		TimeValue GetDeadline(TimerId id) const { return m_schedule.GetDeadline(id); }
+
+		/**
+		 * 最も期限の早いタイマー
+		 */
+		TimerId Top() const { return m_schedule.Top(); }
+
+		/**
+		 * 最も早い期限。期限の決まったタイマーが無ければ DEADLINE_UNKNOWN
+		 */
+		TimeValue NextDeadline() const;
+
+		/**
+		 * 番組終了待ちのタイマーがあるか
+		 */
+		bool HasEventEndTimers() const { return m_EventEndCount > 0; }
+
+		/**
+		 * 期限が決まらず、定期的に番組を確認する必要があるか
+		 */
+		bool NeedsPolling() const { return m_PollingCount > 0; }
+
+		/**
+		 * 現在の番組から番組終了待ちのタイマーの期限を求め直す
+		 * 対象の番組が決まるまでは期限を DEADLINE_UNKNOWN にしておき、実行しない
+		 * 新たに対象の番組が決まったタイマーの数を返す
+		 * pChanged が nullptr でなければ、対象の番組か終了日時が変わった(保存し直す)タイマーを返す
+		 */
+		int UpdateEventEnd(const ProgramState& program, TimeValue now, std::vector<TimerId>* pChanged = nullptr);
+
+		/**
+		 * ストリームから番組が変わったのを知った時に呼ぶ
+		 * serviceID の番組の終了を待っていて event_id が変わったタイマーの期限を now にする
+		 * 期限を変えたタイマーの数を返す
+		 */
+		int OnEventChanged(std::uint16_t serviceID, std::uint16_t eventID, TimeValue now);
+
+		/**
+		 * 放送局の時刻とシステム時刻の差(放送 - システム)を設定する
+		 * 放送局の時刻に合わせる指定時刻のタイマーの期限を求め直し、その数を返す
+		 */
+		int SetBroadcastOffset(TimeValue offset);
+		TimeValue GetBroadcastOffset() const { return m_BroadcastOffset; }
+
+		/**
+		 * 期限が time 以前のタイマーを一つ取り出す
+		 * pDeadline が nullptr でなければ、取り出したタイマーの期限を返す
+		 */
+		bool PopDue(TimeValue time, Timer* pTimer, TimeValue* pDeadline = nullptr);
+
+		/**
+		 * 全てのタイマーを列挙する(順序は不定)
+		 */
+		template<typename F>
+		void ForEach(F func) const { m_schedule.ForEach(func); }
+
+	private:
+		Schedule m_schedule;
+		int m_EventEndCount = 0;	// 番組終了待ちのタイマーの数
+		int m_PollingCount = 0;		// 期限が決まらず確認が必要なタイマーの数
+		int m_BroadcastCount = 0;	// 放送局の時刻に合わせるタイマーの数
+		TimeValue m_BroadcastOffset = 0;
+
+		TimerId Insert(Timer&& timer, TimeValue now);
+		void SetDeadline(TimerId id, TimeValue deadline);
+	};
+
+	// 予定表はビルド時に選ぶ。CHANNELTIMER_TIMING_WHEEL を定義するとタイミングホイールにする
+	// (CMake では -DCHANNELTIMER_TIMING_WHEEL=ON、ChannelTimer.vcxproj では /p:ChannelTimerTimingWheel=true)
+#ifdef CHANNELTIMER_TIMING_WHEEL
+	using CTimerScheduler = CBasicTimerScheduler<CTimingWheel<Timer>>;
+#else
+	using CTimerScheduler = CBasicTimerScheduler<CSchedule<Timer>>;
+#endif
+
+	/**
+	 * 条件から切り替えの期限を求める
+	 * 番組終了待ちは対象の番組の終了日時から求め、分からなければ DEADLINE_UNKNOWN
+	 * broadcastOffset は放送局の時刻とシステム時刻の差(放送 - システム)
+	 */
+	TimeValue ComputeDeadline(const Timer& timer, TimeValue now, TimeValue broadcastOffset = 0);
+}
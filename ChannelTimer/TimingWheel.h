@@ -0,0 +1,447 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "Clock.h"
+#include "Schedule.h"
+
+namespace ChannelTimer {
+	/**
+	 * 秒・分・時・日の階層を持つタイミングホイールの予定表
+	 * CSchedule と同じ使い方で、追加・取り消し・期限変更は O(1)
+	 * Advance で時刻を進めた時に上の階層のタイマーを下へ移し、その手間は一つのタイマーにつき高々階層の数
+	 * 期限の来たタイマーは期限順に並べておくので、続けて取り出す時の Top は O(1)
+	 * 期限が TICK 単位より細かくても、取り出す順序は期限順になる
+	 */
+	template<typename T, std::int64_t TICK = FILETIME_SEC>
+	class CTimingWheel {
+	public:
+		using Deadline = std::int64_t;
+
+		static constexpr int LEVEL_COUNT = 4;
+		// 各階層のスロット数(秒、分、時、日)。64 を超えないこと
+		static constexpr int SLOT_COUNT[LEVEL_COUNT] = { 60, 60, 24, 64 };
+
+		CTimingWheel()
+		{
+			for (TimerId& head : m_heads)
+				head = INVALID_TIMER_ID;
+		}
+
+		TimerId Add(T value, Deadline deadline)
+		{
+			TimerId id;
+			if (!m_free.empty()) {
+				id = m_free.back();
+				m_free.pop_back();
+			} else {
+				id = static_cast<TimerId>(m_nodes.size());
+				m_nodes.emplace_back();
+			}
+			Node& node = m_nodes[id];
+			node.value = std::move(value);
+			node.deadline = deadline;
+			node.used = true;
+			Insert(id);
+			SortDue();
+			m_size++;
+			m_fTopValid = false;
+			return id;
+		}
+
+		bool Cancel(TimerId id)
+		{
+			if (!Contains(id))
+				return false;
+			Unlink(id);
+			m_nodes[id] = Node();
+			m_free.push_back(id);
+			m_size--;
+			m_fTopValid = false;
+			return true;
+		}
+
+		bool Reschedule(TimerId id, Deadline deadline)
+		{
+			if (!Contains(id))
+				return false;
+			Unlink(id);
+			m_nodes[id].deadline = deadline;
+			Insert(id);
+			SortDue();
+			m_fTopValid = false;
+			return true;
+		}
+
+		/**
+		 * 時刻を time まで進める。期限の来たタイマーを取り出す前に呼ぶ
+		 * 戻すことはできない(time が前より早ければ何もしない)
+		 */
+		void Advance(Deadline time)
+		{
+			const std::int64_t target = time / TICK;
+			if (target <= m_tick)
+				return;
+			m_fTopValid = false;
+
+			while (m_tick < target) {
+				// 下の階層が空なら、その階層の境界は飛ばしてよい
+				std::int64_t unit;
+				if (m_counts[0] != 0 || m_counts[1] != 0)
+					unit = TICKS_PER_MINUTE;
+				else if (m_counts[2] != 0)
+					unit = TICKS_PER_HOUR;
+				else if (m_counts[3] != 0)
+					unit = TICKS_PER_DAY;
+				else
+					unit = 0;
+
+				const std::int64_t next = unit != 0 ? (m_tick / unit + 1) * unit : target;
+				if (next > target || unit == 0) {
+					CollectDue(m_tick + 1, target);
+					const bool fNewDay = target / TICKS_PER_DAY != m_tick / TICKS_PER_DAY;
+					m_tick = target;
+					if (fNewDay)
+						CascadeFar();
+					break;
+				}
+
+				CollectDue(m_tick + 1, next);
+				m_tick = next;
+				if (m_tick % TICKS_PER_DAY == 0) {
+					Cascade(3, static_cast<int>(m_tick / TICKS_PER_DAY % SLOT_COUNT[3]));
+					CascadeFar();
+				}
+				if (m_tick % TICKS_PER_HOUR == 0)
+					Cascade(2, static_cast<int>(m_tick / TICKS_PER_HOUR % SLOT_COUNT[2]));
+				Cascade(1, static_cast<int>(m_tick / TICKS_PER_MINUTE % SLOT_COUNT[1]));
+			}
+
+			SortDue();
+		}
+
+		bool Contains(TimerId id) const
+		{
+			return id < m_nodes.size() && m_nodes[id].used;
+		}
+
+		T* Get(TimerId id)
+		{
+			return Contains(id) ? &m_nodes[id].value : nullptr;
+		}
+
+		const T* Get(TimerId id) const
+		{
+			return Contains(id) ? &m_nodes[id].value : nullptr;
+		}
+
+		Deadline GetDeadline(TimerId id) const
+		{
+			return m_nodes[id].deadline;
+		}
+
+		bool Empty() const { return m_size == 0; }
+		std::size_t Size() const { return m_size; }
+
+		// 最も期限の早いタイマー
+		TimerId Top() const
+		{
+			if (!m_fTopValid) {
+				m_top = FindTop();
+				m_fTopValid = true;
+			}
+			return m_top;
+		}
+
+		Deadline TopDeadline() const { return m_nodes[Top()].deadline; }
+
+		// 全てのタイマーを列挙する(順序は不定)
+		template<typename F>
+		void ForEach(F func) const
+		{
+			for (TimerId id = 0; id < m_nodes.size(); id++) {
+				if (m_nodes[id].used)
+					func(id, m_nodes[id].value, m_nodes[id].deadline);
+			}
+		}
+
+		void Clear()
+		{
+			m_nodes.clear();
+			m_free.clear();
+			for (TimerId& head : m_heads)
+				head = INVALID_TIMER_ID;
+			for (std::uint64_t& bits : m_occupied)
+				bits = 0;
+			for (std::size_t& count : m_counts)
+				count = 0;
+			m_size = 0;
+			m_fDueSorted = true;
+			m_fTopValid = false;
+		}
+
+	private:
+		static constexpr std::int64_t TICKS_PER_MINUTE = 60;
+		static constexpr std::int64_t TICKS_PER_HOUR = 60 * TICKS_PER_MINUTE;
+		static constexpr std::int64_t TICKS_PER_DAY = 24 * TICKS_PER_HOUR;
+		// 各階層に入れる期限の範囲(現在からの TICK 数)
+		static constexpr std::int64_t LEVEL_SPAN[LEVEL_COUNT] = {
+			TICKS_PER_MINUTE, TICKS_PER_HOUR, TICKS_PER_DAY, 64 * TICKS_PER_DAY
+		};
+		static constexpr std::int64_t LEVEL_UNIT[LEVEL_COUNT] = {
+			1, TICKS_PER_MINUTE, TICKS_PER_HOUR, TICKS_PER_DAY
+		};
+
+		// 期限の来たタイマー、各階層のスロット、日の階層より先のタイマー(期限未定を含む)の順に並べたリスト
+		// 期限の来たタイマーのリストだけは期限順にしておく
+		static constexpr int BUCKET_DUE = 0;
+		static constexpr int BUCKET_LEVEL_BEGIN = 1;
+		static constexpr int BUCKET_FAR = BUCKET_LEVEL_BEGIN + 60 + 60 + 24 + 64;
+		static constexpr int BUCKET_COUNT = BUCKET_FAR + 1;
+
+		struct Node {
+			T value = T();
+			Deadline deadline = 0;
+			TimerId prev = INVALID_TIMER_ID;
+			TimerId next = INVALID_TIMER_ID;
+			std::uint16_t bucket = 0;
+			bool used = false;
+		};
+
+		std::vector<Node> m_nodes;
+		std::vector<TimerId> m_free;
+		TimerId m_heads[BUCKET_COUNT] = {};
+		std::uint64_t m_occupied[LEVEL_COUNT] = {};	// 空でないスロット
+		std::size_t m_counts[LEVEL_COUNT] = {};		// 階層ごとのタイマーの数
+		std::size_t m_size = 0;
+		std::int64_t m_tick = 0;					// 現在の時刻(TICK 単位)
+		bool m_fDueSorted = true;					// 期限の来たタイマーのリストが期限順か
+		std::vector<TimerId> m_dueOrder;			// 並べ直す時の作業用
+		mutable TimerId m_top = INVALID_TIMER_ID;
+		mutable bool m_fTopValid = false;
+
+		static int LevelBucket(int level, int slot)
+		{
+			static const int base[LEVEL_COUNT] = { 0, 60, 120, 144 };
+			return BUCKET_LEVEL_BEGIN + base[level] + slot;
+		}
+
+		static int BucketLevel(int bucket, int* pSlot)
+		{
+			if (bucket < BUCKET_LEVEL_BEGIN || bucket >= BUCKET_FAR)
+				return -1;
+			int slot = bucket - BUCKET_LEVEL_BEGIN;
+			for (int level = 0; level < LEVEL_COUNT; level++) {
+				if (slot < SLOT_COUNT[level]) {
+					*pSlot = slot;
+					return level;
+				}
+				slot -= SLOT_COUNT[level];
+			}
+			return -1;
+		}
+
+		void Insert(TimerId id)
+		{
+			Node& node = m_nodes[id];
+			const std::int64_t tick = node.deadline / TICK;
+			const std::int64_t delta = tick - m_tick;
+
+			int bucket = BUCKET_FAR;
+			if (delta <= 0) {
+				bucket = BUCKET_DUE;
+			} else {
+				for (int level = 0; level < LEVEL_COUNT; level++) {
+					if (delta < LEVEL_SPAN[level]
+							// 日の階層は日付の差で決める(先のタイマーは日付が変わる時に見直す)
+							&& (level < 3 || tick / TICKS_PER_DAY - m_tick / TICKS_PER_DAY < SLOT_COUNT[3])) {
+						const int slot = static_cast<int>(tick / LEVEL_UNIT[level] % SLOT_COUNT[level]);
+						bucket = LevelBucket(level, slot);
+						m_occupied[level] |= std::uint64_t(1) << slot;
+						m_counts[level]++;
+						break;
+					}
+				}
+			}
+
+			Link(id, bucket);
+		}
+
+		bool Less(TimerId a, TimerId b) const
+		{
+			return m_nodes[a].deadline < m_nodes[b].deadline
+				|| (m_nodes[a].deadline == m_nodes[b].deadline && a < b);
+		}
+
+		void Link(TimerId id, int bucket)
+		{
+			Node& node = m_nodes[id];
+			node.bucket = static_cast<std::uint16_t>(bucket);
+			node.prev = INVALID_TIMER_ID;
+			node.next = m_heads[bucket];
+			if (node.next != INVALID_TIMER_ID) {
+				m_nodes[node.next].prev = id;
+				// 期限の来たリストは先頭に入れて、順序が崩れたら後でまとめて並べ直す
+				if (bucket == BUCKET_DUE && Less(node.next, id))
+					m_fDueSorted = false;
+			}
+			m_heads[bucket] = id;
+		}
+
+		// 期限の来たタイマーのリストを期限順に並べ直す
+		// 時刻を進めるたびに一度だけなので、一度に多くのタイマーの期限が来ても取り出す手間は増えない
+		void SortDue()
+		{
+			if (m_fDueSorted)
+				return;
+			m_dueOrder.clear();
+			for (TimerId id = m_heads[BUCKET_DUE]; id != INVALID_TIMER_ID; id = m_nodes[id].next)
+				m_dueOrder.push_back(id);
+			std::sort(m_dueOrder.begin(), m_dueOrder.end(),
+				[this](TimerId a, TimerId b) { return Less(a, b); });
+			TimerId prev = INVALID_TIMER_ID;
+			for (const TimerId id : m_dueOrder) {
+				m_nodes[id].prev = prev;
+				if (prev != INVALID_TIMER_ID)
+					m_nodes[prev].next = id;
+				else
+					m_heads[BUCKET_DUE] = id;
+				prev = id;
+			}
+			m_nodes[prev].next = INVALID_TIMER_ID;
+			m_fDueSorted = true;
+		}
+
+		void Unlink(TimerId id)
+		{
+			Node& node = m_nodes[id];
+			if (node.prev != INVALID_TIMER_ID)
+				m_nodes[node.prev].next = node.next;
+			else
+				m_heads[node.bucket] = node.next;
+			if (node.next != INVALID_TIMER_ID)
+				m_nodes[node.next].prev = node.prev;
+
+			int slot;
+			const int level = BucketLevel(node.bucket, &slot);
+			if (level >= 0) {
+				m_counts[level]--;
+				if (m_heads[node.bucket] == INVALID_TIMER_ID)
+					m_occupied[level] &= ~(std::uint64_t(1) << slot);
+			}
+		}
+
+		// バケットのタイマーを全て外して、現在の時刻から入れ直す
+		void Reinsert(int bucket)
+		{
+			TimerId id = m_heads[bucket];
+			while (id != INVALID_TIMER_ID) {
+				const TimerId next = m_nodes[id].next;
+				Unlink(id);
+				Insert(id);
+				id = next;
+			}
+		}
+
+		void Cascade(int level, int slot)
+		{
+			if (m_occupied[level] & (std::uint64_t(1) << slot))
+				Reinsert(LevelBucket(level, slot));
+		}
+
+		void CascadeFar()
+		{
+			// 入れ直して遠いままのものは先頭に戻るので、一度外してから入れる
+			TimerId id = m_heads[BUCKET_FAR];
+			m_heads[BUCKET_FAR] = INVALID_TIMER_ID;
+			while (id != INVALID_TIMER_ID) {
+				const TimerId next = m_nodes[id].next;
+				Insert(id);
+				id = next;
+			}
+		}
+
+		// 秒の階層で first から last までの TICK のスロットを、期限の来たリストへ移す
+		// 時刻を進める前に呼ぶので、入れ直さずに直接移す
+		void CollectDue(std::int64_t first, std::int64_t last)
+		{
+			if (m_counts[0] == 0 || last < first)
+				return;
+			const std::int64_t count = last - first + 1 < SLOT_COUNT[0] ? last - first + 1 : SLOT_COUNT[0];
+			for (std::int64_t i = 0; i < count; i++) {
+				const int slot = static_cast<int>((first + i) % SLOT_COUNT[0]);
+				if ((m_occupied[0] & (std::uint64_t(1) << slot)) == 0)
+					continue;
+				TimerId id = m_heads[LevelBucket(0, slot)];
+				while (id != INVALID_TIMER_ID) {
+					const TimerId next = m_nodes[id].next;
+					Unlink(id);
+					Link(id, BUCKET_DUE);
+					id = next;
+				}
+			}
+		}
+
+		// 最下位のビットの位置
+		static int LowestBit(std::uint64_t v)
+		{
+			static const int table[64] = {
+				 0,  1, 48,  2, 57, 49, 28,  3, 61, 58, 50, 42, 38, 29, 17,  4,
+				62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12,  5,
+				63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+				46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19,  9, 13,  8,  7,  6
+			};
+			return table[((v & (~v + 1)) * 0x03F79D71B4CB0A89ULL) >> 58];
+		}
+
+		// リストの中で最も期限の早いタイマーを best と比べる
+		void FindMin(int bucket, TimerId* pBest) const
+		{
+			for (TimerId id = m_heads[bucket]; id != INVALID_TIMER_ID; id = m_nodes[id].next) {
+				if (*pBest == INVALID_TIMER_ID || Less(id, *pBest))
+					*pBest = id;
+			}
+		}
+
+		TimerId FindTop() const
+		{
+			// 期限の来たタイマーは期限順で、階層にあるどのタイマーよりも早い(時刻を進める時に全て移している)
+			if (m_heads[BUCKET_DUE] != INVALID_TIMER_ID)
+				return m_heads[BUCKET_DUE];
+
+			// 各階層の現在の次のスロットから一周した中で最初の空でないスロット
+			// 上の階層にまだ下へ移していない早いタイマーがあり得るので、全ての階層を見る
+			// ただし、スロットの始まりが見つけたものより遅ければ、その中は見なくてよい
+			TimerId best = INVALID_TIMER_ID;
+			bool fFound = false;
+			for (int level = 0; level < LEVEL_COUNT; level++) {
+				const std::uint64_t bits = m_occupied[level];
+				if (bits == 0)
+					continue;
+				fFound = true;
+				const std::int64_t index = m_tick / LEVEL_UNIT[level];
+				const int current = static_cast<int>(index % SLOT_COUNT[level]);
+				const std::uint64_t after = current + 1 < 64 ? bits & (~std::uint64_t(0) << (current + 1)) : 0;
+				const int slot = LowestBit(after != 0 ? after : bits);
+				const std::int64_t start = (index + (slot > current ? slot - current : slot + SLOT_COUNT[level] - current)) * LEVEL_UNIT[level];
+				if (best != INVALID_TIMER_ID && start * TICK > m_nodes[best].deadline)
+					continue;
+				FindMin(LevelBucket(level, slot), &best);
+			}
+
+			// 日の階層より先のタイマーは、他の全てより遅い
+			if (!fFound)
+				FindMin(BUCKET_FAR, &best);
+			return best;
+		}
+	};
+
+	template<typename T, std::int64_t TICK>
+	constexpr int CTimingWheel<T, TICK>::SLOT_COUNT[CTimingWheel<T, TICK>::LEVEL_COUNT];
+	template<typename T, std::int64_t TICK>
+	constexpr std::int64_t CTimingWheel<T, TICK>::LEVEL_SPAN[CTimingWheel<T, TICK>::LEVEL_COUNT];
+	template<typename T, std::int64_t TICK>
+	constexpr std::int64_t CTimingWheel<T, TICK>::LEVEL_UNIT[CTimingWheel<T, TICK>::LEVEL_COUNT];
+}
@@ -0,0 +1,145 @@
+#include "TunerPlanner.h"
+#include <algorithm>
+#include <iterator>
+
+namespace ChannelTimer {
+	bool CTunerPlanner::Add(const Request& request, std::vector<std::uint32_t>* pConflicts)
+	{
+		Remove(request.serial);
+
+		Plan& plan = m_plans[request.serial];
+		plan.begin = request.begin;
+		plan.end = std::max(request.end, request.begin + 1);
+		for (const std::wstring& name : request.tuners) {
+			const TunerId tuner = GetTunerId(name);
+			if (std::find(plan.tuners.begin(), plan.tuners.end(), tuner) == plan.tuners.end())
+				plan.tuners.push_back(tuner);
+		}
+
+		if (pConflicts != nullptr)
+			pConflicts->clear();
+		if (Place(request.serial, plan, pConflicts))
+			return true;
+		m_conflicts.insert(request.serial);
+		return false;
+	}
+
+	void CTunerPlanner::Remove(std::uint32_t serial)
+	{
+		const auto it = m_plans.find(serial);
+		if (it == m_plans.end())
+			return;
+		const TimeValue begin = it->second.begin;
+		const TimeValue end = it->second.end;
+		const bool fAssigned = it->second.tuner >= 0;
+		Unassign(it->second);
+		m_plans.erase(it);
+		m_conflicts.erase(serial);
+
+		// 空いた区間と重なっていて置けていなかったタイマーだけを置き直す
+		if (!fAssigned)
+			return;
+		for (auto c = m_conflicts.begin(); c != m_conflicts.end();) {
+			Plan& plan = m_plans[*c];
+			if (plan.begin < end && begin < plan.end && Place(*c, plan, nullptr))
+				c = m_conflicts.erase(c);
+			else
+				++c;
+		}
+	}
+
+	void CTunerPlanner::Clear()
+	{
+		m_plans.clear();
+		m_conflicts.clear();
+		for (Lane& lane : m_lanes)
+			lane.clear();
+	}
+
+	const std::wstring* CTunerPlanner::GetTuner(std::uint32_t serial) const
+	{
+		const auto it = m_plans.find(serial);
+		if (it == m_plans.end() || it->second.tuner < 0)
+			return nullptr;
+		return &m_tunerNames[it->second.tuner];
+	}
+
+	CTunerPlanner::TunerId CTunerPlanner::GetTunerId(const std::wstring& name)
+	{
+		const auto it = m_tunerIds.find(name);
+		if (it != m_tunerIds.end())
+			return it->second;
+		const TunerId tuner = static_cast<TunerId>(m_tunerNames.size());
+		m_tunerNames.push_back(name);
+		m_lanes.emplace_back();
+		m_tunerIds.emplace(name, tuner);
+		return tuner;
+	}
+
+	bool CTunerPlanner::Place(std::uint32_t serial, Plan& plan, std::vector<std::uint32_t>* pConflicts)
+	{
+		// 空いているチューナー
+		for (const TunerId tuner : plan.tuners) {
+			if (IsFree(tuner, plan.begin, plan.end)) {
+				Assign(serial, plan, tuner);
+				return true;
+			}
+		}
+
+		// 重なるタイマーが一つだけなら、それを他の空いているチューナーへ移す
+		std::vector<std::uint32_t> overlaps;
+		for (const TunerId tuner : plan.tuners) {
+			overlaps.clear();
+			if (FindOverlaps(tuner, plan.begin, plan.end, 2, &overlaps) != 1)
+				continue;
+			Plan& other = m_plans[overlaps[0]];
+			for (const TunerId alternative : other.tuners) {
+				if (alternative != tuner && IsFree(alternative, other.begin, other.end)) {
+					Unassign(other);
+					Assign(overlaps[0], other, alternative);
+					Assign(serial, plan, tuner);
+					return true;
+				}
+			}
+		}
+
+		if (pConflicts != nullptr) {
+			for (const TunerId tuner : plan.tuners)
+				FindOverlaps(tuner, plan.begin, plan.end, SIZE_MAX, pConflicts);
+			std::sort(pConflicts->begin(), pConflicts->end());
+			pConflicts->erase(std::unique(pConflicts->begin(), pConflicts->end()), pConflicts->end());
+		}
+		return false;
+	}
+
+	void CTunerPlanner::Assign(std::uint32_t serial, Plan& plan, TunerId tuner)
+	{
+		m_lanes[tuner].emplace(plan.begin, serial);
+		plan.tuner = tuner;
+	}
+
+	void CTunerPlanner::Unassign(Plan& plan)
+	{
+		if (plan.tuner < 0)
+			return;
+		m_lanes[plan.tuner].erase(plan.begin);
+		plan.tuner = -1;
+	}
+
+	std::size_t CTunerPlanner::FindOverlaps(TunerId tuner, TimeValue begin, TimeValue end,
+		std::size_t limit, std::vector<std::uint32_t>* pOverlaps) const
+	{
+		// 区間は重ならないので終了日時も開始日時順に並ぶ。begin より前に始まったものは直前の一つだけ確かめればよい
+		const Lane& lane = m_lanes[tuner];
+		auto it = lane.lower_bound(begin);
+		if (it != lane.begin() && m_plans.at(std::prev(it)->second).end > begin)
+			--it;
+		std::size_t count = 0;
+		for (; it != lane.end() && it->first < end && count < limit; ++it) {
+			if (pOverlaps != nullptr)
+				pOverlaps->push_back(it->second);
+			count++;
+		}
+		return count;
+	}
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Clock.h"
+
+namespace ChannelTimer {
+	/**
+	 * タイマーのチューナーの割り当て
+	 * タイマーはチューナーを使う区間 [begin, end) と、使えるチューナー(先頭ほど優先)で表し、
+	 * 区間の重なるタイマーには別のチューナーを割り当てる(区間グラフの彩色)
+	 * 割り当て直すのは追加・取り消したタイマーの周りだけにする
+	 * - 追加したタイマーは空いているチューナーに置く。空いていなければ、重なるタイマーが一つだけのチューナーから
+	 *   そのタイマーを他の空いているチューナーへ移して空ける
+	 * - それでも置けなければ重なりとして残し、重なっていたタイマーが取り消された時に置き直す
+	 */
+	class CTunerPlanner {
+	public:
+		struct Request {
+			std::uint32_t serial;			// タイマーの通し番号
+			TimeValue begin;
+			TimeValue end;
+			std::vector<std::wstring> tuners;	// 使えるチューナー(先頭ほど優先)
+		};
+
+		/**
+		 * タイマーを割り当てる。同じ通し番号のタイマーがあれば置き換える
+		 * 置けなければ false で、pConflicts に重なるタイマーの通し番号を返す
+		 */
+		bool Add(const Request& request, std::vector<std::uint32_t>* pConflicts = nullptr);
+
+		void Remove(std::uint32_t serial);
+		void Clear();
+
+		/**
+		 * 割り当てたチューナー。重なって置けていないか、無ければ nullptr
+		 */
+		const std::wstring* GetTuner(std::uint32_t serial) const;
+
+		std::size_t Size() const { return m_plans.size(); }
+
+		/**
+		 * 重なって置けていないタイマーの数
+		 */
+		std::size_t ConflictCount() const { return m_conflicts.size(); }
+
+	private:
+		using TunerId = int;
+		using Lane = std::map<TimeValue, std::uint32_t>;	// 開始日時 -> 通し番号(区間は重ならない)
+
+		struct Plan {
+			TimeValue begin;
+			TimeValue end;
+			std::vector<TunerId> tuners;
+			TunerId tuner = -1;		// 割り当てたチューナー。置けていなければ -1
+		};
+
+		std::vector<std::wstring> m_tunerNames;
+		std::unordered_map<std::wstring, TunerId> m_tunerIds;
+		std::vector<Lane> m_lanes;			// チューナーごとの割り当てた区間
+		std::unordered_map<std::uint32_t, Plan> m_plans;
+		std::set<std::uint32_t> m_conflicts;	// 置けていないタイマー(古い順に置き直す)
+
+		TunerId GetTunerId(const std::wstring& name);
+		bool Place(std::uint32_t serial, Plan& plan, std::vector<std::uint32_t>* pConflicts);
+		void Assign(std::uint32_t serial, Plan& plan, TunerId tuner);
+		void Unassign(Plan& plan);
+
+		// tuner で [begin, end) と重なるタイマーを、最大 limit 個まで集める
+		std::size_t FindOverlaps(TunerId tuner, TimeValue begin, TimeValue end,
+			std::size_t limit, std::vector<std::uint32_t>* pOverlaps) const;
+		bool IsFree(TunerId tuner, TimeValue begin, TimeValue end) const {
+			return FindOverlaps(tuner, begin, end, 1, nullptr) == 0;
+		}
+	};
+}
@@ -26,6 +26,8 @@
 #define IDC_SETTINGS_TUNING_SPACE			120
 #define IDC_SETTINGS_CHANNELS				121
 #define IDC_SETTINGS_DRIVERS				122
+#define IDC_SETTINGS_BROADCASTTIME			123
+#define IDC_SETTINGS_RECURRENCE				124
 
 #define IDC_CONFIRM_MODE					100
 #define IDC_CONFIRM_TIMEOUT					101
@@ -0,0 +1,208 @@
+// CBenchmark::RunCore を TVTest を使わずに実行する
+//   ChannelTimerBenchmark [--baseline 基準値.csv] [--ratio 比] [--csv 結果.csv] [--json 結果.json]
+// 結果の CSV はそのまま次の基準値に使える。基準値より遅くなったか確保が増えたケースがあれば 1 を返す
+// 基準値と違う環境(最適化しないビルドなど)では --ratio で遅くなったとする比を緩める
+// テスト用のホストを使えれば(CHANNELTIMER_BENCHMARK_HOST)、10000 チャンネルのチューナーで RunHost も実行する
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <string>
+#include "Benchmark.h"
+#ifdef CHANNELTIMER_BENCHMARK_HOST
+#include "FakeHost.h"
+#endif
+
+namespace {
+	std::atomic<std::uint64_t> g_allocationCount{ 0 };
+
+	std::uint64_t GetAllocationCount()
+	{
+		return g_allocationCount.load(std::memory_order_relaxed);
+	}
+
+	void* Allocate(std::size_t size)
+	{
+		g_allocationCount.fetch_add(1, std::memory_order_relaxed);
+		void* p = std::malloc(size != 0 ? size : 1);
+		if (p == nullptr)
+			throw std::bad_alloc();
+		return p;
+	}
+
+	std::int64_t GetTickValue()
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	std::string ToUtf8(const std::wstring& s)
+	{
+		std::string utf8;
+		for (std::size_t i = 0; i < s.size(); i++) {
+			std::uint32_t c = static_cast<std::uint32_t>(s[i]);
+			if (c >= 0xD800 && c < 0xDC00 && i + 1 < s.size()) {
+				c = 0x10000 + ((c - 0xD800) << 10) + (static_cast<std::uint32_t>(s[++i]) - 0xDC00);
+			}
+			if (c < 0x80) {
+				utf8 += static_cast<char>(c);
+			} else if (c < 0x800) {
+				utf8 += static_cast<char>(0xC0 | (c >> 6));
+				utf8 += static_cast<char>(0x80 | (c & 0x3F));
+			} else if (c < 0x10000) {
+				utf8 += static_cast<char>(0xE0 | (c >> 12));
+				utf8 += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+				utf8 += static_cast<char>(0x80 | (c & 0x3F));
+			} else {
+				utf8 += static_cast<char>(0xF0 | (c >> 18));
+				utf8 += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+				utf8 += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+				utf8 += static_cast<char>(0x80 | (c & 0x3F));
+			}
+		}
+		return utf8;
+	}
+
+	// ケースの名前は ASCII
+	std::wstring FromAscii(const std::string& s)
+	{
+		return std::wstring(s.begin(), s.end());
+	}
+
+	std::string FormatNumber(double value)
+	{
+		char szValue[32];
+		std::snprintf(szValue, sizeof(szValue), "%.2f", value);
+		return szValue;
+	}
+
+	// 結果の CSV の 1 列目(名前)と 3 列目(ns/op)、4 列目(確保の回数/op)を基準値として読む
+	int LoadBaseline(const char* pszFileName, ChannelTimer::CBenchmark* pBench)
+	{
+		std::ifstream file(pszFileName);
+		if (!file)
+			return -1;
+		int count = 0;
+		std::string line;
+		std::getline(file, line);	// 見出し
+		while (std::getline(file, line)) {
+			std::istringstream fields(line);
+			std::string name, ops, nsPerOp, allocsPerOp;
+			if (std::getline(fields, name, ',') && std::getline(fields, ops, ',') && std::getline(fields, nsPerOp, ',')
+					&& std::getline(fields, allocsPerOp, ',')
+					// 数えていなかった時の負の値は比べない
+					&& pBench->ParseBaseline(FromAscii(name), FromAscii(nsPerOp),
+						allocsPerOp.compare(0, 1, "-") != 0 ? FromAscii(allocsPerOp) : std::wstring()))
+				count++;
+		}
+		return count;
+	}
+
+	bool WriteCsv(const char* pszFileName, const ChannelTimer::CBenchmark& bench)
+	{
+		std::ofstream file(pszFileName);
+		file << "name,ops,ns_per_op,allocs_per_op,baseline_ns_per_op,regression\n";
+		for (const ChannelTimer::CBenchmarkResult& result : bench.GetResults()) {
+			file << ToUtf8(result.name) << ',' << result.ops << ',' << FormatNumber(result.nsPerOp) << ','
+				<< FormatNumber(result.allocsPerOp) << ',' << FormatNumber(result.baseline) << ','
+				<< (bench.IsRegression(result) ? 1 : 0) << '\n';
+		}
+		return static_cast<bool>(file);
+	}
+
+	bool WriteJson(const char* pszFileName, const ChannelTimer::CBenchmark& bench)
+	{
+		std::ofstream file(pszFileName);
+		file << "{\n  \"results\": [";
+		const char* pszSeparator = "\n";
+		for (const ChannelTimer::CBenchmarkResult& result : bench.GetResults()) {
+			file << pszSeparator
+				<< "    { \"name\": \"" << ToUtf8(result.name) << "\", \"ops\": " << result.ops
+				<< ", \"ns_per_op\": " << FormatNumber(result.nsPerOp)
+				<< ", \"allocs_per_op\": " << FormatNumber(result.allocsPerOp)
+				<< ", \"baseline_ns_per_op\": " << FormatNumber(result.baseline)
+				<< ", \"regression\": " << (bench.IsRegression(result) ? "true" : "false") << " }";
+			pszSeparator = ",\n";
+		}
+		file << "\n  ]\n}\n";
+		return static_cast<bool>(file);
+	}
+}
+
+// 全ての確保を数える
+void* operator new(std::size_t size) { return Allocate(size); }
+void* operator new[](std::size_t size) { return Allocate(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+int main(int argc, char* argv[])
+{
+	const char* pszBaseline = nullptr;
+	const char* pszCsv = nullptr;
+	const char* pszJson = nullptr;
+	const char* pszRatio = nullptr;
+	for (int i = 1; i < argc; i++) {
+		const char** ppszValue =
+			std::strcmp(argv[i], "--baseline") == 0 ? &pszBaseline :
+			std::strcmp(argv[i], "--ratio") == 0 ? &pszRatio :
+			std::strcmp(argv[i], "--csv") == 0 ? &pszCsv :
+			std::strcmp(argv[i], "--json") == 0 ? &pszJson : nullptr;
+		if (ppszValue == nullptr || i + 1 >= argc) {
+			std::fprintf(stderr, "usage: %s [--baseline file.csv] [--ratio ratio] [--csv file.csv] [--json file.json]\n", argv[0]);
+			return 2;
+		}
+		*ppszValue = argv[++i];
+	}
+
+	ChannelTimer::CBenchmark bench(GetTickValue, GetAllocationCount);
+	if (pszRatio != nullptr) {
+		const double ratio = std::atof(pszRatio);
+		if (!(ratio > 1.0)) {
+			std::fprintf(stderr, "%s: ratio must be greater than 1\n", pszRatio);
+			return 2;
+		}
+		bench.SetRegressionRatio(ratio);
+	}
+	if (pszBaseline != nullptr && LoadBaseline(pszBaseline, &bench) < 0)
+		std::fprintf(stderr, "%s: baseline not found, results are not compared\n", pszBaseline);
+
+	bench.RunCore();
+
+#ifdef CHANNELTIMER_BENCHMARK_HOST
+	{
+		// 地デジ一つの空間に CHANNEL_COUNT のチャンネルを持つチューナー
+		ChannelTimer::Test::CFakeHost host;
+		ChannelTimer::Test::CFakeHost::Driver& driver = host.AddDriver(L"BonDriver_Benchmark.dll");
+		driver.spaces.push_back(ChannelTimer::Test::CFakeHost::Space{ L"地デジ", {} });
+		for (const ChannelTimer::CServiceInfo& service : ChannelTimer::CBenchmark::MakeServices(ChannelTimer::CBenchmark::CHANNEL_COUNT)) {
+			driver.spaces[0].channels.push_back(ChannelTimer::Test::CFakeHost::MakeChannel(
+				service.NetworkID, service.TransportStreamID, service.ServiceID, service.channel, service.channelName.c_str()));
+		}
+		bench.RunHost(host.GetApp(), driver.name);
+	}
+#endif
+
+	int regressions = 0;
+	for (const ChannelTimer::CBenchmarkResult& result : bench.GetResults()) {
+		if (bench.IsRegression(result))
+			regressions++;
+	}
+	for (const std::wstring& line : bench.FormatReport())
+		std::printf("%s\n", ToUtf8(line).c_str());
+
+	if (pszCsv != nullptr && !WriteCsv(pszCsv, bench)) {
+		std::fprintf(stderr, "%s: cannot write\n", pszCsv);
+		return 2;
+	}
+	if (pszJson != nullptr && !WriteJson(pszJson, bench)) {
+		std::fprintf(stderr, "%s: cannot write\n", pszJson);
+		return 2;
+	}
+	return regressions > 0 ? 1 : 0;
+}
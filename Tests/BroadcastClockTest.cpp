@@ -0,0 +1,198 @@
+#include "Test.h"
+#include <array>
+#include <cstring>
+#include <vector>
+#include "BroadcastClock.h"
+
+using namespace ChannelTimer;
+
+namespace {
+	using Bytes = std::vector<std::uint8_t>;
+
+	const TimeValue BASE_TIME = 132223104000000000LL;	// 2020/1/1 0:00 UTC
+	const std::uint16_t MJD_2020_01_01 = 58849;
+
+	// MJD と BCD の時分秒(JST)
+	Bytes MakeJstTime(std::uint16_t mjd, std::uint8_t hour, std::uint8_t minute, std::uint8_t second)
+	{
+		return Bytes{ static_cast<std::uint8_t>(mjd >> 8), static_cast<std::uint8_t>(mjd & 0xFF), hour, minute, second };
+	}
+
+	Bytes MakeTdt(const Bytes& jstTime)
+	{
+		Bytes section = { CTotWatcher::TABLE_ID_TDT, 0x70, 0x05 };
+		section.insert(section.end(), jstTime.begin(), jstTime.end());
+		return section;
+	}
+
+	// 記述子無しの TOT(CRC を付ける)
+	Bytes MakeTot(const Bytes& jstTime)
+	{
+		Bytes section = { CTotWatcher::TABLE_ID_TOT, 0x70, 5 + 2 + 4 };
+		section.insert(section.end(), jstTime.begin(), jstTime.end());
+		section.push_back(0xF0);
+		section.push_back(0x00);
+		const std::uint32_t crc = CSectionCollector::Crc32(section.data(), section.size());
+		for (int shift = 24; shift >= 0; shift -= 8)
+			section.push_back(static_cast<std::uint8_t>(crc >> shift));
+		return section;
+	}
+
+	// 一つのパケットに収まるセクション
+	std::array<std::uint8_t, TS_PACKET_SIZE> MakePacket(std::uint16_t pid, const Bytes& section, int continuity)
+	{
+		std::array<std::uint8_t, TS_PACKET_SIZE> packet;
+		packet.fill(0xFF);
+		packet[0] = 0x47;
+		packet[1] = static_cast<std::uint8_t>(0x40 | (pid >> 8));
+		packet[2] = static_cast<std::uint8_t>(pid & 0xFF);
+		packet[3] = static_cast<std::uint8_t>(0x10 | (continuity & 0x0F));
+		packet[4] = 0;
+		std::memcpy(packet.data() + 5, section.data(), section.size());
+		return packet;
+	}
+
+	struct Times {
+		std::vector<TimeValue> times;
+		int continuity = 0;
+
+		static void Callback(void* pClientData, TimeValue broadcastTime)
+		{
+			static_cast<Times*>(pClientData)->times.push_back(broadcastTime);
+		}
+	};
+
+	void Feed(CTotWatcher* pWatcher, Times* pTimes, const Bytes& section, std::uint16_t pid = CTotWatcher::PID_TOT)
+	{
+		pWatcher->OnPacket(MakePacket(pid, section, pTimes->continuity++).data());
+	}
+}
+
+TEST(TotDecodesJstTime)
+{
+	// JST の 9:00 は UTC の 0:00
+	EXPECT(CTotWatcher::DecodeJstTime(MakeJstTime(MJD_2020_01_01, 0x09, 0x00, 0x00).data()) == BASE_TIME);
+	EXPECT(CTotWatcher::DecodeJstTime(MakeJstTime(MJD_2020_01_01, 0x23, 0x59, 0x59).data())
+		== BASE_TIME + 14 * FILETIME_HOUR + 59 * FILETIME_MIN + 59 * FILETIME_SEC);
+	// JST の 0 時台は UTC では前の日
+	EXPECT(CTotWatcher::DecodeJstTime(MakeJstTime(MJD_2020_01_01, 0x00, 0x30, 0x15).data())
+		== BASE_TIME - 9 * FILETIME_HOUR + 30 * FILETIME_MIN + 15 * FILETIME_SEC);
+	EXPECT(CTotWatcher::DecodeJstTime(MakeJstTime(MJD_2020_01_01 + 366, 0x09, 0x00, 0x00).data())
+		== BASE_TIME + 366 * FILETIME_DAY);
+	// うるう秒
+	EXPECT(CTotWatcher::DecodeJstTime(MakeJstTime(MJD_2020_01_01, 0x08, 0x59, 0x60).data()) == BASE_TIME);
+}
+
+TEST(TotRejectsInvalidBcd)
+{
+	EXPECT(CTotWatcher::DecodeJstTime(MakeJstTime(MJD_2020_01_01, 0x24, 0x00, 0x00).data()) == -1);
+	EXPECT(CTotWatcher::DecodeJstTime(MakeJstTime(MJD_2020_01_01, 0x12, 0x60, 0x00).data()) == -1);
+	EXPECT(CTotWatcher::DecodeJstTime(MakeJstTime(MJD_2020_01_01, 0x12, 0x00, 0x61).data()) == -1);
+	EXPECT(CTotWatcher::DecodeJstTime(MakeJstTime(MJD_2020_01_01, 0x1A, 0x00, 0x00).data()) == -1);
+	EXPECT(CTotWatcher::DecodeJstTime(MakeJstTime(MJD_2020_01_01, 0x12, 0x0F, 0x00).data()) == -1);
+	EXPECT(CTotWatcher::DecodeJstTime(MakeJstTime(MJD_2020_01_01, 0x12, 0x00, 0xA0).data()) == -1);
+}
+
+TEST(TotWatcherReadsSections)
+{
+	Times times;
+	CTotWatcher watcher(Times::Callback, &times);
+
+	Feed(&watcher, &times, MakeTdt(MakeJstTime(MJD_2020_01_01, 0x09, 0x00, 0x05)));
+	Feed(&watcher, &times, MakeTot(MakeJstTime(MJD_2020_01_01, 0x09, 0x00, 0x10)));
+	REQUIRE(times.times.size() == 2);
+	EXPECT(times.times[0] == BASE_TIME + 5 * FILETIME_SEC);
+	EXPECT(times.times[1] == BASE_TIME + 10 * FILETIME_SEC);
+
+	// TOT の CRC が合わない
+	Bytes tot = MakeTot(MakeJstTime(MJD_2020_01_01, 0x09, 0x00, 0x15));
+	tot[5] ^= 0x01;
+	Feed(&watcher, &times, tot);
+	// 時刻が不正
+	Feed(&watcher, &times, MakeTdt(MakeJstTime(MJD_2020_01_01, 0x25, 0x00, 0x00)));
+	// 他の PID と他のテーブル
+	Feed(&watcher, &times, MakeTdt(MakeJstTime(MJD_2020_01_01, 0x09, 0x00, 0x20)), 0x0012);
+	Bytes other = MakeTdt(MakeJstTime(MJD_2020_01_01, 0x09, 0x00, 0x25));
+	other[0] = 0x72;
+	Feed(&watcher, &times, other);
+	EXPECT(times.times.size() == 2);
+}
+
+TEST(BroadcastClockFirstSample)
+{
+	CBroadcastClock clock;
+	EXPECT(!clock.IsValid());
+	EXPECT(clock.GetOffset() == 0);
+	EXPECT(clock.EpgToSystem(BASE_TIME + EPG_TIME_OFFSET) == BASE_TIME);
+
+	// 放送局の時刻が 2 秒進んでいる
+	EXPECT(clock.AddSample(BASE_TIME + 2 * FILETIME_SEC, BASE_TIME));
+	EXPECT(clock.IsValid());
+	EXPECT(clock.GetOffset() == 2 * FILETIME_SEC);
+	EXPECT(clock.BroadcastToSystem(BASE_TIME + 2 * FILETIME_SEC) == BASE_TIME);
+	EXPECT(clock.EpgToSystem(BASE_TIME + EPG_TIME_OFFSET + 2 * FILETIME_SEC) == BASE_TIME);
+
+	// 知らせるほど動かない差
+	CBroadcastClock small;
+	EXPECT(!small.AddSample(BASE_TIME + 100 * FILETIME_MS, BASE_TIME));
+	EXPECT(small.IsValid());
+	EXPECT(small.GetOffset() == 100 * FILETIME_MS);
+}
+
+TEST(BroadcastClockIgnoresLargeOffsets)
+{
+	CBroadcastClock clock;
+	EXPECT(!clock.AddSample(BASE_TIME + 2 * FILETIME_HOUR, BASE_TIME));
+	EXPECT(!clock.AddSample(BASE_TIME - 2 * FILETIME_HOUR, BASE_TIME));
+	EXPECT(!clock.IsValid());
+	EXPECT(clock.GetOffset() == 0);
+}
+
+TEST(BroadcastClockSmoothsOffset)
+{
+	CBroadcastClock clock;
+	TimeValue now = BASE_TIME;
+	clock.AddSample(now + 2 * FILETIME_SEC, now);
+
+	// 差の 1/8 ずつ近づく
+	now += 10 * FILETIME_SEC;
+	EXPECT(!clock.AddSample(now + 2800 * FILETIME_MS, now));
+	EXPECT(clock.GetOffset() == 2100 * FILETIME_MS);
+	now += 10 * FILETIME_SEC;
+	EXPECT(!clock.AddSample(now + 2820 * FILETIME_MS, now));
+	EXPECT(clock.GetOffset() == 2190 * FILETIME_MS);
+	// 知らせた時の差(2 秒)から NOTIFY_THRESHOLD 以上動いた
+	now += 10 * FILETIME_SEC;
+	EXPECT(clock.AddSample(now + 2990 * FILETIME_MS, now));
+	EXPECT(clock.GetOffset() == 2290 * FILETIME_MS);
+
+	// 同じ差が続けば、その差に近づいていく
+	for (int i = 0; i < 100; i++) {
+		now += 10 * FILETIME_SEC;
+		clock.AddSample(now + 3 * FILETIME_SEC, now);
+	}
+	EXPECT(clock.GetOffset() <= 3 * FILETIME_SEC);
+	EXPECT(3 * FILETIME_SEC - clock.GetOffset() < 1 * FILETIME_MS);
+	EXPECT(clock.EpgToSystem(now + EPG_TIME_OFFSET + clock.GetOffset()) == now);
+}
+
+TEST(BroadcastClockOutliers)
+{
+	CBroadcastClock clock;
+	clock.AddSample(BASE_TIME + 2 * FILETIME_SEC, BASE_TIME);
+
+	// 外れた標本は続くまで採らない
+	const TimeValue jump = 2 * FILETIME_SEC + 60 * FILETIME_SEC;
+	EXPECT(!clock.AddSample(BASE_TIME + jump, BASE_TIME));
+	EXPECT(!clock.AddSample(BASE_TIME + jump, BASE_TIME));
+	EXPECT(clock.GetOffset() == 2 * FILETIME_SEC);
+	// 間に普通の標本があれば数え直す
+	EXPECT(!clock.AddSample(BASE_TIME + 2 * FILETIME_SEC, BASE_TIME));
+	EXPECT(!clock.AddSample(BASE_TIME + jump, BASE_TIME));
+	EXPECT(!clock.AddSample(BASE_TIME + jump, BASE_TIME));
+	EXPECT(clock.GetOffset() == 2 * FILETIME_SEC);
+
+	// OUTLIER_RESET_COUNT 回続けば、そのまま採る
+	EXPECT(clock.AddSample(BASE_TIME + jump, BASE_TIME));
+	EXPECT(clock.GetOffset() == jump);
+}
@@ -0,0 +1,193 @@
+#include "Test.h"
+#include "Catalog.h"
+#include "FakeHost.h"
+#include "Model.h"
+
+using namespace ChannelTimer;
+using ChannelTimer::Test::CFakeHost;
+
+namespace {
+	// 地デジと BS の二つの空間を持つチューナーを二つ
+	void SetupHost(CFakeHost* pHost)
+	{
+		CFakeHost::Driver& t = pHost->AddDriver(L"BonDriver_T.dll");
+		t.spaces.push_back(CFakeHost::Space{ L"地デジ", {
+			CFakeHost::MakeChannel(0x7FE0, 0x7FE0, 1024, 13, L"NHK総合"),
+			CFakeHost::MakeChannel(0x7FE1, 0x7FE1, 1032, 14, L"NHKEテレ", true),
+			CFakeHost::MakeChannel(0x7FE2, 0x7FE2, 1040, 15, L"日テレ"),
+		} });
+		t.spaces.push_back(CFakeHost::Space{ L"BS", {
+			CFakeHost::MakeChannel(4, 0x4010, 101, 0, L"NHK BS1"),
+			CFakeHost::MakeChannel(0x7FE0, 0x7FE0, 1024, 13, L"NHK総合"),
+		} });
+		CFakeHost::Driver& s = pHost->AddDriver(L"BonDriver_S.dll");
+		s.spaces.push_back(CFakeHost::Space{ L"BS", {
+			CFakeHost::MakeChannel(4, 0x4010, 101, 0, L"NHK BS1"),
+		} });
+	}
+}
+
+TEST(ModelEnumeratesHost)
+{
+	CFakeHost host;
+	SetupHost(&host);
+	TVTest::CTVTestApp* pApp = host.GetApp();
+
+	const std::vector<std::wstring> drivers = GetDrivers(pApp);
+	EXPECT((drivers == std::vector<std::wstring>{ L"BonDriver_T.dll", L"BonDriver_S.dll" }));
+	EXPECT((GetTuningSpaces(pApp) == std::vector<std::wstring>{ L"地デジ", L"BS" }));
+
+	// 無効なチャンネルは飛ばす
+	const std::vector<CServiceInfo> channels = GetChannels(pApp, 0);
+	REQUIRE(channels.size() == 2);
+	EXPECT(channels[0].ServiceID == 1024 && channels[1].ServiceID == 1040);
+	EXPECT(channels[1].channelName == L"日テレ");
+
+	const std::vector<CServiceInfo> bs = GetChannels(pApp, L"BonDriver_S.dll", 0);
+	EXPECT(bs.size() == 1 && bs[0].ServiceID == 101);
+	EXPECT(GetChannels(pApp, L"BonDriver_S.dll", 3).empty());
+	EXPECT(host.GetListCount() == host.GetFreeCount());
+}
+
+TEST(CatalogCachesDriverChannels)
+{
+	CFakeHost host;
+	SetupHost(&host);
+	TVTest::CTVTestApp* pApp = host.GetApp();
+	CChannelCatalog catalog;
+
+	EXPECT(catalog.GetDrivers(pApp).size() == 2);
+	const std::shared_ptr<const CDriverChannels> channels = catalog.GetDriverChannels(pApp, L"BonDriver_T.dll");
+	REQUIRE(channels);
+	EXPECT(channels->spaces.size() == 2);
+	EXPECT(channels->spaces[0].channels.Size() == 2);
+	EXPECT(catalog.GetDriverChannels(pApp, L"BonDriver_T.dll") == channels);
+	EXPECT(host.GetListCount() == 1);
+	EXPECT(host.GetFreeCount() == 1);
+
+	// 別の空間にもあるサービスは最初の空間で引ける
+	const ServiceKey nhk = MakeServiceKey(0x7FE0, 0x7FE0, 1024);
+	const CServiceLocation* pLocation = channels->FindService(nhk);
+	REQUIRE(pLocation != nullptr);
+	EXPECT(pLocation->space == 0 && pLocation->index == 0);
+	EXPECT(channels->ResolveSpace(nhk, 1) == 1);
+	EXPECT(channels->ResolveSpace(MakeServiceKey(4, 0x4010, 101), 0) == 1);
+	EXPECT(channels->ResolveSpace(MakeServiceKey(1, 1, 1), 0) == 0);
+
+	EXPECT((catalog.GetStaleDrivers() == std::vector<std::wstring>{ L"BonDriver_S.dll" }));
+}
+
+TEST(CatalogInvalidatesByFileName)
+{
+	CFakeHost host;
+	SetupHost(&host);
+	TVTest::CTVTestApp* pApp = host.GetApp();
+	CChannelCatalog catalog;
+	catalog.GetDrivers(pApp);
+	const std::shared_ptr<const CDriverChannels> old = catalog.GetDriverChannels(pApp, L"BonDriver_T.dll");
+	const unsigned int generation = catalog.GetGeneration(L"BonDriver_T.dll");
+
+	// ホストはパスで知らせてくることがある
+	catalog.InvalidateDriver(L"C:\\TVTest\\bondriver_t.dll");
+	EXPECT(catalog.GetGeneration(L"BonDriver_T.dll") != generation);
+	EXPECT(catalog.IsStale(L"BonDriver_T.dll"));
+	const std::shared_ptr<const CDriverChannels> reloaded = catalog.GetDriverChannels(pApp, L"BonDriver_T.dll");
+	EXPECT(reloaded && reloaded != old);
+	EXPECT(host.GetListCount() == 2);
+}
+
+TEST(CatalogRejectsOutdatedChannels)
+{
+	CFakeHost host;
+	SetupHost(&host);
+	TVTest::CTVTestApp* pApp = host.GetApp();
+	CChannelCatalog catalog;
+	catalog.GetDrivers(pApp);
+
+	// 別スレッドで読み込んでいる間に読み直しが必要になった
+	const unsigned int generation = catalog.GetGeneration(L"BonDriver_S.dll");
+	const std::shared_ptr<const CDriverChannels> channels = LoadDriverChannels(pApp, L"BonDriver_S.dll");
+	REQUIRE(channels);
+	catalog.InvalidateAll();
+	EXPECT(!catalog.SetDriverChannels(L"BonDriver_S.dll", channels, generation));
+	EXPECT(catalog.IsStale(L"BonDriver_S.dll"));
+	EXPECT(catalog.SetDriverChannels(L"BonDriver_S.dll", channels, catalog.GetGeneration(L"BonDriver_S.dll")));
+	EXPECT(!catalog.IsStale(L"BonDriver_S.dll"));
+	EXPECT(catalog.GetDriverChannels(pApp, L"BonDriver_S.dll") == channels);
+	EXPECT(catalog.GetLoadedServiceCount() == 1);
+}
+
+TEST(CatalogKeepsOtherDriversInFlight)
+{
+	CFakeHost host;
+	SetupHost(&host);
+	TVTest::CTVTestApp* pApp = host.GetApp();
+	CChannelCatalog catalog;
+	catalog.GetDrivers(pApp);
+
+	// 選局のたびに現在のチューナーが読み直しになっても、他のチューナーの読み込みは捨てない
+	const unsigned int generationS = catalog.GetGeneration(L"BonDriver_S.dll");
+	const unsigned int generationT = catalog.GetGeneration(L"BonDriver_T.dll");
+	const std::shared_ptr<const CDriverChannels> s = LoadDriverChannels(pApp, L"BonDriver_S.dll");
+	const std::shared_ptr<const CDriverChannels> t = LoadDriverChannels(pApp, L"BonDriver_T.dll");
+	catalog.InvalidateDriver(L"BonDriver_T.dll");
+	catalog.InvalidateDriver(L"BonDriver_T.dll");
+	EXPECT(catalog.SetDriverChannels(L"BonDriver_S.dll", s, generationS));
+	EXPECT(!catalog.SetDriverChannels(L"BonDriver_T.dll", t, generationT));
+	EXPECT((catalog.GetStaleDrivers() == std::vector<std::wstring>{ L"BonDriver_T.dll" }));
+
+	// 無いチューナーのものは入れない
+	EXPECT(!catalog.SetDriverChannels(L"BonDriver_X.dll", s, 0));
+}
+
+TEST(CatalogCachesLoadFailure)
+{
+	CFakeHost host;
+	SetupHost(&host);
+	TVTest::CTVTestApp* pApp = host.GetApp();
+	CChannelCatalog catalog;
+	catalog.GetDrivers(pApp);
+
+	// 読み込めなければ、読み直しが必要になるまでホストに尋ねない
+	host.SetFailing(L"BonDriver_S.dll", true);
+	EXPECT(!catalog.GetDriverChannels(pApp, L"BonDriver_S.dll"));
+	EXPECT(!catalog.GetDriverChannels(pApp, L"BonDriver_S.dll"));
+	EXPECT(host.GetListCount() == 1);
+	EXPECT(catalog.GetStaleDrivers() == std::vector<std::wstring>{ L"BonDriver_T.dll" });
+
+	host.SetFailing(L"BonDriver_S.dll", false);
+	catalog.InvalidateDriver(L"BonDriver_S.dll");
+	EXPECT(catalog.GetDriverChannels(pApp, L"BonDriver_S.dll") != nullptr);
+	EXPECT(host.GetListCount() == 2);
+}
+
+TEST(CatalogBuildsFromCopy)
+{
+	CFakeHost host;
+	SetupHost(&host);
+	TVTest::CTVTestApp* pApp = host.GetApp();
+
+	// ホストから写すのは UI スレッド、作るのは別スレッド(ここでは同じスレッド)
+	CDriverTuningSpaceCopy copy;
+	REQUIRE(CopyDriverTuningSpaces(pApp, L"BonDriver_T.dll", &copy));
+	EXPECT(host.GetListCount() == 1 && host.GetFreeCount() == 1);
+	EXPECT(copy.spaceNames.size() == 2 && copy.channels[0].size() == 2);
+
+	const std::shared_ptr<const CDriverChannels> built = BuildDriverChannels(copy);
+	const std::shared_ptr<const CDriverChannels> loaded = LoadDriverChannels(pApp, L"BonDriver_T.dll");
+	REQUIRE(built && loaded);
+	EXPECT(built->driverName == L"BonDriver_T.dll");
+	REQUIRE(built->spaces.size() == loaded->spaces.size());
+	for (std::size_t i = 0; i < built->spaces.size(); i++) {
+		EXPECT(built->spaces[i].name == loaded->spaces[i].name);
+		REQUIRE(built->spaces[i].channels.Size() == loaded->spaces[i].channels.Size());
+		for (std::size_t j = 0; j < built->spaces[i].channels.Size(); j++) {
+			EXPECT(built->spaces[i].channels[j].ServiceID == loaded->spaces[i].channels[j].ServiceID);
+			EXPECT(std::wstring(built->spaces[i].channels[j].channelName) == loaded->spaces[i].channels[j].channelName);
+		}
+	}
+	EXPECT(built->services.Size() == loaded->services.Size());
+
+	host.SetFailing(L"BonDriver_S.dll", true);
+	EXPECT(!CopyDriverTuningSpaces(pApp, L"BonDriver_S.dll", &copy));
+}
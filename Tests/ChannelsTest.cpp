@@ -0,0 +1,43 @@
+#include "Test.h"
+#include "Channels.h"
+
+using namespace ChannelTimer;
+
+TEST(ChannelTableFind)
+{
+	CChannelTable table;
+	table.Add(0x7FE0, 0x7FE0, 1024, 13, L"NHK総合");
+	table.Add(0x7FE1, 0x7FE1, 1024, 14, L"別の局");
+	table.Add(0x7FE0, 0x7FE0, 1024, 20, L"NHK総合");
+
+	// service_id が同じでもネットワークが違えば別のサービスで、同じサービスなら最初のもの
+	EXPECT(table.Find(MakeServiceKey(0x7FE0, 0x7FE0, 1024)) == 0);
+	EXPECT(table.Find(MakeServiceKey(0x7FE1, 0x7FE1, 1024)) == 1);
+	EXPECT(table.Find(MakeServiceKey(0x7FE2, 0x7FE2, 1024)) == -1);
+	EXPECT(CChannelTable().Find(MakeServiceKey(0x7FE0, 0x7FE0, 1024)) == -1);
+
+	// 表を広げても引ける
+	for (std::uint16_t i = 1; i <= 100; i++)
+		table.Add(4, 0x4010, i, 0, L"BS");
+	for (std::uint16_t i = 1; i <= 100; i++)
+		EXPECT(table.Find(MakeServiceKey(4, 0x4010, i)) == i + 2);
+	EXPECT(table.Find(MakeServiceKey(0x7FE1, 0x7FE1, 1024)) == 1);
+}
+
+TEST(DriverChannelsResolveSpace)
+{
+	CDriverChannels channels;
+	channels.AddSpace(L"地デジ");
+	channels.AddSpace(L"BS");
+	channels.AddChannel(0, 0x7FE0, 0x7FE0, 1024, 13, L"NHK総合");
+	channels.AddChannel(1, 4, 0x4010, 101, 0, L"NHK BS1");
+	channels.AddChannel(1, 0x7FE0, 0x7FE0, 1024, 13, L"NHK総合");
+
+	// 二つ目の空間にもあるサービスは、その空間の中で引ける
+	const ServiceKey nhk = MakeServiceKey(0x7FE0, 0x7FE0, 1024);
+	EXPECT(channels.spaces[1].FindService(nhk) == 1);
+	EXPECT(channels.ResolveSpace(nhk, 1) == 1);
+	EXPECT(channels.ResolveSpace(nhk, 0) == 0);
+	EXPECT(channels.ResolveSpace(MakeServiceKey(4, 0x4010, 101), 0) == 1);
+	EXPECT(channels.ResolveSpace(MakeServiceKey(1, 1, 1), 0) == 0);
+}
@@ -0,0 +1,4 @@
+#pragma once
+#include <windows.h>
+
+LPWSTR PathFindFileName(LPCWSTR pszPath);
@@ -0,0 +1,112 @@
+#pragma once
+// Windows 以外でホストとやり取りする部分(Model, Catalog)をテストするための最小限の宣言
+// TVTestPlugin.h を読み込めるだけの型と、テストで使う関数だけを用意する(実装は FakeHost.cpp)
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cwchar>
+
+#define WINAPI
+#define CALLBACK
+#define CONST const
+#define TRUE 1
+#define FALSE 0
+#define MAX_PATH 260
+#define TEXT(x) L##x
+
+typedef int BOOL;
+typedef unsigned char BYTE;
+typedef std::uint16_t WORD;
+typedef std::uint32_t DWORD;
+typedef unsigned int UINT;
+typedef int INT;
+typedef std::int32_t LONG;
+typedef std::uint32_t ULONG;
+typedef long long LONGLONG;
+typedef unsigned long long ULONGLONG;
+typedef short SHORT;
+typedef unsigned short USHORT;
+typedef char CHAR;
+typedef wchar_t WCHAR;
+typedef WCHAR TCHAR;
+typedef std::intptr_t INT_PTR;
+typedef std::uintptr_t UINT_PTR;
+typedef std::intptr_t LONG_PTR;
+typedef std::uintptr_t ULONG_PTR;
+typedef ULONG_PTR DWORD_PTR;
+typedef ULONG_PTR SIZE_T;
+typedef UINT_PTR WPARAM;
+typedef LONG_PTR LPARAM;
+typedef LONG_PTR LRESULT;
+typedef std::int64_t INT64;
+typedef std::uint64_t UINT64;
+typedef std::uint64_t DWORD64;
+typedef std::int32_t INT32;
+typedef std::uint32_t UINT32;
+typedef std::uint8_t UINT8;
+typedef std::uint16_t UINT16;
+typedef DWORD COLORREF;
+typedef WORD ATOM;
+typedef LONG HRESULT;
+
+typedef void *LPVOID, *PVOID, *HANDLE;
+typedef const void *LPCVOID;
+typedef WCHAR *LPWSTR, *PWSTR, *LPTSTR;
+typedef const WCHAR *LPCWSTR, *PCWSTR, *LPCTSTR;
+typedef CHAR *LPSTR;
+typedef const CHAR *LPCSTR;
+typedef BYTE *LPBYTE, *PBYTE;
+typedef DWORD *LPDWORD;
+typedef BOOL *LPBOOL;
+typedef int *LPINT;
+
+#define DECLARE_HANDLE(name) struct name##__ { int unused; }; typedef struct name##__ *name
+DECLARE_HANDLE(HWND);
+DECLARE_HANDLE(HINSTANCE);
+DECLARE_HANDLE(HBITMAP);
+DECLARE_HANDLE(HDC);
+DECLARE_HANDLE(HICON);
+DECLARE_HANDLE(HFONT);
+DECLARE_HANDLE(HMENU);
+DECLARE_HANDLE(HBRUSH);
+DECLARE_HANDLE(HCURSOR);
+DECLARE_HANDLE(HPEN);
+DECLARE_HANDLE(HMONITOR);
+typedef HINSTANCE HMODULE;
+typedef HANDLE HGDIOBJ;
+
+typedef struct { LONG left, top, right, bottom; } RECT, *LPRECT;
+typedef const RECT *LPCRECT;
+typedef struct { LONG x, y; } POINT, *LPPOINT;
+typedef struct { LONG cx, cy; } SIZE, *LPSIZE;
+typedef struct { DWORD dwLowDateTime, dwHighDateTime; } FILETIME, *LPFILETIME;
+typedef struct {
+	WORD wYear, wMonth, wDayOfWeek, wDay, wHour, wMinute, wSecond, wMilliseconds;
+} SYSTEMTIME, *LPSYSTEMTIME;
+typedef struct {
+	LONG lfHeight, lfWidth, lfEscapement, lfOrientation, lfWeight;
+	BYTE lfItalic, lfUnderline, lfStrikeOut, lfCharSet;
+	BYTE lfOutPrecision, lfClipPrecision, lfQuality, lfPitchAndFamily;
+	WCHAR lfFaceName[32];
+} LOGFONTW, LOGFONT, *LPLOGFONTW, *LPLOGFONT;
+typedef struct { BYTE dummy[40]; } BITMAPINFOHEADER;
+typedef struct { BITMAPINFOHEADER bmiHeader; } BITMAPINFO;
+typedef struct { HWND hwndFrom; UINT_PTR idFrom; UINT code; } NMHDR;
+typedef struct { HWND hwnd; UINT message; WPARAM wParam; LPARAM lParam; DWORD time; POINT pt; } MSG;
+
+#define LOWORD(l) ((WORD)(((DWORD_PTR)(l)) & 0xffff))
+#define HIWORD(l) ((WORD)((((DWORD_PTR)(l)) >> 16) & 0xffff))
+#define MAKELONG(a, b) ((LONG)(((WORD)(a)) | ((DWORD)((WORD)(b))) << 16))
+#define MAKELPARAM(l, h) ((LPARAM)(DWORD)MAKELONG(l, h))
+#define RGB(r, g, b) ((COLORREF)(((BYTE)(r) | ((WORD)((BYTE)(g)) << 8)) | (((DWORD)(BYTE)(b)) << 16)))
+#define _countof(a) (sizeof(a) / sizeof((a)[0]))
+#define CLR_INVALID 0xFFFFFFFF
+#define IMAGE_BITMAP 0
+#define LR_CREATEDIBSECTION 0x2000
+#define CopyMemory(d, s, n) std::memcpy((d), (s), (n))
+#define ZeroMemory(d, n) std::memset((d), 0, (n))
+
+int lstrlenW(LPCWSTR psz);
+int lstrcmpi(LPCWSTR psz1, LPCWSTR psz2);
+HANDLE LoadImage(HINSTANCE hinst, LPCWSTR pszName, UINT Type, int cx, int cy, UINT Flags);
+BOOL DeleteObject(HGDIOBJ hObject);
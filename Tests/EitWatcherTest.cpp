@@ -0,0 +1,365 @@
+#include "Test.h"
+#include <array>
+#include <cstring>
+#include <utility>
+#include <vector>
+#include "EitWatcher.h"
+
+using namespace ChannelTimer;
+
+namespace {
+	using Bytes = std::vector<std::uint8_t>;
+	using Packet = std::array<std::uint8_t, TS_PACKET_SIZE>;
+
+	/**
+	 * セクションを TS パケットに分ける
+	 * セクションが始まるパケットには payload_unit_start_indicator と pointer_field を付け、余りは 0xFF で埋める
+	 */
+	class CPacketizer {
+	public:
+		explicit CPacketizer(std::uint16_t pid)
+			: m_pid(pid)
+		{}
+
+		std::vector<Packet> Packetize(const std::vector<Bytes>& sections)
+		{
+			Bytes stream;
+			std::vector<std::size_t> starts;
+			for (const Bytes& section : sections) {
+				starts.push_back(stream.size());
+				stream.insert(stream.end(), section.begin(), section.end());
+			}
+
+			std::vector<Packet> packets;
+			std::size_t pos = 0;
+			std::size_t nextStart = 0;
+			while (pos < stream.size()) {
+				Packet packet;
+				packet.fill(0xFF);
+				packet[0] = 0x47;
+				packet[1] = static_cast<std::uint8_t>(m_pid >> 8);
+				packet[2] = static_cast<std::uint8_t>(m_pid & 0xFF);
+				packet[3] = static_cast<std::uint8_t>(0x10 | m_continuity);
+				m_continuity = (m_continuity + 1) & 0x0F;
+
+				while (nextStart < starts.size() && starts[nextStart] < pos)
+					nextStart++;
+				std::size_t size;
+				std::size_t offset = 4;
+				if (nextStart < starts.size() && starts[nextStart] - pos < TS_PACKET_SIZE - 5) {
+					packet[1] |= 0x40;
+					packet[4] = static_cast<std::uint8_t>(starts[nextStart] - pos);
+					offset = 5;
+					size = TS_PACKET_SIZE - 5;
+				} else if (nextStart < starts.size() && starts[nextStart] - pos < TS_PACKET_SIZE - 4) {
+					// pointer_field の後に始まりを置けないので、前のセクションの残りだけを入れる
+					size = starts[nextStart] - pos;
+				} else {
+					size = TS_PACKET_SIZE - 4;
+				}
+				if (size > stream.size() - pos)
+					size = stream.size() - pos;
+				std::memcpy(packet.data() + offset, stream.data() + pos, size);
+				pos += size;
+				packets.push_back(packet);
+			}
+			return packets;
+		}
+
+	private:
+		std::uint16_t m_pid;
+		int m_continuity = 0;
+	};
+
+	void AppendCrc(Bytes* pSection)
+	{
+		const std::uint32_t crc = CSectionCollector::Crc32(pSection->data(), pSection->size());
+		for (int shift = 24; shift >= 0; shift -= 8)
+			pSection->push_back(static_cast<std::uint8_t>(crc >> shift));
+	}
+
+	// section_syntax_indicator の付いたセクション(CRC を付ける)
+	Bytes MakeSection(std::uint8_t tableID, const Bytes& body)
+	{
+		Bytes section = { tableID, 0, 0 };
+		section.insert(section.end(), body.begin(), body.end());
+		const std::size_t length = section.size() - 3 + 4;
+		section[1] = static_cast<std::uint8_t>(0xB0 | (length >> 8));
+		section[2] = static_cast<std::uint8_t>(length & 0xFF);
+		AppendCrc(&section);
+		return section;
+	}
+
+	Bytes MakeBody(std::size_t size, std::uint8_t seed)
+	{
+		Bytes body(size);
+		for (std::size_t i = 0; i < size; i++)
+			body[i] = static_cast<std::uint8_t>(seed + i);
+		return body;
+	}
+
+	// EIT p/f 自ストリームの一つのイベントのセクション。descriptorSize でセクションを長くする
+	Bytes MakeEitSection(std::uint16_t serviceID, std::uint8_t sectionNumber, std::uint16_t eventID,
+		bool fCurrent = true, std::size_t descriptorSize = 0)
+	{
+		Bytes body = {
+			static_cast<std::uint8_t>(serviceID >> 8), static_cast<std::uint8_t>(serviceID & 0xFF),
+			static_cast<std::uint8_t>(0xC0 | (3 << 1) | (fCurrent ? 1 : 0)),	// version_number 3
+			sectionNumber, 1,
+			0x7F, 0xE0, 0x7F, 0xE0,		// transport_stream_id, original_network_id
+			1, CEitPfWatcher::TABLE_ID_EIT_PF_ACTUAL,
+			static_cast<std::uint8_t>(eventID >> 8), static_cast<std::uint8_t>(eventID & 0xFF),
+			0xE3, 0x9B, 0x12, 0x00, 0x00,	// start_time
+			0x00, 0x30, 0x00,				// duration
+			static_cast<std::uint8_t>(0x80 | (descriptorSize >> 8)), static_cast<std::uint8_t>(descriptorSize & 0xFF),
+		};
+		for (std::size_t i = 0; i < descriptorSize; i++)
+			body.push_back(static_cast<std::uint8_t>(i));
+		return MakeSection(CEitPfWatcher::TABLE_ID_EIT_PF_ACTUAL, body);
+	}
+
+	class CSectionRecorder : public CSectionHandler {
+	public:
+		explicit CSectionRecorder(std::uint8_t tableID)
+			: m_tableID(tableID)
+		{}
+
+		bool AcceptTable(std::uint8_t tableID) const override { return tableID == m_tableID; }
+		void OnSection(const std::uint8_t* pSection, std::size_t size) override
+		{
+			sections.push_back(Bytes(pSection, pSection + size));
+		}
+
+		std::vector<Bytes> sections;
+
+	private:
+		std::uint8_t m_tableID;
+	};
+
+	void Feed(CSectionCollector* pCollector, const std::vector<Packet>& packets)
+	{
+		for (const Packet& packet : packets)
+			pCollector->OnPacket(packet.data());
+	}
+
+	void Feed(CEitPfWatcher* pWatcher, const std::vector<Packet>& packets)
+	{
+		for (const Packet& packet : packets)
+			pWatcher->OnPacket(packet.data());
+	}
+
+	struct EventChanges {
+		std::vector<std::pair<std::uint16_t, std::uint16_t>> changes;
+
+		static void Callback(void* pClientData, std::uint16_t serviceID, std::uint16_t eventID)
+		{
+			static_cast<EventChanges*>(pClientData)->changes.push_back(std::make_pair(serviceID, eventID));
+		}
+	};
+
+	const std::uint8_t TABLE_ID = 0x4E;
+	const std::uint16_t PID = CEitPfWatcher::PID_EIT;
+}
+
+TEST(SectionCrc32)
+{
+	const char* pszCheck = "123456789";
+	EXPECT(CSectionCollector::Crc32(reinterpret_cast<const std::uint8_t*>(pszCheck), 9) == 0x0376E6E7U);
+
+	// CRC を含めたセクション全体なら 0
+	Bytes section = MakeSection(TABLE_ID, MakeBody(50, 1));
+	EXPECT(CSectionCollector::Crc32(section.data(), section.size()) == 0);
+	section[10] ^= 0x01;
+	EXPECT(CSectionCollector::Crc32(section.data(), section.size()) != 0);
+}
+
+TEST(SectionSplitAcrossPackets)
+{
+	CSectionRecorder recorder(TABLE_ID);
+	CSectionCollector collector(&recorder);
+	CPacketizer packetizer(PID);
+
+	const Bytes section = MakeSection(TABLE_ID, MakeBody(500, 7));
+	const std::vector<Packet> packets = packetizer.Packetize({ section });
+	REQUIRE(packets.size() == 3);
+	collector.OnPacket(packets[0].data());
+	collector.OnPacket(packets[1].data());
+	EXPECT(recorder.sections.empty());
+	collector.OnPacket(packets[2].data());
+	REQUIRE(recorder.sections.size() == 1);
+	EXPECT(recorder.sections[0] == section);
+}
+
+TEST(SectionsSharingPackets)
+{
+	CSectionRecorder recorder(TABLE_ID);
+	CSectionCollector collector(&recorder);
+	CPacketizer packetizer(PID);
+
+	// 一つのパケットに二つ
+	const Bytes first = MakeSection(TABLE_ID, MakeBody(20, 1));
+	const Bytes second = MakeSection(TABLE_ID, MakeBody(30, 2));
+	std::vector<Packet> packets = packetizer.Packetize({ first, second });
+	EXPECT(packets.size() == 1);
+	Feed(&collector, packets);
+	REQUIRE(recorder.sections.size() == 2);
+	EXPECT(recorder.sections[0] == first);
+	EXPECT(recorder.sections[1] == second);
+
+	// 前のセクションの残りの後に次のセクションが始まる
+	recorder.sections.clear();
+	const Bytes third = MakeSection(TABLE_ID, MakeBody(250, 3));
+	const Bytes fourth = MakeSection(TABLE_ID, MakeBody(40, 4));
+	packets = packetizer.Packetize({ third, fourth });
+	REQUIRE(packets.size() == 2);
+	EXPECT((packets[1][1] & 0x40) != 0);
+	EXPECT(packets[1][4] != 0);
+	Feed(&collector, packets);
+	REQUIRE(recorder.sections.size() == 2);
+	EXPECT(recorder.sections[0] == third);
+	EXPECT(recorder.sections[1] == fourth);
+}
+
+TEST(SectionDroppedOnDiscontinuity)
+{
+	CSectionRecorder recorder(TABLE_ID);
+	CSectionCollector collector(&recorder);
+	CPacketizer packetizer(PID);
+
+	const Bytes lost = MakeSection(TABLE_ID, MakeBody(500, 5));
+	std::vector<Packet> packets = packetizer.Packetize({ lost });
+	REQUIRE(packets.size() == 3);
+	collector.OnPacket(packets[0].data());
+	collector.OnPacket(packets[2].data());
+	EXPECT(recorder.sections.empty());
+
+	// 次のセクションからは読める
+	const Bytes next = MakeSection(TABLE_ID, MakeBody(100, 6));
+	Feed(&collector, packetizer.Packetize({ next }));
+	REQUIRE(recorder.sections.size() == 1);
+	EXPECT(recorder.sections[0] == next);
+}
+
+TEST(SectionSkipsOtherTablesAndBadPackets)
+{
+	CSectionRecorder recorder(TABLE_ID);
+	CSectionCollector collector(&recorder);
+	CPacketizer packetizer(PID);
+
+	const Bytes other = MakeSection(0x4F, MakeBody(400, 8));
+	const Bytes wanted = MakeSection(TABLE_ID, MakeBody(60, 9));
+	Feed(&collector, packetizer.Packetize({ other, wanted }));
+	REQUIRE(recorder.sections.size() == 1);
+	EXPECT(recorder.sections[0] == wanted);
+
+	// transport_error_indicator の付いたパケットは読まない
+	recorder.sections.clear();
+	std::vector<Packet> packets = packetizer.Packetize({ wanted });
+	packets[0][1] |= 0x80;
+	Feed(&collector, packets);
+	EXPECT(recorder.sections.empty());
+
+	// アダプテーションフィールドの後のペイロード
+	Packet packet;
+	packet.fill(0xFF);
+	packet[0] = 0x47;
+	packet[1] = 0x40 | (PID >> 8);
+	packet[2] = PID & 0xFF;
+	packet[3] = 0x30 | 0x0F;
+	packet[4] = 10;		// adaptation_field_length
+	packet[5] = 0x00;
+	packet[15] = 0;		// pointer_field
+	std::memcpy(packet.data() + 16, wanted.data(), wanted.size());
+	collector.OnPacket(packet.data());
+	REQUIRE(recorder.sections.size() == 1);
+	EXPECT(recorder.sections[0] == wanted);
+}
+
+TEST(EitWatcherDetectsEventChange)
+{
+	EventChanges changes;
+	CEitPfWatcher watcher(EventChanges::Callback, &changes);
+	CPacketizer packetizer(PID);
+
+	// サービスを設定するまでは何もしない
+	Feed(&watcher, packetizer.Packetize({ MakeEitSection(1024, 0, 100) }));
+	EXPECT(watcher.GetPresentEventID() == 0);
+
+	watcher.SetService(1024);
+	Feed(&watcher, packetizer.Packetize({ MakeEitSection(1024, 0, 100) }));
+	EXPECT(watcher.GetPresentEventID() == 100);
+	// 最初に知った番組は変化ではない
+	EXPECT(changes.changes.empty());
+
+	// following と他のサービスは見ない
+	Feed(&watcher, packetizer.Packetize({ MakeEitSection(1024, 1, 200), MakeEitSection(1025, 0, 300) }));
+	EXPECT(watcher.GetPresentEventID() == 100);
+	EXPECT(changes.changes.empty());
+
+	// 複数のパケットにまたがるセクションで番組が変わる
+	Feed(&watcher, packetizer.Packetize({ MakeEitSection(1024, 0, 101, true, 400) }));
+	EXPECT(watcher.GetPresentEventID() == 101);
+	REQUIRE(changes.changes.size() == 1);
+	EXPECT(changes.changes[0] == std::make_pair(std::uint16_t(1024), std::uint16_t(101)));
+
+	// 同じ番組なら知らせない
+	Feed(&watcher, packetizer.Packetize({ MakeEitSection(1024, 0, 101) }));
+	EXPECT(changes.changes.size() == 1);
+}
+
+TEST(EitWatcherRejectsInvalidSections)
+{
+	EventChanges changes;
+	CEitPfWatcher watcher(EventChanges::Callback, &changes);
+	CPacketizer packetizer(PID);
+	watcher.SetService(1024);
+	Feed(&watcher, packetizer.Packetize({ MakeEitSection(1024, 0, 100) }));
+	REQUIRE(watcher.GetPresentEventID() == 100);
+
+	// CRC が合わない
+	Bytes section = MakeEitSection(1024, 0, 101);
+	section[section.size() - 1] ^= 0x01;
+	Feed(&watcher, packetizer.Packetize({ section }));
+	EXPECT(watcher.GetPresentEventID() == 100);
+
+	// current_next_indicator が 0
+	Feed(&watcher, packetizer.Packetize({ MakeEitSection(1024, 0, 102, false) }));
+	EXPECT(watcher.GetPresentEventID() == 100);
+
+	// EIT でない PID
+	CPacketizer otherPid(0x0011);
+	Feed(&watcher, otherPid.Packetize({ MakeEitSection(1024, 0, 103) }));
+	EXPECT(watcher.GetPresentEventID() == 100);
+
+	// 短すぎる
+	Feed(&watcher, packetizer.Packetize({ MakeSection(CEitPfWatcher::TABLE_ID_EIT_PF_ACTUAL, { 0x04, 0x00, 0xC1, 0x00 }) }));
+	EXPECT(watcher.GetPresentEventID() == 100);
+	EXPECT(changes.changes.empty());
+}
+
+TEST(EitWatcherResetsOnServiceChange)
+{
+	EventChanges changes;
+	CEitPfWatcher watcher(EventChanges::Callback, &changes);
+	CPacketizer packetizer(PID);
+	watcher.SetService(1024);
+	Feed(&watcher, packetizer.Packetize({ MakeEitSection(1024, 0, 100) }));
+
+	// サービスが変われば、前のサービスの番組からの変化とはしない
+	watcher.SetService(1025);
+	EXPECT(watcher.GetPresentEventID() == 0);
+	Feed(&watcher, packetizer.Packetize({ MakeEitSection(1025, 0, 300) }));
+	EXPECT(watcher.GetPresentEventID() == 300);
+	EXPECT(changes.changes.empty());
+	Feed(&watcher, packetizer.Packetize({ MakeEitSection(1025, 0, 301) }));
+	REQUIRE(changes.changes.size() == 1);
+	EXPECT(changes.changes[0] == std::make_pair(std::uint16_t(1025), std::uint16_t(301)));
+
+	// 同じサービスを設定し直しても知っている番組はそのまま
+	watcher.SetService(1025);
+	EXPECT(watcher.GetPresentEventID() == 301);
+
+	watcher.SetService(0);
+	Feed(&watcher, packetizer.Packetize({ MakeEitSection(1025, 0, 302) }));
+	EXPECT(changes.changes.size() == 1);
+}
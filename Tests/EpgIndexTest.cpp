@@ -0,0 +1,137 @@
+#include "Test.h"
+#include <vector>
+#include "EpgIndex.h"
+
+using namespace ChannelTimer;
+
+namespace {
+	const TimeValue BASE_TIME = 132223104000000000LL;	// 2020/1/1 0:00 UTC
+	const ServiceKey SERVICE = MakeServiceKey(0x7FE0, 0x7FE0, 1024);
+
+	// duration は秒単位、0 なら長さ未定
+	CEpgIndex::EventSource MakeEvent(std::uint16_t eventID, TimeValue startTime, std::uint32_t duration,
+		const wchar_t* pszName = nullptr)
+	{
+		CEpgIndex::EventSource event = {};
+		event.startTime = startTime;
+		event.duration = duration;
+		event.eventID = eventID;
+		event.pszName = pszName;
+		return event;
+	}
+
+	TimeValue At(int minutes)
+	{
+		return BASE_TIME + minutes * FILETIME_MIN;
+	}
+
+	int FoundID(const CEpgEvent* pEvent)
+	{
+		return pEvent != nullptr ? pEvent->eventID : -1;
+	}
+
+	// 0:00-0:30, 0:30-(未定), 1:00-1:30, 1:30-(未定)
+	void AddUnknownDurations(CEpgIndex* pIndex)
+	{
+		pIndex->UpdateService(SERVICE, {
+			MakeEvent(1, At(0), 30 * 60, L"ニュース"),
+			MakeEvent(2, At(30), 0, L"中継"),
+			MakeEvent(3, At(60), 30 * 60),
+			MakeEvent(4, At(90), 0),
+		}, At(0));
+	}
+}
+
+TEST(EpgIndexFindsUnknownDurationUntilNextEvent)
+{
+	CEpgIndex index;
+	AddUnknownDurations(&index);
+
+	EXPECT(FoundID(index.FindAt(SERVICE, At(0) - 1)) == -1);
+	EXPECT(FoundID(index.FindAt(SERVICE, At(29))) == 1);
+	// 長さ未定の番組は次の番組が始まるまで
+	EXPECT(FoundID(index.FindAt(SERVICE, At(30))) == 2);
+	EXPECT(FoundID(index.FindAt(SERVICE, At(45))) == 2);
+	EXPECT(FoundID(index.FindAt(SERVICE, At(60) - 1)) == 2);
+	EXPECT(FoundID(index.FindAt(SERVICE, At(60))) == 3);
+	// 最後の番組なら、ずっと続く
+	EXPECT(FoundID(index.FindAt(SERVICE, At(90))) == 4);
+	EXPECT(FoundID(index.FindAt(SERVICE, BASE_TIME + 7 * FILETIME_DAY)) == 4);
+
+	EXPECT(FoundID(index.FindNext(SERVICE, At(45))) == 3);
+	EXPECT(FoundID(index.FindNext(SERVICE, At(90))) == -1);
+
+	const CEpgEvent* pEvent = index.FindAt(SERVICE, At(45));
+	REQUIRE(pEvent != nullptr);
+	EXPECT(pEvent->duration == 0);
+	EXPECT(index.GetEventName(SERVICE, *pEvent) == L"中継");
+}
+
+TEST(EpgIndexFindsRangeWithUnknownDuration)
+{
+	CEpgIndex index;
+	AddUnknownDurations(&index);
+
+	// 長さ未定の番組の途中から
+	auto range = index.FindRange(SERVICE, At(45), At(50));
+	REQUIRE(range.second - range.first == 1);
+	EXPECT(range.first->eventID == 2);
+
+	range = index.FindRange(SERVICE, At(45), At(60));
+	REQUIRE(range.second - range.first == 1);
+	EXPECT(range.first->eventID == 2);
+
+	range = index.FindRange(SERVICE, At(45), At(61));
+	REQUIRE(range.second - range.first == 2);
+	EXPECT(range.first[0].eventID == 2);
+	EXPECT(range.first[1].eventID == 3);
+
+	// 最後の長さ未定の番組は、どれだけ後でも含む
+	range = index.FindRange(SERVICE, At(24 * 60), At(25 * 60));
+	REQUIRE(range.second - range.first == 1);
+	EXPECT(range.first->eventID == 4);
+
+	range = index.FindRange(SERVICE, At(0), At(24 * 60));
+	EXPECT(range.second - range.first == 4);
+
+	// 始まる前
+	range = index.FindRange(SERVICE, At(-60), At(0));
+	EXPECT(range.first == range.second);
+}
+
+TEST(EpgIndexLeavesGapsBetweenKnownDurations)
+{
+	CEpgIndex index;
+	// 0:00-0:10, 0:30-1:00
+	index.UpdateService(SERVICE, {
+		MakeEvent(1, At(0), 10 * 60),
+		MakeEvent(2, At(30), 30 * 60),
+	}, At(0));
+
+	EXPECT(FoundID(index.FindAt(SERVICE, At(5))) == 1);
+	EXPECT(FoundID(index.FindAt(SERVICE, At(10))) == -1);
+	EXPECT(FoundID(index.FindAt(SERVICE, At(20))) == -1);
+	EXPECT(FoundID(index.FindAt(SERVICE, At(60))) == -1);
+
+	auto range = index.FindRange(SERVICE, At(15), At(25));
+	EXPECT(range.first == range.second);
+	range = index.FindRange(SERVICE, At(15), At(31));
+	REQUIRE(range.second - range.first == 1);
+	EXPECT(range.first->eventID == 2);
+	range = index.FindRange(SERVICE, At(5), At(31));
+	EXPECT(range.second - range.first == 2);
+}
+
+TEST(EpgIndexSortsEvents)
+{
+	CEpgIndex index;
+	index.UpdateService(SERVICE, {
+		MakeEvent(3, At(60), 0),
+		MakeEvent(1, At(0), 0),
+		MakeEvent(2, At(30), 0),
+	}, At(0));
+
+	EXPECT(FoundID(index.FindAt(SERVICE, At(10))) == 1);
+	EXPECT(FoundID(index.FindAt(SERVICE, At(40))) == 2);
+	EXPECT(FoundID(index.FindAt(SERVICE, At(70))) == 3);
+}
@@ -0,0 +1,267 @@
+#include "Test.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "EpgSearch.h"
+
+using namespace ChannelTimer;
+
+namespace {
+	const TimeValue BASE_TIME = 132223104000000000LL;	// 2020/1/1 0:00 UTC
+	const ServiceKey SERVICE = MakeServiceKey(0x7FE0, 0x7FE0, 1024);
+	const ServiceKey OTHER = MakeServiceKey(4, 0x4010, 101);
+
+	// genre が負ならジャンル無し
+	CEpgIndex::EventSource MakeEvent(std::uint16_t eventID, TimeValue startTime,
+		const wchar_t* pszName, const wchar_t* pszText = nullptr, int genre = -1)
+	{
+		CEpgIndex::EventSource event = {};
+		event.startTime = startTime;
+		event.duration = 30 * 60;
+		event.eventID = eventID;
+		event.pszName = pszName;
+		event.pszText = pszText;
+		if (genre >= 0) {
+			event.genreCount = 1;
+			event.genres[0] = static_cast<std::uint8_t>(genre);
+		}
+		return event;
+	}
+
+	CSearchRule ParseRule(const wchar_t* pszText)
+	{
+		CSearchRule rule;
+		CSearchRule::Parse(pszText, &rule);
+		return rule;
+	}
+
+	// 合った番組の event_id(昇順)
+	std::vector<std::uint16_t> MatchIDs(const CEpgSearchIndex& index, const wchar_t* pszRule,
+		TimeValue from = BASE_TIME, TimeValue to = BASE_TIME + 30 * FILETIME_DAY)
+	{
+		std::vector<CSearchMatch> matches;
+		index.Match(ParseRule(pszRule), from, to, &matches);
+		std::vector<std::uint16_t> ids;
+		for (const CSearchMatch& match : matches)
+			ids.push_back(match.eventID);
+		std::sort(ids.begin(), ids.end());
+		return ids;
+	}
+
+	using IDs = std::vector<std::uint16_t>;
+}
+
+TEST(EpgSearchParsesRules)
+{
+	CSearchRule rule;
+	EXPECT(CSearchRule::Parse(L"ＮＨＫ　ニュース", &rule));
+	EXPECT((rule.keywords == std::vector<std::wstring>{ L"nhk", L"ニュース" }));
+	EXPECT(rule.genreMask == 0);
+
+	EXPECT(CSearchRule::Parse(L"3:", &rule));
+	EXPECT(rule.keywords.empty() && rule.genre == 0x30 && rule.genreMask == 0xF0);
+	EXPECT(CSearchRule::Parse(L"31:ドラマ", &rule));
+	EXPECT(rule.genre == 0x31 && rule.genreMask == 0xFF && rule.keywords.size() == 1);
+
+	EXPECT(!CSearchRule::Parse(L"", &rule));
+	EXPECT(!CSearchRule::Parse(L"x:ドラマ", &rule));
+}
+
+TEST(EpgSearchMatchesKeywords)
+{
+	CEpgSearchIndex index;
+	index.UpdateService(SERVICE, {
+		MakeEvent(1, BASE_TIME, L"ニュース7", L"全国の話題"),
+		MakeEvent(2, BASE_TIME + FILETIME_HOUR, L"天気予報", L"明日のニュースと天気"),
+		MakeEvent(3, BASE_TIME + 2 * FILETIME_HOUR, L"ＮＨＫニュース"),
+		MakeEvent(4, BASE_TIME + 3 * FILETIME_HOUR, L"ドキュメント", nullptr),
+	});
+	EXPECT(index.EventCount() == 4);
+
+	// 番組名でも番組内容でもよく、全角英字も大文字も同じに扱う
+	EXPECT((MatchIDs(index, L"ニュース") == IDs{ 1, 2, 3 }));
+	EXPECT((MatchIDs(index, L"nhk") == IDs{ 3 }));
+	EXPECT((MatchIDs(index, L"NHK ニュース") == IDs{ 3 }));
+	EXPECT((MatchIDs(index, L"天気 ニュース") == IDs{ 2 }));
+	EXPECT(MatchIDs(index, L"ドラマ").empty());
+	// 語をまたぐ組では合わない
+	EXPECT(MatchIDs(index, L"予報明日").empty());
+	// 期間の外
+	EXPECT((MatchIDs(index, L"ニュース", BASE_TIME + FILETIME_HOUR, BASE_TIME + 2 * FILETIME_HOUR) == IDs{ 2 }));
+}
+
+TEST(EpgSearchMatchesGenres)
+{
+	CEpgSearchIndex index;
+	index.UpdateService(SERVICE, {
+		MakeEvent(1, BASE_TIME, L"ニュース", nullptr, 0x00),
+		MakeEvent(2, BASE_TIME + FILETIME_HOUR, L"連続ドラマ", nullptr, 0x30),
+		MakeEvent(3, BASE_TIME + 2 * FILETIME_HOUR, L"海外ドラマ", nullptr, 0x31),
+		MakeEvent(4, BASE_TIME + 3 * FILETIME_HOUR, L"ドラマの話", nullptr),
+	});
+
+	EXPECT((MatchIDs(index, L"3:") == IDs{ 2, 3 }));
+	EXPECT((MatchIDs(index, L"31:") == IDs{ 3 }));
+	EXPECT((MatchIDs(index, L"0:") == IDs{ 1 }));
+	EXPECT((MatchIDs(index, L"3:ドラマ") == IDs{ 2, 3 }));
+	EXPECT((MatchIDs(index, L"30:ドラマ") == IDs{ 2 }));
+	EXPECT((MatchIDs(index, L"ドラマ") == IDs{ 2, 3, 4 }));
+	EXPECT(MatchIDs(index, L"7:").empty());
+}
+
+TEST(EpgSearchReplacesEditedEvents)
+{
+	CEpgSearchIndex index;
+	index.UpdateService(SERVICE, {
+		MakeEvent(1, BASE_TIME, L"旧番組"),
+		MakeEvent(2, BASE_TIME + FILETIME_HOUR, L"天気予報"),
+	});
+
+	// 同じ event_id で内容が変わった
+	index.UpdateService(SERVICE, {
+		MakeEvent(1, BASE_TIME, L"新番組"),
+		MakeEvent(2, BASE_TIME + FILETIME_HOUR, L"天気予報"),
+	});
+	EXPECT(index.EventCount() == 2);
+	EXPECT(MatchIDs(index, L"旧番組").empty());
+	EXPECT((MatchIDs(index, L"新番組") == IDs{ 1 }));
+	EXPECT((MatchIDs(index, L"天気") == IDs{ 2 }));
+
+	// 開始日時だけ変わっても入れ替える
+	index.UpdateService(SERVICE, {
+		MakeEvent(1, BASE_TIME + 5 * FILETIME_HOUR, L"新番組"),
+		MakeEvent(2, BASE_TIME + FILETIME_HOUR, L"天気予報"),
+	});
+	EXPECT(index.EventCount() == 2);
+	EXPECT(MatchIDs(index, L"新番組", BASE_TIME, BASE_TIME + FILETIME_HOUR).empty());
+	EXPECT((MatchIDs(index, L"新番組", BASE_TIME + 5 * FILETIME_HOUR, BASE_TIME + 6 * FILETIME_HOUR) == IDs{ 1 }));
+}
+
+TEST(EpgSearchForgetsRemovedEvents)
+{
+	CEpgSearchIndex index;
+	index.UpdateService(SERVICE, {
+		MakeEvent(1, BASE_TIME, L"ニュース"),
+		MakeEvent(2, BASE_TIME + FILETIME_HOUR, L"ニュース特集"),
+	});
+	index.UpdateService(OTHER, {
+		MakeEvent(1, BASE_TIME, L"ニュース"),
+	});
+	EXPECT(index.EventCount() == 3);
+
+	// 番組表から無くなった
+	index.UpdateService(SERVICE, { MakeEvent(1, BASE_TIME, L"ニュース") });
+	EXPECT(index.EventCount() == 2);
+	EXPECT(MatchIDs(index, L"特集").empty());
+
+	// サービスごと無くなった
+	index.RemoveService(OTHER);
+	EXPECT(index.EventCount() == 1);
+	std::vector<CSearchMatch> matches;
+	index.Match(ParseRule(L"ニュース"), BASE_TIME, BASE_TIME + FILETIME_DAY, &matches);
+	REQUIRE(matches.size() == 1);
+	EXPECT(matches[0].key == SERVICE && matches[0].eventID == 1 && matches[0].startTime == BASE_TIME);
+
+	index.Clear();
+	EXPECT(index.EventCount() == 0 && index.TermCount() == 0);
+	EXPECT(MatchIDs(index, L"ニュース").empty());
+}
+
+TEST(EpgSearchMatchesAfterCompact)
+{
+	// 無効な番組が 1024 以上で半分を超えると詰める
+	std::vector<std::wstring> names;
+	for (int i = 0; i < 1500; i++)
+		names.push_back(L"番組" + std::to_wstring(i) + (i == 700 ? L" 特集" : L""));
+	std::vector<CEpgIndex::EventSource> events;
+	for (int i = 0; i < 1500; i++)
+		events.push_back(MakeEvent(static_cast<std::uint16_t>(i), BASE_TIME + i * FILETIME_MIN, names[i].c_str()));
+	CEpgSearchIndex index;
+	index.UpdateService(SERVICE, events);
+	index.UpdateService(OTHER, { MakeEvent(1, BASE_TIME, L"ニュース特集") });
+	const std::size_t termCount = index.TermCount();
+	EXPECT(index.EventCount() == 1501);
+
+	events.resize(100);
+	for (CEpgIndex::EventSource& event : events)
+		event.pszText = L"再放送";
+	index.UpdateService(SERVICE, events);
+	EXPECT(index.EventCount() == 101);
+	EXPECT(index.TermCount() < termCount);
+
+	EXPECT((MatchIDs(index, L"特集") == IDs{ 1 }));
+	EXPECT(MatchIDs(index, L"再放送").size() == 100);
+	EXPECT((MatchIDs(index, L"番組42 再放送") == IDs{ 42 }));
+
+	// 詰めた後も入れ替えと削除ができる
+	index.UpdateService(OTHER, { MakeEvent(1, BASE_TIME, L"ニュース") });
+	EXPECT(MatchIDs(index, L"特集").empty());
+	EXPECT(index.EventCount() == 101);
+	index.RemoveService(SERVICE);
+	EXPECT(index.EventCount() == 1);
+	EXPECT((MatchIDs(index, L"ニュース") == IDs{ 1 }));
+}
+
+TEST(EpgSearchMatchesSingleCharacters)
+{
+	// 1 文字の語は組の索引を使えないので、番組を直接確かめる
+	CEpgSearchIndex index;
+	index.UpdateService(SERVICE, {
+		MakeEvent(1, BASE_TIME, L"ニュース7"),
+		MakeEvent(2, BASE_TIME + FILETIME_HOUR, L"ニュース9", nullptr, 0x00),
+		MakeEvent(3, BASE_TIME + 2 * FILETIME_HOUR, L"Ｎスペ"),
+	});
+	EXPECT((MatchIDs(index, L"7") == IDs{ 1 }));
+	EXPECT((MatchIDs(index, L"n") == IDs{ 3 }));
+	EXPECT((MatchIDs(index, L"ス") == IDs{ 1, 2, 3 }));
+	EXPECT((MatchIDs(index, L"9 ニュース") == IDs{ 2 }));
+	EXPECT((MatchIDs(index, L"0:ス") == IDs{ 2 }));
+	EXPECT(MatchIDs(index, L"8").empty());
+}
+
+TEST(EpgSearchWindowAndIndexAgree)
+{
+	// 期間の番組が少なければ期間を、索引の候補が少なければ索引を使う。どちらでも結果は同じ
+	const int COUNT = 600;
+	std::vector<std::wstring> names;
+	for (int i = 0; i < COUNT; i++) {
+		std::wstring name = L"ニュース" + std::to_wstring(i);
+		if (i % 97 == 0)
+			name += L" 特集";
+		names.push_back(name);
+	}
+	std::vector<CEpgIndex::EventSource> events;
+	for (int i = 0; i < COUNT; i++) {
+		events.push_back(MakeEvent(static_cast<std::uint16_t>(i + 1), BASE_TIME + i * FILETIME_HOUR,
+			names[i].c_str(), nullptr, i % 5 == 0 ? 0x31 : 0x00));
+	}
+	CEpgSearchIndex index;
+	index.UpdateService(SERVICE, events);
+
+	// 期間の中で条件に合う番組を素直に数える
+	const auto expected = [&](const wchar_t* pszKeyword, int genre, int first, int last) {
+		IDs ids;
+		for (int i = first; i < last && i < COUNT; i++) {
+			if (pszKeyword != nullptr && names[i].find(pszKeyword) == std::wstring::npos)
+				continue;
+			if (genre >= 0 && (i % 5 == 0 ? 0x31 : 0x00) != genre)
+				continue;
+			ids.push_back(static_cast<std::uint16_t>(i + 1));
+		}
+		return ids;
+	};
+
+	const int widths[] = { 1, 3, 10, 50, 200, COUNT };
+	for (const int width : widths) {
+		for (int first = 0; first < COUNT; first += 131) {
+			const TimeValue from = BASE_TIME + first * FILETIME_HOUR;
+			const TimeValue to = from + width * FILETIME_HOUR;
+			// どの期間でも全ての番組に合う語、少ない番組に合う語、ジャンル、1 文字の語
+			EXPECT(MatchIDs(index, L"ニュース", from, to) == expected(L"ニュース", -1, first, first + width));
+			EXPECT(MatchIDs(index, L"特集", from, to) == expected(L"特集", -1, first, first + width));
+			EXPECT(MatchIDs(index, L"31:", from, to) == expected(nullptr, 0x31, first, first + width));
+			EXPECT(MatchIDs(index, L"31:特集", from, to) == expected(L"特集", 0x31, first, first + width));
+			EXPECT(MatchIDs(index, L"7", from, to) == expected(L"7", -1, first, first + width));
+		}
+	}
+}
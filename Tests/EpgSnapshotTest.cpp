@@ -0,0 +1,450 @@
+#include "Test.h"
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include "EpgSnapshot.h"
+
+using namespace ChannelTimer;
+
+namespace {
+	using Format = CEpgSnapshotFormat;
+
+	const TimeValue BASE_TIME = 132223104000000000LL;	// 2020/1/1 0:00 UTC
+	const TimeValue NOW = BASE_TIME + 60 * FILETIME_MIN;
+	const ServiceKey SERVICE = MakeServiceKey(0x7FE0, 0x7FE0, 1024);
+	const ServiceKey OTHER = MakeServiceKey(4, 0x4010, 101);
+	const ServiceKey ENDED = MakeServiceKey(4, 0x4011, 103);
+
+	/**
+	 * メモリを持ったスナップショット(8 バイト境界に置く)
+	 */
+	class CBufferSnapshot : public CEpgSnapshot {
+	public:
+		bool Load(const std::vector<std::uint8_t>& data)
+		{
+			m_buffer.assign((data.size() + 7) / 8, 0);
+			if (!data.empty())
+				std::memcpy(m_buffer.data(), data.data(), data.size());
+			return Attach(m_buffer.data(), data.size());
+		}
+
+	private:
+		std::vector<std::uint64_t> m_buffer;
+	};
+
+	CEpgEvent MakeEvent(std::uint16_t eventID, TimeValue startTime, std::uint32_t duration,
+		std::uint32_t nameOffset, std::uint16_t nameLength)
+	{
+		CEpgEvent event = {};
+		event.startTime = startTime;
+		event.duration = duration;
+		event.eventID = eventID;
+		event.nameOffset = nameOffset;
+		event.nameLength = nameLength;
+		return event;
+	}
+
+	// SERVICE と OTHER の番組(NOW より前に終わった番組と、番組が全て終わった ENDED も足しておく)
+	void BuildSample(std::vector<std::uint8_t>* pData)
+	{
+		const std::wstring serviceNames = L"朝の連続ドラマ天気予報ニュース映画";
+		const CEpgEvent serviceEvents[] = {
+			MakeEvent(1, BASE_TIME, 30 * 60, 0, 7),						// 終わっている
+			MakeEvent(2, BASE_TIME + 30 * FILETIME_MIN, 0, 7, 4),		// 長さ未定で、次の番組が始まっている
+			MakeEvent(3, BASE_TIME + 50 * FILETIME_MIN, 30 * 60, 11, 4),
+			MakeEvent(4, BASE_TIME + 80 * FILETIME_MIN, 0, 15, 2),		// 長さ未定の最後の番組
+		};
+		const std::wstring otherNames = L"スポーツ";
+		const CEpgEvent otherEvents[] = {
+			MakeEvent(10, BASE_TIME + 45 * FILETIME_MIN, 60 * 60, 0, 4),
+		};
+		const std::wstring endedNames = L"深夜番組";
+		const CEpgEvent endedEvents[] = {
+			MakeEvent(20, BASE_TIME, 60 * 60, 0, 4),
+		};
+
+		CEpgSnapshotBuilder builder(NOW);
+		builder.AddService(SERVICE, BASE_TIME + 5 * FILETIME_MIN, std::begin(serviceEvents), std::end(serviceEvents), serviceNames);
+		builder.AddService(ENDED, BASE_TIME, std::begin(endedEvents), std::end(endedEvents), endedNames);
+		builder.AddService(OTHER, BASE_TIME + 10 * FILETIME_MIN, std::begin(otherEvents), std::end(otherEvents), otherNames);
+		builder.Build(pData);
+	}
+
+	Format::Header GetHeader(const std::vector<std::uint8_t>& data)
+	{
+		Format::Header header;
+		std::memcpy(&header, data.data(), sizeof(header));
+		return header;
+	}
+
+	void SetHeader(std::vector<std::uint8_t>* pData, const Format::Header& header)
+	{
+		std::memcpy(pData->data(), &header, sizeof(header));
+	}
+
+	Format::Service GetService(const std::vector<std::uint8_t>& data, std::size_t index)
+	{
+		Format::Service service;
+		std::memcpy(&service, data.data() + GetHeader(data).servicesOffset + index * sizeof(service), sizeof(service));
+		return service;
+	}
+
+	void SetService(std::vector<std::uint8_t>* pData, std::size_t index, const Format::Service& service)
+	{
+		std::memcpy(pData->data() + GetHeader(*pData).servicesOffset + index * sizeof(service), &service, sizeof(service));
+	}
+
+	bool Loads(const std::vector<std::uint8_t>& data)
+	{
+		CBufferSnapshot snapshot;
+		return snapshot.Load(data);
+	}
+}
+
+TEST(EpgSnapshotRoundTrip)
+{
+	std::vector<std::uint8_t> data;
+	BuildSample(&data);
+	EXPECT(data.size() % 8 == 0);
+
+	CBufferSnapshot snapshot;
+	REQUIRE(snapshot.Load(data));
+	EXPECT(snapshot.IsAttached());
+	EXPECT(snapshot.GetCreatedTime() == NOW);
+	// ENDED は番組が残らないので書かない
+	EXPECT(snapshot.ServiceCount() == 2);
+	EXPECT(snapshot.EventCount() == 3);
+	// キー順
+	EXPECT(snapshot.GetService(0).key == OTHER);
+	EXPECT(snapshot.GetService(1).key == SERVICE);
+
+	CEpgSnapshot::Service service;
+	EXPECT(!snapshot.FindService(ENDED, &service));
+	REQUIRE(snapshot.FindService(SERVICE, &service));
+	EXPECT(service.loadedTime == BASE_TIME + 5 * FILETIME_MIN);
+	REQUIRE(service.last - service.first == 2);
+	EXPECT(service.first[0].eventID == 3);
+	EXPECT(service.first[0].startTime == BASE_TIME + 50 * FILETIME_MIN);
+	EXPECT(service.first[0].duration == 30 * 60);
+	EXPECT(CEpgSnapshot::GetEventName(service, service.first[0]) == L"ニュース");
+	EXPECT(service.first[1].eventID == 4);
+	EXPECT(service.first[1].duration == 0);
+	EXPECT(CEpgSnapshot::GetEventName(service, service.first[1]) == L"映画");
+	// 捨てた番組の名前は書かない
+	EXPECT(service.nameLength == 6);
+
+	REQUIRE(snapshot.FindService(OTHER, &service));
+	REQUIRE(service.last - service.first == 1);
+	EXPECT(service.first[0].eventID == 10);
+	EXPECT(CEpgSnapshot::GetEventName(service, service.first[0]) == L"スポーツ");
+
+	// 名前の位置が範囲外なら空
+	CEpgEvent event = service.first[0];
+	event.nameOffset = 3;
+	EXPECT(CEpgSnapshot::GetEventName(service, event).empty());
+}
+
+TEST(EpgSnapshotRebuildsFromSnapshot)
+{
+	std::vector<std::uint8_t> data;
+	BuildSample(&data);
+	CBufferSnapshot snapshot;
+	REQUIRE(snapshot.Load(data));
+
+	// 読んだサービスをそのまま足せば同じ内容になる
+	// (番組の並びは足した順なので、バイト列ではなく中身を比べる)
+	CEpgSnapshotBuilder builder(NOW);
+	for (std::size_t i = 0; i < snapshot.ServiceCount(); i++)
+		builder.AddService(snapshot.GetService(i));
+	std::vector<std::uint8_t> rebuilt;
+	builder.Build(&rebuilt);
+	CBufferSnapshot rebuiltSnapshot;
+	REQUIRE(rebuiltSnapshot.Load(rebuilt));
+	EXPECT(rebuiltSnapshot.GetCreatedTime() == NOW);
+	REQUIRE(rebuiltSnapshot.ServiceCount() == snapshot.ServiceCount());
+	EXPECT(rebuiltSnapshot.EventCount() == snapshot.EventCount());
+	for (std::size_t i = 0; i < snapshot.ServiceCount(); i++) {
+		const CEpgSnapshot::Service a = snapshot.GetService(i);
+		const CEpgSnapshot::Service b = rebuiltSnapshot.GetService(i);
+		EXPECT(a.key == b.key);
+		EXPECT(a.loadedTime == b.loadedTime);
+		REQUIRE(a.last - a.first == b.last - b.first);
+		for (std::ptrdiff_t j = 0; j < a.last - a.first; j++) {
+			EXPECT(std::memcmp(&a.first[j], &b.first[j], sizeof(CEpgEvent)) == 0);
+			EXPECT(CEpgSnapshot::GetEventName(a, a.first[j]) == CEpgSnapshot::GetEventName(b, b.first[j]));
+		}
+	}
+	// 組み立て直した物をもう一度組み立てれば、同じバイト列になる
+	CEpgSnapshotBuilder again(NOW);
+	for (std::size_t i = 0; i < rebuiltSnapshot.ServiceCount(); i++)
+		again.AddService(rebuiltSnapshot.GetService(i));
+	std::vector<std::uint8_t> rebuiltAgain;
+	again.Build(&rebuiltAgain);
+	EXPECT(rebuiltAgain == rebuilt);
+
+	// 後の日時で組み立てれば、その間に終わった番組が落ちる
+	CEpgSnapshotBuilder later(BASE_TIME + 90 * FILETIME_MIN);
+	for (std::size_t i = 0; i < snapshot.ServiceCount(); i++)
+		later.AddService(snapshot.GetService(i));
+	later.Build(&rebuilt);
+	CBufferSnapshot laterSnapshot;
+	REQUIRE(laterSnapshot.Load(rebuilt));
+	EXPECT(laterSnapshot.ServiceCount() == 2);
+	CEpgSnapshot::Service service;
+	REQUIRE(laterSnapshot.FindService(SERVICE, &service));
+	REQUIRE(service.last - service.first == 1);
+	EXPECT(service.first[0].eventID == 4);
+	EXPECT(CEpgSnapshot::GetEventName(service, service.first[0]) == L"映画");
+}
+
+TEST(EpgSnapshotEmpty)
+{
+	std::vector<std::uint8_t> data;
+	CEpgSnapshotBuilder(NOW).Build(&data);
+	EXPECT(data.size() == sizeof(Format::Header));
+
+	CBufferSnapshot snapshot;
+	REQUIRE(snapshot.Load(data));
+	EXPECT(snapshot.ServiceCount() == 0);
+	EXPECT(snapshot.EventCount() == 0);
+	CEpgSnapshot::Service service;
+	EXPECT(!snapshot.FindService(SERVICE, &service));
+
+	// 読めていない時
+	CEpgSnapshot empty;
+	EXPECT(!empty.IsAttached());
+	EXPECT(empty.ServiceCount() == 0);
+	EXPECT(!empty.FindService(SERVICE, &service));
+}
+
+TEST(EpgSnapshotRejectsHeader)
+{
+	std::vector<std::uint8_t> data;
+	BuildSample(&data);
+	REQUIRE(Loads(data));
+	const Format::Header header = GetHeader(data);
+
+	std::vector<std::uint8_t> bad = data;
+	bad[0] = 'X';
+	EXPECT(!Loads(bad));
+
+	Format::Header h = header;
+	h.version = Format::VERSION + 1;
+	bad = data;
+	SetHeader(&bad, h);
+	EXPECT(!Loads(bad));
+
+	h = header;
+	h.headerSize = 48;
+	bad = data;
+	SetHeader(&bad, h);
+	EXPECT(!Loads(bad));
+
+	// ヘッダより短い
+	bad.assign(data.begin(), data.begin() + sizeof(Format::Header) - 8);
+	EXPECT(!Loads(bad));
+
+	// 途中で切れている
+	bad.assign(data.begin(), data.end() - 8);
+	EXPECT(!Loads(bad));
+
+	h = header;
+	h.fileSize = sizeof(Format::Header) - 8;
+	bad = data;
+	SetHeader(&bad, h);
+	EXPECT(!Loads(bad));
+
+	// 読めなかったら前に読んだ内容も使わない
+	CBufferSnapshot snapshot;
+	REQUIRE(snapshot.Load(data));
+	bad = data;
+	bad[0] = 'X';
+	EXPECT(!snapshot.Load(bad));
+	EXPECT(!snapshot.IsAttached());
+	EXPECT(snapshot.ServiceCount() == 0);
+}
+
+TEST(EpgSnapshotRejectsOffsets)
+{
+	std::vector<std::uint8_t> data;
+	BuildSample(&data);
+	const Format::Header header = GetHeader(data);
+
+	// ファイルの外
+	Format::Header h = header;
+	h.namesOffset = header.fileSize + 8;
+	std::vector<std::uint8_t> bad = data;
+	SetHeader(&bad, h);
+	EXPECT(!Loads(bad));
+
+	h = header;
+	h.servicesOffset = header.fileSize - sizeof(Format::Service);
+	bad = data;
+	SetHeader(&bad, h);
+	EXPECT(!Loads(bad));
+
+	h = header;
+	h.eventCount = header.eventCount + 100;
+	bad = data;
+	SetHeader(&bad, h);
+	EXPECT(!Loads(bad));
+
+	h = header;
+	h.nameLength = 0xFFFFFFFF;
+	bad = data;
+	SetHeader(&bad, h);
+	EXPECT(!Loads(bad));
+
+	// 境界に無い
+	h = header;
+	h.eventsOffset = header.eventsOffset + 4;
+	bad = data;
+	SetHeader(&bad, h);
+	EXPECT(!Loads(bad));
+
+	h = header;
+	h.servicesOffset = header.servicesOffset + 4;
+	bad = data;
+	SetHeader(&bad, h);
+	EXPECT(!Loads(bad));
+
+	h = header;
+	h.namesOffset = header.namesOffset + 1;
+	bad = data;
+	SetHeader(&bad, h);
+	EXPECT(!Loads(bad));
+
+	// 渡されたメモリが境界に無い
+	std::vector<std::uint64_t> buffer(data.size() / 8 + 1);
+	std::uint8_t* p = reinterpret_cast<std::uint8_t*>(buffer.data()) + 4;
+	std::memcpy(p, data.data(), data.size());
+	CEpgSnapshot snapshot;
+	EXPECT(!snapshot.Attach(p, data.size()));
+	EXPECT(!snapshot.Attach(nullptr, data.size()));
+}
+
+TEST(EpgSnapshotRejectsServices)
+{
+	std::vector<std::uint8_t> data;
+	BuildSample(&data);
+	const Format::Header header = GetHeader(data);
+	const Format::Service first = GetService(data, 0);
+	const Format::Service second = GetService(data, 1);
+
+	// キーが昇順でない
+	std::vector<std::uint8_t> bad = data;
+	Format::Service s = first;
+	s.key = second.key;
+	SetService(&bad, 0, s);
+	s = second;
+	s.key = first.key;
+	SetService(&bad, 1, s);
+	EXPECT(!Loads(bad));
+
+	// 同じキー
+	bad = data;
+	s = second;
+	s.key = first.key;
+	SetService(&bad, 1, s);
+	EXPECT(!Loads(bad));
+
+	// 番組名の範囲が外
+	bad = data;
+	s = second;
+	s.nameLength = header.nameLength - second.firstName + 1;
+	SetService(&bad, 1, s);
+	EXPECT(!Loads(bad));
+
+	bad = data;
+	s = first;
+	s.firstName = header.nameLength;
+	SetService(&bad, 0, s);
+	EXPECT(!Loads(bad));
+
+	// 番組の範囲が外
+	bad = data;
+	s = second;
+	s.eventCount = header.eventCount - second.firstEvent + 1;
+	SetService(&bad, 1, s);
+	EXPECT(!Loads(bad));
+
+	bad = data;
+	s = first;
+	s.firstEvent = 0xFFFFFFFF;
+	SetService(&bad, 0, s);
+	EXPECT(!Loads(bad));
+}
+
+TEST(EpgIndexFallsBackToSnapshot)
+{
+	std::vector<std::uint8_t> data;
+	BuildSample(&data);
+	std::shared_ptr<CBufferSnapshot> snapshot = std::make_shared<CBufferSnapshot>();
+	REQUIRE(snapshot->Load(data));
+
+	CEpgIndex index;
+	EXPECT(index.FindAt(SERVICE, BASE_TIME + 60 * FILETIME_MIN) == nullptr);
+	index.SetSnapshot(snapshot);
+	EXPECT(index.GetSnapshot() == snapshot);
+
+	// 読み込んでいないサービスはスナップショットから引く
+	EXPECT(index.ServiceCount() == 0);
+	EXPECT(index.NeedsRefresh(SERVICE, NOW, 60 * FILETIME_MIN));
+	const CEpgEvent* pEvent = index.FindAt(SERVICE, BASE_TIME + 60 * FILETIME_MIN);
+	REQUIRE(pEvent != nullptr);
+	EXPECT(pEvent->eventID == 3);
+	EXPECT(index.GetEventName(SERVICE, *pEvent) == L"ニュース");
+	pEvent = index.FindNext(SERVICE, BASE_TIME + 60 * FILETIME_MIN);
+	REQUIRE(pEvent != nullptr);
+	EXPECT(pEvent->eventID == 4);
+	const auto range = index.FindRange(OTHER, NOW, NOW + 60 * FILETIME_MIN);
+	REQUIRE(range.second - range.first == 1);
+	EXPECT(range.first->eventID == 10);
+	EXPECT(index.GetEventName(OTHER, *range.first) == L"スポーツ");
+	EXPECT(index.FindAt(ENDED, BASE_TIME + 30 * FILETIME_MIN) == nullptr);
+
+	// 読み込んだら、そちらを使う
+	CEpgIndex::EventSource source = {};
+	source.startTime = BASE_TIME + 55 * FILETIME_MIN;
+	source.duration = 60 * 60;
+	source.eventID = 30;
+	source.pszName = L"特別番組";
+	index.UpdateService(SERVICE, { source }, NOW);
+	pEvent = index.FindAt(SERVICE, BASE_TIME + 60 * FILETIME_MIN);
+	REQUIRE(pEvent != nullptr);
+	EXPECT(pEvent->eventID == 30);
+	EXPECT(index.GetEventName(SERVICE, *pEvent) == L"特別番組");
+	EXPECT(index.FindNext(SERVICE, BASE_TIME + 60 * FILETIME_MIN) == nullptr);
+	// 他のサービスはスナップショットのまま
+	pEvent = index.FindAt(OTHER, NOW);
+	REQUIRE(pEvent != nullptr);
+	EXPECT(pEvent->eventID == 10);
+
+	// 書き出すと、読み込んだサービスと読み込んでいないサービスを合わせる
+	std::vector<std::uint8_t> written;
+	index.WriteSnapshot(NOW, &written);
+	CBufferSnapshot merged;
+	REQUIRE(merged.Load(written));
+	EXPECT(merged.ServiceCount() == 2);
+	CEpgSnapshot::Service service;
+	REQUIRE(merged.FindService(SERVICE, &service));
+	EXPECT(service.loadedTime == NOW);
+	REQUIRE(service.last - service.first == 1);
+	EXPECT(service.first[0].eventID == 30);
+	EXPECT(CEpgSnapshot::GetEventName(service, service.first[0]) == L"特別番組");
+	REQUIRE(merged.FindService(OTHER, &service));
+	REQUIRE(service.last - service.first == 1);
+	EXPECT(service.first[0].eventID == 10);
+
+	// 番組が無くなれば、またスナップショットから引く
+	index.UpdateService(SERVICE, {}, NOW);
+	pEvent = index.FindAt(SERVICE, BASE_TIME + 60 * FILETIME_MIN);
+	REQUIRE(pEvent != nullptr);
+	EXPECT(pEvent->eventID == 3);
+
+	index.SetSnapshot(nullptr);
+	EXPECT(index.FindAt(OTHER, NOW) == nullptr);
+	EXPECT(index.FindAt(SERVICE, BASE_TIME + 60 * FILETIME_MIN) == nullptr);
+}
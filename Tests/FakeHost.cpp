@@ -0,0 +1,205 @@
+#include "FakeHost.h"
+#include <algorithm>
+#include <cwctype>
+#include <shlwapi.h>
+
+// テストで使う Win32 の関数
+int lstrlenW(LPCWSTR psz)
+{
+	return psz != nullptr ? static_cast<int>(std::wcslen(psz)) : 0;
+}
+
+int lstrcmpi(LPCWSTR psz1, LPCWSTR psz2)
+{
+	for (;; psz1++, psz2++) {
+		const std::wint_t c1 = std::towlower(*psz1);
+		const std::wint_t c2 = std::towlower(*psz2);
+		if (c1 != c2)
+			return c1 < c2 ? -1 : 1;
+		if (c1 == L'\0')
+			return 0;
+	}
+}
+
+LPWSTR PathFindFileName(LPCWSTR pszPath)
+{
+	LPCWSTR pszName = pszPath;
+	for (LPCWSTR p = pszPath; *p != L'\0'; p++) {
+		if ((*p == L'\\' || *p == L'/' || *p == L':') && p[1] != L'\0')
+			pszName = p + 1;
+	}
+	return const_cast<LPWSTR>(pszName);
+}
+
+HANDLE LoadImage(HINSTANCE, LPCWSTR, UINT, int, int, UINT)
+{
+	return nullptr;
+}
+
+BOOL DeleteObject(HGDIOBJ)
+{
+	return TRUE;
+}
+
+namespace ChannelTimer {
+	namespace Test {
+		namespace {
+			void CopyString(LPWSTR pszDest, std::size_t MaxLength, const std::wstring& src)
+			{
+				const std::size_t length = std::min(src.size(), MaxLength - 1);
+				std::wmemcpy(pszDest, src.c_str(), length);
+				pszDest[length] = L'\0';
+			}
+		}
+
+		CFakeHost::CFakeHost()
+			: m_param()
+			, m_app(&m_param)
+		{
+			m_param.Callback = Callback;
+			m_param.pClientData = this;
+		}
+
+		CFakeHost::Driver& CFakeHost::AddDriver(const std::wstring& name)
+		{
+			m_drivers.emplace_back();
+			m_drivers.back().name = name;
+			return m_drivers.back();
+		}
+
+		TVTest::ChannelInfo CFakeHost::MakeChannel(WORD NetworkID, WORD TransportStreamID, WORD ServiceID,
+			int Channel, LPCWSTR pszName, bool fDisabled)
+		{
+			TVTest::ChannelInfo ChInfo = {};
+			ChInfo.Size = sizeof(ChInfo);
+			ChInfo.Channel = Channel;
+			ChInfo.NetworkID = NetworkID;
+			ChInfo.TransportStreamID = TransportStreamID;
+			ChInfo.ServiceID = ServiceID;
+			ChInfo.Flags = fDisabled ? TVTest::CHANNEL_FLAG_DISABLED : 0;
+			CopyString(ChInfo.szChannelName, _countof(ChInfo.szChannelName), pszName);
+			return ChInfo;
+		}
+
+		void CFakeHost::SetFailing(const std::wstring& name, bool fFailing)
+		{
+			if (fFailing)
+				m_failing.insert(name);
+			else
+				m_failing.erase(name);
+		}
+
+		const CFakeHost::Driver* CFakeHost::FindDriver(LPCWSTR pszName) const
+		{
+			for (const Driver& driver : m_drivers) {
+				if (::lstrcmpi(driver.name.c_str(), pszName) == 0)
+					return &driver;
+			}
+			return nullptr;
+		}
+
+		LRESULT CFakeHost::OnMessage(UINT Message, LPARAM lParam1, LPARAM lParam2)
+		{
+			const Driver* pCurrent =
+				m_currentDriver >= 0 && m_currentDriver < static_cast<int>(m_drivers.size()) ? &m_drivers[m_currentDriver] : nullptr;
+
+			switch (Message) {
+			case TVTest::MESSAGE_ENUMDRIVER:
+				{
+					const int Index = LOWORD(lParam2);
+					if (Index >= static_cast<int>(m_drivers.size()))
+						return 0;
+					CopyString(reinterpret_cast<LPWSTR>(lParam1), HIWORD(lParam2), m_drivers[Index].name);
+					return static_cast<LRESULT>(m_drivers[Index].name.size());
+				}
+
+			case TVTest::MESSAGE_GETTUNINGSPACE:
+				{
+					const int NumSpaces = pCurrent != nullptr ? static_cast<int>(pCurrent->spaces.size()) : 0;
+					if (lParam1 != 0)
+						*reinterpret_cast<int*>(lParam1) = NumSpaces;
+					return 0;
+				}
+
+			case TVTest::MESSAGE_GETTUNINGSPACENAME:
+				{
+					const int Index = LOWORD(lParam2);
+					if (pCurrent == nullptr || Index >= static_cast<int>(pCurrent->spaces.size()))
+						return 0;
+					CopyString(reinterpret_cast<LPWSTR>(lParam1), HIWORD(lParam2), pCurrent->spaces[Index].name);
+					return static_cast<LRESULT>(pCurrent->spaces[Index].name.size());
+				}
+
+			case TVTest::MESSAGE_GETCHANNELINFO:
+				{
+					m_channelInfoCount++;
+					const int Space = static_cast<SHORT>(LOWORD(lParam2));
+					const int Index = static_cast<SHORT>(HIWORD(lParam2));
+					if (pCurrent == nullptr || Space < 0 || Space >= static_cast<int>(pCurrent->spaces.size()))
+						return FALSE;
+					const std::vector<TVTest::ChannelInfo>& channels = pCurrent->spaces[Space].channels;
+					if (Index < 0 || Index >= static_cast<int>(channels.size()))
+						return FALSE;
+					*reinterpret_cast<TVTest::ChannelInfo*>(lParam1) = channels[Index];
+					return TRUE;
+				}
+
+			case TVTest::MESSAGE_GETDRIVERTUNINGSPACELIST:
+				{
+					m_listCount++;
+					LPCWSTR pszName = reinterpret_cast<LPCWSTR>(lParam1);
+					TVTest::DriverTuningSpaceList* pList = reinterpret_cast<TVTest::DriverTuningSpaceList*>(lParam2);
+					const Driver* pDriver = FindDriver(pszName);
+					if (pDriver == nullptr || m_failing.count(pDriver->name) != 0)
+						return FALSE;
+
+					std::unique_ptr<List> list(new List);
+					const std::size_t NumSpaces = pDriver->spaces.size();
+					list->spaces.resize(NumSpaces);
+					list->infos.resize(NumSpaces);
+					list->channelPointers.resize(NumSpaces);
+					for (std::size_t i = 0; i < NumSpaces; i++) {
+						const Space& space = pDriver->spaces[i];
+						TVTest::TuningSpaceInfo& SpaceInfo = list->spaces[i];
+						SpaceInfo.Size = sizeof(SpaceInfo);
+						CopyString(SpaceInfo.szName, _countof(SpaceInfo.szName), space.name);
+						for (const TVTest::ChannelInfo& ChInfo : space.channels)
+							list->channelPointers[i].push_back(const_cast<TVTest::ChannelInfo*>(&ChInfo));
+						TVTest::DriverTuningSpaceInfo& Info = list->infos[i];
+						Info.Flags = 0;
+						Info.NumChannels = static_cast<DWORD>(space.channels.size());
+						Info.pInfo = &SpaceInfo;
+						Info.ChannelList = list->channelPointers[i].data();
+						list->infoPointers.push_back(&Info);
+					}
+					pList->NumSpaces = static_cast<DWORD>(NumSpaces);
+					pList->SpaceList = list->infoPointers.data();
+					m_lists.push_back(std::move(list));
+					return TRUE;
+				}
+
+			case TVTest::MESSAGE_FREEDRIVERTUNINGSPACELIST:
+				{
+					m_freeCount++;
+					TVTest::DriverTuningSpaceList* pList = reinterpret_cast<TVTest::DriverTuningSpaceList*>(lParam1);
+					for (auto it = m_lists.begin(); it != m_lists.end(); ++it) {
+						if ((*it)->infoPointers.data() == pList->SpaceList) {
+							m_lists.erase(it);
+							break;
+						}
+					}
+					pList->NumSpaces = 0;
+					pList->SpaceList = nullptr;
+					return 0;
+				}
+			}
+
+			return 0;
+		}
+
+		LRESULT CALLBACK CFakeHost::Callback(TVTest::PluginParam* pParam, UINT Message, LPARAM lParam1, LPARAM lParam2)
+		{
+			return static_cast<CFakeHost*>(pParam->pClientData)->OnMessage(Message, lParam1, lParam2);
+		}
+	}
+}
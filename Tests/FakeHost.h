@@ -0,0 +1,77 @@
+#pragma once
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#include <windows.h>
+#include "TVTestPlugin.h"
+
+namespace ChannelTimer {
+	namespace Test {
+		/**
+		 * テスト用のホスト
+		 * PluginParam::Callback でチューナー・チューニング空間・チャンネルの一覧のメッセージに答える
+		 */
+		class CFakeHost {
+		public:
+			struct Space {
+				std::wstring name;
+				std::vector<TVTest::ChannelInfo> channels;
+			};
+
+			struct Driver {
+				std::wstring name;
+				std::vector<Space> spaces;
+			};
+
+			CFakeHost();
+			CFakeHost(const CFakeHost&) = delete;
+			CFakeHost& operator=(const CFakeHost&) = delete;
+
+			TVTest::CTVTestApp* GetApp() { return &m_app; }
+
+			Driver& AddDriver(const std::wstring& name);
+			static TVTest::ChannelInfo MakeChannel(WORD NetworkID, WORD TransportStreamID, WORD ServiceID,
+				int Channel, LPCWSTR pszName, bool fDisabled = false);
+
+			/**
+			 * 現在のチューナー(GetTuningSpace と GetChannelInfo が使う)
+			 */
+			void SetCurrentDriver(int index) { m_currentDriver = index; }
+
+			/**
+			 * GetDriverTuningSpaceList を失敗させる
+			 */
+			void SetFailing(const std::wstring& name, bool fFailing);
+
+			// 答えたメッセージの数
+			int GetListCount() const { return m_listCount; }
+			int GetFreeCount() const { return m_freeCount; }
+			int GetChannelInfoCount() const { return m_channelInfoCount; }
+
+		private:
+			// ホストが確保して渡す一覧
+			struct List {
+				std::vector<TVTest::TuningSpaceInfo> spaces;
+				std::vector<TVTest::DriverTuningSpaceInfo> infos;
+				std::vector<TVTest::DriverTuningSpaceInfo*> infoPointers;
+				std::vector<std::vector<TVTest::ChannelInfo*>> channelPointers;
+			};
+
+			TVTest::PluginParam m_param;
+			TVTest::CTVTestApp m_app;
+			std::vector<Driver> m_drivers;
+			std::set<std::wstring> m_failing;
+			std::vector<std::unique_ptr<List>> m_lists;
+			int m_currentDriver = 0;
+			int m_listCount = 0;
+			int m_freeCount = 0;
+			int m_channelInfoCount = 0;
+
+			const Driver* FindDriver(LPCWSTR pszName) const;
+			LRESULT OnMessage(UINT Message, LPARAM lParam1, LPARAM lParam2);
+
+			static LRESULT CALLBACK Callback(TVTest::PluginParam* pParam, UINT Message, LPARAM lParam1, LPARAM lParam2);
+		};
+	}
+}
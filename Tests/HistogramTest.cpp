@@ -0,0 +1,92 @@
+#include "Test.h"
+#include <cstdint>
+#include <limits>
+#include "Histogram.h"
+
+using namespace ChannelTimer;
+
+TEST(HistogramEmpty)
+{
+	CLatencyHistogram histogram;
+	EXPECT(histogram.Count() == 0);
+	EXPECT(histogram.Max() == 0);
+	EXPECT(histogram.Percentile(0.5) == 0);
+	EXPECT(histogram.Percentile(1.0) == 0);
+}
+
+TEST(HistogramSmallValuesAreExact)
+{
+	// SUB_BUCKET_COUNT * 2 未満はバケットが値ごと
+	CLatencyHistogram histogram;
+	for (int i = 0; i < CLatencyHistogram::SUB_BUCKET_COUNT * 2; i++)
+		histogram.Record(i);
+	EXPECT(histogram.Count() == 32);
+	EXPECT(histogram.Max() == 31);
+	EXPECT(histogram.Percentile(0.0) == 0);
+	EXPECT(histogram.Percentile(0.25) == 7);
+	EXPECT(histogram.Percentile(0.5) == 15);
+	EXPECT(histogram.Percentile(0.75) == 23);
+	EXPECT(histogram.Percentile(1.0) == 31);
+}
+
+TEST(HistogramPercentileRanks)
+{
+	CLatencyHistogram histogram;
+	for (int i = 1; i <= 100; i++)
+		histogram.Record(i);
+	// 50 は [50, 51] のバケット、99 は [96, 99] のバケット
+	EXPECT(histogram.Percentile(0.5) == 51);
+	EXPECT(histogram.Percentile(0.99) == 99);
+	// 100 は [100, 103] のバケットだが、最大値は超えない
+	EXPECT(histogram.Percentile(1.0) == 100);
+	EXPECT(histogram.Max() == 100);
+}
+
+TEST(HistogramBucketBounds)
+{
+	// バケットの上端を返し、相対誤差は 1/SUB_BUCKET_COUNT 以内
+	const std::int64_t values[] = {
+		32, 33, 47, 1000, 65535, 65536, 123456789, (std::int64_t(1) << 40) + 12345,
+	};
+	for (std::int64_t value : values) {
+		CLatencyHistogram histogram;
+		histogram.Record(value);
+		histogram.Record(std::numeric_limits<std::int64_t>::max());
+		const std::int64_t lower = histogram.Percentile(0.0);
+		EXPECT(lower >= value);
+		EXPECT(lower - value <= value / CLatencyHistogram::SUB_BUCKET_COUNT);
+	}
+
+	// 2 の冪の直前と直後は別のバケット
+	CLatencyHistogram histogram;
+	histogram.Record(63);
+	histogram.Record(64);
+	histogram.Record(1000000);
+	EXPECT(histogram.Percentile(0.0) == 63);
+	EXPECT(histogram.Percentile(0.5) == 67);
+}
+
+TEST(HistogramClampsToMax)
+{
+	CLatencyHistogram histogram;
+	// 32 のバケットは [32, 33]
+	histogram.Record(32);
+	EXPECT(histogram.Percentile(1.0) == 32);
+	histogram.Record(33);
+	EXPECT(histogram.Percentile(0.5) == 33);
+
+	CLatencyHistogram large;
+	large.Record(std::numeric_limits<std::int64_t>::max());
+	EXPECT(large.Max() == std::numeric_limits<std::int64_t>::max());
+	EXPECT(large.Percentile(1.0) == std::numeric_limits<std::int64_t>::max());
+}
+
+TEST(HistogramNegativeIsZero)
+{
+	CLatencyHistogram histogram;
+	histogram.Record(-5);
+	histogram.Record(-1);
+	EXPECT(histogram.Count() == 2);
+	EXPECT(histogram.Max() == 0);
+	EXPECT(histogram.Percentile(1.0) == 0);
+}
@@ -0,0 +1,233 @@
+#include "Test.h"
+#include <cstdint>
+#include <vector>
+#include "Journal.h"
+
+using namespace ChannelTimer;
+
+namespace {
+	const TimeValue BASE_TIME = 132223104000000000LL;	// 2020/1/1 0:00 UTC
+
+	Timer MakeTimer(std::uint32_t serial)
+	{
+		Timer timer;
+		timer.condition = Timer::SleepCondition::CONDITION_DATETIME;
+		timer.serial = serial;
+		timer.addedTime = BASE_TIME;
+		timer.dateToChange = BASE_TIME + serial * FILETIME_HOUR;
+		timer.leadTime = 15 * FILETIME_SEC;
+		timer.tuner = L"BonDriver_Test.dll";
+		timer.space = 1;
+		timer.channel = 12;
+		timer.networkID = 0x7FE0;
+		timer.transportStreamID = 0x7FE0;
+		timer.serviceID = 1024;
+		return timer;
+	}
+
+	void PutUnsigned(std::vector<std::uint8_t>* pBuffer, std::uint64_t v, int bytes)
+	{
+		for (int i = 0; i < bytes; i++)
+			pBuffer->push_back(static_cast<std::uint8_t>(v >> (i * 8)));
+	}
+
+	// ペイロードに長さと CRC を付けて追加する
+	void PutRecord(std::vector<std::uint8_t>* pBuffer, const std::vector<std::uint8_t>& payload)
+	{
+		PutUnsigned(pBuffer, payload.size(), 4);
+		PutUnsigned(pBuffer, CJournalCodec::Crc32(payload.data(), payload.size()), 4);
+		pBuffer->insert(pBuffer->end(), payload.begin(), payload.end());
+	}
+
+	// 放送局の時刻・繰り返し・番組を加える前の形式の ADD レコード
+	std::vector<std::uint8_t> MakeOldAddPayload(const Timer& timer)
+	{
+		std::vector<std::uint8_t> payload;
+		PutUnsigned(&payload, static_cast<std::uint8_t>(CJournalCodec::RecordType::ADD), 1);
+		PutUnsigned(&payload, timer.serial, 4);
+		PutUnsigned(&payload, static_cast<std::uint8_t>(timer.condition), 1);
+		PutUnsigned(&payload, static_cast<std::uint64_t>(timer.addedTime), 8);
+		PutUnsigned(&payload, static_cast<std::uint64_t>(timer.dateToChange), 8);
+		PutUnsigned(&payload, timer.durationToChange, 4);
+		PutUnsigned(&payload, static_cast<std::uint64_t>(timer.leadTime), 8);
+		PutUnsigned(&payload, static_cast<std::uint32_t>(timer.space), 4);
+		PutUnsigned(&payload, static_cast<std::uint32_t>(timer.channel), 4);
+		PutUnsigned(&payload, timer.networkID, 2);
+		PutUnsigned(&payload, timer.transportStreamID, 2);
+		PutUnsigned(&payload, timer.serviceID, 2);
+		PutUnsigned(&payload, timer.tuner.size(), 2);
+		for (const wchar_t c : timer.tuner)
+			PutUnsigned(&payload, static_cast<std::uint16_t>(c), 2);
+		return payload;
+	}
+}
+
+TEST(Crc32MatchesReference)
+{
+	const std::uint8_t data[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+	EXPECT(CJournalCodec::Crc32(data, sizeof(data)) == 0xCBF43926U);
+	EXPECT(CJournalCodec::Crc32(data, 0) == 0);
+}
+
+TEST(ReplayRoundTrip)
+{
+	Timer timer = MakeTimer(3);
+	timer.broadcastTime = true;
+	timer.recurrence.rule = Recurrence::Rule::RULE_WEEKLY;
+	timer.recurrence.weekdays = 0x22;
+	timer.recurrence.localOffset = EPG_TIME_OFFSET;
+	timer.recurrence.exceptions = { 150000, 149990 };
+	timer.programEventID = 0x1234;
+
+	std::vector<std::uint8_t> buffer;
+	CJournalCodec::AppendHeader(&buffer);
+	CJournalCodec::AppendAdd(&buffer, MakeTimer(1));
+	CJournalCodec::AppendAdd(&buffer, MakeTimer(2));
+	CJournalCodec::AppendAdd(&buffer, timer);
+	CJournalCodec::AppendRemove(&buffer, 2);
+
+	const CJournalCodec::ReplayResult result = CJournalCodec::Replay(buffer.data(), buffer.size());
+	EXPECT(result.validSize == buffer.size());
+	EXPECT(result.recordCount == 4);
+	EXPECT(result.maxSerial == 3);
+	REQUIRE(result.timers.size() == 2);
+	EXPECT(result.timers.count(2) == 0);
+
+	const Timer& restored = result.timers.at(3);
+	EXPECT(restored.condition == timer.condition);
+	EXPECT(restored.dateToChange == timer.dateToChange);
+	EXPECT(restored.leadTime == timer.leadTime);
+	EXPECT(restored.tuner == timer.tuner);
+	EXPECT(restored.space == 1 && restored.channel == 12);
+	EXPECT(restored.serviceID == 1024);
+	EXPECT(restored.broadcastTime);
+	EXPECT(restored.recurrence.rule == Recurrence::Rule::RULE_WEEKLY);
+	EXPECT(restored.recurrence.weekdays == 0x22);
+	EXPECT(restored.recurrence.localOffset == EPG_TIME_OFFSET);
+	EXPECT(restored.recurrence.exceptions == timer.recurrence.exceptions);
+	EXPECT(restored.programEventID == 0x1234);
+}
+
+TEST(ReplayStopsAtTornTail)
+{
+	std::vector<std::uint8_t> buffer;
+	CJournalCodec::AppendHeader(&buffer);
+	CJournalCodec::AppendAdd(&buffer, MakeTimer(1));
+	const std::size_t complete = buffer.size();
+	CJournalCodec::AppendAdd(&buffer, MakeTimer(2));
+
+	// 最後のレコードのどこで切れても、その前までが読める
+	for (std::size_t size = complete; size < buffer.size(); size++) {
+		const CJournalCodec::ReplayResult result = CJournalCodec::Replay(buffer.data(), size);
+		EXPECT(result.validSize == complete);
+		EXPECT(result.recordCount == 1);
+		EXPECT(result.timers.size() == 1 && result.timers.count(1) == 1);
+	}
+}
+
+TEST(ReplayStopsAtCorruptRecord)
+{
+	std::vector<std::uint8_t> buffer;
+	CJournalCodec::AppendHeader(&buffer);
+	CJournalCodec::AppendAdd(&buffer, MakeTimer(1));
+	const std::size_t complete = buffer.size();
+	CJournalCodec::AppendAdd(&buffer, MakeTimer(2));
+	CJournalCodec::AppendAdd(&buffer, MakeTimer(3));
+
+	// 2 番目のペイロードが壊れていれば、以降も読まない
+	buffer[complete + CJournalCodec::RECORD_HEADER_SIZE + 2] ^= 0x40;
+	const CJournalCodec::ReplayResult result = CJournalCodec::Replay(buffer.data(), buffer.size());
+	EXPECT(result.validSize == complete);
+	EXPECT(result.timers.size() == 1);
+	EXPECT(result.maxSerial == 1);
+}
+
+TEST(ReplayRejectsMissingHeader)
+{
+	std::vector<std::uint8_t> buffer;
+	CJournalCodec::AppendAdd(&buffer, MakeTimer(1));
+	const CJournalCodec::ReplayResult result = CJournalCodec::Replay(buffer.data(), buffer.size());
+	EXPECT(result.validSize == 0);
+	EXPECT(result.timers.empty());
+}
+
+TEST(ReplayReadsOlderRecords)
+{
+	const Timer timer = MakeTimer(5);
+	std::vector<std::uint8_t> buffer;
+	CJournalCodec::AppendHeader(&buffer);
+	PutRecord(&buffer, MakeOldAddPayload(timer));
+
+	const CJournalCodec::ReplayResult result = CJournalCodec::Replay(buffer.data(), buffer.size());
+	EXPECT(result.validSize == buffer.size());
+	REQUIRE(result.timers.count(5) == 1);
+	const Timer& restored = result.timers.at(5);
+	EXPECT(restored.dateToChange == timer.dateToChange);
+	EXPECT(restored.tuner == timer.tuner);
+	EXPECT(!restored.broadcastTime);
+	EXPECT(restored.recurrence.rule == Recurrence::Rule::RULE_NONE);
+	EXPECT(restored.recurrence.exceptions.empty());
+	EXPECT(restored.programEventID == 0);
+	EXPECT(restored.eventID == 0 && restored.eventEndTime == 0);
+}
+
+TEST(ReplayStopsAtUnknownRecord)
+{
+	std::vector<std::uint8_t> buffer;
+	CJournalCodec::AppendHeader(&buffer);
+	CJournalCodec::AppendAdd(&buffer, MakeTimer(1));
+	const std::size_t complete = buffer.size();
+	PutRecord(&buffer, std::vector<std::uint8_t>{ 0x7F, 1, 2, 3 });
+	CJournalCodec::AppendAdd(&buffer, MakeTimer(2));
+
+	const CJournalCodec::ReplayResult result = CJournalCodec::Replay(buffer.data(), buffer.size());
+	EXPECT(result.validSize == complete);
+	EXPECT(result.timers.size() == 1);
+}
+
+TEST(ReplayEvent)
+{
+	Timer timer = MakeTimer(1);
+	timer.condition = Timer::SleepCondition::CONDITION_EVENTEND;
+	std::vector<std::uint8_t> buffer;
+	CJournalCodec::AppendHeader(&buffer);
+	CJournalCodec::AppendAdd(&buffer, timer);
+
+	// 対象の番組が決まったら追記する
+	timer.eventServiceID = 1024;
+	timer.eventID = 0x100;
+	timer.eventEndTime = BASE_TIME + FILETIME_HOUR;
+	CJournalCodec::AppendEvent(&buffer, timer);
+	CJournalCodec::AppendEvent(&buffer, MakeTimer(9));
+
+	CJournalCodec::ReplayResult result = CJournalCodec::Replay(buffer.data(), buffer.size());
+	EXPECT(result.recordCount == 3);
+	REQUIRE(result.timers.size() == 1);
+	EXPECT(result.timers.at(1).eventServiceID == 1024);
+	EXPECT(result.timers.at(1).eventID == 0x100);
+	EXPECT(result.timers.at(1).eventEndTime == BASE_TIME + FILETIME_HOUR);
+
+	// 書き直した ADD レコードにも残る
+	buffer.clear();
+	CJournalCodec::AppendHeader(&buffer);
+	CJournalCodec::AppendAdd(&buffer, timer);
+	result = CJournalCodec::Replay(buffer.data(), buffer.size());
+	REQUIRE(result.timers.size() == 1);
+	EXPECT(result.timers.at(1).eventID == 0x100);
+	EXPECT(result.timers.at(1).eventEndTime == BASE_TIME + FILETIME_HOUR);
+}
+
+TEST(ReplayClear)
+{
+	std::vector<std::uint8_t> buffer;
+	CJournalCodec::AppendHeader(&buffer);
+	CJournalCodec::AppendAdd(&buffer, MakeTimer(1));
+	CJournalCodec::AppendAdd(&buffer, MakeTimer(2));
+	CJournalCodec::AppendClear(&buffer);
+	CJournalCodec::AppendAdd(&buffer, MakeTimer(3));
+
+	const CJournalCodec::ReplayResult result = CJournalCodec::Replay(buffer.data(), buffer.size());
+	EXPECT(result.recordCount == 4);
+	EXPECT(result.maxSerial == 3);
+	EXPECT(result.timers.size() == 1 && result.timers.count(3) == 1);
+}
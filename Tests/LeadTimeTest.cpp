@@ -0,0 +1,115 @@
+#include "Test.h"
+#include <string>
+#include "LeadTime.h"
+
+using namespace ChannelTimer;
+
+namespace {
+	const std::wstring TUNER = L"C:\\TVTest\\BonDriver_PT3-T.dll";
+	const int SPACE = 0;
+
+	TimeValue Seconds(int seconds)
+	{
+		return seconds * FILETIME_SEC;
+	}
+}
+
+TEST(LeadTimeDefaultWithoutSamples)
+{
+	CLeadTimeEstimator estimator;
+	EXPECT(estimator.Estimate(TUNER, SPACE, Seconds(5)) == Seconds(5));
+	// 負の計測値は捨てる
+	estimator.AddSample(TUNER, SPACE, -Seconds(1));
+	EXPECT(estimator.Estimate(TUNER, SPACE, Seconds(5)) == Seconds(5));
+	EXPECT(estimator.FormatValue(TUNER, SPACE).empty());
+}
+
+TEST(LeadTimeUsesPercentileRank)
+{
+	CLeadTimeEstimator estimator;
+	estimator.AddSample(TUNER, SPACE, Seconds(2));
+	EXPECT(estimator.Estimate(TUNER, SPACE, 0) == Seconds(2) + CLeadTimeEstimator::MARGIN);
+
+	// 10 回なら 9 番目
+	for (int i = 10; i >= 1; i--) {
+		if (i != 2)
+			estimator.AddSample(TUNER, SPACE, Seconds(i));
+	}
+	EXPECT(estimator.Estimate(TUNER, SPACE, 0) == Seconds(9) + CLeadTimeEstimator::MARGIN);
+
+	// チューナーとチューニング空間ごと
+	EXPECT(estimator.Estimate(TUNER, SPACE + 1, Seconds(5)) == Seconds(5));
+	EXPECT(estimator.Estimate(L"BonDriver_Spinel.dll", SPACE, Seconds(5)) == Seconds(5));
+}
+
+TEST(LeadTimeKeepsRecentWindow)
+{
+	CLeadTimeEstimator estimator;
+	// 1 秒から 20 秒まで。残るのは 5 秒から 20 秒までの 16 回で、その 14 番目
+	for (int i = 1; i <= 20; i++)
+		estimator.AddSample(TUNER, SPACE, Seconds(i));
+	EXPECT(estimator.Estimate(TUNER, SPACE, 0) == Seconds(18) + CLeadTimeEstimator::MARGIN);
+
+	std::wstring expected;
+	for (int i = 5; i <= 20; i++) {
+		if (!expected.empty())
+			expected += L',';
+		expected += std::to_wstring(i * 1000);
+	}
+	EXPECT(estimator.FormatValue(TUNER, SPACE) == expected);
+}
+
+TEST(LeadTimeClamps)
+{
+	CLeadTimeEstimator estimator;
+	estimator.AddSample(TUNER, SPACE, 100 * FILETIME_MS);
+	EXPECT(estimator.Estimate(TUNER, SPACE, 0) == CLeadTimeEstimator::MIN_LEAD_TIME);
+
+	estimator.AddSample(TUNER, SPACE + 1, Seconds(120));
+	EXPECT(estimator.Estimate(TUNER, SPACE + 1, 0) == CLeadTimeEstimator::MAX_LEAD_TIME);
+}
+
+TEST(LeadTimeFormatAndParse)
+{
+	CLeadTimeEstimator estimator;
+	for (int i = 1; i <= 20; i++)
+		estimator.AddSample(TUNER, SPACE, i * 1500 * FILETIME_MS);
+	estimator.AddSample(TUNER, 3, 2500 * FILETIME_MS);
+
+	const std::wstring key = estimator.FormatKey(TUNER, SPACE);
+	EXPECT(key == TUNER + L":0");
+	const std::wstring value = estimator.FormatValue(TUNER, SPACE);
+
+	// パスの ':' があっても最後の ':' で区切る
+	CLeadTimeEstimator loaded;
+	REQUIRE(loaded.Parse(key, value));
+	REQUIRE(loaded.Parse(estimator.FormatKey(TUNER, 3), estimator.FormatValue(TUNER, 3)));
+	EXPECT(loaded.FormatValue(TUNER, SPACE) == value);
+	EXPECT(loaded.FormatValue(TUNER, 3) == L"2500");
+	EXPECT(loaded.Estimate(TUNER, SPACE, 0) == estimator.Estimate(TUNER, SPACE, 0));
+	EXPECT(loaded.Estimate(TUNER, 3, 0) == estimator.Estimate(TUNER, 3, 0));
+
+	// 読み込んでから足した計測値は古い順の後ろに付く
+	loaded.AddSample(TUNER, 3, 3000 * FILETIME_MS);
+	EXPECT(loaded.FormatValue(TUNER, 3) == L"2500,3000");
+
+	// WINDOW_SIZE より多ければ新しい方を残す
+	CLeadTimeEstimator many;
+	REQUIRE(many.Parse(L"BonDriver.dll:1", L"1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18"));
+	EXPECT(many.FormatValue(L"BonDriver.dll", 1) == L"3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18");
+}
+
+TEST(LeadTimeParseRejects)
+{
+	CLeadTimeEstimator estimator;
+	EXPECT(!estimator.Parse(L"BonDriver.dll", L"1000"));
+	EXPECT(!estimator.Parse(L":0", L"1000"));
+	EXPECT(!estimator.Parse(L"BonDriver.dll:", L"1000"));
+	EXPECT(!estimator.Parse(L"BonDriver.dll:x", L"1000"));
+	EXPECT(!estimator.Parse(L"BonDriver.dll:0", L""));
+	EXPECT(!estimator.Parse(L"BonDriver.dll:0", L"1000,-1"));
+	EXPECT(!estimator.Parse(L"BonDriver.dll:0", L"1000,abc"));
+	// 読めなかったものは残さない
+	EXPECT(estimator.FormatValue(L"BonDriver.dll", 0).empty());
+	EXPECT(estimator.Estimate(L"BonDriver.dll", 0, Seconds(5)) == Seconds(5));
+}
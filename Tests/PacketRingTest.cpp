@@ -0,0 +1,177 @@
+#include "Test.h"
+#include <array>
+#include <cstdint>
+#include "PacketRing.h"
+
+using namespace ChannelTimer;
+
+namespace {
+	using Packet = std::array<std::uint8_t, TS_PACKET_SIZE>;
+
+	// 連番を PID の後ろ(continuity_counter の位置)とペイロードの末尾に入れる
+	Packet MakePacket(std::uint32_t sequence)
+	{
+		Packet packet;
+		packet.fill(static_cast<std::uint8_t>(sequence));
+		packet[0] = 0x47;
+		packet[1] = 0x00;
+		packet[2] = 0x12;
+		packet[3] = static_cast<std::uint8_t>(0x10 | (sequence & 0x0F));
+		packet[TS_PACKET_SIZE - 1] = static_cast<std::uint8_t>(sequence >> 4);
+		return packet;
+	}
+
+	bool IsPacket(const std::uint8_t* pPacket, std::uint32_t sequence)
+	{
+		const Packet expected = MakePacket(sequence);
+		return std::memcmp(pPacket, expected.data(), TS_PACKET_SIZE) == 0;
+	}
+
+	// 読めるだけ読み、連番が続いているか確かめる。読んだ数を返す
+	std::size_t Drain(CPacketRing* pRing, std::uint32_t* pSequence, bool* pInOrder)
+	{
+		std::size_t total = 0;
+		const std::uint8_t* pPackets;
+		std::size_t count;
+		while ((count = pRing->Peek(&pPackets)) > 0) {
+			for (std::size_t i = 0; i < count; i++) {
+				if (!IsPacket(pPackets + i * TS_PACKET_SIZE, (*pSequence)++))
+					*pInOrder = false;
+			}
+			pRing->Consume(count);
+			total += count;
+		}
+		return total;
+	}
+}
+
+TEST(PacketRingRoundsCapacity)
+{
+	EXPECT(CPacketRing(1).Capacity() == 1);
+	EXPECT(CPacketRing(5).Capacity() == 8);
+	EXPECT(CPacketRing(8).Capacity() == 8);
+	EXPECT(CPacketRing(1000).Capacity() == 1024);
+}
+
+TEST(PacketRingPushAndPeek)
+{
+	CPacketRing ring(8);
+	const std::uint8_t* pPackets;
+	EXPECT(ring.Size() == 0);
+	EXPECT(ring.Peek(&pPackets) == 0);
+
+	for (std::uint32_t i = 0; i < 3; i++)
+		EXPECT(ring.Push(MakePacket(i).data()));
+	EXPECT(ring.Size() == 3);
+	REQUIRE(ring.Peek(&pPackets) == 3);
+	EXPECT(IsPacket(pPackets, 0));
+	EXPECT(IsPacket(pPackets + 2 * TS_PACKET_SIZE, 2));
+
+	// 一部だけ読み終える
+	ring.Consume(1);
+	EXPECT(ring.Size() == 2);
+	REQUIRE(ring.Peek(&pPackets) == 2);
+	EXPECT(IsPacket(pPackets, 1));
+}
+
+TEST(PacketRingWrapsAround)
+{
+	CPacketRing ring(8);
+	std::uint32_t pushed = 0;
+	std::uint32_t sequence = 0;
+	bool fInOrder = true;
+
+	for (int i = 0; i < 6; i++)
+		ring.Push(MakePacket(pushed++).data());
+	EXPECT(Drain(&ring, &sequence, &fInOrder) == 6);
+
+	// 末尾の 2 つと先頭の 3 つに分かれる
+	for (int i = 0; i < 5; i++)
+		ring.Push(MakePacket(pushed++).data());
+	const std::uint8_t* pPackets;
+	REQUIRE(ring.Peek(&pPackets) == 2);
+	EXPECT(IsPacket(pPackets, 6));
+	ring.Consume(2);
+	REQUIRE(ring.Peek(&pPackets) == 3);
+	EXPECT(IsPacket(pPackets, 8));
+	ring.Consume(3);
+	sequence = pushed;
+
+	// 何周しても順番は変わらない
+	for (int round = 0; round < 100; round++) {
+		for (int i = 0; i < 1 + round % 8; i++)
+			EXPECT(ring.Push(MakePacket(pushed++).data()));
+		Drain(&ring, &sequence, &fInOrder);
+	}
+	EXPECT(fInOrder);
+	EXPECT(sequence == pushed);
+	EXPECT(ring.Size() == 0);
+	EXPECT(ring.GetPushedCount() == pushed);
+	EXPECT(ring.GetDroppedCount() == 0);
+}
+
+TEST(PacketRingCountsOverflow)
+{
+	CPacketRing ring(4);
+	std::uint32_t pushed = 0;
+	for (int i = 0; i < 4; i++)
+		EXPECT(ring.Push(MakePacket(pushed++).data()));
+	EXPECT(ring.GetHighWater() == 4);
+
+	// 満杯なら捨てて数え、入っているパケットは変わらない
+	EXPECT(!ring.Push(MakePacket(100).data()));
+	EXPECT(!ring.Push(MakePacket(101).data()));
+	EXPECT(ring.GetDroppedCount() == 2);
+	EXPECT(ring.GetPushedCount() == 4);
+	EXPECT(ring.Size() == 4);
+
+	std::uint32_t sequence = 0;
+	bool fInOrder = true;
+	EXPECT(Drain(&ring, &sequence, &fInOrder) == 4);
+	EXPECT(fInOrder);
+
+	// 空けば入る。最大の数はそのまま
+	EXPECT(ring.Push(MakePacket(pushed++).data()));
+	EXPECT(ring.GetPushedCount() == 5);
+	EXPECT(ring.GetDroppedCount() == 2);
+	EXPECT(ring.GetHighWater() == 4);
+	const std::uint8_t* pPackets;
+	REQUIRE(ring.Peek(&pPackets) == 1);
+	EXPECT(IsPacket(pPackets, 4));
+}
+
+TEST(PacketRingHighWater)
+{
+	CPacketRing ring(16);
+	for (std::uint32_t i = 0; i < 3; i++)
+		ring.Push(MakePacket(i).data());
+	EXPECT(ring.GetHighWater() == 3);
+	ring.Consume(2);
+	ring.Push(MakePacket(3).data());
+	EXPECT(ring.GetHighWater() == 3);
+	for (std::uint32_t i = 4; i < 10; i++)
+		ring.Push(MakePacket(i).data());
+	EXPECT(ring.Size() == 8);
+	EXPECT(ring.GetHighWater() == 8);
+}
+
+TEST(PacketRingReset)
+{
+	CPacketRing ring(4);
+	for (std::uint32_t i = 0; i < 3; i++)
+		ring.Push(MakePacket(i).data());
+	ring.Consume(1);
+	ring.Reset();
+	EXPECT(ring.Size() == 0);
+	const std::uint8_t* pPackets;
+	EXPECT(ring.Peek(&pPackets) == 0);
+
+	// 先頭から入れ直す
+	for (std::uint32_t i = 10; i < 14; i++)
+		EXPECT(ring.Push(MakePacket(i).data()));
+	REQUIRE(ring.Peek(&pPackets) == 4);
+	EXPECT(IsPacket(pPackets, 10));
+	EXPECT(IsPacket(pPackets + 3 * TS_PACKET_SIZE, 13));
+	// 数は Reset しても続く
+	EXPECT(ring.GetPushedCount() == 7);
+}
@@ -0,0 +1,146 @@
+#include "Test.h"
+#include "Recurrence.h"
+
+using namespace ChannelTimer;
+
+namespace {
+	// 2020/1/1(水) 20:00 JST
+	const TimeValue WEDNESDAY = 132223104000000000LL + 11 * FILETIME_HOUR;
+
+	Recurrence MakeRecurrence(Recurrence::Rule rule, std::uint8_t weekdays = 0)
+	{
+		Recurrence recurrence;
+		recurrence.rule = rule;
+		recurrence.weekdays = weekdays;
+		recurrence.localOffset = EPG_TIME_OFFSET;
+		return recurrence;
+	}
+
+	int LocalWeekday(TimeValue time)
+	{
+		return GetWeekday(GetLocalDay(time, EPG_TIME_OFFSET));
+	}
+}
+
+TEST(LocalDayAndWeekday)
+{
+	EXPECT(GetWeekday(0) == 1);
+	EXPECT(LocalWeekday(WEDNESDAY) == 3);
+	// 地方時では 1/2(木) 0:30
+	EXPECT(LocalWeekday(WEDNESDAY + 4 * FILETIME_HOUR + 30 * FILETIME_MIN) == 4);
+	EXPECT(GetLocalDay(-1, 0) == -1);
+}
+
+TEST(NextOccurrenceNone)
+{
+	Recurrence recurrence;
+	TimeValue time = WEDNESDAY;
+	EXPECT(!NextOccurrence(&recurrence, &time, WEDNESDAY));
+	EXPECT(time == WEDNESDAY);
+
+	recurrence = MakeRecurrence(Recurrence::Rule::RULE_WEEKLY, 0);
+	EXPECT(!NextOccurrence(&recurrence, &time, WEDNESDAY));
+}
+
+TEST(NextOccurrenceDaily)
+{
+	Recurrence recurrence = MakeRecurrence(Recurrence::Rule::RULE_DAILY);
+	TimeValue time = WEDNESDAY;
+	EXPECT(NextOccurrence(&recurrence, &time, WEDNESDAY));
+	EXPECT(time == WEDNESDAY + FILETIME_DAY);
+}
+
+TEST(NextOccurrenceWeekdays)
+{
+	// 金曜の次は月曜
+	Recurrence recurrence = MakeRecurrence(Recurrence::Rule::RULE_WEEKDAYS);
+	const TimeValue friday = WEDNESDAY + 2 * FILETIME_DAY;
+	TimeValue time = friday;
+	EXPECT(NextOccurrence(&recurrence, &time, friday));
+	EXPECT(time == friday + 3 * FILETIME_DAY);
+	EXPECT(LocalWeekday(time) == 1);
+}
+
+TEST(NextOccurrenceWeekly)
+{
+	// 日曜と水曜
+	Recurrence recurrence = MakeRecurrence(Recurrence::Rule::RULE_WEEKLY, 0x09);
+	TimeValue time = WEDNESDAY;
+	EXPECT(NextOccurrence(&recurrence, &time, WEDNESDAY));
+	EXPECT(time == WEDNESDAY + 4 * FILETIME_DAY);
+	EXPECT(NextOccurrence(&recurrence, &time, time));
+	EXPECT(time == WEDNESDAY + 7 * FILETIME_DAY);
+}
+
+TEST(NextOccurrenceSkipsPast)
+{
+	// 長く止まっていても、after より後の最初の回になる
+	Recurrence recurrence = MakeRecurrence(Recurrence::Rule::RULE_WEEKLY, 0x08);
+	const TimeValue after = WEDNESDAY + 100 * FILETIME_DAY + FILETIME_HOUR;
+	TimeValue time = WEDNESDAY;
+	EXPECT(NextOccurrence(&recurrence, &time, after));
+	EXPECT(time > after && time - after <= 7 * FILETIME_DAY);
+	EXPECT((time - WEDNESDAY) % (7 * FILETIME_DAY) == 0);
+}
+
+TEST(NextOccurrenceExceptions)
+{
+	// 例外の木曜と金曜を飛ばし、過ぎた例外の日は取り除く
+	Recurrence recurrence = MakeRecurrence(Recurrence::Rule::RULE_DAILY);
+	const std::int32_t today = GetLocalDay(WEDNESDAY, EPG_TIME_OFFSET);
+	recurrence.exceptions = { today + 10, today + 2, today + 1, today - 5 };
+	TimeValue time = WEDNESDAY;
+	EXPECT(NextOccurrence(&recurrence, &time, WEDNESDAY));
+	EXPECT(time == WEDNESDAY + 3 * FILETIME_DAY);
+	EXPECT(recurrence.exceptions == std::vector<std::int32_t>{ today + 10 });
+}
+
+TEST(AlignOccurrence)
+{
+	Recurrence recurrence = MakeRecurrence(Recurrence::Rule::RULE_WEEKDAYS);
+	// 平日でまだ来ていなければそのまま
+	TimeValue time = WEDNESDAY;
+	EXPECT(AlignOccurrence(&recurrence, &time, WEDNESDAY - FILETIME_MIN));
+	EXPECT(time == WEDNESDAY);
+
+	// 土曜なら月曜にする
+	const TimeValue saturday = WEDNESDAY + 3 * FILETIME_DAY;
+	time = saturday;
+	EXPECT(AlignOccurrence(&recurrence, &time, saturday - FILETIME_MIN));
+	EXPECT(time == saturday + 2 * FILETIME_DAY);
+
+	// 例外の日なら次の回にする
+	recurrence.exceptions = { GetLocalDay(WEDNESDAY, EPG_TIME_OFFSET) };
+	time = WEDNESDAY;
+	EXPECT(AlignOccurrence(&recurrence, &time, WEDNESDAY - FILETIME_MIN));
+	EXPECT(time == WEDNESDAY + FILETIME_DAY);
+}
+
+TEST(SkipOccurrence)
+{
+	// 平日の水曜を休むと木曜になる。その先の例外の日は残す
+	Recurrence recurrence = MakeRecurrence(Recurrence::Rule::RULE_WEEKDAYS);
+	const std::int32_t today = GetLocalDay(WEDNESDAY, EPG_TIME_OFFSET);
+	recurrence.exceptions = { today + 7 };
+	TimeValue time = WEDNESDAY;
+	EXPECT(SkipOccurrence(&recurrence, &time, WEDNESDAY - FILETIME_MIN));
+	EXPECT(time == WEDNESDAY + FILETIME_DAY);
+	EXPECT(recurrence.exceptions == std::vector<std::int32_t>{ today + 7 });
+
+	// 続けて休むと、金曜と週末を飛ばして月曜になる
+	EXPECT(SkipOccurrence(&recurrence, &time, WEDNESDAY - FILETIME_MIN));
+	EXPECT(SkipOccurrence(&recurrence, &time, WEDNESDAY - FILETIME_MIN));
+	EXPECT(time == WEDNESDAY + 5 * FILETIME_DAY);
+	EXPECT(LocalWeekday(time) == 1);
+
+	// 翌週の水曜は例外の日なので、月曜を休むと火曜、火曜を休むと木曜になる
+	EXPECT(SkipOccurrence(&recurrence, &time, WEDNESDAY - FILETIME_MIN));
+	EXPECT(SkipOccurrence(&recurrence, &time, WEDNESDAY - FILETIME_MIN));
+	EXPECT(time == WEDNESDAY + 8 * FILETIME_DAY);
+
+	// 繰り返さなければ何もしない
+	Recurrence none = MakeRecurrence(Recurrence::Rule::RULE_NONE);
+	time = WEDNESDAY;
+	EXPECT(!SkipOccurrence(&none, &time, WEDNESDAY - FILETIME_MIN));
+	EXPECT(time == WEDNESDAY && none.exceptions.empty());
+}
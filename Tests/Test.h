@@ -0,0 +1,81 @@
+#pragma once
+#include <cstdio>
+#include <vector>
+
+namespace ChannelTimer {
+	namespace Test {
+		/**
+		 * テストケースの登録と実行
+		 * TEST(name) で定義した関数を登録し、EXPECT が失敗したら続きを実行してから失敗として数える
+		 */
+		class CRegistry {
+		public:
+			using Function = void (*)();
+
+			struct Case {
+				const char* name;
+				Function function;
+			};
+
+			static CRegistry& Instance()
+			{
+				static CRegistry registry;
+				return registry;
+			}
+
+			void Add(const char* name, Function function) { m_cases.push_back(Case{ name, function }); }
+			void Fail() { m_fFailed = true; }
+
+			/**
+			 * 全てのケースを実行し、失敗したケースの数を返す
+			 */
+			int RunAll()
+			{
+				int failed = 0;
+				for (const Case& c : m_cases) {
+					m_fFailed = false;
+					c.function();
+					std::printf("%s %s\n", m_fFailed ? "FAIL" : "ok  ", c.name);
+					if (m_fFailed)
+						failed++;
+				}
+				std::printf("%d/%d passed\n", static_cast<int>(m_cases.size()) - failed, static_cast<int>(m_cases.size()));
+				return failed;
+			}
+
+		private:
+			std::vector<Case> m_cases;
+			bool m_fFailed = false;
+		};
+
+		struct CRegistrar {
+			CRegistrar(const char* name, CRegistry::Function function)
+			{
+				CRegistry::Instance().Add(name, function);
+			}
+		};
+	}
+}
+
+#define TEST(name) \
+	static void name(); \
+	static const ::ChannelTimer::Test::CRegistrar name##Registrar(#name, name); \
+	static void name()
+
+#define EXPECT(condition) \
+	do { \
+		if (!(condition)) { \
+			std::printf("%s:%d: EXPECT(%s) failed\n", __FILE__, __LINE__, #condition); \
+			::ChannelTimer::Test::CRegistry::Instance().Fail(); \
+		} \
+	} while (false)
+
+// 続けても意味が無い時に使う
+#define REQUIRE(condition) \
+	do { \
+		if (!(condition)) { \
+			std::printf("%s:%d: REQUIRE(%s) failed\n", __FILE__, __LINE__, #condition); \
+			::ChannelTimer::Test::CRegistry::Instance().Fail(); \
+			return; \
+		} \
+	} while (false)
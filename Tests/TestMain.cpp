@@ -0,0 +1,6 @@
+#include "Test.h"
+
+int main()
+{
+	return ChannelTimer::Test::CRegistry::Instance().RunAll() == 0 ? 0 : 1;
+}
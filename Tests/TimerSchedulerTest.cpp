@@ -0,0 +1,245 @@
+#include "Test.h"
+#include "TimerScheduler.h"
+
+using namespace ChannelTimer;
+
+namespace {
+	const TimeValue BASE_TIME = 132223104000000000LL;	// 2020/1/1 0:00 UTC
+	const TimeValue LEAD_TIME = 15 * FILETIME_SEC;
+
+	Timer MakeEventEndTimer()
+	{
+		Timer timer;
+		timer.condition = Timer::SleepCondition::CONDITION_EVENTEND;
+		timer.leadTime = LEAD_TIME;
+		return timer;
+	}
+
+	Timer MakeDateTimeTimer(TimeValue time)
+	{
+		Timer timer;
+		timer.condition = Timer::SleepCondition::CONDITION_DATETIME;
+		timer.dateToChange = time;
+		timer.leadTime = LEAD_TIME;
+		return timer;
+	}
+
+	// どちらの予定表でも同じように動くことを確かめる
+	template<typename Scheduler>
+	void TestDeadlines()
+	{
+		Scheduler scheduler;
+		Timer duration;
+		duration.durationToChange = 60;
+		duration.leadTime = LEAD_TIME;
+		const TimerId a = scheduler.Add(duration, BASE_TIME);
+		const TimerId b = scheduler.Add(MakeDateTimeTimer(BASE_TIME + 30 * FILETIME_SEC), BASE_TIME);
+		EXPECT(scheduler.GetDeadline(a) == BASE_TIME + FILETIME_MIN - LEAD_TIME);
+		EXPECT(scheduler.GetDeadline(b) == BASE_TIME + 30 * FILETIME_SEC - LEAD_TIME);
+		EXPECT(scheduler.Get(a)->addedTime == BASE_TIME);
+		EXPECT(scheduler.NextDeadline() == BASE_TIME + 15 * FILETIME_SEC);
+		EXPECT(!scheduler.NeedsPolling());
+
+		Timer timer;
+		TimeValue deadline;
+		EXPECT(!scheduler.PopDue(BASE_TIME + 14 * FILETIME_SEC, &timer));
+		EXPECT(scheduler.PopDue(BASE_TIME + 50 * FILETIME_SEC, &timer, &deadline));
+		EXPECT(timer.condition == Timer::SleepCondition::CONDITION_DATETIME);
+		EXPECT(deadline == BASE_TIME + 15 * FILETIME_SEC);
+		EXPECT(scheduler.PopDue(BASE_TIME + 50 * FILETIME_SEC, &timer));
+		EXPECT(timer.condition == Timer::SleepCondition::CONDITION_DURATION);
+		EXPECT(scheduler.Empty());
+		EXPECT(scheduler.NextDeadline() == Scheduler::DEADLINE_UNKNOWN);
+	}
+
+	template<typename Scheduler>
+	void TestBroadcastOffset()
+	{
+		Scheduler scheduler;
+		Timer timer = MakeDateTimeTimer(BASE_TIME + FILETIME_HOUR);
+		timer.broadcastTime = true;
+		const TimerId anchored = scheduler.Add(timer, BASE_TIME);
+		const TimerId system = scheduler.Add(MakeDateTimeTimer(BASE_TIME + FILETIME_HOUR), BASE_TIME);
+
+		// 放送局の時計が 3 秒進んでいれば、その分早く切り替える
+		EXPECT(scheduler.SetBroadcastOffset(3 * FILETIME_SEC) == 1);
+		EXPECT(scheduler.GetDeadline(anchored) == BASE_TIME + FILETIME_HOUR - LEAD_TIME - 3 * FILETIME_SEC);
+		EXPECT(scheduler.GetDeadline(system) == BASE_TIME + FILETIME_HOUR - LEAD_TIME);
+		EXPECT(scheduler.SetBroadcastOffset(3 * FILETIME_SEC) == 0);
+	}
+
+	template<typename Scheduler>
+	void TestUpdateEventEnd()
+	{
+		Scheduler scheduler;
+		const TimerId id = scheduler.Add(MakeEventEndTimer(), BASE_TIME);
+		EXPECT(scheduler.HasEventEndTimers());
+		EXPECT(scheduler.NeedsPolling());
+		EXPECT(scheduler.GetDeadline(id) == Scheduler::DEADLINE_UNKNOWN);
+
+		// 番組の終了時刻が分かれば対象にする
+		ProgramState program = { 1024, 0x100, BASE_TIME + 30 * FILETIME_MIN };
+		EXPECT(scheduler.UpdateEventEnd(program, BASE_TIME) == 1);
+		EXPECT(scheduler.Get(id)->eventID == 0x100);
+		EXPECT(scheduler.Get(id)->eventServiceID == 1024);
+		EXPECT(scheduler.GetDeadline(id) == program.endTime - LEAD_TIME);
+		EXPECT(!scheduler.NeedsPolling());
+
+		// 延長されれば期限を合わせる
+		program.endTime += 10 * FILETIME_MIN;
+		EXPECT(scheduler.UpdateEventEnd(program, BASE_TIME + FILETIME_MIN) == 0);
+		EXPECT(scheduler.GetDeadline(id) == program.endTime - LEAD_TIME);
+
+		// 別のサービスを視聴中なら変えない
+		const ProgramState other = { 2048, 0x200, BASE_TIME + 5 * FILETIME_MIN };
+		EXPECT(scheduler.UpdateEventEnd(other, BASE_TIME + 2 * FILETIME_MIN) == 0);
+		EXPECT(scheduler.GetDeadline(id) == program.endTime - LEAD_TIME);
+
+		// 番組が変わっていれば直ちに実行する
+		const ProgramState next = { 1024, 0x101, BASE_TIME + 90 * FILETIME_MIN };
+		EXPECT(scheduler.UpdateEventEnd(next, BASE_TIME + 3 * FILETIME_MIN) == 0);
+		EXPECT(scheduler.GetDeadline(id) == BASE_TIME + 3 * FILETIME_MIN);
+	}
+
+	template<typename Scheduler>
+	void TestUnknownEndTime()
+	{
+		// 終了時刻が未定の番組でも対象にするが、期限は未定のまま確認を続ける
+		Scheduler scheduler;
+		const TimerId id = scheduler.Add(MakeEventEndTimer(), BASE_TIME);
+		const ProgramState program = { 1024, 0x100, Scheduler::DEADLINE_UNKNOWN };
+		EXPECT(scheduler.UpdateEventEnd(program, BASE_TIME) == 1);
+		EXPECT(scheduler.Get(id)->eventID == 0x100);
+		EXPECT(scheduler.GetDeadline(id) == Scheduler::DEADLINE_UNKNOWN);
+		EXPECT(scheduler.NeedsPolling());
+
+		Timer timer;
+		EXPECT(!scheduler.PopDue(BASE_TIME + FILETIME_DAY, &timer));
+	}
+
+	template<typename Scheduler>
+	void TestNearEndWaitsForNextEvent()
+	{
+		// 終了間際に予約したタイマーは、次の番組が始まるまで対象を決めず、期限も決めない
+		Scheduler scheduler;
+		const TimerId id = scheduler.Add(MakeEventEndTimer(), BASE_TIME);
+		const ProgramState ending = { 1024, 0x100, BASE_TIME + FILETIME_MIN };
+		EXPECT(scheduler.UpdateEventEnd(ending, BASE_TIME) == 0);
+		EXPECT(scheduler.Get(id)->eventID == 0);
+		EXPECT(scheduler.GetDeadline(id) == Scheduler::DEADLINE_UNKNOWN);
+		EXPECT(scheduler.NeedsPolling());
+
+		// 番組の終了時刻を過ぎても、前の番組の情報のままなら実行しない
+		Timer timer;
+		EXPECT(scheduler.UpdateEventEnd(ending, BASE_TIME + 2 * FILETIME_MIN) == 0);
+		EXPECT(!scheduler.PopDue(BASE_TIME + 2 * FILETIME_MIN, &timer));
+		EXPECT(scheduler.OnEventChanged(1024, 0x101, BASE_TIME + 2 * FILETIME_MIN) == 0);
+		EXPECT(!scheduler.PopDue(BASE_TIME + 2 * FILETIME_MIN, &timer));
+
+		// 次の番組を対象にする
+		const ProgramState next = { 1024, 0x101, BASE_TIME + 60 * FILETIME_MIN };
+		EXPECT(scheduler.UpdateEventEnd(next, BASE_TIME + 2 * FILETIME_MIN) == 1);
+		EXPECT(scheduler.Get(id)->eventID == 0x101);
+		EXPECT(scheduler.GetDeadline(id) == next.endTime - LEAD_TIME);
+		EXPECT(!scheduler.NeedsPolling());
+	}
+
+	template<typename Scheduler>
+	void TestOnEventChanged()
+	{
+		Scheduler scheduler;
+		const TimerId id = scheduler.Add(MakeEventEndTimer(), BASE_TIME);
+		// 対象が決まっていなければ何もしない
+		EXPECT(scheduler.OnEventChanged(1024, 0x101, BASE_TIME) == 0);
+
+		const ProgramState program = { 1024, 0x100, BASE_TIME + 30 * FILETIME_MIN };
+		scheduler.UpdateEventEnd(program, BASE_TIME);
+		EXPECT(scheduler.OnEventChanged(1024, 0x100, BASE_TIME + FILETIME_MIN) == 0);
+		EXPECT(scheduler.OnEventChanged(2048, 0x101, BASE_TIME + FILETIME_MIN) == 0);
+		EXPECT(scheduler.GetDeadline(id) == program.endTime - LEAD_TIME);
+
+		// 番組が変わったら期限を今にする
+		const TimeValue now = BASE_TIME + 20 * FILETIME_MIN;
+		EXPECT(scheduler.OnEventChanged(1024, 0x101, now) == 1);
+		EXPECT(scheduler.GetDeadline(id) == now);
+		// 既に期限が来ていれば数えない
+		EXPECT(scheduler.OnEventChanged(1024, 0x102, now) == 0);
+
+		Timer timer;
+		EXPECT(scheduler.PopDue(now, &timer));
+		EXPECT(timer.eventID == 0x100);
+		EXPECT(!scheduler.HasEventEndTimers());
+	}
+
+	template<typename Scheduler>
+	void TestRestore()
+	{
+		// 対象の番組と終了日時を保存しておいたタイマーは、その期限で戻す
+		Scheduler scheduler;
+		const TimerId id = scheduler.Add(MakeEventEndTimer(), BASE_TIME);
+		ProgramState program = { 1024, 0x100, BASE_TIME + 30 * FILETIME_MIN };
+		std::vector<TimerId> changed;
+		EXPECT(scheduler.UpdateEventEnd(program, BASE_TIME, &changed) == 1);
+		EXPECT(changed == std::vector<TimerId>{ id });
+		EXPECT(scheduler.Get(id)->eventEndTime == program.endTime);
+
+		// 終了日時が同じなら保存し直さない
+		changed.clear();
+		scheduler.UpdateEventEnd(program, BASE_TIME + FILETIME_MIN, &changed);
+		EXPECT(changed.empty());
+		program.endTime += 10 * FILETIME_MIN;
+		scheduler.UpdateEventEnd(program, BASE_TIME + 2 * FILETIME_MIN, &changed);
+		EXPECT(changed == std::vector<TimerId>{ id });
+
+		Timer saved = *scheduler.Get(id);
+		Scheduler restored;
+		const TimerId restoredId = restored.Restore(saved);
+		EXPECT(restored.Get(restoredId)->eventID == 0x100);
+		EXPECT(restored.Get(restoredId)->addedTime == BASE_TIME);
+		EXPECT(restored.GetDeadline(restoredId) == program.endTime - LEAD_TIME);
+		EXPECT(!restored.NeedsPolling());
+
+		// 別の番組を視聴中でも期限は変えず、同じサービスの別の番組なら直ちに実行する
+		EXPECT(restored.UpdateEventEnd({ 2048, 0x200, BASE_TIME + FILETIME_HOUR }, BASE_TIME + 3 * FILETIME_MIN) == 0);
+		EXPECT(restored.GetDeadline(restoredId) == program.endTime - LEAD_TIME);
+		EXPECT(restored.UpdateEventEnd({ 1024, 0x101, BASE_TIME + FILETIME_HOUR }, BASE_TIME + 4 * FILETIME_MIN) == 0);
+		EXPECT(restored.GetDeadline(restoredId) == BASE_TIME + 4 * FILETIME_MIN);
+
+		// Add で予約し直せば対象の番組は決め直す
+		const TimerId added = restored.Add(saved, BASE_TIME);
+		EXPECT(restored.Get(added)->eventID == 0 && restored.Get(added)->eventEndTime == 0);
+		EXPECT(restored.GetDeadline(added) == Scheduler::DEADLINE_UNKNOWN);
+	}
+
+	template<typename Scheduler>
+	void TestRemoveCounts()
+	{
+		Scheduler scheduler;
+		const TimerId id = scheduler.Add(MakeEventEndTimer(), BASE_TIME);
+		EXPECT(scheduler.Remove(id));
+		EXPECT(!scheduler.Remove(id));
+		EXPECT(!scheduler.HasEventEndTimers());
+		EXPECT(!scheduler.NeedsPolling());
+		EXPECT(scheduler.Empty());
+	}
+
+	using HeapScheduler = CBasicTimerScheduler<CSchedule<Timer>>;
+	using WheelScheduler = CBasicTimerScheduler<CTimingWheel<Timer>>;
+}
+
+TEST(HeapDeadlines) { TestDeadlines<HeapScheduler>(); }
+TEST(WheelDeadlines) { TestDeadlines<WheelScheduler>(); }
+TEST(HeapBroadcastOffset) { TestBroadcastOffset<HeapScheduler>(); }
+TEST(WheelBroadcastOffset) { TestBroadcastOffset<WheelScheduler>(); }
+TEST(HeapUpdateEventEnd) { TestUpdateEventEnd<HeapScheduler>(); }
+TEST(WheelUpdateEventEnd) { TestUpdateEventEnd<WheelScheduler>(); }
+TEST(HeapUnknownEndTime) { TestUnknownEndTime<HeapScheduler>(); }
+TEST(WheelUnknownEndTime) { TestUnknownEndTime<WheelScheduler>(); }
+TEST(HeapNearEndWaitsForNextEvent) { TestNearEndWaitsForNextEvent<HeapScheduler>(); }
+TEST(WheelNearEndWaitsForNextEvent) { TestNearEndWaitsForNextEvent<WheelScheduler>(); }
+TEST(HeapOnEventChanged) { TestOnEventChanged<HeapScheduler>(); }
+TEST(WheelOnEventChanged) { TestOnEventChanged<WheelScheduler>(); }
+TEST(HeapRestore) { TestRestore<HeapScheduler>(); }
+TEST(WheelRestore) { TestRestore<WheelScheduler>(); }
+TEST(HeapRemoveCounts) { TestRemoveCounts<HeapScheduler>(); }
+TEST(WheelRemoveCounts) { TestRemoveCounts<WheelScheduler>(); }
@@ -0,0 +1,146 @@
+#include "Test.h"
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <random>
+#include "TimingWheel.h"
+
+using namespace ChannelTimer;
+
+namespace {
+	const TimeValue BASE_TIME = 132223104000000000LL;	// 2020/1/1 0:00 UTC
+
+	// 期限の近さを階層ごとにばらつかせる(過ぎた期限と期限未定も含む)
+	TimeValue RandomDeadline(std::mt19937_64& random, TimeValue now)
+	{
+		switch (random() % 6) {
+		case 0: return now + static_cast<TimeValue>(random() % (70 * FILETIME_SEC));
+		case 1: return now + static_cast<TimeValue>(random() % (2 * FILETIME_HOUR));
+		case 2: return now + static_cast<TimeValue>(random() % (3 * FILETIME_DAY));
+		case 3: return now + static_cast<TimeValue>(random() % (100 * FILETIME_DAY));
+		case 4: return INT64_MAX;
+		default: return now - static_cast<TimeValue>(random() % FILETIME_MIN);
+		}
+	}
+
+	TimeValue RandomStep(std::mt19937_64& random)
+	{
+		switch (random() % 4) {
+		case 0: return static_cast<TimeValue>(random() % (3 * FILETIME_SEC));
+		case 1: return static_cast<TimeValue>(random() % (5 * FILETIME_MIN));
+		case 2: return static_cast<TimeValue>(random() % (5 * FILETIME_HOUR));
+		default: return static_cast<TimeValue>(random() % (80 * FILETIME_DAY));
+		}
+	}
+}
+
+TEST(WheelOrdersWithinTick)
+{
+	// 同じ秒の中でも期限順に取り出す
+	CTimingWheel<int> wheel;
+	wheel.Advance(BASE_TIME);
+	wheel.Add(1, BASE_TIME + 5 * FILETIME_SEC + 900 * FILETIME_MS);
+	wheel.Add(2, BASE_TIME + 5 * FILETIME_SEC + 100 * FILETIME_MS);
+	wheel.Add(3, BASE_TIME + 5 * FILETIME_SEC + 500 * FILETIME_MS);
+
+	wheel.Advance(BASE_TIME + 6 * FILETIME_SEC);
+	int order[3];
+	for (int& value : order) {
+		REQUIRE(!wheel.Empty());
+		const TimerId id = wheel.Top();
+		value = *wheel.Get(id);
+		wheel.Cancel(id);
+	}
+	EXPECT(order[0] == 2 && order[1] == 3 && order[2] == 1);
+}
+
+TEST(WheelDrainsBurstInOrder)
+{
+	// 一度に期限の来た多くのタイマーを、期限順に取り出す
+	std::mt19937_64 random(2);
+	CTimingWheel<int> wheel;
+	wheel.Advance(BASE_TIME);
+	const int COUNT = 5000;
+	for (int i = 0; i < COUNT; i++)
+		wheel.Add(i, BASE_TIME + static_cast<TimeValue>(random() % (3 * FILETIME_DAY)));
+	// 期限の過ぎたタイマーを足しても順序は崩れない
+	wheel.Advance(BASE_TIME + 4 * FILETIME_DAY);
+	wheel.Add(COUNT, BASE_TIME + FILETIME_HOUR);
+
+	int count = 0;
+	TimeValue last = 0;
+	while (!wheel.Empty()) {
+		const TimeValue deadline = wheel.TopDeadline();
+		EXPECT(deadline >= last);
+		last = deadline;
+		wheel.Cancel(wheel.Top());
+		count++;
+	}
+	EXPECT(count == COUNT + 1);
+}
+
+TEST(WheelKeepsFarAndUnknownDeadlines)
+{
+	CTimingWheel<int> wheel;
+	wheel.Advance(BASE_TIME);
+	const TimerId unknown = wheel.Add(1, INT64_MAX);
+	const TimerId far = wheel.Add(2, BASE_TIME + 200 * FILETIME_DAY);
+	EXPECT(wheel.Top() == far);
+
+	wheel.Advance(BASE_TIME + 199 * FILETIME_DAY);
+	EXPECT(wheel.Top() == far);
+	wheel.Advance(BASE_TIME + 200 * FILETIME_DAY);
+	EXPECT(wheel.TopDeadline() == BASE_TIME + 200 * FILETIME_DAY);
+	wheel.Cancel(far);
+	EXPECT(wheel.Top() == unknown);
+	EXPECT(wheel.TopDeadline() == INT64_MAX);
+}
+
+TEST(WheelMatchesHeap)
+{
+	// 同じ操作をした CSchedule と同じ順序で取り出す
+	std::mt19937_64 random(1);
+	for (int round = 0; round < 50; round++) {
+		CTimingWheel<int> wheel;
+		CSchedule<int> heap;
+		std::map<TimerId, TimerId> ids;	// ホイール -> ヒープ
+		TimeValue now = BASE_TIME + static_cast<TimeValue>(random() % FILETIME_DAY);
+		wheel.Advance(now);
+
+		for (int step = 0; step < 2000; step++) {
+			const int op = static_cast<int>(random() % 10);
+			if (op < 4) {
+				const TimeValue deadline = RandomDeadline(random, now);
+				ids[wheel.Add(step, deadline)] = heap.Add(step, deadline);
+			} else if (op < 5 && !ids.empty()) {
+				auto it = std::next(ids.begin(), static_cast<std::ptrdiff_t>(random() % ids.size()));
+				EXPECT(wheel.Cancel(it->first));
+				EXPECT(heap.Cancel(it->second));
+				ids.erase(it);
+			} else if (op < 6 && !ids.empty()) {
+				auto it = std::next(ids.begin(), static_cast<std::ptrdiff_t>(random() % ids.size()));
+				const TimeValue deadline = RandomDeadline(random, now);
+				wheel.Reschedule(it->first, deadline);
+				heap.Reschedule(it->second, deadline);
+			} else if (op < 8) {
+				now += RandomStep(random);
+				wheel.Advance(now);
+			} else {
+				while (!wheel.Empty() && wheel.TopDeadline() <= now) {
+					REQUIRE(!heap.Empty());
+					const TimerId a = wheel.Top();
+					const TimerId b = heap.Top();
+					REQUIRE(wheel.TopDeadline() == heap.TopDeadline());
+					REQUIRE(*wheel.Get(a) == *heap.Get(b));
+					wheel.Cancel(a);
+					heap.Cancel(b);
+					ids.erase(a);
+				}
+			}
+
+			REQUIRE(wheel.Size() == heap.Size());
+			if (!wheel.Empty())
+				REQUIRE(wheel.TopDeadline() == heap.TopDeadline());
+		}
+	}
+}
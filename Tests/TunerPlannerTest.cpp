@@ -0,0 +1,93 @@
+#include "Test.h"
+#include <vector>
+#include "TunerPlanner.h"
+
+using namespace ChannelTimer;
+
+namespace {
+	CTunerPlanner::Request MakeRequest(std::uint32_t serial, TimeValue begin, TimeValue end,
+		std::vector<std::wstring> tuners)
+	{
+		return CTunerPlanner::Request{ serial, begin, end, std::move(tuners) };
+	}
+
+	bool IsTuner(const CTunerPlanner& planner, std::uint32_t serial, const wchar_t* pszTuner)
+	{
+		const std::wstring* pTuner = planner.GetTuner(serial);
+		return pTuner != nullptr && *pTuner == pszTuner;
+	}
+}
+
+TEST(PlannerAssignsFreeTuners)
+{
+	CTunerPlanner planner;
+	EXPECT(planner.Add(MakeRequest(1, 0, 10, { L"A", L"B" })));
+	EXPECT(planner.Add(MakeRequest(2, 5, 15, { L"A", L"B" })));
+	// 重ならなければ優先するチューナーを使う
+	EXPECT(planner.Add(MakeRequest(3, 10, 20, { L"A", L"B" })));
+	EXPECT(IsTuner(planner, 1, L"A"));
+	EXPECT(IsTuner(planner, 2, L"B"));
+	EXPECT(IsTuner(planner, 3, L"A"));
+	EXPECT(planner.Size() == 3);
+	EXPECT(planner.ConflictCount() == 0);
+}
+
+TEST(PlannerMovesSingleOverlap)
+{
+	// 1 を B へ移して、A しか使えない 2 を置く
+	CTunerPlanner planner;
+	EXPECT(planner.Add(MakeRequest(1, 0, 10, { L"A", L"B" })));
+	EXPECT(planner.Add(MakeRequest(2, 0, 10, { L"A" })));
+	EXPECT(IsTuner(planner, 1, L"B"));
+	EXPECT(IsTuner(planner, 2, L"A"));
+}
+
+TEST(PlannerReportsConflicts)
+{
+	CTunerPlanner planner;
+	planner.Add(MakeRequest(1, 0, 10, { L"A", L"B" }));
+	planner.Add(MakeRequest(2, 5, 15, { L"A", L"B" }));
+
+	std::vector<std::uint32_t> conflicts;
+	EXPECT(!planner.Add(MakeRequest(3, 6, 8, { L"A", L"B" }), &conflicts));
+	EXPECT((conflicts == std::vector<std::uint32_t>{ 1, 2 }));
+	EXPECT(planner.GetTuner(3) == nullptr);
+	EXPECT(planner.ConflictCount() == 1);
+
+	// 重なっていたタイマーが無くなれば置き直す
+	planner.Remove(1);
+	EXPECT(IsTuner(planner, 3, L"A"));
+	EXPECT(planner.ConflictCount() == 0);
+}
+
+TEST(PlannerReplacesSameSerial)
+{
+	CTunerPlanner planner;
+	planner.Add(MakeRequest(1, 0, 10, { L"A" }));
+	EXPECT(!planner.Add(MakeRequest(2, 5, 15, { L"A" })));
+	// 1 を後へずらせば 2 を置ける
+	EXPECT(planner.Add(MakeRequest(1, 20, 30, { L"A" })));
+	EXPECT(planner.Size() == 2);
+	planner.Remove(1);
+	planner.Remove(2);
+	EXPECT(planner.Size() == 0);
+	EXPECT(planner.ConflictCount() == 0);
+}
+
+TEST(PlannerSequentialSwitches)
+{
+	// 一つのレーンに確認から切り替えまでの区間を置けば、続けて予約したタイマーは重ならない
+	const TimeValue lead = 20 * FILETIME_SEC;
+	const TimeValue at2000 = 20 * FILETIME_HOUR;
+	const TimeValue at2030 = at2000 + 30 * FILETIME_MIN;
+	CTunerPlanner planner;
+	EXPECT(planner.Add(MakeRequest(1, at2000 - lead, at2000, { L"" })));
+	EXPECT(planner.Add(MakeRequest(2, at2030 - lead, at2030, { L"" })));
+	EXPECT(planner.Add(MakeRequest(3, at2030, at2030 + lead, { L"" })));
+
+	// 同じ時刻に切り替えるものだけが重なる
+	std::vector<std::uint32_t> conflicts;
+	EXPECT(!planner.Add(MakeRequest(4, at2000 - lead, at2000, { L"" }), &conflicts));
+	EXPECT((conflicts == std::vector<std::uint32_t>{ 1 }));
+	EXPECT(planner.ConflictCount() == 1);
+}